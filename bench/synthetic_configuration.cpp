@@ -0,0 +1,107 @@
+#include "synthetic_configuration.hpp"
+#include "configuration_keys.hpp"
+#include "base64.hpp"
+#include <random>
+#include <fstream>
+#include <unistd.h>
+
+#define DAY 86400
+
+namespace timlibs
+{
+    namespace
+    {
+        /// @brief Generates random key in wireguard format
+        /// @param random generator
+        /// @return 32 bytes in base64
+        std::string GenerateKey(std::mt19937_64& random)
+        {
+            uint8_t key[WG_KEY_SIZE];
+            for (size_t index = 0; index < WG_KEY_SIZE; index += sizeof(uint64_t))
+            {
+                uint64_t value = random();
+                for (size_t byte = 0; byte < sizeof(uint64_t); byte++) key[index + byte] = (uint8_t)(value >> (byte * 8));
+            }
+            return Base64Encode(key, WG_KEY_SIZE);
+        }
+    }
+
+    /// @brief Generates clients and peers
+    /// @param settings count of clients, seed and shares of client kinds
+    /// @param now time that dates and handshakes are relative to
+    SyntheticConfiguration::SyntheticConfiguration(const SyntheticSettings& settings, time_t now)
+    {
+        std::mt19937_64 random(settings.seed);
+        std::uniform_real_distribution<double> share(0.0, 1.0);
+        this->clients.reserve(settings.clients);
+        for (size_t index = 0; index < settings.clients; index++)
+        {
+            Client client;
+            client.private_key = GenerateKey(random);
+            client.public_key = GenerateKey(random);
+            client.login = "user" + std::to_string(index);
+            client.full_name = "Synthetic User " + std::to_string(index);
+            client.ip = FromHostOrder(ToHostOrder(IPv4(std::string(SYNTHETIC_SERVER_IP))) + 1 + index);
+            client.allowed_ips = client.ip.GetAsString() + "/32";
+            client.administrative_account_status = share(random) >= settings.disabled_share;
+            client.creation_date = Time((time_t)(now - 30 * DAY));
+            double kind = share(random);
+            if (kind < settings.expired_share) client.expiration_date = Time((time_t)(now - 1 - (time_t)(random() % (30 * DAY))));
+            else if (kind < settings.expired_share + settings.pending_share) client.release_date = Time((time_t)(now + 1 + (time_t)(random() % (30 * DAY))));
+            else client.expiration_date = Time((time_t)(now + 365 * DAY));
+            this->clients.push_back(client);
+
+            bool active = client.administrative_account_status && ToUnixTime(client.release_date) <= now && now < ToUnixTime(client.expiration_date);
+            if (!active) continue;
+            PeerInfo peer{ client.public_key.ToString(), client.allowed_ips };
+            peer.endpoint = "198.51.100." + std::to_string(random() % 256) + ":" + std::to_string(1024 + random() % 64000);
+            if (share(random) < settings.connected_share) peer.latest_handshake = now - (time_t)(random() % 120);
+            else if (random() % 2 == 0) peer.latest_handshake = now - 200 - (time_t)(random() % DAY); // stale, else never connected
+            peer.rx_bytes = random() % (1ull << 32);
+            peer.tx_bytes = random() % (1ull << 32);
+            this->peers.push_back(std::move(peer));
+        }
+    }
+
+    const std::vector<Client>& SyntheticConfiguration::GetClients() const { return this->clients; }
+
+    std::vector<PeerInfo> SyntheticConfiguration::GetPeers() const { return this->peers; }
+
+    /// @brief Writes json snapshot of interface: server section by hand, clients by one batch of Wireguard
+    /// @param interface_name name of wireguard interface, ex. wgbench
+    void SyntheticConfiguration::Write(const std::string& interface_name) const
+    {
+        Clean(interface_name);
+        nlohmann::json json_server_configuration;
+        json_server_configuration[keys.at(server::KEY::INTERFACE_NAME)] = interface_name;
+        json_server_configuration[keys.at(server::KEY::LISTEN_PORT)] = 51820;
+        json_server_configuration[keys.at(server::KEY::IP)] = SYNTHETIC_SERVER_IP;
+        json_server_configuration[keys.at(server::KEY::NETWORK)] = SYNTHETIC_NETWORK;
+        json_server_configuration[keys.at(server::KEY::ENDPOINT_DNS)] = "vpn.example.com";
+        json_server_configuration[keys.at(server::KEY::ENDPOINT_IP)] = "203.0.113.1";
+        json_server_configuration[keys.at(server::KEY::PUBLIC_LISTEN_PORT)] = 51820;
+        json_server_configuration[keys.at(server::KEY::PRIVATE_KEY)] = "";
+        json_server_configuration[keys.at(server::KEY::PUBLIC_KEY)] = "";
+        json_server_configuration[keys.at(server::KEY::PRE_UP)] = "";
+        json_server_configuration[keys.at(server::KEY::POST_UP)] = "";
+        json_server_configuration[keys.at(server::KEY::PRE_DOWN)] = "";
+        json_server_configuration[keys.at(server::KEY::POST_DOWN)] = "";
+        nlohmann::json json_configuration;
+        json_configuration[keys.at(general::KEY::SERVER)] = json_server_configuration;
+        json_configuration[keys.at(general::KEY::CLIENTS)] = nlohmann::json::array();
+        std::ofstream file(SYNTHETIC_ROOT_PATH + interface_name + ".json");
+        if (!(file << json_configuration.dump())) throw WireguardException("Unable to write synthetic configuration of " + interface_name);
+        file.close();
+
+        Wireguard wireguard(interface_name, std::make_shared<FakePeerController>());
+        wireguard.SetJournalSizeLimit(0); // batch goes straight to snapshot
+        wireguard.CreateClients(this->clients);
+    }
+
+    /// @brief Removes files of interface
+    /// @param interface_name name of wireguard interface, ex. wgbench
+    void SyntheticConfiguration::Clean(const std::string& interface_name)
+    {
+        for (const char* extension : { ".json", ".snap", ".journal" }) unlink((SYNTHETIC_ROOT_PATH + interface_name + extension).c_str());
+    }
+}
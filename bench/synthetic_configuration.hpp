@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <ctime>
+#include "wireguard.hpp"
+
+#define SYNTHETIC_ROOT_PATH "/etc/wireguard/" // the same as ROOT_PATH_DEFAULT of library
+#define SYNTHETIC_NETWORK "10.0.0.0/8" // fits 1M clients
+#define SYNTHETIC_SERVER_IP "10.0.0.1"
+
+
+namespace timlibs
+{
+	struct SyntheticSettings
+	{
+		size_t clients{ 1000 };
+		uint64_t seed{ 1 }; // the same seed gives the same clients and peers
+		double disabled_share{ 0.05 }; // administrative status is off
+		double expired_share{ 0.05 }; // expiration date has passed
+		double pending_share{ 0.05 }; // release date hasn't come
+		double connected_share{ 0.5 }; // peers with handshake younger than ConnectionThresholds::connected
+	};
+
+	// Reproducible configuration of many clients and live peers of interface for them
+	class SyntheticConfiguration
+	{
+	public:
+		SyntheticConfiguration(const SyntheticSettings& settings, time_t now);
+
+		const std::vector<Client>& GetClients() const; // ips are set, uuids are empty (they are generated by Wireguard)
+		std::vector<PeerInfo> GetPeers() const; // peers of active clients with handshakes, endpoints and counters
+		void Write(const std::string& interface_name) const; // json snapshot is written by Wireguard itself, so its format is the production one
+		static void Clean(const std::string& interface_name); // removes snapshots and journal of interface
+	private:
+		std::vector<Client> clients;
+		std::vector<PeerInfo> peers;
+	};
+}
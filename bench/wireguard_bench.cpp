@@ -0,0 +1,431 @@
+#include "synthetic_configuration.hpp"
+#include "peer_reconciler.hpp"
+#include "client_state_table.hpp"
+#include "metrics.hpp"
+#include "client_configuration.hpp"
+#include "thread_pool.hpp"
+#include "curve25519.hpp"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <functional>
+#include <numeric>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <malloc.h>
+
+#define BENCH_INTERFACE_NAME "wgbench"
+#define BENCH_LOOKUPS 100000 // lookups per iteration
+#define BENCH_READS_PER_THREAD 20000 // snapshot reads per reader thread and iteration
+#define BENCH_TIMER_OBSERVATIONS 1000000
+#define BENCH_QR_CLIENTS 2000 // QR codes are rendered for the first clients only
+#define BENCH_KEY_PAIRS 100000
+#define BENCH_ROTATED_CLIENTS 1000 // keys of the first clients are rotated
+#define BENCH_CREATED_CLIENTS 1000 // clients created one by one per iteration
+
+namespace timlibs
+{
+    namespace
+    {
+        struct BenchSettings
+        {
+            std::vector<size_t> clients{ 1000, 10000, 100000 };
+            size_t iterations{ 5 };
+            uint64_t seed{ 1 };
+            std::chrono::microseconds dump_latency{ 0 };
+            std::chrono::microseconds apply_latency{ 0 };
+            std::string filter{}; // only benchmarks with name containing filter
+            std::string output{}; // stdout if empty
+        };
+
+        // Runs benchmarks and writes one json object per result, so results of releases can be compared by scripts
+        class BenchRunner
+        {
+        public:
+            BenchRunner(const BenchSettings& settings, std::ostream& output) : settings{ settings }, output{ output } {}
+
+            /// @brief Runs body warm-up iteration and settings.iterations measured iterations
+            /// @param name name of benchmark
+            /// @param clients count of clients of configuration
+            /// @param operations operations in one iteration, ex. lookups
+            /// @param body measured code
+            /// @param setup code before every iteration that isn't measured
+            void Measure(const std::string& name, size_t clients, size_t operations, const std::function<void()>& body, const std::function<void()>& setup = nullptr)
+            {
+                if (!this->IsEnabled(name)) return;
+                std::vector<double> samples;
+                for (size_t iteration = 0; iteration <= this->settings.iterations; iteration++)
+                {
+                    if (setup) setup();
+                    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                    body();
+                    std::chrono::duration<double, std::nano> duration = std::chrono::steady_clock::now() - start;
+                    if (iteration > 0) samples.push_back(duration.count()); // the first iteration warms caches up
+                }
+                this->Report(name, clients, operations, samples);
+            }
+
+            bool IsEnabled(const std::string& name) const
+            {
+                return this->settings.filter.empty() || name.find(this->settings.filter) != std::string::npos;
+            }
+
+            /// @brief Writes result which isn't timed, ex. memory usage
+            /// @param name name of benchmark
+            /// @param clients count of clients of configuration
+            /// @param values measured values
+            void ReportValues(const std::string& name, size_t clients, const nlohmann::json& values)
+            {
+                if (!this->IsEnabled(name)) return;
+                nlohmann::json result = values;
+                result["benchmark"] = name;
+                result["clients"] = clients;
+                this->output << result.dump() << std::endl;
+                std::cerr << name << " [" << clients << " clients]: " << values.dump() << std::endl;
+            }
+        private:
+            void Report(const std::string& name, size_t clients, size_t operations, std::vector<double>& samples)
+            {
+                std::sort(samples.begin(), samples.end());
+                double median = samples[samples.size() / 2];
+                nlohmann::json result;
+                result["benchmark"] = name;
+                result["clients"] = clients;
+                result["iterations"] = samples.size();
+                result["operations"] = operations;
+                result["min_ns"] = samples.front();
+                result["median_ns"] = median;
+                result["mean_ns"] = std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+                result["max_ns"] = samples.back();
+                result["ops_per_second"] = (median > 0) ? operations / (median / 1e9) : 0.0;
+                this->output << result.dump() << std::endl;
+                std::cerr << name << " [" << clients << " clients]: " << median / 1e6 << " ms, " << median / operations << " ns/op" << std::endl;
+            }
+
+            BenchSettings settings;
+            std::ostream& output;
+        };
+
+        /// @brief Checks result of benchmark body, so compiler doesn't drop the measured code
+        /// @param condition expected result
+        /// @param name name of benchmark
+        void Expect(bool condition, const std::string& name)
+        {
+            if (!condition) throw WireguardException("Benchmark " + name + " got unexpected result");
+        }
+
+        /// @brief Returns bytes allocated by malloc, free memory is returned to system first
+        size_t GetHeapUsage()
+        {
+            malloc_trim(0);
+            return mallinfo2().uordblks;
+        }
+
+        /// @brief Changes live peers as if interface was changed outside: every 100th peer is removed or has other allowed ips, extra peers are added
+        /// @param peers desired peers
+        /// @return live peers
+        std::vector<PeerInfo> MakeDrift(const std::vector<PeerInfo>& peers)
+        {
+            std::vector<PeerInfo> live;
+            live.reserve(peers.size() + peers.size() / 100);
+            for (size_t index = 0; index < peers.size(); index++)
+            {
+                if (index % 100 == 0) continue;
+                live.push_back(peers[index]);
+                if (index % 100 == 1) live.back().allowed_ips += ", 192.168.0.0/24";
+                if (index % 100 == 2) live.push_back(PeerInfo{ "extra" + std::to_string(index), "172.16.0.1/32" });
+            }
+            return live;
+        }
+
+        /// @brief Runs benchmarks of configuration with count of clients
+        /// @param runner runner of benchmarks
+        /// @param settings settings of run
+        /// @param count count of clients
+        void RunBenchmarks(BenchRunner& runner, const BenchSettings& settings, size_t count)
+        {
+            time_t now = time(nullptr);
+            SyntheticSettings synthetic_settings;
+            synthetic_settings.clients = count;
+            synthetic_settings.seed = settings.seed;
+            SyntheticConfiguration configuration(synthetic_settings, now);
+            configuration.Write(BENCH_INTERFACE_NAME);
+            std::shared_ptr<FakePeerController> peer_controller = std::make_shared<FakePeerController>();
+            peer_controller->SetPeers(BENCH_INTERFACE_NAME, configuration.GetPeers());
+            peer_controller->SetLatency(settings.dump_latency, settings.apply_latency);
+
+            runner.Measure("load_json", count, count, []() { Wireguard wireguard(BENCH_INTERFACE_NAME, std::make_shared<FakePeerController>()); });
+
+            Wireguard wireguard(BENCH_INTERFACE_NAME, peer_controller);
+            runner.Measure("snapshot_write_binary", count, count, [&wireguard]() { wireguard.SetSnapshotFormat(SnapshotFormat::BINARY); },
+                [&wireguard]() { wireguard.SetSnapshotFormat(SnapshotFormat::JSON); });
+            wireguard.SetSnapshotFormat(SnapshotFormat::BINARY);
+            runner.Measure("load_binary", count, count, []() { Wireguard wireguard(BENCH_INTERFACE_NAME, std::make_shared<FakePeerController>()); });
+            runner.Measure("snapshot_write_json", count, count, [&wireguard]() { wireguard.SetSnapshotFormat(SnapshotFormat::JSON); },
+                [&wireguard]() { wireguard.SetSnapshotFormat(SnapshotFormat::BINARY); });
+            wireguard.SetSnapshotFormat(SnapshotFormat::JSON);
+
+            // the first (warm-up) tick applies statuses and peers, next ticks are steady state: all peers are dumped twice and reconciled
+            runner.Measure("controller_tick", count, count, [&wireguard]() { wireguard.Controller(); });
+            wireguard.Controller();
+
+            std::shared_ptr<const ConfigurationSnapshot> snapshot = wireguard.GetSnapshot();
+            const ClientRegistry& clients = snapshot->clients;
+            std::mt19937_64 random(settings.seed);
+            std::vector<const Client*> targets(BENCH_LOOKUPS);
+            for (const Client*& target : targets) target = &clients.At(random() % clients.Size());
+            runner.Measure("lookup_uuid", count, targets.size(), [&clients, &targets]()
+            {
+                size_t found = 0;
+                for (const Client* target : targets) found += clients.FindByUuid(target->uuid) != nullptr;
+                Expect(found == targets.size(), "lookup_uuid");
+            });
+            runner.Measure("lookup_public_key", count, targets.size(), [&clients, &targets]()
+            {
+                size_t found = 0;
+                for (const Client* target : targets) found += clients.FindByPublicKey(target->public_key) != nullptr;
+                Expect(found == targets.size(), "lookup_public_key");
+            });
+            runner.Measure("lookup_login", count, targets.size(), [&clients, &targets]()
+            {
+                size_t found = 0;
+                for (const Client* target : targets) found += clients.FindByLogin(target->login) != nullptr;
+                Expect(found == targets.size(), "lookup_login");
+            });
+
+            // records and indexes of clients are measured as heap of registry rebuilt from clients (copy of registry would share
+            // its pages, pooled strings are shared by copy of client), logins and full names as their part of the pool
+            if (runner.IsEnabled("memory_per_client"))
+            {
+                size_t heap_before = GetHeapUsage();
+                std::unique_ptr<ClientRegistry> copy = std::make_unique<ClientRegistry>();
+                copy->Reserve(clients.Size());
+                for (const Client& client : clients) copy->Insert(client);
+                size_t heap_bytes = GetHeapUsage() - heap_before;
+                size_t pooled = 0;
+                for (size_t position = 0; position < clients.Size(); position++) pooled += !clients.At(position).login.empty() + !clients.At(position).full_name.empty();
+                StringPool& string_pool = StringPool::GetInstance();
+                double pool_bytes = string_pool.GetSize() ? (double)string_pool.GetMemoryUsage() * pooled / string_pool.GetSize() : 0.0;
+                nlohmann::json values;
+                values["client_size"] = sizeof(Client);
+                values["registry_bytes_per_client"] = (double)heap_bytes / count;
+                values["pool_bytes_per_client"] = pool_bytes / count;
+                values["bytes_per_client"] = (heap_bytes + pool_bytes) / count;
+                runner.ReportValues("memory_per_client", count, values);
+            }
+
+            const AllowedIpsTrie& routes = snapshot->routes;
+            runner.Measure("lookup_address", count, targets.size(), [&routes, &targets]()
+            {
+                size_t found = 0;
+                for (const Client* target : targets) found += routes.FindOwner(ToHostOrder(target->ip)) != nullptr; // synthetic allowed ips are ip/32
+                Expect(found == targets.size(), "lookup_address");
+            });
+
+            // sweep of state table against the per-record loop over clients, at the moment when pending clients are released
+            int64_t moment = now + 31 * 86400;
+            std::vector<size_t> changed;
+            clients.GetStates().SweepDates(moment, changed);
+            size_t expected_changes = changed.size();
+            runner.Measure("date_sweep_table", count, count, [&clients, &changed, expected_changes, moment]()
+            {
+                changed.clear();
+                clients.GetStates().SweepDates(moment, changed);
+                Expect(changed.size() == expected_changes, "date_sweep_table");
+            });
+            runner.Measure("date_sweep_records", count, count, [&clients, &changed, expected_changes, moment]()
+            {
+                changed.clear();
+                for (size_t position = 0; position < clients.Size(); position++)
+                {
+                    const Client& client = clients.At(position);
+                    bool status = client.administrative_account_status && ToUnixTime(client.release_date) <= moment && moment <= ToUnixTime(client.expiration_date);
+                    if (status != client.account_status) changed.push_back(position);
+                }
+                Expect(changed.size() == expected_changes, "date_sweep_records");
+            });
+
+            std::vector<PeerInfo> peers = configuration.GetPeers();
+            std::vector<DesiredPeer> desired;
+            desired.reserve(peers.size());
+            for (const PeerInfo& peer : peers) desired.push_back(DesiredPeer{ WireguardKey(peer.public_key), peer.allowed_ips });
+            PeerReconciler reconciler;
+            reconciler.SetDesired(desired);
+            std::vector<PeerInfo> drift = MakeDrift(peers);
+            std::vector<PeerInfo> live;
+            runner.Measure("reconcile", count, desired.size(), [&reconciler, &live]()
+            {
+                ReconciliationReport report = reconciler.Reconcile(live);
+                Expect(!report.changes.Empty(), "reconcile");
+            }, [&live, &drift]() { live = drift; });
+
+            // readers take snapshots while writer creates and removes clients, every write publishes a new snapshot
+            size_t readers = std::max<size_t>(std::thread::hardware_concurrency(), 2) - 1;
+            runner.Measure("snapshot_reads", count, readers * BENCH_READS_PER_THREAD, [&wireguard, &targets, readers]()
+            {
+                std::atomic<bool> done{ false };
+                std::thread writer([&wireguard, &done]()
+                {
+                    for (size_t index = 0; !done; index++)
+                    {
+                        Client client;
+                        client.login = "writer" + std::to_string(index);
+                        client.public_key = "writer" + std::to_string(index);
+                        wireguard.RemoveClient(wireguard.CreateClient(client));
+                    }
+                });
+                std::vector<std::thread> threads;
+                std::atomic<size_t> found{ 0 };
+                for (size_t reader = 0; reader < readers; reader++)
+                {
+                    threads.emplace_back([&wireguard, &targets, &found, reader]()
+                    {
+                        size_t reader_found = 0;
+                        for (size_t index = 0; index < BENCH_READS_PER_THREAD; index++)
+                        {
+                            reader_found += wireguard.GetSnapshot()->clients.FindByUuid(targets[(reader + index) % targets.size()]->uuid) != nullptr;
+                        }
+                        found += reader_found;
+                    });
+                }
+                for (std::thread& thread : threads) thread.join();
+                done = true;
+                writer.join();
+                Expect(found == readers * BENCH_READS_PER_THREAD, "snapshot_reads");
+            });
+
+            // every creation is journalled and publishes a snapshot, which shares unchanged pages with the previous one
+            std::vector<std::string> created;
+            std::function<void()> remove_created = [&wireguard, &created]()
+            {
+                for (const std::string& uuid : created) wireguard.RemoveClient(uuid);
+                created.clear();
+            };
+            runner.Measure("create_client", count, BENCH_CREATED_CLIENTS, [&wireguard, &created]()
+            {
+                for (size_t index = 0; index < BENCH_CREATED_CLIENTS; index++)
+                {
+                    Client client;
+                    client.login = "created" + std::to_string(index);
+                    client.public_key = "created" + std::to_string(index);
+                    created.push_back(wireguard.CreateClient(client));
+                }
+            }, remove_created);
+            remove_created();
+
+            // configurations of all clients into archive, QR codes of the first clients (they take most of bundle time)
+            ThreadPool pool;
+            ClientBundleSettings bundle_settings;
+            runner.Measure("client_configurations", count, count, [&snapshot, &bundle_settings, &pool]()
+            {
+                std::string archive = ArchiveClientBundles(RenderClientBundles(*snapshot, bundle_settings, pool));
+                Expect(archive.size() >= snapshot->clients.Size() * 1024, "client_configurations"); // header and data block per file
+            });
+            size_t qr_clients = std::min<size_t>(count, BENCH_QR_CLIENTS);
+            ClientBundleSettings qr_settings;
+            qr_settings.formats = bundle_formats::PNG | bundle_formats::SVG;
+            runner.Measure("client_qr_codes", count, qr_clients, [&snapshot, &qr_settings, &pool, qr_clients]()
+            {
+                std::vector<std::vector<ClientBundleFile>> bundles(qr_clients);
+                pool.ParallelFor(qr_clients, [&](size_t index) { bundles[index] = RenderClientBundle(snapshot->server, snapshot->clients.At(index), qr_settings); });
+                Expect(bundles.back().size() == 2, "client_qr_codes");
+            });
+
+            // key generation, one journal write and one batch of peers for all rotated clients
+            std::vector<std::string> rotated;
+            for (size_t index = 0; index < std::min<size_t>(count, BENCH_ROTATED_CLIENTS); index++) rotated.push_back(clients.At(index).uuid.ToString());
+            runner.Measure("rotate_keys", count, rotated.size(), [&wireguard, &rotated]()
+            {
+                Expect(wireguard.RotateClientKeys(rotated).applied, "rotate_keys");
+            });
+
+            SyntheticConfiguration::Clean(BENCH_INTERFACE_NAME);
+        }
+
+        /// @brief Parses list of numbers, ex.: 1000,10000
+        /// @param text list
+        /// @return numbers
+        std::vector<size_t> ParseCounts(const std::string& text)
+        {
+            std::vector<size_t> counts;
+            std::stringstream stream(text);
+            std::string item;
+            while (std::getline(stream, item, ',')) counts.push_back(std::stoull(item));
+            return counts;
+        }
+
+        void PrintUsage()
+        {
+            std::cerr << "Usage: wireguard_bench [--clients 1000,10000,100000] [--iterations 5] [--seed 1] [--dump-latency-us 0] [--apply-latency-us 0]\n"
+                         "                       [--filter name] [--output results.jsonl]\n"
+                         "Writes one json object per benchmark. Configuration files are written to " SYNTHETIC_ROOT_PATH BENCH_INTERFACE_NAME ".*" << std::endl;
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    using namespace timlibs;
+
+    BenchSettings settings;
+    try
+    {
+        for (int index = 1; index < argc; index++)
+        {
+            std::string argument = argv[index];
+            if (argument == "--help")
+            {
+                PrintUsage();
+                return 0;
+            }
+            if (index + 1 == argc) throw std::invalid_argument(argument);
+            std::string value = argv[++index];
+            if (argument == "--clients") settings.clients = ParseCounts(value);
+            else if (argument == "--iterations") settings.iterations = std::max<size_t>(std::stoull(value), 1);
+            else if (argument == "--seed") settings.seed = std::stoull(value);
+            else if (argument == "--dump-latency-us") settings.dump_latency = std::chrono::microseconds(std::stoll(value));
+            else if (argument == "--apply-latency-us") settings.apply_latency = std::chrono::microseconds(std::stoll(value));
+            else if (argument == "--filter") settings.filter = value;
+            else if (argument == "--output") settings.output = value;
+            else throw std::invalid_argument(argument);
+        }
+    }
+    catch (const std::exception&)
+    {
+        PrintUsage();
+        return 2;
+    }
+
+    std::ofstream file;
+    if (!settings.output.empty()) file.open(settings.output);
+    std::ostream& output = settings.output.empty() ? std::cout : file;
+    BenchRunner runner(settings, output);
+    try
+    {
+        Histogram histogram;
+        runner.Measure("metrics_scoped_timer", 0, BENCH_TIMER_OBSERVATIONS, [&histogram]()
+        {
+            for (size_t index = 0; index < BENCH_TIMER_OBSERVATIONS; index++) ScopedTimer timer(histogram);
+        });
+        runner.Measure("key_pairs_single_thread", 0, BENCH_KEY_PAIRS, []()
+        {
+            Expect(GenerateKeyPairs(BENCH_KEY_PAIRS).size() == BENCH_KEY_PAIRS, "key_pairs_single_thread");
+        });
+        ThreadPool pool;
+        runner.Measure("key_pairs_pool", 0, BENCH_KEY_PAIRS, [&pool]()
+        {
+            Expect(GenerateKeyPairs(BENCH_KEY_PAIRS, pool).size() == BENCH_KEY_PAIRS, "key_pairs_pool");
+        });
+        for (size_t count : settings.clients) RunBenchmarks(runner, settings, count);
+    }
+    catch (const WireguardException&)
+    {
+        SyntheticConfiguration::Clean(BENCH_INTERFACE_NAME);
+        std::cerr << "Benchmark failed (is " SYNTHETIC_ROOT_PATH " writable?)" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,327 @@
+#include "synthetic_configuration.hpp"
+#include "client_state_table.hpp"
+#include "curve25519.hpp"
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+
+#define STRESS_INTERFACE_NAME "wgstress"
+#define STRESS_CREATED_CLIENTS 1000 // clients created by writer at most, then it removes them
+#define STRESS_HELD_SNAPSHOT_READS 1000 // reader holds a snapshot for so many reads, then checks that it wasn't changed
+#define STRESS_CHECKED_CLIENTS 16 // clients of held snapshot whose records are compared
+
+namespace timlibs
+{
+    namespace
+    {
+        struct StressSettings
+        {
+            size_t clients{ 10000 };
+            size_t seconds{ 10 };
+            size_t readers{ 4 };
+            uint64_t seed{ 1 };
+        };
+
+        // Failures of all threads, only the first message is kept
+        class StressFailures
+        {
+        public:
+            void Add(const std::string& message)
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                if (this->count++ == 0) this->first = message;
+            }
+
+            size_t GetCount() const
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                return this->count;
+            }
+
+            std::string GetFirst() const
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                return this->first;
+            }
+        private:
+            mutable std::mutex mutex;
+            size_t count{ 0 };
+            std::string first{};
+        };
+
+        // Records of clients of held snapshot, compared again after writers have changed configuration many times
+        struct SnapshotFingerprint
+        {
+            uint64_t version{ 0 };
+            size_t size{ 0 };
+            std::vector<size_t> positions{};
+            std::vector<std::string> records{};
+        };
+
+        /// @brief Text of fields of client which writers change
+        /// @param client client
+        /// @return uuid, key, login, ip, allowed ips and statuses
+        std::string FormatRecord(const Client& client)
+        {
+            std::stringstream record;
+            record << client.uuid.ToString() << ' ' << client.public_key.ToString() << ' ' << client.login.ToString() << ' ' << client.ip.GetAsString()
+                   << ' ' << client.allowed_ips << ' ' << client.account_status << client.administrative_account_status << client.connection_status;
+            return record.str();
+        }
+
+        /// @brief Checks that indexes, state table and routes of snapshot agree with client at position
+        /// @param snapshot published snapshot
+        /// @param position position of client
+        /// @return empty if consistent, else description of the first mismatch
+        std::string CheckClient(const ConfigurationSnapshot& snapshot, size_t position)
+        {
+            const ClientRegistry& clients = snapshot.clients;
+            const Client& client = clients.At(position);
+            std::string name = "client " + client.uuid.ToString() + " at " + std::to_string(position) + " of version " + std::to_string(snapshot.version);
+            if (clients.FindByUuid(client.uuid) != &client) return name + ": uuid index";
+            if (clients.GetPosition(client.uuid) != position) return name + ": position";
+            if (!client.public_key.empty() && clients.FindByPublicKey(client.public_key.ToString()) != &client) return name + ": public key index";
+            if (clients.FindByLogin(client.login.ToString()) != &client) return name + ": login index";
+            if (clients.FindByIp(client.ip) != &client) return name + ": ip index";
+            const ClientStateTable& states = clients.GetStates();
+            if (states.GetAccountStatus(position) != client.account_status) return name + ": account status of state table";
+            if (states.GetConnectionStatus(position) != client.connection_status) return name + ": connection status of state table";
+            if (client.allowed_ips == client.ip.GetAsString() + "/32")
+            {
+                const std::string* owner = snapshot.routes.FindOwner(ToHostOrder(client.ip));
+                if (owner == nullptr || client.uuid != *owner) return name + ": route of " + client.allowed_ips;
+            }
+            return NULL_STRING;
+        }
+
+        /// @brief Remembers records of some clients of snapshot
+        /// @param snapshot held snapshot
+        /// @param random generator of positions
+        /// @return fingerprint
+        SnapshotFingerprint TakeFingerprint(const ConfigurationSnapshot& snapshot, std::mt19937_64& random)
+        {
+            SnapshotFingerprint fingerprint;
+            fingerprint.version = snapshot.version;
+            fingerprint.size = snapshot.clients.Size();
+            for (size_t index = 0; index < STRESS_CHECKED_CLIENTS && fingerprint.size > 0; index++)
+            {
+                size_t position = random() % fingerprint.size;
+                fingerprint.positions.push_back(position);
+                fingerprint.records.push_back(FormatRecord(snapshot.clients.At(position)));
+            }
+            return fingerprint;
+        }
+
+        /// @brief Reads snapshots and clients until stop: every snapshot must be consistent, newer than the previous one
+        /// @brief and never changed while it's held
+        void RunReader(Wireguard& wireguard, const std::vector<Client>& synthetic, uint64_t seed, const std::atomic<bool>& stop,
+            StressFailures& failures, std::atomic<size_t>& reads)
+        {
+            std::mt19937_64 random(seed);
+            std::shared_ptr<const ConfigurationSnapshot> held = wireguard.GetSnapshot();
+            SnapshotFingerprint fingerprint = TakeFingerprint(*held, random);
+            uint64_t last_version = held->version;
+            size_t count = 0;
+            while (!stop.load(std::memory_order_relaxed))
+            {
+                std::shared_ptr<const ConfigurationSnapshot> snapshot = wireguard.GetSnapshot();
+                if (snapshot->version < last_version) failures.Add("version " + std::to_string(snapshot->version) + " after " + std::to_string(last_version));
+                last_version = snapshot->version;
+                if (!snapshot->clients.Empty())
+                {
+                    std::string error = CheckClient(*snapshot, random() % snapshot->clients.Size());
+                    if (error != NULL_STRING) failures.Add(error);
+                }
+
+                // synthetic clients are never removed, so GetClient() finds them whatever writers do
+                const Client& expected = synthetic[random() % synthetic.size()];
+                const Client* client = snapshot->clients.FindByLogin(expected.login.ToString());
+                if (client == nullptr) failures.Add("synthetic client " + expected.login.ToString() + " isn't found");
+                else
+                {
+                    try
+                    {
+                        if (wireguard.GetClient(client->uuid.ToString()).login != expected.login) failures.Add("login of " + client->uuid.ToString());
+                    }
+                    catch (const WireguardException&)
+                    {
+                        failures.Add("GetClient of " + client->uuid.ToString() + " threw");
+                    }
+                }
+
+                if (++count % STRESS_HELD_SNAPSHOT_READS == 0)
+                {
+                    bool changed = held->version != fingerprint.version || held->clients.Size() != fingerprint.size;
+                    for (size_t index = 0; index < fingerprint.positions.size() && !changed; index++)
+                    {
+                        changed = FormatRecord(held->clients.At(fingerprint.positions[index])) != fingerprint.records[index];
+                    }
+                    if (changed) failures.Add("held snapshot of version " + std::to_string(fingerprint.version) + " is changed");
+                    held = snapshot;
+                    fingerprint = TakeFingerprint(*held, random);
+                }
+            }
+            reads.fetch_add(count);
+        }
+
+        /// @brief Creates clients one by one and removes them in random order until stop
+        void RunChanges(Wireguard& wireguard, uint64_t seed, const std::atomic<bool>& stop, StressFailures& failures, std::atomic<size_t>& changes)
+        {
+            std::mt19937_64 random(seed);
+            std::vector<std::string> created;
+            size_t count = 0;
+            while (!stop.load(std::memory_order_relaxed))
+            {
+                try
+                {
+                    if (created.size() < STRESS_CREATED_CLIENTS && (created.empty() || random() % 2 == 0))
+                    {
+                        Client client;
+                        client.login = "stress" + std::to_string(count);
+                        KeyPair keys = GenerateKeyPair();
+                        client.private_key = keys.private_key;
+                        client.public_key = keys.public_key; // active clients become peers
+                        client.administrative_account_status = random() % 2 == 0;
+                        created.push_back(wireguard.CreateClient(client)); // ip and allowed ips are allocated
+                    }
+                    else
+                    {
+                        size_t index = random() % created.size();
+                        std::swap(created[index], created.back());
+                        wireguard.RemoveClient(created.back());
+                        created.pop_back();
+                    }
+                    count++;
+                }
+                catch (const WireguardException&)
+                {
+                    failures.Add("change " + std::to_string(count) + " threw");
+                }
+            }
+            for (const std::string& uuid : created) wireguard.RemoveClient(uuid);
+            changes.fetch_add(count);
+        }
+
+        /// @brief Moves handshakes of peers, so controller changes connection statuses, and runs controller until stop
+        void RunController(Wireguard& wireguard, FakePeerController& peer_controller, const std::vector<PeerInfo>& peers, uint64_t seed,
+            const std::atomic<bool>& stop, StressFailures& failures, std::atomic<size_t>& ticks)
+        {
+            std::mt19937_64 random(seed);
+            size_t count = 0;
+            while (!stop.load(std::memory_order_relaxed))
+            {
+                time_t now = time(nullptr);
+                for (size_t index = 0; index < peers.size() / 100 + 1 && !peers.empty(); index++)
+                {
+                    const PeerInfo& peer = peers[random() % peers.size()]; // peers of active synthetic clients, they are kept by controller
+                    peer_controller.SetHandshake(STRESS_INTERFACE_NAME, peer.public_key, random() % 2 == 0 ? now : now - 3600);
+                }
+                try
+                {
+                    wireguard.Controller();
+                }
+                catch (const WireguardException&)
+                {
+                    failures.Add("controller threw");
+                }
+                count++;
+            }
+            ticks.fetch_add(count);
+        }
+
+        void PrintUsage()
+        {
+            std::cerr << "Usage: wireguard_stress [--clients 10000] [--seconds 10] [--readers 4] [--seed 1]\n"
+                         "Readers check snapshots while writers create and remove clients and run controller, exit code is 1 if any check fails.\n"
+                         "Build with -fsanitize=thread to find races. Configuration files are written to " SYNTHETIC_ROOT_PATH STRESS_INTERFACE_NAME ".*" << std::endl;
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    using namespace timlibs;
+
+    StressSettings settings;
+    try
+    {
+        for (int index = 1; index < argc; index++)
+        {
+            std::string argument = argv[index];
+            if (argument == "--help")
+            {
+                PrintUsage();
+                return 0;
+            }
+            if (index + 1 == argc) throw std::invalid_argument(argument);
+            std::string value = argv[++index];
+            if (argument == "--clients") settings.clients = std::max<size_t>(std::stoull(value), 1);
+            else if (argument == "--seconds") settings.seconds = std::stoull(value);
+            else if (argument == "--readers") settings.readers = std::max<size_t>(std::stoull(value), 1);
+            else if (argument == "--seed") settings.seed = std::stoull(value);
+            else throw std::invalid_argument(argument);
+        }
+    }
+    catch (const std::exception&)
+    {
+        PrintUsage();
+        return 2;
+    }
+
+    StressFailures failures;
+    std::atomic<size_t> reads{ 0 };
+    std::atomic<size_t> changes{ 0 };
+    std::atomic<size_t> ticks{ 0 };
+    try
+    {
+        SyntheticSettings synthetic_settings;
+        synthetic_settings.clients = settings.clients;
+        synthetic_settings.seed = settings.seed;
+        SyntheticConfiguration configuration(synthetic_settings, time(nullptr));
+        configuration.Write(STRESS_INTERFACE_NAME);
+        std::shared_ptr<FakePeerController> peer_controller = std::make_shared<FakePeerController>();
+        peer_controller->SetPeers(STRESS_INTERFACE_NAME, configuration.GetPeers());
+        Wireguard wireguard(STRESS_INTERFACE_NAME, peer_controller);
+        wireguard.Controller();
+
+        std::atomic<bool> stop{ false };
+        std::vector<std::thread> threads;
+        for (size_t reader = 0; reader < settings.readers; reader++)
+        {
+            threads.emplace_back(RunReader, std::ref(wireguard), std::cref(configuration.GetClients()), settings.seed + 3 + reader, std::cref(stop),
+                std::ref(failures), std::ref(reads));
+        }
+        threads.emplace_back(RunChanges, std::ref(wireguard), settings.seed + 1, std::cref(stop), std::ref(failures), std::ref(changes));
+        std::vector<PeerInfo> peers = configuration.GetPeers();
+        threads.emplace_back(RunController, std::ref(wireguard), std::ref(*peer_controller), std::cref(peers), settings.seed + 2,
+            std::cref(stop), std::ref(failures), std::ref(ticks));
+        std::this_thread::sleep_for(std::chrono::seconds(settings.seconds));
+        stop.store(true);
+        for (std::thread& thread : threads) thread.join();
+
+        std::shared_ptr<const ConfigurationSnapshot> snapshot = wireguard.GetSnapshot();
+        if (snapshot->clients.Size() != settings.clients) failures.Add("writer left " + std::to_string(snapshot->clients.Size()) + " clients");
+        for (size_t position = 0; position < snapshot->clients.Size(); position++)
+        {
+            std::string error = CheckClient(*snapshot, position);
+            if (error != NULL_STRING) failures.Add(error);
+        }
+    }
+    catch (const WireguardException&)
+    {
+        SyntheticConfiguration::Clean(STRESS_INTERFACE_NAME);
+        std::cerr << "Stress test failed to run (is " SYNTHETIC_ROOT_PATH " writable?)" << std::endl;
+        return 2;
+    }
+    SyntheticConfiguration::Clean(STRESS_INTERFACE_NAME);
+
+    std::cout << "reads: " << reads.load() << ", changes: " << changes.load() << ", controller ticks: " << ticks.load() << ", failures: " << failures.GetCount() << std::endl;
+    if (failures.GetCount() == 0) return 0;
+    std::cerr << "The first failure: " << failures.GetFirst() << std::endl;
+    return 1;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "ipv4.hpp"
+
+#define ADDRESS_ALLOCATOR_MIN_PREFIX 8 // bitmap of /8 network is 2 MiB
+
+
+namespace timlibs
+{
+	// Free vpn addresses of server network: bitmap of used addresses, cursor over never used part and free-list of released addresses.
+	// Addresses are numbers in host byte order, ex.: 10.0.30.1 -> 0x0A001E01
+	class AddressAllocator
+	{
+	public:
+		void Reset(const IPv4Mask& network, const IPv4& server_ip); // all addresses are free except network, broadcast and server addresses
+		bool Contains(uint32_t address) const; // address is in network and may be given to client
+		bool Reserve(uint32_t address); // marks address as used, false if it can't be used or it's used already
+		void Release(uint32_t address);
+		bool Allocate(uint32_t& address); // next free address, false if network is full
+		std::vector<uint32_t> Allocate(size_t count); // all or nothing, throws WireguardException if there are less free addresses
+		size_t GetFreeCount() const;
+	private:
+		bool IsUsed(uint32_t offset) const;
+		void SetUsed(uint32_t offset, bool used);
+
+		uint32_t base{ 0 }; // network address
+		uint64_t size{ 0 }; // count of addresses in network
+		uint32_t first{ 0 }; // offsets of the first and the last usable addresses
+		uint32_t last{ 0 };
+		std::vector<uint64_t> used; // bit per address of network
+		uint64_t cursor{ 0 }; // all free offsets before cursor are in released
+		std::vector<uint32_t> released; // offsets of released addresses, may be reserved again explicitly (checked on pop)
+		size_t free_count{ 0 };
+	};
+
+	bool ParseNetwork(const std::string& text, uint32_t& address, uint32_t& prefix); // "10.0.30.0/24" or "10.0.30.0/255.255.255.0", address in host byte order
+}
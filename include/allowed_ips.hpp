@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <limits>
+#include "shared_pages.hpp"
+
+#define NO_OWNER std::numeric_limits<uint32_t>::max()
+#define TRIE_PAGE_SIZE 256 // nodes and owners per shared page of trie
+
+
+namespace timlibs
+{
+	// IPv4 prefix, address in host byte order with host bits cleared, ex.: 10.0.30.0/24 -> { 0x0A001E00, 24 }
+	struct IpPrefix
+	{
+		uint32_t address{ 0 };
+		uint32_t length{ 32 };
+
+		bool Contains(const IpPrefix& other) const; // other is the same prefix or it's inside
+		bool operator==(const IpPrefix& other) const { return this->address == other.address && this->length == other.length; }
+	};
+
+	bool ParseAllowedIps(const std::string& text, std::vector<IpPrefix>& prefixes); // "10.0.30.5/24, 10.0.31.0/24,10.0.0.1" -> minimal set 10.0.0.1/32, 10.0.30.0/23; false if any prefix isn't IPv4
+	void CompactPrefixes(std::vector<IpPrefix>& prefixes); // sorted, covered prefixes are dropped, sibling prefixes are merged
+	std::string FormatPrefix(const IpPrefix& prefix); // 10.0.30.0/24
+	std::string FormatAllowedIps(const std::vector<IpPrefix>& prefixes); // "10.0.0.1/32, 10.0.30.0/23", empty for no prefixes
+
+	// Allowed ips of all peers in one path-compressed binary trie: longest prefix match of address and overlap check of prefix
+	// are O(32) (plus owned prefixes inside of checked prefix), every prefix has one owner (uuid of client).
+	// Nodes and owners are paged, so copy of trie (ex. in snapshot of configuration) shares pages with it
+	class AllowedIpsTrie
+	{
+	public:
+		AllowedIpsTrie();
+
+		void Insert(const std::string& owner, const std::vector<IpPrefix>& prefixes); // replaces prefixes of owner, equal prefix of other owner is taken over (as wireguard does)
+		void Remove(const std::string& owner);
+		void Clear();
+
+		const std::string* FindOwner(uint32_t address) const; // owner of the longest prefix containing address, nullptr if none
+		const std::string* FindOverlap(const IpPrefix& prefix, const std::unordered_set<std::string>& ignored_owners) const; // owner of prefix which contains prefix or is inside of it
+		const std::vector<IpPrefix>* GetPrefixes(const std::string& owner) const; // nullptr if owner has no prefixes
+		size_t Size() const; // count of owned prefixes
+	private:
+		struct Node
+		{
+			IpPrefix prefix{ 0, 0 };
+			uint32_t children[2]{ 0, 0 }; // 0 - no child (root can't be a child)
+			uint32_t owner{ NO_OWNER }; // index of owners, NO_OWNER for branching nodes
+			uint32_t owned{ 0 }; // owned prefixes in subtree, including the node
+		};
+
+		struct Owner
+		{
+			std::string name{};
+			std::vector<IpPrefix> prefixes{}; // prefixes inserted by owner, some may be taken over
+		};
+
+		void InsertPrefix(const IpPrefix& prefix, uint32_t owner);
+		void RemovePrefix(const IpPrefix& prefix, uint32_t owner);
+		uint32_t NewNode(const IpPrefix& prefix);
+		void FreeNode(uint32_t index);
+		const Node* FindOwnedInside(uint32_t index, const std::unordered_set<std::string>& ignored_owners) const;
+
+		PagedVector<Node, TRIE_PAGE_SIZE> nodes; // nodes[0] is root 0.0.0.0/0
+		PagedVector<uint32_t, TRIE_PAGE_SIZE> free_nodes;
+		PagedVector<Owner, TRIE_PAGE_SIZE> owners;
+		PagedVector<uint32_t, TRIE_PAGE_SIZE> free_owners;
+		ShardedMap<std::string, uint32_t> owner_indexes;
+		size_t size{ 0 };
+	};
+}
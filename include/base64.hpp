@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+#define WG_KEY_SIZE 32
+
+
+namespace timlibs
+{
+	std::string Base64Encode(const uint8_t* data, size_t size);
+	bool Base64Decode(const std::string& text, uint8_t* data, size_t size); // true if text is exactly size bytes in base64
+	bool Base64DecodeCanonical(const std::string& text, uint8_t* data, size_t size); // also false if unused bits of the last symbol are set, so Base64Encode() restores text exactly
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "wireguard.hpp"
+
+#define BINARY_SNAPSHOT_MAGIC "WGSNAP"
+#define BINARY_SNAPSHOT_VERSION 1
+
+
+namespace timlibs
+{
+	// Read-only memory-mapped binary snapshot of configuration. Clients are fixed-size records, so any client is decoded without parsing others
+	class BinarySnapshot
+	{
+	public:
+		BinarySnapshot(const std::string& path); // throws WireguardException if file isn't valid snapshot
+		~BinarySnapshot();
+		BinarySnapshot(const BinarySnapshot&) = delete;
+		BinarySnapshot& operator=(const BinarySnapshot&) = delete;
+
+		Server GetServer() const;
+		size_t GetClientCount() const;
+		Client GetClient(size_t index) const;
+
+		static void Write(const std::string& path, const Server& server, const ClientRegistry& clients); // atomically
+	private:
+		std::string GetString(const uint8_t* reference) const;
+
+		const uint8_t* data{ nullptr };
+		size_t size{ 0 };
+		size_t client_count{ 0 };
+		size_t server_offset{ 0 };
+		size_t clients_offset{ 0 };
+		size_t strings_offset{ 0 };
+		size_t strings_size{ 0 };
+	};
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <utility>
+
+
+namespace timlibs
+{
+	// Bounded lock-free queue for many producers and many consumers (Vyukov's ring of cells with sequence numbers):
+	// push and pop are one CAS each, queue never allocates after construction
+	template <typename T>
+	class BoundedQueue
+	{
+	public:
+		BoundedQueue(size_t capacity); // rounded up to power of two, at least 2
+		BoundedQueue(const BoundedQueue&) = delete;
+		BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+		bool TryPush(T& value); // value is moved on success, false if queue is full
+		bool TryPop(T& value); // false if queue is empty
+		size_t GetCapacity() const;
+	private:
+		struct Cell
+		{
+			std::atomic<size_t> sequence{ 0 };
+			T value{};
+		};
+
+		std::unique_ptr<Cell[]> cells;
+		size_t mask{ 0 };
+		alignas(64) std::atomic<size_t> enqueue_position{ 0 }; // producers and consumers don't share cache line
+		alignas(64) std::atomic<size_t> dequeue_position{ 0 };
+	};
+
+	template <typename T>
+	BoundedQueue<T>::BoundedQueue(size_t capacity)
+	{
+		size_t size = 2;
+		while (size < capacity) size <<= 1;
+		this->cells.reset(new Cell[size]);
+		this->mask = size - 1;
+		for (size_t index = 0; index < size; index++) this->cells[index].sequence.store(index, std::memory_order_relaxed);
+	}
+
+	template <typename T>
+	bool BoundedQueue<T>::TryPush(T& value)
+	{
+		size_t position = this->enqueue_position.load(std::memory_order_relaxed);
+		while (true)
+		{
+			Cell& cell = this->cells[position & this->mask];
+			size_t sequence = cell.sequence.load(std::memory_order_acquire);
+			intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+			if (difference == 0)
+			{
+				if (this->enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+				{
+					cell.value = std::move(value);
+					cell.sequence.store(position + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (difference < 0) return false; // cell still holds value of the previous lap
+			else position = this->enqueue_position.load(std::memory_order_relaxed);
+		}
+	}
+
+	template <typename T>
+	bool BoundedQueue<T>::TryPop(T& value)
+	{
+		size_t position = this->dequeue_position.load(std::memory_order_relaxed);
+		while (true)
+		{
+			Cell& cell = this->cells[position & this->mask];
+			size_t sequence = cell.sequence.load(std::memory_order_acquire);
+			intptr_t difference = (intptr_t)sequence - (intptr_t)(position + 1);
+			if (difference == 0)
+			{
+				if (this->dequeue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+				{
+					value = std::move(cell.value);
+					cell.sequence.store(position + this->mask + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (difference < 0) return false; // cell isn't written yet
+			else position = this->dequeue_position.load(std::memory_order_relaxed);
+		}
+	}
+
+	template <typename T>
+	size_t BoundedQueue<T>::GetCapacity() const { return this->mask + 1; }
+}
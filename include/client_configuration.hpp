@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <ostream>
+#include "qr_code.hpp"
+
+#define CLIENT_BUNDLE_LOGIN_LENGTH_MAX 48 // longer logins are cut in file names, so ustar names fit 100 bytes
+#define CLIENT_BUNDLE_FILE_MODE 0600 // files contain private keys
+
+
+namespace timlibs
+{
+	struct Server;
+	struct Client;
+	struct ConfigurationSnapshot;
+	class ThreadPool;
+
+	namespace bundle_formats
+	{
+		enum FORMAT : uint32_t
+		{
+			CONF = 1 << 0, // <name>.conf, wg-quick configuration
+			PNG = 1 << 1, // <name>.png, QR code of configuration for mobile clients
+			SVG = 1 << 2, // <name>.svg
+			ALL = (1 << 3) - 1
+		};
+	}
+
+	struct ClientBundleFile
+	{
+		std::string name{}; // file name without directory, ex.: bivanov.conf
+		std::string content{};
+	};
+
+	struct ClientBundleSettings
+	{
+		uint32_t formats{ bundle_formats::CONF }; // bundle_formats
+		QrErrorCorrection error_correction{ QrErrorCorrection::MEDIUM };
+		int png_scale{ QR_PNG_SCALE_DEFAULT };
+		int border{ QR_BORDER_DEFAULT };
+	};
+
+	void RenderClientConfiguration(const Server& server, const Client& client, std::ostream& output); // wg-quick text of client, server is the only peer
+	std::string RenderClientConfiguration(const Server& server, const Client& client);
+	std::string GetClientBundleName(const Client& client); // login, or uuid if login can't be a file name
+	std::vector<ClientBundleFile> RenderClientBundle(const Server& server, const Client& client, const ClientBundleSettings& settings); // files of one client in order conf, png, svg
+	std::vector<ClientBundleFile> RenderClientBundles(const ConfigurationSnapshot& snapshot, const ClientBundleSettings& settings, ThreadPool& pool); // files of all clients in order of registry, rendered in parallel
+	std::string ArchiveClientBundles(const std::vector<ClientBundleFile>& files); // in-memory ustar (tar) archive
+	void WriteClientBundles(const std::vector<ClientBundleFile>& files, const std::string& directory, ThreadPool& pool); // directory is created if it doesn't exist, files are replaced
+}
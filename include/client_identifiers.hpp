@@ -0,0 +1,167 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <cstring>
+#include "json.hpp"
+#include "base64.hpp"
+#include "string_pool.hpp"
+
+#define UUID_SIZE 16
+#define UUID_TEXT_SIZE 36
+
+
+namespace timlibs
+{
+	struct UuidCodec
+	{
+		static constexpr size_t SIZE = UUID_SIZE;
+		static constexpr bool ORDERED = true; // order of bytes is order of texts
+		static bool Parse(const std::string& text, uint8_t* bytes); // canonical uuid only (lowercase 8-4-4-4-12)
+		static std::string Format(const uint8_t* bytes);
+	};
+
+	struct KeyCodec
+	{
+		static constexpr size_t SIZE = WG_KEY_SIZE;
+		static constexpr bool ORDERED = false;
+		static bool Parse(const std::string& text, uint8_t* bytes); // canonical base64 of 32 bytes only
+		static std::string Format(const uint8_t* bytes);
+	};
+
+	// Identifier which is text at json boundary and raw bytes inside: canonical text is kept as SIZE bytes without heap,
+	// any other text (and canonical text of zero bytes) is kept in StringPool, so every text is restored exactly
+	template <typename Codec>
+	class PackedText
+	{
+	public:
+		PackedText() = default;
+		PackedText(const std::string& text) { *this = text; }
+		PackedText(const char* text) { *this = std::string(text); }
+		PackedText& operator=(const std::string& text);
+		PackedText& operator=(const char* text) { return *this = std::string(text); }
+
+		static bool Lookup(const std::string& text, PackedText& value); // value without interning, false if nothing can be equal to text
+		static PackedText FromBytes(const uint8_t* bytes); // SIZE bytes of canonical text, ex. from binary snapshot
+
+		std::string ToString() const;
+		bool empty() const { return this->text.empty() && IsZero(this->bytes); }
+		const uint8_t* GetBytes() const { return this->text.empty() && !IsZero(this->bytes) ? this->bytes : nullptr; } // nullptr if text isn't canonical
+		size_t Hash() const;
+
+		bool operator==(const PackedText& other) const { return this->text == other.text && memcmp(this->bytes, other.bytes, Codec::SIZE) == 0; }
+		bool operator!=(const PackedText& other) const { return !(*this == other); }
+		bool operator==(const std::string& other) const;
+		bool operator!=(const std::string& other) const { return !(*this == other); }
+		bool operator==(const char* other) const { return *this == std::string(other); }
+		bool operator!=(const char* other) const { return !(*this == other); }
+		bool operator<(const PackedText& other) const; // order of texts
+	private:
+		static bool IsZero(const uint8_t* bytes);
+
+		uint8_t bytes[Codec::SIZE]{}; // zero if text isn't canonical
+		PooledString text{}; // non-canonical text
+	};
+
+	using ClientUuid = PackedText<UuidCodec>; // 24 bytes instead of std::string and 37 bytes on heap
+	using WireguardKey = PackedText<KeyCodec>; // 40 bytes instead of std::string and 45 bytes on heap
+
+	struct PackedTextHash
+	{
+		template <typename Codec>
+		size_t operator()(const PackedText<Codec>& value) const { return value.Hash(); }
+	};
+
+	template <typename Codec>
+	PackedText<Codec>& PackedText<Codec>::operator=(const std::string& text)
+	{
+		if (!text.empty() && Codec::Parse(text, this->bytes) && !IsZero(this->bytes))
+		{
+			this->text = PooledString();
+			return *this;
+		}
+		memset(this->bytes, 0, Codec::SIZE);
+		this->text = text;
+		return *this;
+	}
+
+	template <typename Codec>
+	bool PackedText<Codec>::Lookup(const std::string& text, PackedText& value)
+	{
+		if (!text.empty() && Codec::Parse(text, value.bytes) && !IsZero(value.bytes))
+		{
+			value.text = PooledString();
+			return true;
+		}
+		memset(value.bytes, 0, Codec::SIZE);
+		return PooledString::Lookup(text, value.text);
+	}
+
+	template <typename Codec>
+	PackedText<Codec> PackedText<Codec>::FromBytes(const uint8_t* bytes)
+	{
+		PackedText value;
+		if (IsZero(bytes)) value.text = Codec::Format(bytes); // zero bytes are kept as text, see operator=
+		else memcpy(value.bytes, bytes, Codec::SIZE);
+		return value;
+	}
+
+	template <typename Codec>
+	std::string PackedText<Codec>::ToString() const
+	{
+		if (!this->text.empty()) return this->text.ToString();
+		return IsZero(this->bytes) ? std::string() : Codec::Format(this->bytes);
+	}
+
+	template <typename Codec>
+	size_t PackedText<Codec>::Hash() const
+	{
+		if (!this->text.empty()) return this->text.Hash();
+		return std::hash<std::string_view>()(std::string_view((const char*)this->bytes, Codec::SIZE)); // all bytes: time based uuids (v1, v7) share prefixes
+	}
+
+	template <typename Codec>
+	bool PackedText<Codec>::operator==(const std::string& other) const
+	{
+		if (!this->text.empty()) return this->text == other;
+		if (IsZero(this->bytes)) return other.empty();
+		uint8_t bytes[Codec::SIZE];
+		return Codec::Parse(other, bytes) && memcmp(this->bytes, bytes, Codec::SIZE) == 0;
+	}
+
+	template <typename Codec>
+	bool PackedText<Codec>::operator<(const PackedText& other) const
+	{
+		if (Codec::ORDERED && this->text.empty() && other.text.empty()) return memcmp(this->bytes, other.bytes, Codec::SIZE) < 0; // empty is zero, the first text
+		return this->ToString() < other.ToString();
+	}
+
+	template <typename Codec>
+	bool PackedText<Codec>::IsZero(const uint8_t* bytes)
+	{
+		for (size_t index = 0; index < Codec::SIZE; index++)
+		{
+			if (bytes[index] != 0) return false;
+		}
+		return true;
+	}
+
+	template <typename Codec>
+	bool operator==(const std::string& text, const PackedText<Codec>& value) { return value == text; }
+
+	template <typename Codec>
+	bool operator!=(const std::string& text, const PackedText<Codec>& value) { return value != text; }
+
+	template <typename Codec>
+	std::string operator+(const std::string& text, const PackedText<Codec>& value) { return text + value.ToString(); }
+
+	template <typename Codec>
+	std::string operator+(const PackedText<Codec>& value, const std::string& text) { return value.ToString() + text; }
+
+	template <typename Codec>
+	void to_json(nlohmann::json& json, const PackedText<Codec>& value) { json = value.ToString(); }
+
+	template <typename Codec>
+	void from_json(const nlohmann::json& json, PackedText<Codec>& value) { value = json.get_ref<const std::string&>(); }
+}
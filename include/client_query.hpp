@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include "time.hpp"
+
+#define QUERY_LIMIT_DEFAULT 100
+
+
+namespace timlibs
+{
+	struct Client;
+	struct ConfigurationSnapshot;
+
+	namespace client_fields
+	{
+		enum FIELD : uint32_t
+		{
+			UUID = 1 << 0,
+			PRIVATE_KEY = 1 << 1,
+			PUBLIC_KEY = 1 << 2,
+			LOGIN = 1 << 3,
+			FULL_NAME = 1 << 4,
+			IP = 1 << 5,
+			ACCOUNT_STATUS = 1 << 6,
+			ADMINISTRATIVE_ACCOUNT_STATUS = 1 << 7,
+			CONNECTION_STATUS = 1 << 8,
+			CREATION_DATE = 1 << 9,
+			RELEASE_DATE = 1 << 10,
+			EXPIRATION_DATE = 1 << 11,
+			ALLOWED_IPS = 1 << 12,
+			DNS = 1 << 13,
+			ALL = (1 << 14) - 1
+		};
+	}
+
+	enum class StatusFilter
+	{
+		ANY,
+		ON, // active account or connected client
+		OFF
+	};
+
+	// Position in order of clients by (login, uuid), it stays valid after changes of configuration
+	struct ClientCursor
+	{
+		std::string login{};
+		std::string uuid{};
+
+		bool Empty() const; // cursor of the first page or after the last page
+	};
+
+	struct ClientQuery
+	{
+		StatusFilter connection_status{ StatusFilter::ANY };
+		StatusFilter account_status{ StatusFilter::ANY };
+		Time expiration_from{ MIN_TIME }; // expiration date in [from, to]
+		Time expiration_to{ MAX_TIME };
+		std::string login_prefix{};
+		ClientCursor after{}; // next_cursor of previous page
+		size_t limit{ QUERY_LIMIT_DEFAULT };
+	};
+
+	// Clients of one snapshot without copies, pointers are valid while page exists
+	class ClientPage
+	{
+	public:
+		ClientPage(std::shared_ptr<const ConfigurationSnapshot> snapshot, std::vector<const Client*> items, ClientCursor next_cursor);
+
+		const std::vector<const Client*>& GetItems() const;
+		size_t Size() const;
+		const Client& operator[](size_t index) const;
+		const ClientCursor& GetNextCursor() const; // empty if there are no more clients
+		uint64_t GetVersion() const; // version of snapshot
+	private:
+		std::shared_ptr<const ConfigurationSnapshot> snapshot; // keeps clients alive
+		std::vector<const Client*> items;
+		ClientCursor next_cursor;
+	};
+
+	Client Project(const Client& client, uint32_t fields); // owned copy of selected client_fields, other fields are default
+}
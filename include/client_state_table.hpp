@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <limits>
+#include "base64.hpp"
+#include "shared_pages.hpp"
+
+#define NO_POSITION std::numeric_limits<size_t>::max()
+#define STATE_TABLE_PAGE_SIZE 4096 // positions per shared page of state table, multiple of 64
+
+
+namespace timlibs
+{
+	struct Client;
+
+	// Hot fields of clients in structure of arrays, positions are equal to positions in ClientRegistry.
+	// Statuses are packed in bitsets (bit = position % 64 of word position / 64), dates are unix time.
+	// Arrays are paged, so copy of table (ex. in snapshot of registry) shares pages with it
+	class ClientStateTable
+	{
+	public:
+		void Append(const Client& client);
+		void Update(size_t position, const Client& client); // administrative status and dates; statuses are kept
+		void Remove(size_t position); // last client is moved to position, as in ClientRegistry
+		void Clear();
+		void Reserve(size_t count);
+		size_t Size() const;
+
+		bool GetAccountStatus(size_t position) const;
+		void SetAccountStatus(size_t position, bool status); // use ClientRegistry::SetAccountStatus, it keeps Client in sync
+		bool GetConnectionStatus(size_t position) const;
+		void SetConnectionStatus(size_t position, bool status); // use ClientRegistry::SetConnectionStatus, it keeps Client in sync
+
+		int64_t GetExpirationDate(size_t position) const;
+
+		void SweepDates(int64_t now, std::vector<size_t>& changed) const; // positions whose account status differs from administrative status and dates
+		void SweepConnections(const std::vector<size_t>& connected, std::vector<size_t>& changed) const; // positions whose connection status differs from connected positions
+		int64_t GetNextMoment(size_t position, int64_t now) const; // next release/expiration moment of client, NEVER if there is no one
+		bool GetDueAccountStatus(size_t position, int64_t now) const; // status by administrative status and dates, as SweepDates() evaluates it
+	private:
+		using Bits = PagedVector<uint64_t, STATE_TABLE_PAGE_SIZE / 64>;
+		using Dates = PagedVector<int64_t, STATE_TABLE_PAGE_SIZE>;
+
+		Bits account_bits;
+		Bits administrative_bits;
+		Bits connection_bits;
+		Dates release_dates;
+		Dates expiration_dates;
+	};
+}
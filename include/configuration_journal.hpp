@@ -0,0 +1,55 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include "json.hpp"
+
+#define JOURNAL_SIZE_LIMIT_DEFAULT (4 * 1024 * 1024) // bytes of journal after which it is compacted into snapshot
+#define ATOMIC_FILE_BUFFER_SIZE 65536
+
+
+namespace timlibs
+{
+	// Append-only journal of configuration changes, one JSON record per line
+	class ConfigurationJournal
+	{
+	public:
+		ConfigurationJournal(const std::string& path); // file is created by first Append
+		~ConfigurationJournal();
+		ConfigurationJournal(const ConfigurationJournal&) = delete;
+		ConfigurationJournal& operator=(const ConfigurationJournal&) = delete;
+
+		void Append(const std::vector<nlohmann::json>& records); // one write and fdatasync for all records
+		std::vector<nlohmann::json> Read() const; // records until the first broken one (torn last write)
+		void Reset(); // empties journal, call after snapshot is written
+		size_t GetSize() const;
+	private:
+		void Open();
+
+		std::string path;
+		int fd{ -1 };
+		size_t size{ 0 };
+	};
+
+	// Buffered stream to temporary file that replaces file on Commit, for content that is rendered by parts
+	class AtomicFileWriter
+	{
+	public:
+		AtomicFileWriter(const std::string& path); // throws WireguardException if temporary file can't be created
+		~AtomicFileWriter(); // temporary file is removed if it isn't committed
+		AtomicFileWriter(const AtomicFileWriter&) = delete;
+		AtomicFileWriter& operator=(const AtomicFileWriter&) = delete;
+
+		std::ostream& GetStream();
+		void Commit(); // flush + fsync + rename
+	private:
+		std::string path;
+		std::string temporary_path;
+		std::vector<char> buffer;
+		std::ofstream stream;
+		bool committed{ false };
+	};
+
+	void WriteFileAtomically(const std::string& path, const std::string& content); // temp file + fsync + rename
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <stdint.h>
+
+
+namespace timlibs
+{
+	namespace general
+	{
+		enum KEY
+		{
+			FIRST,
+			SERVER = FIRST,
+			CLIENTS,
+			LAST // leave it as the last value!!!
+		};
+	}
+	
+	namespace server
+	{
+		enum KEY
+		{
+			FIRST = general::KEY::LAST,
+			INTERFACE_NAME = FIRST,
+			LISTEN_PORT,
+			IP,
+			NETWORK,
+			ENDPOINT_DNS,
+			ENDPOINT_IP,
+			PUBLIC_LISTEN_PORT,
+			PRIVATE_KEY,
+			PUBLIC_KEY,
+			PRE_UP,
+			POST_UP,
+			PRE_DOWN,
+			POST_DOWN,
+			LAST // leave it as the last value!!!
+		};
+	}
+	
+	namespace clients
+	{
+		enum KEY
+		{
+			FIRST = server::KEY::LAST,
+			UUID = FIRST,
+			PRIVATE_KEY,
+			PUBLIC_KEY,
+			LOGIN,
+			FULL_NAME,
+			IP,
+			ACCOUNT_STATUS,
+			ADMINISTRATIVE_ACCOUNT_STATUS,
+			CONNECTION_STATUS,
+			CREATION_DATE,
+			RELEASE_DATE,
+			EXPIRATION_DATE,
+			ALLOWED_IPS,
+			DNS,
+			LAST
+		};
+	}
+
+	// Names of fields in json configuration, KEY is index of name
+	struct KeyNames
+	{
+		const char* names[clients::KEY::LAST];
+
+		constexpr const char* at(uint32_t key) const { return this->names[key]; } // key must be valid KEY
+	};
+
+	inline constexpr KeyNames keys
+	{{
+		"server", // general::KEY::SERVER
+		"clients", // general::KEY::CLIENTS
+		"interface_name", // server::KEY::INTERFACE_NAME
+		"listen_port",
+		"ip",
+		"network",
+		"endpoint_dns",
+		"endpoint_ip",
+		"public_listen_port",
+		"private_key",
+		"public_key",
+		"pre_up",
+		"post_up",
+		"pre_down",
+		"post_down",
+		"uuid", // clients::KEY::UUID
+		"private_key",
+		"public_key",
+		"login",
+		"full_name",
+		"ip",
+		"account_status",
+		"administrative_account_status",
+		"connection_status",
+		"creation_date",
+		"release_date",
+		"expiration_date",
+		"allowed_ips",
+		"dns"
+	}};
+
+	static_assert(keys.names[clients::KEY::LAST - 1] != nullptr, "every KEY must have a name");
+}
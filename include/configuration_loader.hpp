@@ -0,0 +1,12 @@
+#pragma once
+
+#include <istream>
+#include <functional>
+#include "wireguard.hpp"
+
+
+namespace timlibs
+{
+	// Streaming (SAX) loader of json configuration: every field is validated and written into Server or Client while parsing, json document isn't built
+	void LoadJsonConfiguration(std::istream& input, Server& server, const std::function<void(Client& client)>& on_client);
+}
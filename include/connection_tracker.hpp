@@ -0,0 +1,101 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <mutex>
+#include <ctime>
+#include <chrono>
+#include <functional>
+#include "peer_controller.hpp"
+
+#define SESSION_HISTORY_DEFAULT 4096 // closed sessions of all peers kept in memory
+
+
+namespace timlibs
+{
+	enum class ConnectionState : uint8_t
+	{
+		DISCONNECTED, // without handshake, or handshake is older than stale threshold, or peer is absent
+		CONNECTED, // handshake is younger than connected threshold (wireguard renews session every 2 minutes while traffic flows)
+		IDLE, // session keys are still valid, but peer sends nothing
+		STALE // session is expired, peer may come back with the next handshake
+	};
+
+	struct ConnectionThresholds
+	{
+		std::chrono::seconds connected{ 130 }; // maximal handshake age of connected peer
+		std::chrono::seconds idle{ 180 }; // of idle peer (wireguard rejects session keys after 180 seconds)
+		std::chrono::seconds stale{ 600 }; // of stale peer, peer with older handshake is disconnected
+	};
+
+	struct ConnectionEvent
+	{
+		uint64_t sequence{ 0 }; // grows by one with every event
+		time_t time{ 0 }; // time of dump where transition was seen
+		std::string public_key{};
+		ConnectionState old_state{ ConnectionState::DISCONNECTED }; // DISCONNECTED: connect event
+		ConnectionState new_state{ ConnectionState::DISCONNECTED }; // DISCONNECTED: disconnect event
+		time_t latest_handshake{ 0 };
+	};
+
+	struct ConnectionSession
+	{
+		uint64_t sequence{ 0 }; // order of closed sessions, 0 while session is open
+		std::string public_key{};
+		time_t started{ 0 }; // handshake which opened session
+		time_t latest_handshake{ 0 };
+		time_t ended{ 0 }; // when disconnect was seen, 0 while session is open
+		uint64_t rx_bytes{ 0 }; // traffic of session
+		uint64_t tx_bytes{ 0 };
+	};
+
+	using ConnectionHandler = std::function<void(const ConnectionEvent& event)>;
+
+	const char* ToString(ConnectionState state); // connected, idle, stale, disconnected
+
+	// Connection state machine of every peer of interface, keyed by public key. Process is one pass over dump (and over tracked
+	// peers which are absent in it), transitions go to subscribers, closed sessions stay in ring for usage accounting. All methods are thread-safe
+	class ConnectionTracker
+	{
+	public:
+		ConnectionTracker(size_t history_size = SESSION_HISTORY_DEFAULT);
+
+		void SetThresholds(const ConnectionThresholds& thresholds); // of peers without own thresholds
+		ConnectionThresholds GetThresholds() const;
+		void Process(const std::vector<PeerInfo>& peers, time_t now, const std::vector<const ConnectionThresholds*>& thresholds, std::vector<ConnectionState>& states); // thresholds: own thresholds of peers of dump or nullptr (or empty vector); states: state of every peer of dump
+		ConnectionState GetState(const std::string& public_key) const; // DISCONNECTED if peer is unknown
+		size_t GetCount(ConnectionState state) const; // peers of the last dump in state
+
+		std::vector<ConnectionSession> GetSessions(const std::string& public_key) const; // closed sessions that are still in ring and open session, oldest first
+		std::vector<ConnectionSession> GetClosedSessions(uint64_t after_sequence = 0) const; // sessions that are still in ring, oldest first
+
+		uint64_t Subscribe(ConnectionHandler handler); // handler is called by Process after state of dump is saved, it must not call writing methods of Wireguard
+		void Unsubscribe(uint64_t subscription); // handler may be called once more by running Process
+	private:
+		struct Peer
+		{
+			ConnectionState state{ ConnectionState::DISCONNECTED };
+			ConnectionSession session{}; // open session (if state isn't DISCONNECTED)
+			uint64_t rx_base{ 0 }; // counters of peer when session was opened
+			uint64_t tx_base{ 0 };
+			uint64_t generation{ 0 }; // the last Process call which had peer
+		};
+
+		void Transit(Peer& peer, const std::string& public_key, ConnectionState state, time_t now, std::vector<ConnectionEvent>& events);
+		void CloseSession(Peer& peer);
+
+		mutable std::mutex tracker_mutex;
+		ConnectionThresholds thresholds{};
+		std::unordered_map<std::string, Peer> peers; // public key -> peer
+		size_t counts[4]{ 0, 0, 0, 0 }; // peers by state
+		std::vector<ConnectionSession> sessions; // ring, session with sequence N is at (N - 1) % size
+		uint64_t session_sequence{ 0 };
+		uint64_t event_sequence{ 0 };
+		uint64_t generation{ 0 };
+		std::map<uint64_t, ConnectionHandler> handlers; // subscription -> handler
+		uint64_t subscription_sequence{ 0 };
+	};
+}
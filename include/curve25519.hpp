@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "base64.hpp"
+
+
+namespace timlibs
+{
+	class ThreadPool;
+
+	struct KeyPair
+	{
+		std::string private_key{}; // base64, as output of "wg genkey"
+		std::string public_key{}; // base64, as output of "wg pubkey"
+	};
+
+	void X25519(uint8_t output[WG_KEY_SIZE], const uint8_t scalar[WG_KEY_SIZE], const uint8_t point[WG_KEY_SIZE]); // RFC 7748, constant time
+	void X25519Base(uint8_t public_key[WG_KEY_SIZE], const uint8_t private_key[WG_KEY_SIZE]); // scalar * base point 9
+	void ClampPrivateKey(uint8_t private_key[WG_KEY_SIZE]);
+	void GenerateRandomBytes(uint8_t* data, size_t size); // getrandom(), throws WireguardException on failure
+
+	KeyPair GenerateKeyPair(); // "wg genkey | wg pubkey" without processes
+	std::vector<KeyPair> GenerateKeyPairs(size_t count); // one read of random bytes for all keys
+	std::vector<KeyPair> GenerateKeyPairs(size_t count, ThreadPool& pool); // public keys are derived in parallel
+	std::string DerivePublicKey(const std::string& private_key); // throws WireguardException if key isn't base64 of 32 bytes
+	std::string GeneratePresharedKey(); // "wg genpsk"
+}
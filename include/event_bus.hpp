@@ -0,0 +1,119 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+#include <chrono>
+#include <ctime>
+#include "json.hpp"
+#include "bounded_queue.hpp"
+
+#define EVENT_QUEUE_CAPACITY_DEFAULT 4096
+#define EVENT_DISPATCH_WAIT std::chrono::milliseconds(100) // dispatcher rechecks queue at least so often
+
+
+namespace timlibs
+{
+	namespace event_types
+	{
+		enum TYPE : uint32_t
+		{
+			CLIENT_CREATED = 1 << 0,
+			CLIENT_UPDATED = 1 << 1,
+			CLIENT_REMOVED = 1 << 2,
+			CLIENT_ACTIVATED = 1 << 3, // release date has come or administrative status is on
+			CLIENT_DEACTIVATED = 1 << 4, // administrative status is off or release date is in future
+			CLIENT_EXPIRED = 1 << 5, // expiration date has passed
+			CLIENT_CONNECTED = 1 << 6,
+			CLIENT_DISCONNECTED = 1 << 7,
+			PEERS_CHANGED = 1 << 8, // changes of peers are sent to interface by reconciliation
+			SERVER_UPDATED = 1 << 9,
+			ALL = (1 << 10) - 1
+		};
+	}
+
+	enum class BackpressurePolicy
+	{
+		BLOCK, // publisher waits for free place in queue
+		DROP_NEWEST, // published event is dropped
+		DROP_OLDEST // the oldest queued event is dropped
+	};
+
+	enum class NdjsonTarget
+	{
+		FILE, // events are appended to file
+		UNIX_SOCKET // events are sent to stream socket, it's reconnected after failures (events are dropped while it's down or doesn't read)
+	};
+
+	struct WireguardEvent
+	{
+		uint64_t sequence{ 0 }; // set by bus, grows by one with every delivered event (dropped events have none)
+		event_types::TYPE type{ event_types::CLIENT_CREATED };
+		time_t time{ 0 };
+		std::string interface_name{};
+		std::string uuid{}; // client of event (empty for events of interface)
+		std::string login{};
+		std::string public_key{};
+		uint32_t peers_added{ 0 }; // PEERS_CHANGED only
+		uint32_t peers_updated{ 0 };
+		uint32_t peers_removed{ 0 };
+	};
+
+	using EventHandler = std::function<void(const WireguardEvent& event)>;
+
+	const char* ToString(event_types::TYPE type); // ex.: client_created
+	nlohmann::json ToJson(const WireguardEvent& event);
+
+	// Typed events of interfaces for external consumers. Publishers put events into bounded lock-free queue and don't wait for
+	// consumers (except BLOCK policy), one dispatcher thread delivers them to subscribers in order of sequence. Bus may be shared by interfaces
+	class EventBus
+	{
+	public:
+		EventBus(size_t capacity = EVENT_QUEUE_CAPACITY_DEFAULT, BackpressurePolicy policy = BackpressurePolicy::DROP_OLDEST);
+		~EventBus(); // queued events are delivered
+		EventBus(const EventBus&) = delete;
+		EventBus& operator=(const EventBus&) = delete;
+
+		void Publish(WireguardEvent event); // events are ignored while there are no subscribers
+		uint64_t Subscribe(EventHandler handler, uint32_t types = event_types::ALL); // handler runs on dispatcher thread and must not throw
+		uint64_t SubscribeNdjson(const std::string& path, NdjsonTarget target, uint32_t types = event_types::ALL); // one JSON object per line; throws WireguardException if file can't be opened
+		void Unsubscribe(uint64_t subscription); // handler may be called once more by running delivery
+		void Flush(); // waits until all published events are delivered or dropped
+		uint64_t GetDroppedCount() const;
+		bool HasSubscribers() const; // publishers may skip building of events
+	private:
+		struct Subscriber
+		{
+			uint64_t id{ 0 };
+			uint32_t types{ event_types::ALL };
+			EventHandler handler{};
+		};
+
+		void Dispatch(); // thread of dispatcher
+		void Finish(uint64_t count); // events are delivered or dropped
+
+		BoundedQueue<WireguardEvent> queue;
+		BackpressurePolicy policy;
+		uint64_t sequence{ 0 }; // of the last delivered event, used by dispatcher only
+		std::atomic<uint64_t> published{ 0 }; // accepted events
+		std::atomic<uint64_t> dropped{ 0 };
+		std::atomic<size_t> subscriber_count{ 0 };
+		std::atomic<bool> dispatcher_waiting{ false };
+		std::mutex subscribers_mutex;
+		std::shared_ptr<const std::vector<Subscriber>> subscribers; // replaced on change, dispatcher keeps its copy
+		uint64_t subscription_sequence{ 0 };
+		std::mutex dispatch_mutex;
+		std::condition_variable dispatch_condition; // wakes dispatcher
+		std::condition_variable flush_condition;
+		uint64_t finished{ 0 }; // events delivered or dropped, guarded by dispatch_mutex
+		bool stop_requested{ false }; // guarded by dispatch_mutex
+		std::thread dispatcher; // started by the first subscription
+	};
+}
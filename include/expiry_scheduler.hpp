@@ -0,0 +1,40 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <queue>
+#include <unordered_map>
+#include <ctime>
+#include <limits>
+#include "client_identifiers.hpp"
+
+#define NEVER std::numeric_limits<time_t>::max()
+
+
+namespace timlibs
+{
+	// Min-heap of moments when account status of clients may change (release or expiration), one valid moment per client
+	class ExpiryScheduler
+	{
+	public:
+		void Schedule(const ClientUuid& uuid, time_t moment); // replaces previous moment of client, NEVER cancels it
+		void Cancel(const ClientUuid& uuid);
+		std::vector<ClientUuid> PopDue(time_t now); // clients with moment <= now, they are unscheduled
+		time_t GetNextMoment() const; // NEVER if nothing is scheduled
+		size_t Size() const;
+		void Clear();
+	private:
+		struct Entry
+		{
+			time_t moment;
+			ClientUuid uuid;
+			bool operator>(const Entry& other) const { return this->moment > other.moment; }
+		};
+
+		void DropStale() const;
+		void Compact();
+
+		mutable std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> heap; // may contain replaced entries, they are skipped lazily
+		std::unordered_map<ClientUuid, time_t, PackedTextHash> moments; // uuid -> valid moment
+	};
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <functional>
+#include <mutex>
+
+#define METRICS_CONTENT_TYPE "application/openmetrics-text; version=1.0.0; charset=utf-8"
+#define METRICS_PORT_DEFAULT 9586
+
+
+namespace timlibs
+{
+	// Monotonic counter, updates are relaxed atomics
+	class Counter
+	{
+	public:
+		void Add(uint64_t value = 1);
+		uint64_t Get() const;
+	private:
+		std::atomic<uint64_t> value{ 0 };
+	};
+
+	class Gauge
+	{
+	public:
+		void Set(int64_t value);
+		int64_t Get() const;
+	private:
+		std::atomic<int64_t> value{ 0 };
+	};
+
+	// Histogram of durations with fixed buckets from 100 us to 10 s
+	class Histogram
+	{
+	public:
+		static const std::vector<double>& GetBounds(); // upper bounds of buckets in seconds, without +Inf
+
+		void Observe(std::chrono::nanoseconds duration);
+		uint64_t GetCount() const;
+		double GetSum() const; // seconds
+		std::vector<uint64_t> GetCumulativeCounts() const; // per bound and +Inf
+	private:
+		static const size_t BUCKETS = 12; // bounds and +Inf
+
+		std::atomic<uint64_t> counts[BUCKETS]{};
+		std::atomic<uint64_t> sum_ns{ 0 };
+	};
+
+	// Observes time of scope in histogram
+	class ScopedTimer
+	{
+	public:
+		ScopedTimer(Histogram& histogram);
+		~ScopedTimer();
+		ScopedTimer(const ScopedTimer&) = delete;
+		ScopedTimer& operator=(const ScopedTimer&) = delete;
+	private:
+		Histogram& histogram;
+		std::chrono::steady_clock::time_point start;
+	};
+
+	// Metrics grouped in families by name, rendered as OpenMetrics text. Metrics are never removed, references stay valid
+	class MetricsRegistry
+	{
+	public:
+		Counter& AddCounter(const std::string& name, const std::string& help, const std::string& labels = ""); // name without _total, labels ex.: phase="date"
+		Gauge& AddGauge(const std::string& name, const std::string& help, const std::string& labels = "");
+		Histogram& AddHistogram(const std::string& name, const std::string& help, const std::string& labels = "");
+		std::string Render() const;
+	private:
+		enum class Type { COUNTER, GAUGE, HISTOGRAM };
+
+		struct Family
+		{
+			std::string name;
+			std::string help;
+			Type type;
+			std::vector<std::string> labels;
+			std::vector<std::unique_ptr<Counter>> counters;
+			std::vector<std::unique_ptr<Gauge>> gauges;
+			std::vector<std::unique_ptr<Histogram>> histograms;
+		};
+
+		Family& GetFamily(const std::string& name, const std::string& help, Type type);
+
+		mutable std::mutex families_mutex;
+		std::vector<std::unique_ptr<Family>> families;
+	};
+
+	// Minimal HTTP server: GET /metrics returns result of render callback, one connection at a time
+	class MetricsServer
+	{
+	public:
+		MetricsServer(std::function<std::string()> render, const std::string& address = "127.0.0.1", uint16_t port = METRICS_PORT_DEFAULT); // throws WireguardException if address can't be bound
+		~MetricsServer();
+		MetricsServer(const MetricsServer&) = delete;
+		MetricsServer& operator=(const MetricsServer&) = delete;
+
+		uint16_t GetPort() const; // actual port, if port 0 was requested
+	private:
+		void Serve();
+		void Respond(int connection_fd) const;
+
+		std::function<std::string()> render;
+		int socket_fd{ -1 };
+		uint16_t port{ 0 };
+		std::atomic<bool> stop_requested{ false };
+		std::thread server_thread;
+	};
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <ctime>
+#include <chrono>
+#include "process.hpp"
+
+
+namespace timlibs
+{
+	struct PeerInfo
+	{
+		std::string public_key{}; // peer public key (base64)
+		std::string allowed_ips{}; // ip addresses of peer, ex.: "10.0.30.2/32, 192.168.31.0/24"
+		std::string endpoint{}; // last known endpoint of peer, ex.: "203.0.113.5:51820" (empty if unknown)
+		time_t latest_handshake{ 0 }; // unix time of latest handshake (0 if there was no handshake)
+		uint64_t rx_bytes{ 0 }; // bytes received from peer
+		uint64_t tx_bytes{ 0 }; // bytes sent to peer
+	};
+
+	struct PeerChanges
+	{
+		std::vector<PeerInfo> upserts{}; // peers to add or update (only public_key and allowed_ips are used)
+		std::vector<std::string> removals{}; // public keys of peers to remove
+
+		bool Empty() const;
+		size_t Size() const;
+	};
+
+	// Interface of wireguard peers management. Implementations must read all peers in one call and apply all changes in one call
+	class PeerController
+	{
+	public:
+		virtual ~PeerController() = default;
+
+		virtual std::vector<PeerInfo> Dump(const std::string& interface_name) = 0; // all peers of interface with handshakes and counters
+		virtual void Apply(const std::string& interface_name, const PeerChanges& changes) = 0; // adds, updates and removes peers
+		virtual std::vector<PeerInfo> Dump(const std::string& interface_name, const CallControl& control); // by default expiration is checked only before call
+		virtual void Apply(const std::string& interface_name, const PeerChanges& changes, const CallControl& control);
+	};
+
+	// Peers management through "wg" command: one process for dump and one per batch of changes, process is killed when call expires
+	class ShellPeerController : public PeerController
+	{
+	public:
+		std::vector<PeerInfo> Dump(const std::string& interface_name) override;
+		void Apply(const std::string& interface_name, const PeerChanges& changes) override;
+		std::vector<PeerInfo> Dump(const std::string& interface_name, const CallControl& control) override;
+		void Apply(const std::string& interface_name, const PeerChanges& changes, const CallControl& control) override;
+	};
+
+	// Peers management through wireguard generic netlink protocol (kernel module only): every call has own socket, so reads
+	// and changes don't wait for each other, and waiting for kernel ends at deadline of call
+	class NetlinkPeerController : public PeerController
+	{
+	public:
+		NetlinkPeerController(); // throws WireguardException if wireguard netlink family is unavailable
+
+		std::vector<PeerInfo> Dump(const std::string& interface_name) override;
+		void Apply(const std::string& interface_name, const PeerChanges& changes) override;
+		std::vector<PeerInfo> Dump(const std::string& interface_name, const CallControl& control) override;
+		void Apply(const std::string& interface_name, const PeerChanges& changes, const CallControl& control) override;
+	private:
+		uint16_t family_id{ 0 };
+	};
+
+	// In-memory peers management without kernel module, for tests and benchmarks of controllers
+	class FakePeerController : public PeerController
+	{
+	public:
+		std::vector<PeerInfo> Dump(const std::string& interface_name) override;
+		void Apply(const std::string& interface_name, const PeerChanges& changes) override;
+		std::vector<PeerInfo> Dump(const std::string& interface_name, const CallControl& control) override; // simulated latency ends at deadline
+		void Apply(const std::string& interface_name, const PeerChanges& changes, const CallControl& control) override;
+
+		void SetPeer(const std::string& interface_name, const PeerInfo& peer); // adds or replaces peer as if it was changed outside
+		void SetHandshake(const std::string& interface_name, const std::string& public_key, time_t latest_handshake);
+		void SetPeers(const std::string& interface_name, const std::vector<PeerInfo>& peers); // replaces all peers of interface
+		void SetLatency(std::chrono::microseconds dump_latency, std::chrono::microseconds apply_latency); // simulated cost of wg command per call
+		size_t GetDumpCount() const;
+		size_t GetApplyCount() const;
+	private:
+		mutable std::mutex interfaces_mutex;
+		std::map<std::string, std::map<std::string, PeerInfo>> interfaces; // interface name -> public key -> peer
+		size_t dump_count{ 0 };
+		size_t apply_count{ 0 };
+		std::chrono::microseconds dump_latency{ 0 };
+		std::chrono::microseconds apply_latency{ 0 };
+	};
+}
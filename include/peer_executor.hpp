@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <memory>
+#include <future>
+#include <functional>
+#include <exception>
+#include <mutex>
+#include "peer_controller.hpp"
+#include "process.hpp"
+#include "thread_pool.hpp"
+
+#define PEER_EXECUTOR_READ_THREADS_DEFAULT 1 // workers of reads, changes never take them
+#define PEER_EXECUTOR_CHANGE_THREADS_DEFAULT 1 // workers of changes, one interface uses one of them at a time
+
+
+namespace timlibs
+{
+	using DumpCallback = std::function<void(std::vector<PeerInfo> peers, std::exception_ptr error)>; // error is set if call failed or expired
+	using ApplyCallback = std::function<void(std::exception_ptr error)>;
+
+	// Runs calls of peer controllers on own workers, so callers wait for them with deadline or get callbacks instead of blocking.
+	// Reads and changes have separate workers, so reads are never queued behind changes of any interface. Reads run in parallel;
+	// changes of one interface run one by one in order of submission, so a slow change delays neither reads nor changes of other
+	// interfaces (while change workers are free). Call which expires before it starts isn't run at all
+	class PeerExecutor
+	{
+	public:
+		PeerExecutor(size_t read_threads = PEER_EXECUTOR_READ_THREADS_DEFAULT, size_t change_threads = PEER_EXECUTOR_CHANGE_THREADS_DEFAULT);
+		PeerExecutor(const PeerExecutor&) = delete;
+		PeerExecutor& operator=(const PeerExecutor&) = delete;
+
+		void Dump(std::shared_ptr<PeerController> controller, const std::string& interface_name, std::shared_ptr<CallControl> control, DumpCallback callback); // callback runs on worker
+		void Apply(std::shared_ptr<PeerController> controller, const std::string& interface_name, PeerChanges changes, std::shared_ptr<CallControl> control, ApplyCallback callback);
+		std::future<std::vector<PeerInfo>> Dump(std::shared_ptr<PeerController> controller, const std::string& interface_name, std::shared_ptr<CallControl> control);
+		std::future<void> Apply(std::shared_ptr<PeerController> controller, const std::string& interface_name, PeerChanges changes, std::shared_ptr<CallControl> control);
+		size_t GetPendingChanges(const std::string& interface_name) const; // queued and running changes of interface
+	private:
+		struct ChangesQueue
+		{
+			std::deque<std::function<void()>> calls{};
+			bool running{ false }; // one worker drains queue
+		};
+
+		void Drain(const std::string& interface_name); // task of change pool
+
+		mutable std::mutex queues_mutex;
+		std::unordered_map<std::string, ChangesQueue> queues; // interface name -> changes
+		ThreadPool change_pool; // its tasks use queues, so it's destroyed before them
+		ThreadPool read_pool;
+	};
+
+	std::vector<PeerInfo> WaitForCall(std::future<std::vector<PeerInfo>>& future, CallControl& control, const std::string& operation); // call is cancelled at deadline, throws WireguardException
+	void WaitForCall(std::future<void>& future, CallControl& control, const std::string& operation);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "peer_controller.hpp"
+#include "client_identifiers.hpp"
+
+
+namespace timlibs
+{
+	struct ReconciliationReport
+	{
+		PeerChanges changes{}; // delta that has to be applied to interface
+		size_t added{ 0 }; // peers that are absent on interface
+		size_t updated{ 0 }; // peers with other allowed ips on interface
+		size_t removed{ 0 }; // peers that must not be on interface
+		size_t unchanged{ 0 }; // peers that are equal on interface
+	};
+
+	struct DesiredPeer
+	{
+		WireguardKey public_key{}; // raw key of client, base64 is formatted only for changes
+		std::string allowed_ips{};
+	};
+
+	// Computes delta between desired peers table and live peers of interface by merge of arrays sorted by raw public keys
+	class PeerReconciler
+	{
+	public:
+		void SetDesired(std::vector<DesiredPeer> peers);
+		ReconciliationReport Reconcile(const std::vector<PeerInfo>& live) const; // keys of live peers are decoded once, texts aren't compared
+		size_t GetDesiredCount() const;
+	private:
+		std::vector<DesiredPeer> desired; // sorted by raw public key, allowed ips are normalized
+	};
+
+	std::string NormalizeAllowedIps(const std::string& allowed_ips); // "10.0.30.5/24,10.0.31.0/24,10.0.0.1" -> "10.0.0.1/32, 10.0.30.0/23", see ParseAllowedIps()
+}
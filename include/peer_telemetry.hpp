@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <ctime>
+#include "peer_controller.hpp"
+
+#define TELEMETRY_HISTORY_DEFAULT 60 // samples per peer, ex. 30 minutes with 30 seconds poll interval
+#define TELEMETRY_EVENTS_DEFAULT 1024
+
+
+namespace timlibs
+{
+	struct PeerSample
+	{
+		time_t time{ 0 }; // when sample was taken
+		time_t latest_handshake{ 0 };
+		uint64_t rx_bytes{ 0 };
+		uint64_t tx_bytes{ 0 };
+	};
+
+	struct PeerRate
+	{
+		std::string public_key{};
+		std::string endpoint{};
+		double rx_rate{ 0 }; // bytes per second between the last two samples
+		double tx_rate{ 0 };
+		uint64_t rx_bytes{ 0 }; // counters of the last sample
+		uint64_t tx_bytes{ 0 };
+		time_t latest_handshake{ 0 };
+	};
+
+	struct EndpointChange
+	{
+		uint64_t sequence{ 0 }; // grows by one with every event
+		time_t time{ 0 };
+		std::string public_key{};
+		std::string old_endpoint{};
+		std::string new_endpoint{};
+	};
+
+	// History of peers dumps: fixed ring of samples per peer and ring of endpoint changes, so memory is bounded.
+	// Sample is O(peers) and allocates only for peers that appear for the first time. All methods are thread-safe
+	class PeerTelemetry
+	{
+	public:
+		PeerTelemetry(size_t history_size = TELEMETRY_HISTORY_DEFAULT, size_t events_size = TELEMETRY_EVENTS_DEFAULT);
+
+		void Sample(const std::vector<PeerInfo>& peers, time_t now); // peers that are absent in dump are forgotten
+		std::vector<PeerSample> GetHistory(const std::string& public_key) const; // oldest first
+		bool GetRate(const std::string& public_key, PeerRate& rate) const; // false if peer is unknown
+		std::vector<PeerRate> GetTopTalkers(size_t count) const; // by rx_rate + tx_rate
+		std::vector<EndpointChange> GetEndpointChanges(uint64_t after_sequence = 0) const; // events that are still in ring, oldest first
+		size_t GetPeerCount() const;
+	private:
+		struct Slot
+		{
+			std::string public_key{}; // empty if slot is free
+			std::string endpoint{};
+			size_t head{ 0 }; // index of the next sample in ring
+			size_t count{ 0 }; // samples in ring
+			uint64_t generation{ 0 }; // the last Sample call which had peer
+		};
+
+		const PeerSample& GetSample(const Slot& slot, size_t age) const; // age 0 is the newest sample
+		PeerRate GetRate(const Slot& slot) const;
+		void AddEndpointChange(const Slot& slot, const std::string& new_endpoint, time_t now);
+
+		mutable std::mutex telemetry_mutex;
+		size_t history_size;
+		std::vector<Slot> slots;
+		std::vector<PeerSample> samples; // history_size samples of every slot
+		std::vector<size_t> free_slots;
+		std::unordered_map<std::string, size_t> by_public_key; // public key -> slot
+		std::vector<EndpointChange> events; // ring, event with sequence N is at (N - 1) % size
+		uint64_t sequence{ 0 }; // sequence of the last event
+		uint64_t generation{ 0 };
+	};
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+
+#define CALL_POLL_INTERVAL std::chrono::milliseconds(50) // how often running call checks cancellation
+
+
+namespace timlibs
+{
+	struct ProcessResult
+	{
+		int exit_code{ -1 }; // exit code of process (-1 if it was killed by signal)
+		std::string output{}; // stdout of process
+	};
+
+	// Deadline and cancellation of one call, shared by caller and worker which runs the call
+	class CallControl
+	{
+	public:
+		CallControl(std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max());
+		CallControl(std::chrono::milliseconds timeout); // deadline is now + timeout
+
+		void Cancel(); // can be called from any thread
+		bool IsCancelled() const;
+		bool IsExpired() const; // cancelled or deadline has passed
+		void Check(const std::string& operation) const; // throws WireguardException if call is expired
+		std::chrono::steady_clock::time_point GetDeadline() const;
+	private:
+		std::chrono::steady_clock::time_point deadline;
+		std::atomic<bool> cancelled{ false };
+	};
+
+	ProcessResult RunProcess(const std::vector<std::string>& arguments); // runs program from PATH without shell, arguments[0] is program name
+	ProcessResult RunProcess(const std::vector<std::string>& arguments, const CallControl& control); // process is killed when call expires, then WireguardException is thrown
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#define QR_BORDER_DEFAULT 4 // quiet zone required by standard
+#define QR_PNG_SCALE_DEFAULT 4 // pixels per module
+
+
+namespace timlibs
+{
+	enum class QrErrorCorrection
+	{
+		LOW, // ~7% of codewords may be restored
+		MEDIUM, // ~15%
+		QUARTILE, // ~25%
+		HIGH // ~30%
+	};
+
+	// QR Code model 2 in byte mode (ISO/IEC 18004), version is the smallest one that fits text
+	class QrCode
+	{
+	public:
+		static QrCode Encode(const std::string& text, QrErrorCorrection error_correction = QrErrorCorrection::MEDIUM); // throws WireguardException if text is too long
+
+		int GetVersion() const; // 1 - 40
+		int GetSize() const; // modules per side
+		int GetMask() const;
+		bool GetModule(int x, int y) const; // true for dark module, false outside of code
+		std::string ToSvg(int border = QR_BORDER_DEFAULT) const;
+		std::string ToPng(int scale = QR_PNG_SCALE_DEFAULT, int border = QR_BORDER_DEFAULT) const; // 1-bit grayscale
+	private:
+		QrCode(int version, QrErrorCorrection error_correction);
+
+		void DrawFunctionPatterns();
+		void DrawFinderPattern(int x, int y);
+		void DrawAlignmentPattern(int x, int y);
+		void DrawFormatBits(int mask);
+		void DrawVersion();
+		void DrawCodewords(const std::vector<uint8_t>& codewords);
+		void ApplyMask(int mask);
+		long GetPenaltyScore() const;
+		void SetFunctionModule(int x, int y, bool dark);
+
+		int version;
+		int size;
+		QrErrorCorrection error_correction;
+		int mask{ 0 };
+		std::vector<uint8_t> modules; // size * size, row by row
+		std::vector<uint8_t> function_modules; // modules of patterns that are not masked
+	};
+}
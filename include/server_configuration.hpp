@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <ostream>
+
+#define WG_QUICK_EXTENSION ".conf"
+
+
+namespace timlibs
+{
+	struct Server;
+	class ClientRegistry;
+
+	enum class ServerConfigurationStyle
+	{
+		WG_QUICK, // <interface>.conf for wg-quick, with Address and Pre/Post Up/Down
+		WG // only fields of "wg syncconf", as output of "wg-quick strip"
+	};
+
+	std::string GetInterfaceAddress(const Server& server); // Address of wg-quick, ex.: 10.0.30.1/24, empty if ip or network isn't set
+	void RenderServerConfiguration(const Server& server, const ClientRegistry& clients, ServerConfigurationStyle style, std::ostream& output); // [Interface] and [Peer] of every active client
+	uint64_t HashServerConfiguration(const Server& server, const ClientRegistry& clients, ServerConfigurationStyle style); // FNV-1a of rendered text, text isn't kept in memory
+	bool HashFile(const std::string& path, uint64_t& hash); // false if file can't be read
+	void SyncInterface(const std::string& interface_name, const std::string& path); // "wg syncconf": peers are changed without restart of interface
+	bool InterfaceExists(const std::string& interface_name); // interface is up (or at least created)
+	void ReplaceInterfaceAddress(const std::string& interface_name, const std::string& old_address, const std::string& new_address); // "ip address", ex.: 10.0.30.1/24; old address is removed first
+}
@@ -0,0 +1,267 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <utility>
+
+#define SHARDED_MAP_DIRECTORIES 64 // directories of ShardedMap, copy of map copies pointers to them
+#define SHARDED_MAP_DIRECTORY_SIZE 64 // shards per directory, change of key copies its directory and its shard
+
+
+namespace timlibs
+{
+	// Page of values which can be shared by copies of container: once it's shared it's never changed, change copies it
+	template <typename T>
+	struct SharedPage
+	{
+		SharedPage() = default;
+		SharedPage(const T& value) : value(value) {}
+
+		T value{};
+		std::atomic<bool> shared{ false }; // set by copy of container, never reset
+	};
+
+	template <typename T>
+	void SharePages(const std::vector<std::shared_ptr<SharedPage<T>>>& pages); // marks pages of copied container
+	template <typename T>
+	T& UnsharePage(std::shared_ptr<SharedPage<T>>& page); // copies shared page, so it can be changed
+
+	// Vector of values in pages of PAGE_SIZE values: copy is O(pages) as pages are shared, change of value copies its page only
+	// if page is shared. Copies can be read from other threads while owner changes its copy, ex. snapshots of configuration
+	template <typename T, size_t PAGE_SIZE>
+	class PagedVector
+	{
+	public:
+		class const_iterator
+		{
+		public:
+			using iterator_category = std::forward_iterator_tag;
+			using value_type = T;
+			using difference_type = ptrdiff_t;
+			using pointer = const T*;
+			using reference = const T&;
+
+			const_iterator(const PagedVector* vector, size_t index) : vector(vector), index(index) {}
+			const T& operator*() const { return (*this->vector)[this->index]; }
+			const T* operator->() const { return &(*this->vector)[this->index]; }
+			const_iterator& operator++() { this->index++; return *this; }
+			bool operator==(const const_iterator& other) const { return this->index == other.index; }
+			bool operator!=(const const_iterator& other) const { return this->index != other.index; }
+		private:
+			const PagedVector* vector;
+			size_t index;
+		};
+
+		PagedVector() = default;
+		PagedVector(const PagedVector& other); // pages are shared
+		PagedVector& operator=(const PagedVector& other);
+		PagedVector(PagedVector&& other) = default;
+		PagedVector& operator=(PagedVector&& other) = default;
+
+		const T& operator[](size_t index) const;
+		T& Mutable(size_t index); // reference is valid until the next copy of vector, PushBack(), PopBack() or Clear()
+		const T& Back() const;
+		void PushBack(T value);
+		void PopBack();
+		void Clear();
+		void Reserve(size_t count); // table of pages only, pages are allocated by PushBack()
+		size_t Size() const;
+		bool Empty() const;
+
+		const_iterator begin() const;
+		const_iterator end() const;
+	private:
+		using Page = SharedPage<std::vector<T>>;
+
+		std::vector<std::shared_ptr<Page>> pages; // all pages are full except the last one
+		size_t size{ 0 };
+	};
+
+	// Hash map in shards which are grouped into directories: copy is O(directories), change of key copies its directory and its shard
+	// if they are shared (at 100000 keys a shard has ~25 keys)
+	template <typename Key, typename Value, typename Hash = std::hash<Key>>
+	class ShardedMap
+	{
+	public:
+		ShardedMap() = default;
+		ShardedMap(const ShardedMap& other); // directories are shared
+		ShardedMap& operator=(const ShardedMap& other);
+		ShardedMap(ShardedMap&& other) = default;
+		ShardedMap& operator=(ShardedMap&& other) = default;
+
+		const Value* Find(const Key& key) const; // nullptr if there is no key
+		bool Contains(const Key& key) const;
+		void Set(const Key& key, const Value& value);
+		void Erase(const Key& key);
+		void Clear();
+		void Reserve(size_t count);
+	private:
+		using Map = std::unordered_map<Key, Value, Hash>;
+		using Shard = SharedPage<Map>;
+		using Directory = SharedPage<std::vector<std::shared_ptr<Shard>>>;
+
+		size_t GetShard(const Key& key) const;
+		Map& MutableShard(size_t shard);
+
+		std::vector<std::shared_ptr<Directory>> directories; // empty or SHARDED_MAP_DIRECTORIES, nullptr for empty directory or shard
+	};
+
+	template <typename T>
+	void SharePages(const std::vector<std::shared_ptr<SharedPage<T>>>& pages)
+	{
+		for (const std::shared_ptr<SharedPage<T>>& page : pages)
+		{
+			if (page) page->shared.store(true, std::memory_order_relaxed); // readers of copy never change pages, relaxed is enough
+		}
+	}
+
+	template <typename T>
+	T& UnsharePage(std::shared_ptr<SharedPage<T>>& page)
+	{
+		if (!page) page = std::make_shared<SharedPage<T>>();
+		else if (page->shared.load(std::memory_order_relaxed)) page = std::make_shared<SharedPage<T>>(page->value);
+		return page->value;
+	}
+
+	template <typename T, size_t PAGE_SIZE>
+	PagedVector<T, PAGE_SIZE>::PagedVector(const PagedVector& other) : pages(other.pages), size(other.size) { SharePages(this->pages); }
+
+	template <typename T, size_t PAGE_SIZE>
+	PagedVector<T, PAGE_SIZE>& PagedVector<T, PAGE_SIZE>::operator=(const PagedVector& other)
+	{
+		if (this == &other) return *this;
+		this->pages = other.pages;
+		this->size = other.size;
+		SharePages(this->pages);
+		return *this;
+	}
+
+	template <typename T, size_t PAGE_SIZE>
+	const T& PagedVector<T, PAGE_SIZE>::operator[](size_t index) const { return this->pages[index / PAGE_SIZE]->value[index % PAGE_SIZE]; }
+
+	template <typename T, size_t PAGE_SIZE>
+	T& PagedVector<T, PAGE_SIZE>::Mutable(size_t index) { return UnsharePage(this->pages[index / PAGE_SIZE])[index % PAGE_SIZE]; }
+
+	template <typename T, size_t PAGE_SIZE>
+	const T& PagedVector<T, PAGE_SIZE>::Back() const { return (*this)[this->size - 1]; }
+
+	template <typename T, size_t PAGE_SIZE>
+	void PagedVector<T, PAGE_SIZE>::PushBack(T value)
+	{
+		if (this->size % PAGE_SIZE == 0)
+		{
+			this->pages.push_back(std::make_shared<Page>());
+			this->pages.back()->value.reserve(PAGE_SIZE);
+		}
+		std::vector<T>& page = UnsharePage(this->pages.back());
+		page.reserve(PAGE_SIZE);
+		page.push_back(std::move(value));
+		this->size++;
+	}
+
+	template <typename T, size_t PAGE_SIZE>
+	void PagedVector<T, PAGE_SIZE>::PopBack()
+	{
+		this->size--;
+		if (this->size % PAGE_SIZE == 0) this->pages.pop_back();
+		else UnsharePage(this->pages.back()).pop_back();
+	}
+
+	template <typename T, size_t PAGE_SIZE>
+	void PagedVector<T, PAGE_SIZE>::Clear()
+	{
+		this->pages.clear();
+		this->size = 0;
+	}
+
+	template <typename T, size_t PAGE_SIZE>
+	void PagedVector<T, PAGE_SIZE>::Reserve(size_t count) { this->pages.reserve((count + PAGE_SIZE - 1) / PAGE_SIZE); }
+
+	template <typename T, size_t PAGE_SIZE>
+	size_t PagedVector<T, PAGE_SIZE>::Size() const { return this->size; }
+
+	template <typename T, size_t PAGE_SIZE>
+	bool PagedVector<T, PAGE_SIZE>::Empty() const { return this->size == 0; }
+
+	template <typename T, size_t PAGE_SIZE>
+	typename PagedVector<T, PAGE_SIZE>::const_iterator PagedVector<T, PAGE_SIZE>::begin() const { return const_iterator(this, 0); }
+
+	template <typename T, size_t PAGE_SIZE>
+	typename PagedVector<T, PAGE_SIZE>::const_iterator PagedVector<T, PAGE_SIZE>::end() const { return const_iterator(this, this->size); }
+
+	template <typename Key, typename Value, typename Hash>
+	ShardedMap<Key, Value, Hash>::ShardedMap(const ShardedMap& other) : directories(other.directories) { SharePages(this->directories); }
+
+	template <typename Key, typename Value, typename Hash>
+	ShardedMap<Key, Value, Hash>& ShardedMap<Key, Value, Hash>::operator=(const ShardedMap& other)
+	{
+		if (this == &other) return *this;
+		this->directories = other.directories;
+		SharePages(this->directories);
+		return *this;
+	}
+
+	template <typename Key, typename Value, typename Hash>
+	const Value* ShardedMap<Key, Value, Hash>::Find(const Key& key) const
+	{
+		if (this->directories.empty()) return nullptr;
+		size_t shard = this->GetShard(key);
+		const std::shared_ptr<Directory>& directory = this->directories[shard / SHARDED_MAP_DIRECTORY_SIZE];
+		if (!directory) return nullptr;
+		const std::shared_ptr<Shard>& page = directory->value[shard % SHARDED_MAP_DIRECTORY_SIZE];
+		if (!page) return nullptr;
+		typename Map::const_iterator found = page->value.find(key);
+		return (found != page->value.end()) ? &found->second : nullptr;
+	}
+
+	template <typename Key, typename Value, typename Hash>
+	bool ShardedMap<Key, Value, Hash>::Contains(const Key& key) const { return this->Find(key) != nullptr; }
+
+	template <typename Key, typename Value, typename Hash>
+	void ShardedMap<Key, Value, Hash>::Set(const Key& key, const Value& value) { this->MutableShard(this->GetShard(key))[key] = value; }
+
+	template <typename Key, typename Value, typename Hash>
+	void ShardedMap<Key, Value, Hash>::Erase(const Key& key)
+	{
+		if (!this->Contains(key)) return; // shared shard isn't copied for nothing
+		this->MutableShard(this->GetShard(key)).erase(key);
+	}
+
+	template <typename Key, typename Value, typename Hash>
+	void ShardedMap<Key, Value, Hash>::Clear() { this->directories.clear(); }
+
+	/// @brief Reserves buckets in every shard, small maps aren't reserved as it would allocate all shards
+	template <typename Key, typename Value, typename Hash>
+	void ShardedMap<Key, Value, Hash>::Reserve(size_t count)
+	{
+		size_t shards = SHARDED_MAP_DIRECTORIES * SHARDED_MAP_DIRECTORY_SIZE;
+		if (count < shards) return;
+		for (size_t shard = 0; shard < shards; shard++) this->MutableShard(shard).reserve(count / shards + 1);
+	}
+
+	/// @brief Shard of key, hash is mixed as hashes of integers are identity
+	template <typename Key, typename Value, typename Hash>
+	size_t ShardedMap<Key, Value, Hash>::GetShard(const Key& key) const
+	{
+		uint64_t hash = (uint64_t)Hash{}(key) * 0x9E3779B97F4A7C15ull;
+		return (size_t)(hash >> 32) % (SHARDED_MAP_DIRECTORIES * SHARDED_MAP_DIRECTORY_SIZE);
+	}
+
+	/// @brief Gets shard which can be changed: shared directory and shared shard are copied, shards of copied directory become shared
+	template <typename Key, typename Value, typename Hash>
+	typename ShardedMap<Key, Value, Hash>::Map& ShardedMap<Key, Value, Hash>::MutableShard(size_t shard)
+	{
+		if (this->directories.empty()) this->directories.resize(SHARDED_MAP_DIRECTORIES);
+		std::shared_ptr<Directory>& directory = this->directories[shard / SHARDED_MAP_DIRECTORY_SIZE];
+		bool copied = directory && directory->shared.load(std::memory_order_relaxed);
+		std::vector<std::shared_ptr<Shard>>& shards = UnsharePage(directory);
+		if (copied) SharePages(shards); // shards are referenced by the old directory too
+		else if (shards.empty()) shards.resize(SHARDED_MAP_DIRECTORY_SIZE);
+		return UnsharePage(shards[shard % SHARDED_MAP_DIRECTORY_SIZE]);
+	}
+}
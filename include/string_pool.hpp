@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include "json.hpp"
+
+
+namespace timlibs
+{
+	// Process-wide table of immutable interned strings: equal strings are stored once, every string is counted by references
+	// of PooledString and is freed with the last reference. It's for names of clients (logins, full names), not for arbitrary data
+	class StringPool
+	{
+	public:
+		static StringPool& GetInstance();
+		StringPool(const StringPool&) = delete;
+		StringPool& operator=(const StringPool&) = delete;
+
+		const char* Intern(const char* text, size_t length); // zero-terminated copy with one more reference, its length is stored before it
+		const char* Find(const char* text, size_t length); // as Intern(), but nullptr if text isn't interned
+		void AddReference(const char* text); // text of Intern() or Find()
+		void Release(const char* text); // the last reference frees text
+		static size_t GetLength(const char* text); // length of interned text
+		size_t GetSize() const; // count of distinct strings
+		size_t GetMemoryUsage() const; // bytes of strings and index
+	private:
+		struct Entry;
+
+		StringPool() = default;
+
+		Entry* FindLocked(const char* text, size_t length, uint64_t hash, size_t& slot) const;
+		void EraseLocked(size_t slot); // backward shift, so probes never meet deleted slots
+		void Grow(); // doubles index
+
+		mutable std::mutex pool_mutex;
+		std::vector<Entry*> slots; // open addressing index of interned strings, nullptr - free slot
+		size_t size{ 0 };
+		size_t entry_bytes{ 0 };
+	};
+
+	// String of StringPool: one pointer, copy adds reference without lock, equal strings are equal pointers
+	class PooledString
+	{
+	public:
+		PooledString() = default;
+		PooledString(const std::string& text);
+		PooledString(const char* text);
+		PooledString(const PooledString& other);
+		PooledString(PooledString&& other) noexcept;
+		~PooledString();
+		PooledString& operator=(const std::string& text);
+		PooledString& operator=(const char* text);
+		PooledString& operator=(const PooledString& other);
+		PooledString& operator=(PooledString&& other) noexcept;
+
+		static bool Lookup(const std::string& text, PooledString& value); // value without interning, false if text isn't interned (nothing is equal to it)
+
+		std::string ToString() const;
+		const char* c_str() const; // "" for empty string
+		size_t size() const;
+		bool empty() const;
+		size_t Hash() const;
+		std::string_view View() const; // valid while this string (or its copy) exists
+		int compare(const std::string& other) const { return this->View().compare(other); } // as std::string::compare
+		int compare(size_t position, size_t length, const std::string& other) const { return this->View().compare(position, length, other); }
+
+		bool operator==(const PooledString& other) const { return this->text == other.text; }
+		bool operator!=(const PooledString& other) const { return this->text != other.text; }
+		bool operator==(const std::string& other) const;
+		bool operator!=(const std::string& other) const { return !(*this == other); }
+		bool operator==(const char* other) const;
+		bool operator!=(const char* other) const { return !(*this == other); }
+		bool operator<(const PooledString& other) const; // order of texts
+	private:
+		void Reset(const char* text); // takes reference of text, releases the old one
+
+		const char* text{ nullptr }; // interned text, nullptr for empty string
+	};
+
+	inline bool operator==(const std::string& text, const PooledString& value) { return value == text; }
+	inline bool operator!=(const std::string& text, const PooledString& value) { return value != text; }
+	inline std::string operator+(const std::string& text, const PooledString& value) { return text + value.ToString(); }
+	inline std::string operator+(const PooledString& value, const std::string& text) { return value.ToString() + text; }
+
+	struct PooledStringHash
+	{
+		size_t operator()(const PooledString& value) const { return value.Hash(); }
+	};
+
+	void to_json(nlohmann::json& json, const PooledString& value); // text at json boundary
+	void from_json(const nlohmann::json& json, PooledString& value);
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+
+namespace timlibs
+{
+	// Fixed set of worker threads with queue of tasks
+	class ThreadPool
+	{
+	public:
+		ThreadPool(size_t threads = 0); // 0: one thread per core
+		~ThreadPool(); // queued tasks are finished
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		void Submit(std::function<void()> task); // task must not throw
+		void ParallelFor(size_t count, const std::function<void(size_t index)>& body); // caller works too, so it may be called from task; the first exception of body is rethrown
+		size_t GetThreadCount() const;
+	private:
+		void Work();
+
+		std::mutex queue_mutex;
+		std::condition_variable queue_condition;
+		std::deque<std::function<void()>> tasks;
+		std::vector<std::thread> threads;
+		bool stopping{ false };
+	};
+}
@@ -1,109 +1,403 @@
-#pragma once
-
-#include <stdint.h>
-#include <string>
-#include <vector>
-#include <ctime>
-#include <limits>
-#include "ipv4.hpp"
-#include "json.hpp"
-#include "time.hpp"
-
-#define NULL_STRING ""
-
-
-namespace timlibs
-{
-	class WireguardException
-	{
-	public:
-		WireguardException();
-		WireguardException(const std::string& discription);
-		WireguardException(const char* discription);
-	private:
-		std::string what() const;;
-		std::string error_discription;
-	};
-
-	struct Client
-	{
-		std::string uuid{ NULL_STRING }; // UUID of client
-		std::string private_key{ NULL_STRING }; // client private key
-		std::string public_key{ NULL_STRING }; // client public key
-		std::string login{ NULL_STRING }; // client login (short name), ex.: bivanov
-		std::string full_name{ NULL_STRING }; // client full name, ex.: Ivanov Boris [Ivanovich]
-		IPv4 ip{ NULL_IP_DEC }; // client vpn ip address
-		bool account_status{ false }; // client account current status (active, inactive)
-		bool administrative_account_status{ false }; // client account administartive status (on, off)
-		bool connection_status{ false }; // client connection status (connected, disconnected)
-		Time creation_date{ MIN_TIME }; // date when client account was created
-		Time release_date{ MIN_TIME }; // date when client account will be activated
-		Time expiration_date{ MAX_TIME }; // date when client accaunt will be deactivated
-		std::string allowed_ips{ NULL_STRING }; // ip addresses where the client wants to connect via vpn, ex.: "10.0.0.0/16, 10.100.34.0/28, 192.168.31.5/32"
-		std::string dns{ NULL_STRING }; // ip address of DNS server (overwrites the DNS server of client)
-
-	};
-
-	struct Server
-	{
-		std::string interface_name{ NULL_STRING }; // name of wg interface, ex. wg0
-		uint16_t listen_port{ NULL }; // port number 1 - 65535
-		IPv4 ip{ NULL_IP_DEC }; // server vpn ip address
-		IPv4Mask network{ NULL_IP_DEC }; // vpn network
-		std::string endpoint_dns{ NULL_STRING }; // public domain name of server (if exist)
-		IPv4 endpoint_ip{ NULL_IP_DEC }; // public ip address of server
-		uint16_t public_listen_port{ NULL }; // public port number 1 - 65535 (if the server is behind a firewall, the value may differ from listen_port, else - equal)
-		std::string private_key{ NULL_STRING }; // server private key
-		std::string public_key{ NULL_STRING }; // server public key
-		std::string pre_up{ NULL_STRING }; // pre up commands
-		std::string post_up{ NULL_STRING }; // post up commands
-		std::string pre_down{ NULL_STRING }; // pre down commands
-		std::string post_down{ NULL_STRING }; // post down commands
-	};
-
-	class Wireguard
-	{
-	public:
-		Wireguard(const std::string& interface_name = NULL_STRING);
-
-		Server GetServer();
-		void SetServer(); // тут обновление конфигурации сервера
-
-		std::string CreateClient(Client client);
-		Client GetClient(const std::string& uuid);
-		std::vector<Client> GetClients();
-		void UpgradeClient(const std::string& uuid); // подумай как реализовать обновление полей клиента
-		void RemoveClient(const std::string& uuid);
-
-
-		void Controller(); // Check and modify client account and connection statuses
-
-		// bool SetClientStatus(const std::string& uid, const bool& status); // может не стоит выносить как отдельный метод
-	private:
-		bool DateAndModeController();
-		bool ConnectionStatusController();
-		void PeersConnectionController() const;
-
-		void AddPeer(const Client& client) const;
-		void RemovePeer(const Client& client) const;
-		void RemovePeer(const std::string& public_key) const;
-		
-		void ReadConfiguration(); //configuration -> json -> json file
-		void WriteConfiguration(); //json file -> json -> configuration
-
-		nlohmann::json SerializeConfiguration() const; // configuration -> json
-		void DeserializeConfiguration(const nlohmann::json& json_configuration); // json -> configuration
-
-		void WriteServerConfiguration() const; //configuration -> wg0.conf (only server)
-
-		void UploadConfiguration(const nlohmann::json& json_configuration) const; //json -> json file
-		nlohmann::json DownloadConfiguration() const; //json file -> json
-
-		void StartServer();
-		void StopServer();
-		void RebootServer();
-
-		Server server; // server data
-		std::vector<Client> clients; // clients data
-	};	
-}
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <ctime>
+#include <limits>
+#include <memory>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <string_view>
+#include "ipv4.hpp"
+#include "json.hpp"
+#include "time.hpp"
+#include "peer_controller.hpp"
+#include "peer_executor.hpp"
+#include "peer_reconciler.hpp"
+#include "expiry_scheduler.hpp"
+#include "configuration_journal.hpp"
+#include "client_state_table.hpp"
+#include "address_allocator.hpp"
+#include "client_query.hpp"
+#include "peer_telemetry.hpp"
+#include "connection_tracker.hpp"
+#include "event_bus.hpp"
+#include "metrics.hpp"
+#include "server_configuration.hpp"
+#include "allowed_ips.hpp"
+#include "client_identifiers.hpp"
+#include "string_pool.hpp"
+#include "shared_pages.hpp"
+
+#define NULL_STRING ""
+#define ROOT_PATH_DEFAULT "/etc/wireguard/" // directory of configurations of interfaces
+#define INTERFACE_NAME_DEFAULT "wg0"
+#define CLIENT_PAGE_SIZE 256 // clients per shared page of registry
+
+
+namespace timlibs
+{
+	class WireguardException
+	{
+	public:
+		WireguardException();
+		WireguardException(const std::string& discription);
+		WireguardException(const char* discription);
+	private:
+		std::string what() const;;
+		std::string error_discription;
+	};
+
+	time_t ToUnixTime(const Time& time); // Time -> seconds since epoch
+	uint32_t ToHostOrder(const IPv4& ip); // IPv4 -> number, ex.: 10.0.30.1 -> 0x0A001E01
+	IPv4 FromHostOrder(uint32_t ip); // number -> IPv4
+
+	struct Client
+	{
+		ClientUuid uuid{}; // UUID of client (16 bytes, text at json boundary)
+		WireguardKey private_key{}; // client private key (32 bytes, base64 at json boundary)
+		WireguardKey public_key{}; // client public key
+		PooledString login{}; // client login (short name), ex.: bivanov
+		PooledString full_name{}; // client full name, ex.: Ivanov Boris [Ivanovich]
+		IPv4 ip{ NULL_IP_DEC }; // client vpn ip address
+		bool account_status{ false }; // client account current status (active, inactive)
+		bool administrative_account_status{ false }; // client account administartive status (on, off)
+		bool connection_status{ false }; // client connection status (connected, disconnected)
+		Time creation_date{ MIN_TIME }; // date when client account was created
+		Time release_date{ MIN_TIME }; // date when client account will be activated
+		Time expiration_date{ MAX_TIME }; // date when client accaunt will be deactivated
+		std::string allowed_ips{ NULL_STRING }; // ip addresses where the client wants to connect via vpn, ex.: "10.0.0.0/16, 10.100.34.0/28, 192.168.31.5/32"
+		std::string dns{ NULL_STRING }; // ip address of DNS server (overwrites the DNS server of client)
+
+	};
+
+	struct Server
+	{
+		std::string interface_name{ NULL_STRING }; // name of wg interface, ex. wg0
+		uint16_t listen_port{ NULL }; // port number 1 - 65535
+		IPv4 ip{ NULL_IP_DEC }; // server vpn ip address
+		IPv4Mask network{ NULL_IP_DEC }; // vpn network
+		std::string endpoint_dns{ NULL_STRING }; // public domain name of server (if exist)
+		IPv4 endpoint_ip{ NULL_IP_DEC }; // public ip address of server
+		uint16_t public_listen_port{ NULL }; // public port number 1 - 65535 (if the server is behind a firewall, the value may differ from listen_port, else - equal)
+		std::string private_key{ NULL_STRING }; // server private key
+		std::string public_key{ NULL_STRING }; // server public key
+		std::string pre_up{ NULL_STRING }; // pre up commands
+		std::string post_up{ NULL_STRING }; // post up commands
+		std::string pre_down{ NULL_STRING }; // pre down commands
+		std::string post_down{ NULL_STRING }; // post down commands
+	};
+
+	namespace server_fields
+	{
+		enum FIELD : uint32_t
+		{
+			INTERFACE_NAME = 1 << 0,
+			LISTEN_PORT = 1 << 1,
+			IP = 1 << 2,
+			NETWORK = 1 << 3,
+			ENDPOINT_DNS = 1 << 4,
+			ENDPOINT_IP = 1 << 5,
+			PUBLIC_LISTEN_PORT = 1 << 6,
+			PRIVATE_KEY = 1 << 7,
+			PUBLIC_KEY = 1 << 8,
+			PRE_UP = 1 << 9,
+			POST_UP = 1 << 10,
+			PRE_DOWN = 1 << 11,
+			POST_DOWN = 1 << 12,
+			ALL = (1 << 13) - 1
+		};
+	}
+
+	struct ClientPatch
+	{
+		uint32_t fields{ 0 }; // client_fields which are set by values; UUID, statuses and creation date are set only by library
+		Client values{}; // NULL_IP_DEC keeps the old ip
+	};
+
+	struct ServerPatch
+	{
+		uint32_t fields{ 0 }; // server_fields which are set by values, interface name can't be changed
+		Server values{}; // public key is derived from private key if only private key is set
+	};
+
+	enum class SnapshotFormat
+	{
+		JSON, // <interface>.json, human readable
+		BINARY // <interface>.snap, memory-mapped fixed-size records
+	};
+
+	enum class BatchOperation
+	{
+		CREATE, // uuid is generated, ip is allocated if it's NULL_IP_DEC
+		UPDATE, // client with client.uuid is replaced, creation date and statuses are kept, NULL_IP_DEC keeps the old ip
+		REMOVE // only client.uuid is used
+	};
+
+	struct BatchItem
+	{
+		BatchOperation operation{ BatchOperation::CREATE };
+		Client client{};
+	};
+
+	struct BatchItemResult
+	{
+		std::string uuid{ NULL_STRING }; // UUID of created, updated or removed client (empty if batch isn't applied)
+		std::string error{ NULL_STRING }; // why item isn't valid (empty if it's valid)
+	};
+
+	struct BatchReport
+	{
+		bool applied{ false }; // batch is applied only if all items are valid, else configuration isn't changed
+		std::vector<BatchItemResult> items{}; // in order of batch items
+	};
+
+	struct ControllerSettings
+	{
+		std::chrono::seconds handshake_poll_interval{ 30 }; // how often connection statuses are checked
+		std::chrono::seconds peers_check_interval{ 60 }; // how often peers of interface are reconciled (and after every change of account statuses)
+		ConnectionThresholds connection_thresholds{}; // of clients without own thresholds
+		std::chrono::milliseconds peer_call_timeout{ 10000 }; // deadline of one read or change of peers, stalled wg process is killed after it
+	};
+
+	// Clients with indexes by uuid, public key, login and ip. Clients, indexes and state table are paged, so copy of registry
+	// (snapshot for readers) is O(pages) and following change copies only pages which it touches
+	class ClientRegistry
+	{
+	public:
+		using const_iterator = PagedVector<Client, CLIENT_PAGE_SIZE>::const_iterator;
+
+		void Insert(const Client& client); // throws WireguardException if uuid, public key, login or ip is already used
+		bool Remove(const std::string& uuid);
+		bool Remove(const ClientUuid& uuid);
+		void Update(size_t position, const Client& client); // position, uuid and statuses are kept, version isn't changed (Touch() if peers are changed); throws WireguardException as Insert()
+		void Clear();
+		void Reserve(size_t count);
+
+		const Client* FindByUuid(const std::string& uuid) const; // clients are changed by Insert(), Update(), Remove() and status setters only
+		const Client* FindByUuid(const ClientUuid& uuid) const;
+		const Client* FindByPublicKey(const std::string& public_key) const;
+		const Client* FindByPublicKey(const WireguardKey& public_key) const;
+		const Client* FindByPublicKey(const char* public_key) const; // literals aren't ambiguous
+		const Client* FindByLogin(const std::string& login) const;
+		const Client* FindByLogin(const PooledString& login) const;
+		const Client* FindByLogin(const char* login) const;
+		const Client* FindByIp(const IPv4& ip) const;
+		size_t GetPosition(const std::string& uuid) const; // NO_POSITION if not found, position changes after remove
+		size_t GetPosition(const ClientUuid& uuid) const;
+		size_t GetPositionByPublicKey(const std::string& public_key) const; // base64 key -> position or NO_POSITION
+		const Client& At(size_t position) const;
+
+		void SetAccountStatus(size_t position, bool status); // client record and state table
+		void SetConnectionStatus(size_t position, bool status);
+		const ClientStateTable& GetStates() const;
+
+		size_t Size() const;
+		bool Empty() const;
+		uint64_t GetVersion() const; // changes on every insert, remove and touch
+		void Touch(); // call after Update() or status change which changes peers
+
+		const_iterator begin() const;
+		const_iterator end() const;
+	private:
+		bool RemoveAt(size_t position);
+		void Link(size_t position);
+		void Unlink(size_t position);
+
+		PagedVector<Client, CLIENT_PAGE_SIZE> clients; // clients data, positions are not stable
+		ShardedMap<ClientUuid, size_t, PackedTextHash> by_uuid; // field value -> position in clients
+		ShardedMap<WireguardKey, size_t, PackedTextHash> by_public_key;
+		ShardedMap<std::string_view, size_t> by_login; // views of pooled logins, they live as long as clients of registry
+		ShardedMap<uint32_t, size_t> by_ip; // ip in host byte order
+		ClientStateTable states; // hot fields of clients at the same positions
+		uint64_t version{ 0 };
+	};
+
+	// Immutable state of configuration for readers, it's never changed after publication
+	struct ConfigurationSnapshot
+	{
+		Server server{};
+		ClientRegistry clients{}; // with indexes, ex. snapshot->clients.FindByLogin(login); shares pages with registry of writer
+		AllowedIpsTrie routes{}; // allowed ips of clients, ex. snapshot->routes.FindOwner(address); shares pages as clients
+		uint64_t version{ 0 }; // grows with every publication
+
+		const std::vector<size_t>& GetLoginOrder() const; // positions of clients sorted by (login, uuid), built by the first query
+	private:
+		mutable std::once_flag login_order_flag;
+		mutable std::vector<size_t> login_order;
+	};
+
+	// Instruments of Wireguard, values are lock-free atomics, so they are updated on hot paths
+	struct WireguardMetrics
+	{
+		WireguardMetrics(MetricsRegistry& registry);
+
+		Histogram& date_and_mode_duration; // phases of controller
+		Histogram& connection_status_duration;
+		Histogram& peers_connection_duration;
+		Histogram& serialize_duration; // configuration -> json
+		Histogram& upload_duration; // snapshot file write
+		Histogram& journal_append_duration;
+		Histogram& peers_dump_duration; // latency of peer controller (wg command or netlink)
+		Histogram& peers_apply_duration;
+		Counter& peers_added;
+		Counter& peers_updated;
+		Counter& peers_removed;
+		Counter& account_status_changes;
+		Counter& connection_status_changes;
+		Gauge& clients;
+		Gauge& peers; // peers of interface by the last dump
+	};
+
+	// Thread safety: one writer at a time (changes of clients, controllers, Run), readers don't wait for writer:
+	// they take the last published snapshot (shared_ptr), which is replaced after every change
+	class Wireguard
+	{
+	public:
+		Wireguard(const std::string& interface_name = NULL_STRING, std::shared_ptr<PeerController> peer_controller = nullptr, const std::string& root_path = ROOT_PATH_DEFAULT, std::shared_ptr<PeerExecutor> peer_executor = nullptr, std::shared_ptr<EventBus> event_bus = nullptr); // peer_controller: netlink if available, else wg command; peer_executor, event_bus: own if nullptr
+
+		Server GetServer() const;
+		std::shared_ptr<const ConfigurationSnapshot> GetSnapshot() const; // cheap, snapshot stays valid while it's held
+		uint32_t SetServer(const ServerPatch& patch); // returns changed server_fields; running interface is changed in place (wg syncconf, ip address), without restart
+
+		std::string CreateClient(Client client); // free ip of server network is allocated if client ip is NULL_IP_DEC
+		std::vector<std::string> CreateClients(const std::vector<Client>& clients); // ApplyBatch of creates, throws WireguardException with the first error
+		BatchReport ApplyBatch(const std::vector<BatchItem>& items); // all or nothing: one write of journal and one update of peers
+		BatchReport RotateClientKeys(const std::vector<std::string>& uuids); // new key pairs, applied as one batch of updates
+		Client GetClient(const std::string& uuid) const;
+		Client FindClientByAddress(const IPv4& address) const; // client whose allowed ips route address (the longest prefix), throws WireguardException if none
+		std::string GetClientConfiguration(const std::string& uuid) const; // wg-quick text for client, see RenderClientBundles() for all clients
+		std::vector<Client> GetClients() const; // copy of all clients, use GetSnapshot() or QueryClients() to avoid it
+		ClientPage QueryClients(const ClientQuery& query) const; // filtered page of clients ordered by login, without copies
+		uint32_t UpgradeClient(const std::string& uuid, const ClientPatch& patch); // returns changed client_fields; uuid is kept, only affected peer is changed (if any)
+		void RemoveClient(const std::string& uuid);
+
+
+		void Controller(); // Check and modify client account and connection statuses
+		void Run(); // Runs controllers until Stop(), sleeps until the nearest release/expiration date or poll interval
+		void Stop(); // Can be called from another thread
+		std::chrono::system_clock::time_point RunOnce(); // one iteration of Run() for external schedulers, returns when the next one is due
+		void SetWakeUpHandler(std::function<void()> handler); // called after changes of clients, when the next iteration of Run() is due now
+		const std::string& GetRootPath() const;
+		void SetControllerSettings(const ControllerSettings& settings);
+		void SetJournalSizeLimit(size_t bytes); // journal is compacted into snapshot when it's bigger than limit and than snapshot file
+		void SetSnapshotFormat(SnapshotFormat format); // converts existing snapshot to format
+		SnapshotFormat GetSnapshotFormat() const;
+		ReconciliationReport GetLastReconciliation() const; // peers changed by last Controller call
+		void ApplyServerConfiguration(); // writes <interface>.conf and syncs running interface with it by wg syncconf, without restart
+		const PeerTelemetry& GetTelemetry() const; // traffic and endpoints of peers, sampled with every handshake poll
+		ConnectionTracker& GetConnections(); // connection states, sessions and their subscribers, updated with every handshake poll
+		void SetClientConnectionThresholds(const std::string& uuid, const ConnectionThresholds& thresholds); // instead of thresholds of ControllerSettings, kept only in memory
+		void ResetClientConnectionThresholds(const std::string& uuid);
+		EventBus& GetEventBus(); // changes of clients, peers and server for subscribers, instead of polling GetClients()
+		std::string RenderMetrics() const; // OpenMetrics text, ex.: MetricsServer server([&wireguard]() { return wireguard.RenderMetrics(); });
+		MetricsRegistry& GetMetricsRegistry(); // for metrics of application in the same exposition
+
+		// bool SetClientStatus(const std::string& uid, const bool& status); // может не стоит выносить как отдельный метод
+	private:
+		struct BatchUndo // changes of batch in RAM, see UndoBatch()
+		{
+			std::vector<Client> removed{}; // old records of updates and removes
+			std::vector<uint32_t> reserved{}; // addresses taken by new records
+			std::vector<ClientUuid> inserted{}; // new records
+			size_t records_size{ 0 }; // pending journal records before batch
+			size_t events_size{ 0 }; // pending events before batch
+		};
+
+		bool DateAndModeController(time_t now);
+		bool ConnectionStatusController(const std::vector<PeerInfo>& peers);
+		ReconciliationReport PeersConnectionController(std::vector<PeerInfo>& live_peers); // changes of peers are applied in background, see WaitPeerChanges()
+
+		void AddPeer(const Client& client) const;
+		void RemovePeer(const Client& client) const;
+		void RemovePeer(const std::string& public_key) const;
+		std::vector<PeerInfo> DumpPeers() const; // peer controller calls through executor, with deadline and latency metrics
+		void ApplyPeers(const PeerChanges& changes) const; // waits for changes
+		void ApplyPeersInBackground(const PeerChanges& changes); // changes are queued after earlier changes of interface
+		void WaitPeerChanges(); // throws WireguardException if background changes failed or expired
+		
+		void PublishSnapshot(); // configuration -> snapshot for readers
+		void WakeUp(); // Run() recalculates its sleep after changes of clients
+
+		void ReadConfiguration(); //snapshot file + journal -> configuration
+		void WriteConfiguration(); //configuration -> snapshot file, journal is emptied
+		size_t GetSnapshotSize() const; // bytes of snapshot file of current format
+		void ReadJsonConfiguration(); //json snapshot file -> configuration (streaming)
+		void ReadBinaryConfiguration(); //binary snapshot file -> configuration
+		void RebuildAddresses(); // server network and ip addresses of clients -> address allocator, allowed ips of clients -> routes
+		BatchReport ApplyBatchLocked(const std::vector<BatchItem>& items); // ApplyBatch, write_mutex is held by caller
+		void UndoBatch(const BatchUndo& undo); // ApplyBatchLocked failed in the middle
+		void SyncServerConfiguration(); // ApplyServerConfiguration, write_mutex is held by caller
+		bool ValidateBatch(const std::vector<BatchItem>& items, BatchReport& report) const; // fills errors of items without changes of configuration
+
+		void JournalClient(const char* operation, const Client& client); // create or update record
+		void JournalRemove(const std::string& uuid);
+		void JournalStatus(const Client& client);
+		void JournalServer();
+		WireguardEvent* Emit(event_types::TYPE type, const Client* client); // event -> pending events (published by Persist() after journal), nullptr if nobody listens
+		void PublishEvents();
+		void Persist(); // pending records -> journal (-> snapshot, if journal is too big)
+		void ReplayJournal(); // journal -> configuration
+
+		nlohmann::json SerializeConfiguration() const; // configuration -> json
+		nlohmann::json SerializeServer() const; // server -> json
+		Server DeserializeServer(const nlohmann::json& json_server_configuration) const; // json -> server
+		nlohmann::json SerializeClient(const Client& client) const; // client -> json
+		Client DeserializeClient(const nlohmann::json& json_user_configuration) const; // json -> client
+
+		bool WriteServerConfiguration(); // configuration -> <interface>.conf for wg-quick, false if content is the same
+
+		void UploadConfiguration(const nlohmann::json& json_configuration) const; //json -> json file
+
+		void StartServer();
+		void StopServer();
+		void RebootServer();
+
+		Server server; // server data
+		ClientRegistry clients; // clients data
+		std::shared_ptr<PeerController> peer_controller; // access to peers of wireguard interface
+		std::shared_ptr<PeerExecutor> peer_executor; // runs peer controller calls with deadlines
+		std::chrono::milliseconds peer_call_timeout{ ControllerSettings{}.peer_call_timeout }; // guarded by write_mutex
+		std::future<void> pending_peer_changes; // the last background changes, guarded by write_mutex
+		std::shared_ptr<CallControl> pending_peer_control;
+		std::chrono::steady_clock::time_point pending_peer_start{};
+		PeerReconciler peer_reconciler; // desired peers table
+		uint64_t desired_peers_version{ std::numeric_limits<uint64_t>::max() }; // version of clients used for desired peers table
+		ReconciliationReport last_reconciliation{};
+		ExpiryScheduler expiry_scheduler; // next release/expiration moment of every client
+		bool dates_resync_required{ false }; // configuration is loaded, statuses of all clients are evaluated by one sweep
+		AddressAllocator address_allocator; // free ip addresses of server network
+		AllowedIpsTrie routes; // allowed ips of clients -> uuid of client
+		PeerTelemetry telemetry; // history of peers dumps
+		ConnectionTracker connections; // state machine of every peer
+		std::unordered_map<ClientUuid, ConnectionThresholds, PackedTextHash> client_thresholds; // uuid -> own thresholds, guarded by write_mutex
+		ControllerSettings controller_settings{};
+		mutable std::mutex write_mutex; // the single writer
+		std::shared_ptr<const ConfigurationSnapshot> snapshot; // accessed only by std::atomic_load/atomic_store
+		uint64_t snapshot_version{ 0 };
+		std::mutex run_mutex;
+		std::condition_variable run_condition;
+		bool stop_requested{ false };
+		bool wake_requested{ false };
+		std::function<void()> wake_up_handler; // guarded by run_mutex
+		std::chrono::system_clock::time_point next_handshake_poll{}; // guarded by write_mutex, epoch: due at the first iteration
+		std::chrono::system_clock::time_point next_peers_check{};
+		std::string root_path; // with trailing slash, ex.: /etc/wireguard/
+		std::unique_ptr<ConfigurationJournal> journal; // changes since the last snapshot
+		std::vector<nlohmann::json> pending_records; // changes that aren't in journal yet
+		std::shared_ptr<EventBus> event_bus; // may be shared by interfaces
+		std::vector<WireguardEvent> pending_events; // events of changes that aren't in journal yet
+		size_t journal_size_limit{ JOURNAL_SIZE_LIMIT_DEFAULT };
+		bool snapshot_exists{ false }; // journal is useless without snapshot
+		size_t snapshot_size{ 0 }; // bytes of snapshot file, so compaction is amortized over at least as many bytes of journal
+		SnapshotFormat snapshot_format{ SnapshotFormat::JSON };
+		uint64_t server_configuration_hash{ 0 }; // hash of <interface>.conf (0 if unknown)
+		uint64_t synced_configuration_hash{ 0 }; // hash of configuration of running interface (0 if unknown)
+		MetricsRegistry metrics_registry;
+		WireguardMetrics metrics{ metrics_registry }; // after metrics_registry
+	};	
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include "wireguard.hpp"
+#include "thread_pool.hpp"
+
+#define MANAGER_RETRY_INTERVAL std::chrono::seconds(10) // interface whose controller failed is run again after it
+#define INTERFACE_NAME_LENGTH_MAX 15 // IFNAMSIZ - 1
+
+
+namespace timlibs
+{
+	using PeerControllerFactory = std::function<std::shared_ptr<PeerController>(const std::string& interface_name)>;
+
+	struct InterfaceClient
+	{
+		std::string interface_name{ NULL_STRING };
+		Client client{};
+	};
+
+	struct InterfaceStatus
+	{
+		std::string interface_name{ NULL_STRING };
+		std::chrono::system_clock::time_point next_run{}; // when controllers of interface are due
+		std::string last_error{ NULL_STRING }; // error of the last controllers run (empty if it succeeded)
+	};
+
+	// Interfaces of one root directory (wg0 ... wg15), loaded in parallel. Run() schedules controllers of every interface separately
+	// and runs them on the shared pool, so a slow interface doesn't delay others and at most one run of interface is in progress
+	class WireguardManager
+	{
+	public:
+		WireguardManager(const std::string& root_path = ROOT_PATH_DEFAULT, size_t threads = 0, PeerControllerFactory peer_controller_factory = nullptr); // threads: 0 - one per core; factory: nullptr - default of Wireguard
+		WireguardManager(const WireguardManager&) = delete;
+		WireguardManager& operator=(const WireguardManager&) = delete;
+
+		std::vector<std::string> Load(); // loads every <name>.json and <name>.snap of root path which isn't loaded yet, all or nothing, returns loaded names
+		Wireguard& Add(const std::string& interface_name); // new interface without configuration file (it's written with the first change)
+		Wireguard& Get(const std::string& interface_name); // throws WireguardException if interface isn't loaded
+		std::vector<std::string> GetInterfaceNames() const; // sorted
+
+		std::vector<InterfaceClient> FindClientsByPublicKey(const std::string& public_key) const; // from snapshots, without waiting for writers
+		std::vector<InterfaceClient> FindClientsByIp(const IPv4& ip) const; // networks of interfaces may overlap
+		std::vector<InterfaceStatus> GetStatuses() const;
+
+		void Controller(); // controllers of all interfaces once, in parallel
+		void Run(); // schedules controllers of interfaces until Stop()
+		void Stop(); // can be called from another thread
+		void SetControllerSettings(const ControllerSettings& settings); // for every loaded and later added interface
+		ThreadPool& GetPool(); // shared workers, ex. for RenderClientBundles()
+		EventBus& GetEventBus(); // events of all interfaces, see WireguardEvent::interface_name
+		const std::string& GetRootPath() const;
+	private:
+		struct Interface
+		{
+			std::string name{ NULL_STRING }; // name of interface (file name of snapshot)
+			std::unique_ptr<Wireguard> wireguard;
+			std::chrono::system_clock::time_point next_run{}; // guarded by schedule_mutex
+			bool running{ false };
+			bool woken{ false }; // clients are changed while controllers run, next run is due at once
+			std::string last_error{ NULL_STRING };
+		};
+
+		std::unique_ptr<Interface> Open(const std::string& interface_name, const ControllerSettings& settings);
+		void Attach(std::vector<std::unique_ptr<Interface>> opened); // opened interfaces -> list, they are scheduled at once
+		Interface* Find(const std::string& interface_name) const; // interfaces_mutex is held by caller
+		std::vector<Interface*> GetInterfaces() const; // copy of list, interfaces_mutex isn't held after it
+		void RunInterface(Interface& interface); // task of pool
+		void WakeUp(Interface& interface);
+
+		std::string root_path;
+		PeerControllerFactory peer_controller_factory;
+		std::shared_ptr<PeerExecutor> peer_executor; // shared by interfaces, changes of every interface keep their order
+		std::shared_ptr<EventBus> event_bus; // shared by interfaces
+		ControllerSettings controller_settings{}; // guarded by interfaces_mutex
+		mutable std::mutex interfaces_mutex; // list of interfaces, they are never removed
+		std::vector<std::unique_ptr<Interface>> interfaces; // sorted by name
+		mutable std::mutex schedule_mutex;
+		std::condition_variable schedule_condition;
+		bool stop_requested{ false };
+		bool rescheduled{ false }; // Run() recalculates its sleep
+		size_t running_count{ 0 };
+		ThreadPool pool; // the last member: it's destroyed first, its tasks use other members
+	};
+}
@@ -0,0 +1,156 @@
+#include "address_allocator.hpp"
+#include "wireguard.hpp"
+#include <arpa/inet.h>
+
+namespace timlibs
+{
+    /// @brief Parses network, ex.: "10.0.30.0/24" or "10.0.30.0/255.255.255.0"
+    /// @param text network as string
+    /// @param address network address in host byte order
+    /// @param prefix length of prefix
+    /// @return true if network is valid
+    bool ParseNetwork(const std::string& text, uint32_t& address, uint32_t& prefix)
+    {
+        size_t slash = text.find('/');
+        if (slash == std::string::npos) return false;
+        in_addr parsed{};
+        if (inet_pton(AF_INET, text.substr(0, slash).c_str(), &parsed) != 1) return false;
+        address = ntohl(parsed.s_addr);
+
+        std::string mask = text.substr(slash + 1);
+        if (mask.find('.') != std::string::npos)
+        {
+            if (inet_pton(AF_INET, mask.c_str(), &parsed) != 1) return false;
+            uint32_t bits = ntohl(parsed.s_addr);
+            prefix = (bits == 0) ? 0 : 32 - __builtin_ctz(bits);
+            return bits == ((prefix == 0) ? 0 : ~(uint32_t)0 << (32 - prefix)); // mask must be contiguous
+        }
+        if (mask.empty() || mask.size() > 2 || mask.find_first_not_of("0123456789") != std::string::npos) return false;
+        prefix = (uint32_t)std::stoul(mask);
+        return prefix <= 32;
+    }
+
+    /// @brief Makes all addresses of network free
+    /// @param network vpn network, networks wider than ADDRESS_ALLOCATOR_MIN_PREFIX have no addresses
+    /// @param server_ip server vpn ip address, it's never allocated
+    void AddressAllocator::Reset(const IPv4Mask& network, const IPv4& server_ip)
+    {
+        this->used.clear();
+        this->released.clear();
+        this->size = 0;
+        this->cursor = 0;
+        this->free_count = 0;
+
+        uint32_t address = 0;
+        uint32_t prefix = 0;
+        if (!ParseNetwork(network.GetAsString(), address, prefix) || prefix < ADDRESS_ALLOCATOR_MIN_PREFIX) return;
+        this->size = (uint64_t)1 << (32 - prefix);
+        this->base = address & (uint32_t)~(this->size - 1);
+        this->first = 0;
+        this->last = (uint32_t)(this->size - 1);
+        if (prefix <= 30) // network and broadcast addresses, /31 and /32 have no them
+        {
+            this->first++;
+            this->last--;
+        }
+        this->used.assign((this->size + 63) / 64, 0);
+        for (uint32_t offset = 0; offset < this->first; offset++) this->SetUsed(offset, true);
+        if (this->last + 1 < this->size) this->SetUsed(this->last + 1, true);
+        this->free_count = this->last - this->first + 1;
+        this->cursor = this->first;
+
+        if (ToHostOrder(server_ip) != NULL_IP_DEC) this->Reserve(ToHostOrder(server_ip));
+    }
+
+    /// @brief Checks that address may be given to client
+    /// @param address ip address in host byte order
+    /// @return true if address is in network and it isn't network or broadcast address
+    bool AddressAllocator::Contains(uint32_t address) const
+    {
+        uint32_t offset = address - this->base;
+        return this->size != 0 && offset >= this->first && offset <= this->last;
+    }
+
+    /// @brief Marks address as used, ex. address that was set by administrator
+    /// @param address ip address in host byte order
+    /// @return true if address was free
+    bool AddressAllocator::Reserve(uint32_t address)
+    {
+        if (!this->Contains(address)) return false;
+        uint32_t offset = address - this->base;
+        if (this->IsUsed(offset)) return false;
+        this->SetUsed(offset, true);
+        this->free_count--;
+        return true;
+    }
+
+    /// @brief Makes address free again
+    /// @param address ip address in host byte order
+    void AddressAllocator::Release(uint32_t address)
+    {
+        if (!this->Contains(address)) return;
+        uint32_t offset = address - this->base;
+        if (!this->IsUsed(offset)) return;
+        this->SetUsed(offset, false);
+        this->free_count++;
+        if (offset < this->cursor) this->released.push_back(offset); // cursor finds the others itself
+    }
+
+    /// @brief Takes free address: released addresses first, then the next never used one
+    /// @param address allocated ip address in host byte order
+    /// @return false if there is no free address
+    bool AddressAllocator::Allocate(uint32_t& address)
+    {
+        if (this->free_count == 0) return false; // also network without addresses, it has no bitmap
+        while (!this->released.empty())
+        {
+            uint32_t offset = this->released.back();
+            this->released.pop_back();
+            if (this->IsUsed(offset)) continue; // reserved explicitly after release
+            this->SetUsed(offset, true);
+            this->free_count--;
+            address = this->base + offset;
+            return true;
+        }
+        while (this->cursor <= this->last)
+        {
+            size_t word = this->cursor / 64;
+            uint64_t free_bits = ~this->used[word] & (~(uint64_t)0 << (this->cursor % 64));
+            if (free_bits != 0)
+            {
+                uint64_t offset = word * 64 + __builtin_ctzll(free_bits);
+                if (offset > this->last) break;
+                this->SetUsed((uint32_t)offset, true);
+                this->free_count--;
+                this->cursor = offset + 1;
+                address = this->base + (uint32_t)offset;
+                return true;
+            }
+            this->cursor = (word + 1) * 64; // 64 used addresses are skipped at once
+        }
+        this->cursor = (uint64_t)this->last + 1;
+        return false;
+    }
+
+    /// @brief Takes count free addresses at once, ex. for import of many clients
+    /// @param count count of addresses
+    /// @return ip addresses in host byte order
+    std::vector<uint32_t> AddressAllocator::Allocate(size_t count)
+    {
+        if (count > this->free_count) throw WireguardException("Not enough free ip addresses in network: " + std::to_string(this->free_count) + " free, " + std::to_string(count) + " requested");
+        std::vector<uint32_t> addresses(count);
+        for (uint32_t& address : addresses) this->Allocate(address);
+        return addresses;
+    }
+
+    size_t AddressAllocator::GetFreeCount() const { return this->free_count; }
+
+    bool AddressAllocator::IsUsed(uint32_t offset) const { return this->used[offset / 64] >> (offset % 64) & 1; }
+
+    void AddressAllocator::SetUsed(uint32_t offset, bool used)
+    {
+        uint64_t mask = (uint64_t)1 << (offset % 64);
+        if (used) this->used[offset / 64] |= mask;
+        else this->used[offset / 64] &= ~mask;
+    }
+}
@@ -0,0 +1,332 @@
+#include "allowed_ips.hpp"
+#include <algorithm>
+#include <arpa/inet.h>
+
+namespace timlibs
+{
+    namespace
+    {
+        /// @brief Builds netmask of prefix length
+        /// @param length prefix length 0 - 32
+        /// @return mask in host byte order, ex.: 24 -> 0xFFFFFF00
+        uint32_t GetMask(uint32_t length) { return (length == 0) ? 0 : ~(uint32_t)0 << (32 - length); }
+
+        /// @brief Gets bit of address after first bits
+        /// @param address address in host byte order
+        /// @param position count of bits before the bit (0 - 31)
+        /// @return 0 or 1
+        uint32_t GetBit(uint32_t address, uint32_t position) { return (address >> (31 - position)) & 1; }
+
+        /// @brief Parses one prefix of list
+        /// @param text ip address with or without length, ex.: 10.0.30.5/24 or 10.0.0.1
+        /// @param prefix parsed prefix, host bits are cleared
+        /// @return false if it isn't IPv4 prefix
+        bool ParsePrefix(const std::string& text, IpPrefix& prefix)
+        {
+            size_t slash = text.find('/');
+            in_addr parsed{};
+            if (inet_pton(AF_INET, text.substr(0, slash).c_str(), &parsed) != 1) return false;
+            prefix.length = 32;
+            if (slash != std::string::npos)
+            {
+                std::string length = text.substr(slash + 1);
+                if (length.empty() || length.size() > 2 || length.find_first_not_of("0123456789") != std::string::npos) return false;
+                prefix.length = (uint32_t)std::stoul(length);
+                if (prefix.length > 32) return false;
+            }
+            prefix.address = ntohl(parsed.s_addr) & GetMask(prefix.length);
+            return true;
+        }
+    }
+
+    bool IpPrefix::Contains(const IpPrefix& other) const
+    {
+        return other.length >= this->length && ((other.address ^ this->address) & GetMask(this->length)) == 0;
+    }
+
+    /// @brief Parses allowed ips of client into minimal set of prefixes
+    /// @param text comma separated prefixes, ex.: "10.0.30.5/24, 10.0.31.0/24,10.0.0.1"
+    /// @param prefixes parsed prefixes, ex.: 10.0.0.1/32, 10.0.30.0/23 (empty for empty text)
+    /// @return false if any prefix isn't valid IPv4 prefix
+    bool ParseAllowedIps(const std::string& text, std::vector<IpPrefix>& prefixes)
+    {
+        prefixes.clear();
+        size_t begin = 0;
+        while (begin < text.size())
+        {
+            size_t end = text.find(',', begin);
+            if (end == std::string::npos) end = text.size();
+            size_t first = text.find_first_not_of(" \t", begin);
+            size_t last = text.find_last_not_of(" \t", end - 1);
+            if (first != std::string::npos && first < end && last >= first)
+            {
+                IpPrefix prefix;
+                if (!ParsePrefix(text.substr(first, last - first + 1), prefix)) return false;
+                prefixes.push_back(prefix);
+            }
+            begin = end + 1;
+        }
+        CompactPrefixes(prefixes);
+        return true;
+    }
+
+    /// @brief Converts prefixes to minimal set which covers the same addresses
+    /// @param prefixes prefixes with cleared host bits, ex.: 10.0.31.0/24, 10.0.30.0/24, 10.0.30.7/32
+    void CompactPrefixes(std::vector<IpPrefix>& prefixes)
+    {
+        std::sort(prefixes.begin(), prefixes.end(), [](const IpPrefix& left, const IpPrefix& right)
+        {
+            return left.address != right.address ? left.address < right.address : left.length < right.length;
+        });
+
+        // in this order a covering prefix is always the last kept one, and merged siblings are at the end
+        size_t kept = 0;
+        for (size_t index = 0; index < prefixes.size(); index++)
+        {
+            if (kept > 0 && prefixes[kept - 1].Contains(prefixes[index])) continue;
+            prefixes[kept++] = prefixes[index];
+            while (kept >= 2)
+            {
+                IpPrefix& previous = prefixes[kept - 2];
+                const IpPrefix& last = prefixes[kept - 1];
+                if (previous.length != last.length || last.length == 0) break;
+                uint32_t sibling_bit = (uint32_t)1 << (32 - last.length);
+                if ((previous.address & sibling_bit) != 0 || (previous.address | sibling_bit) != last.address) break;
+                previous.length--;
+                kept--;
+            }
+        }
+        prefixes.resize(kept);
+    }
+
+    std::string FormatPrefix(const IpPrefix& prefix)
+    {
+        in_addr address{ htonl(prefix.address) };
+        char text[INET_ADDRSTRLEN] = { 0 };
+        inet_ntop(AF_INET, &address, text, sizeof(text));
+        return std::string(text) + '/' + std::to_string(prefix.length);
+    }
+
+    /// @brief Converts prefixes to text of allowed ips
+    /// @param prefixes prefixes
+    /// @return list as wg-quick writes it, ex.: "10.0.0.1/32, 10.0.30.0/23"
+    std::string FormatAllowedIps(const std::vector<IpPrefix>& prefixes)
+    {
+        std::string text;
+        for (const IpPrefix& prefix : prefixes)
+        {
+            if (!text.empty()) text += ", ";
+            text += FormatPrefix(prefix);
+        }
+        return text;
+    }
+
+    AllowedIpsTrie::AllowedIpsTrie() { this->nodes.PushBack(Node{}); }
+
+    /// @brief Sets prefixes of owner, old prefixes of owner are removed. Overlaps aren't checked here, see FindOverlap()
+    /// @param owner uuid of client
+    /// @param prefixes compacted prefixes, ex. by ParseAllowedIps()
+    void AllowedIpsTrie::Insert(const std::string& owner, const std::vector<IpPrefix>& prefixes)
+    {
+        this->Remove(owner);
+        if (prefixes.empty()) return;
+
+        uint32_t index = (uint32_t)this->owners.Size();
+        if (!this->free_owners.Empty())
+        {
+            index = this->free_owners.Back();
+            this->free_owners.PopBack();
+        }
+        else this->owners.PushBack(Owner{});
+        this->owners.Mutable(index) = Owner{ owner, prefixes };
+        this->owner_indexes.Set(owner, index);
+        for (const IpPrefix& prefix : prefixes) this->InsertPrefix(prefix, index);
+    }
+
+    /// @brief Removes all prefixes of owner (taken over prefixes stay with their new owners)
+    /// @param owner uuid of client
+    void AllowedIpsTrie::Remove(const std::string& owner)
+    {
+        const uint32_t* found = this->owner_indexes.Find(owner);
+        if (found == nullptr) return;
+        uint32_t index = *found;
+        for (const IpPrefix& prefix : this->owners[index].prefixes) this->RemovePrefix(prefix, index);
+        this->owners.Mutable(index) = Owner{};
+        this->free_owners.PushBack(index);
+        this->owner_indexes.Erase(owner);
+    }
+
+    void AllowedIpsTrie::Clear()
+    {
+        this->nodes.Clear();
+        this->nodes.PushBack(Node{});
+        this->free_nodes.Clear();
+        this->owners.Clear();
+        this->free_owners.Clear();
+        this->owner_indexes.Clear();
+        this->size = 0;
+    }
+
+    /// @brief Finds owner of address as wireguard routes it: by the longest prefix
+    /// @param address address in host byte order
+    /// @return uuid of owner, valid until the next change of trie, nullptr if no prefix contains address
+    const std::string* AllowedIpsTrie::FindOwner(uint32_t address) const
+    {
+        const std::string* owner = nullptr;
+        uint32_t index = 0;
+        do
+        {
+            const Node& node = this->nodes[index];
+            if (((address ^ node.prefix.address) & GetMask(node.prefix.length)) != 0) break;
+            if (node.owner != NO_OWNER) owner = &this->owners[node.owner].name;
+            if (node.prefix.length == 32) break;
+            index = node.children[GetBit(address, node.prefix.length)];
+        } while (index != 0);
+        return owner;
+    }
+
+    /// @brief Finds prefix of other owner which overlaps with prefix: contains it, is equal to it or is inside of it
+    /// @param prefix checked prefix
+    /// @param ignored_owners owners whose prefixes are released (ex. clients updated or removed by the same batch)
+    /// @return uuid of owner, valid until the next change of trie, nullptr if there is no overlap
+    const std::string* AllowedIpsTrie::FindOverlap(const IpPrefix& prefix, const std::unordered_set<std::string>& ignored_owners) const
+    {
+        uint32_t index = 0;
+        do
+        {
+            const Node& node = this->nodes[index];
+            if (node.prefix.length >= prefix.length)
+            {
+                if (!prefix.Contains(node.prefix)) return nullptr;
+                const Node* inside = this->FindOwnedInside(index, ignored_owners);
+                return (inside != nullptr) ? &this->owners[inside->owner].name : nullptr;
+            }
+            if (!node.prefix.Contains(prefix)) return nullptr;
+            if (node.owner != NO_OWNER && !ignored_owners.count(this->owners[node.owner].name)) return &this->owners[node.owner].name;
+            index = node.children[GetBit(prefix.address, node.prefix.length)];
+        } while (index != 0);
+        return nullptr;
+    }
+
+    const std::vector<IpPrefix>* AllowedIpsTrie::GetPrefixes(const std::string& owner) const
+    {
+        const uint32_t* found = this->owner_indexes.Find(owner);
+        return (found != nullptr) ? &this->owners[*found].prefixes : nullptr;
+    }
+
+    size_t AllowedIpsTrie::Size() const { return this->size; }
+
+    /// @brief Adds prefix to trie, nodes are created only where paths of prefixes branch
+    /// @param prefix prefix
+    /// @param owner index of owner
+    void AllowedIpsTrie::InsertPrefix(const IpPrefix& prefix, uint32_t owner)
+    {
+        std::vector<uint32_t> path; // ancestors, their subtrees get the prefix
+        uint32_t index = 0;
+        while (this->nodes[index].prefix.length < prefix.length)
+        {
+            path.push_back(index);
+            uint32_t bit = GetBit(prefix.address, this->nodes[index].prefix.length);
+            uint32_t child = this->nodes[index].children[bit];
+            if (child == 0) child = this->NewNode(prefix);
+            else
+            {
+                IpPrefix child_prefix = this->nodes[child].prefix;
+                uint32_t difference = prefix.address ^ child_prefix.address;
+                uint32_t common = std::min((difference == 0) ? 32 : (uint32_t)__builtin_clz(difference), std::min(prefix.length, child_prefix.length));
+                if (common < child_prefix.length) // child isn't on the path of prefix: node of common part goes between them
+                {
+                    uint32_t middle = this->NewNode(IpPrefix{ prefix.address & GetMask(common), common });
+                    Node& middle_node = this->nodes.Mutable(middle);
+                    middle_node.children[GetBit(child_prefix.address, common)] = child;
+                    middle_node.owned = this->nodes[child].owned;
+                    child = middle;
+                }
+            }
+            if (this->nodes[index].children[bit] != child) this->nodes.Mutable(index).children[bit] = child;
+            index = child;
+        }
+
+        Node& node = this->nodes.Mutable(index);
+        if (node.owner == NO_OWNER)
+        {
+            node.owned++;
+            for (uint32_t ancestor : path) this->nodes.Mutable(ancestor).owned++;
+            this->size++;
+        }
+        node.owner = owner;
+    }
+
+    /// @brief Removes prefix from trie if it's still owned by owner, nodes without purpose are freed
+    /// @param prefix prefix
+    /// @param owner index of owner
+    void AllowedIpsTrie::RemovePrefix(const IpPrefix& prefix, uint32_t owner)
+    {
+        std::vector<uint32_t> path{ 0 };
+        while (this->nodes[path.back()].prefix.length < prefix.length)
+        {
+            const Node& node = this->nodes[path.back()];
+            uint32_t child = node.children[GetBit(prefix.address, node.prefix.length)];
+            if (child == 0 || !this->nodes[child].prefix.Contains(prefix)) return;
+            path.push_back(child);
+        }
+        if (!(this->nodes[path.back()].prefix == prefix) || this->nodes[path.back()].owner != owner) return;
+        this->nodes.Mutable(path.back()).owner = NO_OWNER;
+        for (uint32_t ancestor : path) this->nodes.Mutable(ancestor).owned--;
+        this->size--;
+
+        // node without owner is needed only where two paths branch, root is always kept
+        for (size_t depth = path.size() - 1; depth > 0; depth--)
+        {
+            const Node& current = this->nodes[path[depth]];
+            if (current.owner != NO_OWNER || (current.children[0] != 0 && current.children[1] != 0)) break;
+            uint32_t only_child = current.children[0] | current.children[1];
+            Node& parent = this->nodes.Mutable(path[depth - 1]);
+            parent.children[parent.children[1] == path[depth]] = only_child;
+            this->FreeNode(path[depth]);
+            if (only_child != 0) break; // parent has the same count of children
+        }
+    }
+
+    uint32_t AllowedIpsTrie::NewNode(const IpPrefix& prefix)
+    {
+        Node node{};
+        node.prefix = prefix;
+        uint32_t index = (uint32_t)this->nodes.Size();
+        if (this->free_nodes.Empty()) this->nodes.PushBack(node);
+        else
+        {
+            index = this->free_nodes.Back();
+            this->free_nodes.PopBack();
+            this->nodes.Mutable(index) = node;
+        }
+        return index;
+    }
+
+    void AllowedIpsTrie::FreeNode(uint32_t index)
+    {
+        this->nodes.Mutable(index) = Node{};
+        this->free_nodes.PushBack(index);
+    }
+
+    /// @brief Searches subtree for owned node, subtrees without owned prefixes are skipped
+    /// @param index root of subtree
+    /// @param ignored_owners owners which are skipped
+    /// @return owned node or nullptr
+    const AllowedIpsTrie::Node* AllowedIpsTrie::FindOwnedInside(uint32_t index, const std::unordered_set<std::string>& ignored_owners) const
+    {
+        std::vector<uint32_t> stack{ index };
+        while (!stack.empty())
+        {
+            const Node& node = this->nodes[stack.back()];
+            stack.pop_back();
+            if (node.owned == 0) continue;
+            if (node.owner != NO_OWNER && !ignored_owners.count(this->owners[node.owner].name)) return &node;
+            for (uint32_t child : node.children)
+            {
+                if (child != 0) stack.push_back(child);
+            }
+        }
+        return nullptr;
+    }
+}
@@ -0,0 +1,100 @@
+#include "base64.hpp"
+
+namespace timlibs
+{
+    namespace
+    {
+        const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+        /// @brief Converts base64 symbol to 6-bit value
+        /// @param symbol base64 symbol
+        /// @return value 0 - 63 or -1 if symbol isn't base64
+        int DecodeSymbol(char symbol)
+        {
+            if (symbol >= 'A' && symbol <= 'Z') return symbol - 'A';
+            if (symbol >= 'a' && symbol <= 'z') return symbol - 'a' + 26;
+            if (symbol >= '0' && symbol <= '9') return symbol - '0' + 52;
+            if (symbol == '+') return 62;
+            if (symbol == '/') return 63;
+            return -1;
+        }
+    }
+
+    /// @brief Encodes binary data to base64 with padding
+    /// @param data binary data
+    /// @param size size of data in bytes
+    /// @return base64 text, ex. wireguard key
+    std::string Base64Encode(const uint8_t* data, size_t size)
+    {
+        std::string text;
+        text.reserve((size + 2) / 3 * 4);
+        size_t i = 0;
+        for (; i + 2 < size; i += 3)
+        {
+            uint32_t triple = (uint32_t)data[i] << 16 | (uint32_t)data[i + 1] << 8 | data[i + 2];
+            text.push_back(alphabet[triple >> 18 & 63]);
+            text.push_back(alphabet[triple >> 12 & 63]);
+            text.push_back(alphabet[triple >> 6 & 63]);
+            text.push_back(alphabet[triple & 63]);
+        }
+        if (i < size)
+        {
+            uint32_t triple = (uint32_t)data[i] << 16 | ((i + 1 < size) ? (uint32_t)data[i + 1] << 8 : 0);
+            text.push_back(alphabet[triple >> 18 & 63]);
+            text.push_back(alphabet[triple >> 12 & 63]);
+            text.push_back((i + 1 < size) ? alphabet[triple >> 6 & 63] : '=');
+            text.push_back('=');
+        }
+        return text;
+    }
+
+    /// @brief Decodes base64 text with padding to binary data of fixed size
+    /// @param text base64 text
+    /// @param data output buffer
+    /// @param size expected size of data in bytes
+    /// @return true if text is valid base64 of exactly size bytes
+    bool Base64Decode(const std::string& text, uint8_t* data, size_t size)
+    {
+        if (text.size() != (size + 2) / 3 * 4) return false;
+        size_t written = 0;
+        for (size_t i = 0; i < text.size(); i += 4)
+        {
+            uint32_t triple = 0;
+            size_t symbols = 0;
+            for (size_t j = 0; j < 4; j++)
+            {
+                if (text[i + j] == '=')
+                {
+                    if (i + 4 != text.size()) return false; // padding only at the end
+                    triple <<= 6;
+                    continue;
+                }
+                int value = DecodeSymbol(text[i + j]);
+                if (value < 0 || symbols != j) return false;
+                triple = triple << 6 | (uint32_t)value;
+                symbols++;
+            }
+            if (symbols < 2) return false;
+            for (size_t j = 0; j + 1 < symbols; j++)
+            {
+                if (written == size) return false;
+                data[written++] = (uint8_t)(triple >> (16 - 8 * j));
+            }
+        }
+        return written == size;
+    }
+
+    /// @brief Decodes base64 text which is the only encoding of data: Base64Decode() ignores unused bits of the last symbol,
+    /// @brief so different texts may give the same data
+    /// @param text base64 text
+    /// @param data output buffer
+    /// @param size expected size of data in bytes
+    /// @return true if text is valid base64 of exactly size bytes and Base64Encode() of data is text
+    bool Base64DecodeCanonical(const std::string& text, uint8_t* data, size_t size)
+    {
+        if (!Base64Decode(text, data, size)) return false;
+        if (size % 3 == 0) return true;
+        int last = DecodeSymbol(text[text.size() - (size % 3 == 1 ? 3 : 2)]); // the last symbol before padding
+        return (last & (size % 3 == 1 ? 15 : 3)) == 0;
+    }
+}
@@ -0,0 +1,299 @@
+#include "binary_snapshot.hpp"
+#include "configuration_journal.hpp"
+#include "base64.hpp"
+#include "client_identifiers.hpp"
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace timlibs
+{
+    namespace
+    {
+        // All numbers are in native byte order, records are 8 bytes aligned
+
+        struct StringReference
+        {
+            uint32_t offset; // offset in strings table
+            uint32_t length;
+        };
+
+        struct Header
+        {
+            char magic[8];
+            uint32_t version;
+            uint32_t header_size;
+            uint64_t client_count;
+            uint64_t server_offset;
+            uint64_t clients_offset;
+            uint64_t strings_offset;
+            uint64_t strings_size;
+        };
+
+        struct ServerRecord
+        {
+            StringReference interface_name;
+            StringReference network;
+            StringReference endpoint_dns;
+            StringReference private_key;
+            StringReference public_key;
+            StringReference pre_up;
+            StringReference post_up;
+            StringReference pre_down;
+            StringReference post_down;
+            uint32_t ip;
+            uint32_t endpoint_ip;
+            uint16_t listen_port;
+            uint16_t public_listen_port;
+            uint32_t reserved;
+        };
+
+        enum CLIENT_FLAG : uint32_t
+        {
+            ACCOUNT_STATUS = 1 << 0,
+            ADMINISTRATIVE_ACCOUNT_STATUS = 1 << 1,
+            CONNECTION_STATUS = 1 << 2,
+            RAW_UUID = 1 << 3, // uuid is stored as 16 bytes, else as text
+            RAW_PRIVATE_KEY = 1 << 4, // private key is stored as 32 bytes, else as text
+            RAW_PUBLIC_KEY = 1 << 5 // public key is stored as 32 bytes, else as text
+        };
+
+        struct ClientRecord
+        {
+            uint8_t uuid[UUID_SIZE];
+            uint8_t private_key[WG_KEY_SIZE];
+            uint8_t public_key[WG_KEY_SIZE];
+            int64_t creation_date;
+            int64_t release_date;
+            int64_t expiration_date;
+            uint32_t ip;
+            uint32_t flags; // CLIENT_FLAG
+            StringReference login;
+            StringReference full_name;
+            StringReference allowed_ips;
+            StringReference dns;
+            StringReference uuid_text; // only if uuid isn't canonical
+            StringReference private_key_text; // only if private key isn't 32 bytes in base64
+            StringReference public_key_text; // only if public key isn't 32 bytes in base64
+        };
+
+        static_assert(sizeof(Header) == 56, "binary snapshot header layout is changed");
+        static_assert(sizeof(ServerRecord) == 88, "binary snapshot server layout is changed");
+        static_assert(sizeof(ClientRecord) == 168, "binary snapshot client layout is changed");
+
+        /// @brief Builder of strings table
+        class StringTable
+        {
+        public:
+            StringReference Add(const std::string& value)
+            {
+                if (this->strings.size() + value.size() > UINT32_MAX) throw WireguardException("Binary snapshot strings table is too big");
+                StringReference reference{ (uint32_t)this->strings.size(), (uint32_t)value.size() };
+                this->strings += value;
+                return reference;
+            }
+
+            std::string strings;
+        };
+
+        /// @brief Copies bytes of canonical identifier to record
+        /// @return false if identifier isn't canonical, so it's written as text
+        template <typename Codec>
+        bool WriteBytes(const PackedText<Codec>& value, uint8_t* bytes)
+        {
+            const uint8_t* raw = value.GetBytes();
+            if (raw == nullptr) return false;
+            std::memcpy(bytes, raw, Codec::SIZE);
+            return true;
+        }
+    }
+
+    /// @brief Maps binary snapshot into memory and validates its header
+    /// @param path path of snapshot file, ex. /etc/wireguard/wg0.snap
+    BinarySnapshot::BinarySnapshot(const std::string& path)
+    {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) throw WireguardException("Unable access to " + path + ": " + strerror(errno));
+        struct stat status;
+        if (fstat(fd, &status) < 0 || (size_t)status.st_size < sizeof(Header))
+        {
+            close(fd);
+            throw WireguardException("Binary snapshot " + path + " is too small");
+        }
+        this->size = (size_t)status.st_size;
+        void* mapping = mmap(nullptr, this->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED) throw WireguardException("Unable to map " + path + ": " + strerror(errno));
+        this->data = static_cast<const uint8_t*>(mapping);
+        madvise(mapping, this->size, MADV_SEQUENTIAL);
+
+        Header header;
+        std::memcpy(&header, this->data, sizeof(header));
+        std::string error;
+        if (std::memcmp(header.magic, BINARY_SNAPSHOT_MAGIC, sizeof(BINARY_SNAPSHOT_MAGIC)) != 0) error = "isn't binary snapshot";
+        else if (header.version != BINARY_SNAPSHOT_VERSION) error = "has unsupported version " + std::to_string(header.version);
+        else if (header.header_size != sizeof(Header)) error = "has unexpected header size";
+        else if (header.server_offset + sizeof(ServerRecord) > this->size) error = "has no server record";
+        else if (header.clients_offset > this->size || header.client_count > (this->size - header.clients_offset) / sizeof(ClientRecord)) error = "has truncated clients records";
+        else if (header.strings_offset > this->size || header.strings_size > this->size - header.strings_offset) error = "has truncated strings table";
+        if (!error.empty())
+        {
+            munmap(mapping, this->size);
+            throw WireguardException("Binary snapshot " + path + ' ' + error);
+        }
+
+        this->client_count = (size_t)header.client_count;
+        this->server_offset = (size_t)header.server_offset;
+        this->clients_offset = (size_t)header.clients_offset;
+        this->strings_offset = (size_t)header.strings_offset;
+        this->strings_size = (size_t)header.strings_size;
+    }
+
+    BinarySnapshot::~BinarySnapshot()
+    {
+        if (this->data != nullptr) munmap(const_cast<uint8_t*>(this->data), this->size);
+    }
+
+    /// @brief Decodes server record
+    /// @return server configuration as Server structure
+    Server BinarySnapshot::GetServer() const
+    {
+        ServerRecord record;
+        std::memcpy(&record, this->data + this->server_offset, sizeof(record));
+        const uint8_t* base = this->data + this->server_offset;
+
+        Server server;
+        server.interface_name = this->GetString(base + offsetof(ServerRecord, interface_name));
+        server.listen_port = record.listen_port;
+        server.ip = FromHostOrder(record.ip);
+        try
+        {
+            server.network = IPv4Mask(this->GetString(base + offsetof(ServerRecord, network)));
+        }
+        catch (const ExceptionIPv4& error)
+        {
+            throw WireguardException("Server IPv4 Error: " + error.what());
+        }
+        server.endpoint_dns = this->GetString(base + offsetof(ServerRecord, endpoint_dns));
+        server.endpoint_ip = FromHostOrder(record.endpoint_ip);
+        server.public_listen_port = record.public_listen_port;
+        server.private_key = this->GetString(base + offsetof(ServerRecord, private_key));
+        server.public_key = this->GetString(base + offsetof(ServerRecord, public_key));
+        server.pre_up = this->GetString(base + offsetof(ServerRecord, pre_up));
+        server.post_up = this->GetString(base + offsetof(ServerRecord, post_up));
+        server.pre_down = this->GetString(base + offsetof(ServerRecord, pre_down));
+        server.post_down = this->GetString(base + offsetof(ServerRecord, post_down));
+        return server;
+    }
+
+    size_t BinarySnapshot::GetClientCount() const { return this->client_count; }
+
+    /// @brief Decodes client record
+    /// @param index number of client, 0 - GetClientCount()
+    /// @return client configuration as Client structure
+    Client BinarySnapshot::GetClient(size_t index) const
+    {
+        if (index >= this->client_count) throw WireguardException("Client index is out of binary snapshot");
+        const uint8_t* base = this->data + this->clients_offset + index * sizeof(ClientRecord);
+        ClientRecord record;
+        std::memcpy(&record, base, sizeof(record));
+
+        Client client;
+        client.uuid = (record.flags & RAW_UUID) ? ClientUuid::FromBytes(record.uuid) : ClientUuid(this->GetString(base + offsetof(ClientRecord, uuid_text)));
+        client.private_key = (record.flags & RAW_PRIVATE_KEY) ? WireguardKey::FromBytes(record.private_key) : WireguardKey(this->GetString(base + offsetof(ClientRecord, private_key_text)));
+        client.public_key = (record.flags & RAW_PUBLIC_KEY) ? WireguardKey::FromBytes(record.public_key) : WireguardKey(this->GetString(base + offsetof(ClientRecord, public_key_text)));
+        client.login = this->GetString(base + offsetof(ClientRecord, login));
+        client.full_name = this->GetString(base + offsetof(ClientRecord, full_name));
+        client.ip = FromHostOrder(record.ip);
+        client.account_status = record.flags & ACCOUNT_STATUS;
+        client.administrative_account_status = record.flags & ADMINISTRATIVE_ACCOUNT_STATUS;
+        client.connection_status = record.flags & CONNECTION_STATUS;
+        client.creation_date = Time((time_t)record.creation_date);
+        client.release_date = Time((time_t)record.release_date);
+        client.expiration_date = Time((time_t)record.expiration_date);
+        client.allowed_ips = this->GetString(base + offsetof(ClientRecord, allowed_ips));
+        client.dns = this->GetString(base + offsetof(ClientRecord, dns));
+        return client;
+    }
+
+    /// @brief Writes configuration as binary snapshot
+    /// @param path path of snapshot file, ex. /etc/wireguard/wg0.snap
+    /// @param server server configuration
+    /// @param clients clients configuration
+    void BinarySnapshot::Write(const std::string& path, const Server& server, const ClientRegistry& clients)
+    {
+        StringTable strings;
+
+        ServerRecord server_record{};
+        server_record.interface_name = strings.Add(server.interface_name);
+        server_record.network = strings.Add(server.network.GetAsString());
+        server_record.endpoint_dns = strings.Add(server.endpoint_dns);
+        server_record.private_key = strings.Add(server.private_key);
+        server_record.public_key = strings.Add(server.public_key);
+        server_record.pre_up = strings.Add(server.pre_up);
+        server_record.post_up = strings.Add(server.post_up);
+        server_record.pre_down = strings.Add(server.pre_down);
+        server_record.post_down = strings.Add(server.post_down);
+        server_record.ip = ToHostOrder(server.ip);
+        server_record.endpoint_ip = ToHostOrder(server.endpoint_ip);
+        server_record.listen_port = server.listen_port;
+        server_record.public_listen_port = server.public_listen_port;
+
+        std::vector<ClientRecord> client_records(clients.Size());
+        for (size_t i = 0; i < clients.Size(); i++)
+        {
+            const Client& client = clients.At(i);
+            ClientRecord& record = client_records[i];
+            std::memset(&record, 0, sizeof(record));
+            if (WriteBytes(client.uuid, record.uuid)) record.flags |= RAW_UUID;
+            else record.uuid_text = strings.Add(client.uuid.ToString());
+            if (WriteBytes(client.private_key, record.private_key)) record.flags |= RAW_PRIVATE_KEY;
+            else record.private_key_text = strings.Add(client.private_key.ToString());
+            if (WriteBytes(client.public_key, record.public_key)) record.flags |= RAW_PUBLIC_KEY;
+            else record.public_key_text = strings.Add(client.public_key.ToString());
+            if (client.account_status) record.flags |= ACCOUNT_STATUS;
+            if (client.administrative_account_status) record.flags |= ADMINISTRATIVE_ACCOUNT_STATUS;
+            if (client.connection_status) record.flags |= CONNECTION_STATUS;
+            record.creation_date = (int64_t)ToUnixTime(client.creation_date);
+            record.release_date = (int64_t)ToUnixTime(client.release_date);
+            record.expiration_date = (int64_t)ToUnixTime(client.expiration_date);
+            record.ip = ToHostOrder(client.ip);
+            record.login = strings.Add(client.login.ToString());
+            record.full_name = strings.Add(client.full_name.ToString());
+            record.allowed_ips = strings.Add(client.allowed_ips);
+            record.dns = strings.Add(client.dns);
+        }
+
+        Header header{};
+        std::memcpy(header.magic, BINARY_SNAPSHOT_MAGIC, sizeof(BINARY_SNAPSHOT_MAGIC));
+        header.version = BINARY_SNAPSHOT_VERSION;
+        header.header_size = sizeof(Header);
+        header.client_count = clients.Size();
+        header.server_offset = sizeof(Header);
+        header.clients_offset = header.server_offset + sizeof(ServerRecord);
+        header.strings_offset = header.clients_offset + clients.Size() * sizeof(ClientRecord);
+        header.strings_size = strings.strings.size();
+
+        std::string content;
+        content.reserve((size_t)(header.strings_offset + header.strings_size));
+        content.append(reinterpret_cast<const char*>(&header), sizeof(header));
+        content.append(reinterpret_cast<const char*>(&server_record), sizeof(server_record));
+        if (!client_records.empty()) content.append(reinterpret_cast<const char*>(client_records.data()), client_records.size() * sizeof(ClientRecord));
+        content += strings.strings;
+        WriteFileAtomically(path, content);
+    }
+
+    /// @brief Reads string from strings table
+    /// @param reference pointer to StringReference in mapped file
+    /// @return string value
+    std::string BinarySnapshot::GetString(const uint8_t* reference) const
+    {
+        StringReference string_reference;
+        std::memcpy(&string_reference, reference, sizeof(string_reference));
+        if ((size_t)string_reference.offset + string_reference.length > this->strings_size) throw WireguardException("Binary snapshot string is out of strings table");
+        return std::string(reinterpret_cast<const char*>(this->data + this->strings_offset + string_reference.offset), string_reference.length);
+    }
+}
@@ -0,0 +1,221 @@
+#include "client_configuration.hpp"
+#include "wireguard.hpp"
+#include "thread_pool.hpp"
+#include <sstream>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#define TAR_BLOCK_SIZE 512
+#define TAR_NAME_SIZE 100
+
+namespace timlibs
+{
+    namespace
+    {
+        /// @brief Writes wg-quick field if value is set
+        /// @param output output stream
+        /// @param name name of field, ex.: DNS
+        /// @param value value of field
+        void RenderField(std::ostream& output, const char* name, const std::string& value)
+        {
+            if (value != NULL_STRING) output << name << " = " << value << "\n";
+        }
+
+        /// @brief Writes number as zero-padded octal field of tar header
+        /// @param field field of header
+        /// @param size size of field with terminating null
+        /// @param value value
+        void WriteOctal(char* field, size_t size, uint64_t value)
+        {
+            field[size - 1] = '\0';
+            for (size_t index = size - 1; index > 0; index--)
+            {
+                field[index - 1] = (char)('0' + (value & 7));
+                value >>= 3;
+            }
+        }
+
+        /// @brief Writes whole buffer to file descriptor
+        /// @param fd file descriptor
+        /// @param data buffer
+        /// @param size size of buffer
+        /// @return true if everything was written
+        bool WriteAll(int fd, const char* data, size_t size)
+        {
+            while (size > 0)
+            {
+                ssize_t written = write(fd, data, size);
+                if (written < 0)
+                {
+                    if (errno == EINTR) continue;
+                    return false;
+                }
+                data += written;
+                size -= (size_t)written;
+            }
+            return true;
+        }
+    }
+
+    /// @brief Renders wg-quick configuration of client
+    /// @param server server configuration, it's the peer of client
+    /// @param client client configuration, PrivateKey is omitted if the client keeps its key
+    /// @param output output stream
+    void RenderClientConfiguration(const Server& server, const Client& client, std::ostream& output)
+    {
+        output << "[Interface]\n";
+        RenderField(output, "PrivateKey", client.private_key.ToString());
+        if (ToHostOrder(client.ip) != NULL_IP_DEC) output << "Address = " << client.ip.GetAsString() << "/32\n";
+        RenderField(output, "DNS", client.dns);
+
+        output << "\n[Peer]\n";
+        RenderField(output, "PublicKey", server.public_key);
+        if (client.allowed_ips != NULL_STRING) output << "AllowedIPs = " << client.allowed_ips << "\n";
+        else
+        {
+            uint32_t address = 0;
+            uint32_t prefix = 0;
+            if (ParseNetwork(server.network.GetAsString(), address, prefix) && address != NULL_IP_DEC) output << "AllowedIPs = " << server.network.GetAsString() << "\n"; // whole vpn network
+        }
+        std::string endpoint = (server.endpoint_dns != NULL_STRING) ? server.endpoint_dns
+            : (ToHostOrder(server.endpoint_ip) != NULL_IP_DEC) ? server.endpoint_ip.GetAsString() : NULL_STRING;
+        uint16_t port = (server.public_listen_port != 0) ? server.public_listen_port : server.listen_port;
+        if (endpoint != NULL_STRING && port != 0) output << "Endpoint = " << endpoint << ":" << port << "\n";
+    }
+
+    std::string RenderClientConfiguration(const Server& server, const Client& client)
+    {
+        std::ostringstream output;
+        RenderClientConfiguration(server, client, output);
+        return output.str();
+    }
+
+    /// @brief Builds base name of client files. Logins are unique, but characters other than [A-Za-z0-9._-] are replaced,
+    /// @brief so uuid is added to changed logins to keep names unique
+    /// @param client client configuration
+    /// @return name without extension
+    std::string GetClientBundleName(const Client& client)
+    {
+        std::string name = client.login.ToString().substr(0, CLIENT_BUNDLE_LOGIN_LENGTH_MAX);
+        bool changed = name.size() != client.login.size() || name.empty() || name[0] == '.';
+        for (char& character : name)
+        {
+            bool allowed = (character >= 'a' && character <= 'z') || (character >= 'A' && character <= 'Z') || (character >= '0' && character <= '9')
+                || character == '.' || character == '_' || character == '-';
+            if (allowed) continue;
+            character = '_';
+            changed = true;
+        }
+        if (!changed) return name;
+        return name.empty() ? client.uuid.ToString() : name + "_" + client.uuid;
+    }
+
+    /// @brief Renders files of client
+    /// @param server server configuration
+    /// @param client client configuration
+    /// @param settings formats and QR code parameters
+    /// @return files in order conf, png, svg
+    std::vector<ClientBundleFile> RenderClientBundle(const Server& server, const Client& client, const ClientBundleSettings& settings)
+    {
+        std::vector<ClientBundleFile> files;
+        std::string name = GetClientBundleName(client);
+        std::string configuration = RenderClientConfiguration(server, client);
+        if (settings.formats & (bundle_formats::PNG | bundle_formats::SVG))
+        {
+            QrCode code = QrCode::Encode(configuration, settings.error_correction);
+            if (settings.formats & bundle_formats::PNG) files.push_back({ name + ".png", code.ToPng(settings.png_scale, settings.border) });
+            if (settings.formats & bundle_formats::SVG) files.push_back({ name + ".svg", code.ToSvg(settings.border) });
+        }
+        if (settings.formats & bundle_formats::CONF) files.insert(files.begin(), { name + ".conf", std::move(configuration) });
+        return files;
+    }
+
+    /// @brief Renders files of every client of snapshot, clients are distributed over pool (QR codes take the most time)
+    /// @param snapshot configuration snapshot, it isn't changed while it's held
+    /// @param settings formats and QR code parameters
+    /// @param pool worker threads
+    /// @return files of clients in order of registry
+    std::vector<ClientBundleFile> RenderClientBundles(const ConfigurationSnapshot& snapshot, const ClientBundleSettings& settings, ThreadPool& pool)
+    {
+        const ClientRegistry& clients = snapshot.clients;
+        std::vector<std::vector<ClientBundleFile>> bundles(clients.Size());
+        pool.ParallelFor(clients.Size(), [&](size_t index) { bundles[index] = RenderClientBundle(snapshot.server, clients.At(index), settings); });
+
+        std::vector<ClientBundleFile> files;
+        size_t count = 0;
+        for (const std::vector<ClientBundleFile>& bundle : bundles) count += bundle.size();
+        files.reserve(count);
+        for (std::vector<ClientBundleFile>& bundle : bundles)
+        {
+            for (ClientBundleFile& file : bundle) files.push_back(std::move(file));
+        }
+        return files;
+    }
+
+    /// @brief Packs files into ustar archive, files have CLIENT_BUNDLE_FILE_MODE and the current time
+    /// @param files files with names up to 100 bytes
+    /// @return archive
+    std::string ArchiveClientBundles(const std::vector<ClientBundleFile>& files)
+    {
+        size_t size = TAR_BLOCK_SIZE * 2;
+        for (const ClientBundleFile& file : files) size += TAR_BLOCK_SIZE + (file.content.size() + TAR_BLOCK_SIZE - 1) / TAR_BLOCK_SIZE * TAR_BLOCK_SIZE;
+        std::string archive;
+        archive.reserve(size);
+        time_t now = time(nullptr);
+
+        for (const ClientBundleFile& file : files)
+        {
+            if (file.name.empty() || file.name.size() > TAR_NAME_SIZE) throw WireguardException("Invalid name of archived file: " + file.name);
+            char header[TAR_BLOCK_SIZE] = {};
+            memcpy(header, file.name.data(), file.name.size());
+            WriteOctal(header + 100, 8, CLIENT_BUNDLE_FILE_MODE);
+            WriteOctal(header + 108, 8, 0); // uid
+            WriteOctal(header + 116, 8, 0); // gid
+            WriteOctal(header + 124, 12, file.content.size());
+            WriteOctal(header + 136, 12, (uint64_t)now);
+            memset(header + 148, ' ', 8); // checksum is computed with spaces in its field
+            header[156] = '0'; // regular file
+            memcpy(header + 257, "ustar\0" "00", 8);
+
+            uint32_t checksum = 0;
+            for (char byte : header) checksum += (uint8_t)byte;
+            WriteOctal(header + 148, 7, checksum);
+
+            archive.append(header, TAR_BLOCK_SIZE);
+            archive += file.content;
+            archive.append((TAR_BLOCK_SIZE - file.content.size() % TAR_BLOCK_SIZE) % TAR_BLOCK_SIZE, '\0');
+        }
+        archive.append(TAR_BLOCK_SIZE * 2, '\0'); // end of archive
+        return archive;
+    }
+
+    /// @brief Writes files into directory in parallel. Files aren't synced: they are exports, which can be generated again
+    /// @param files files of bundles
+    /// @param directory output directory
+    /// @param pool worker threads
+    void WriteClientBundles(const std::vector<ClientBundleFile>& files, const std::string& directory, ThreadPool& pool)
+    {
+        if (mkdir(directory.c_str(), 0700) < 0 && errno != EEXIST) throw WireguardException("Unable to create " + directory + ": " + strerror(errno));
+        std::string prefix = (!directory.empty() && directory.back() != '/') ? directory + "/" : directory;
+        pool.ParallelFor(files.size(), [&files, &prefix](size_t index)
+        {
+            const ClientBundleFile& file = files[index];
+            if (file.name.empty() || file.name.find('/') != std::string::npos) throw WireguardException("Invalid name of bundle file: " + file.name);
+            std::string path = prefix + file.name;
+            int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, CLIENT_BUNDLE_FILE_MODE);
+            if (fd < 0) throw WireguardException("Unable to open " + path + ": " + strerror(errno));
+            bool written = WriteAll(fd, file.content.data(), file.content.size());
+            int error = errno;
+            if (close(fd) < 0 && written)
+            {
+                written = false;
+                error = errno;
+            }
+            if (!written) throw WireguardException("Unable to write " + path + ": " + strerror(error));
+        });
+    }
+}
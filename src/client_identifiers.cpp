@@ -0,0 +1,58 @@
+#include "client_identifiers.hpp"
+
+namespace timlibs
+{
+    namespace
+    {
+        int HexValue(char symbol)
+        {
+            if (symbol >= '0' && symbol <= '9') return symbol - '0';
+            if (symbol >= 'a' && symbol <= 'f') return symbol - 'a' + 10;
+            return -1;
+        }
+    }
+
+    /// @brief Converts canonical uuid (lowercase, 8-4-4-4-12) to 16 bytes
+    /// @param text uuid
+    /// @param bytes output 16 bytes
+    /// @return false if uuid isn't canonical, so it can't be restored from bytes exactly
+    bool UuidCodec::Parse(const std::string& text, uint8_t* bytes)
+    {
+        if (text.size() != UUID_TEXT_SIZE) return false;
+        size_t byte = 0;
+        for (size_t i = 0; i < UUID_TEXT_SIZE; i++)
+        {
+            if (i == 8 || i == 13 || i == 18 || i == 23)
+            {
+                if (text[i] != '-') return false;
+                continue;
+            }
+            int high = HexValue(text[i]);
+            int low = HexValue(text[++i]);
+            if (high < 0 || low < 0) return false;
+            bytes[byte++] = (uint8_t)(high << 4 | low);
+        }
+        return byte == UUID_SIZE;
+    }
+
+    /// @brief Converts 16 bytes to canonical uuid
+    /// @param bytes 16 bytes
+    /// @return lowercase uuid, ex.: 0f8fad5b-d9cb-469f-a165-70867728950e
+    std::string UuidCodec::Format(const uint8_t* bytes)
+    {
+        static const char digits[] = "0123456789abcdef";
+        std::string text;
+        text.reserve(UUID_TEXT_SIZE);
+        for (size_t i = 0; i < UUID_SIZE; i++)
+        {
+            if (i == 4 || i == 6 || i == 8 || i == 10) text.push_back('-');
+            text.push_back(digits[bytes[i] >> 4]);
+            text.push_back(digits[bytes[i] & 15]);
+        }
+        return text;
+    }
+
+    bool KeyCodec::Parse(const std::string& text, uint8_t* bytes) { return Base64DecodeCanonical(text, bytes, WG_KEY_SIZE); }
+
+    std::string KeyCodec::Format(const uint8_t* bytes) { return Base64Encode(bytes, WG_KEY_SIZE); }
+}
@@ -0,0 +1,139 @@
+#include "client_query.hpp"
+#include "wireguard.hpp"
+#include <algorithm>
+#include <numeric>
+
+namespace timlibs
+{
+    namespace
+    {
+        /// @brief Compares client with (login, uuid) key
+        /// @param client client configuration
+        /// @param login login of key
+        /// @param uuid UUID of key
+        /// @return negative, zero or positive as strcmp
+        int Compare(const Client& client, const std::string& login, const std::string& uuid)
+        {
+            int result = client.login.compare(login);
+            return (result != 0) ? result : client.uuid.ToString().compare(uuid);
+        }
+
+        /// @brief Compares clients by (login, uuid) without copies of texts, order is the same as Compare() with texts of right client
+        /// @param left client configuration
+        /// @param right client configuration
+        /// @return true if left client goes first
+        bool LoginLess(const Client& left, const Client& right)
+        {
+            int result = left.login.View().compare(right.login.View());
+            return (result != 0) ? result < 0 : left.uuid < right.uuid;
+        }
+
+        /// @brief Checks status against filter
+        /// @param filter status filter
+        /// @param status status of client
+        /// @return true if client passes filter
+        bool Match(StatusFilter filter, bool status)
+        {
+            return filter == StatusFilter::ANY || (filter == StatusFilter::ON) == status;
+        }
+    }
+
+    bool ClientCursor::Empty() const { return this->uuid.empty(); }
+
+    ClientPage::ClientPage(std::shared_ptr<const ConfigurationSnapshot> snapshot, std::vector<const Client*> items, ClientCursor next_cursor) :
+        snapshot{ std::move(snapshot) }, items{ std::move(items) }, next_cursor{ std::move(next_cursor) } {}
+
+    const std::vector<const Client*>& ClientPage::GetItems() const { return this->items; }
+
+    size_t ClientPage::Size() const { return this->items.size(); }
+
+    const Client& ClientPage::operator[](size_t index) const { return *this->items[index]; }
+
+    const ClientCursor& ClientPage::GetNextCursor() const { return this->next_cursor; }
+
+    uint64_t ClientPage::GetVersion() const { return this->snapshot->version; }
+
+    /// @brief Copies selected fields of client
+    /// @param client client configuration
+    /// @param fields bits of client_fields::FIELD
+    /// @return client with selected fields, other fields have default values
+    Client Project(const Client& client, uint32_t fields)
+    {
+        Client projection;
+        if (fields & client_fields::UUID) projection.uuid = client.uuid;
+        if (fields & client_fields::PRIVATE_KEY) projection.private_key = client.private_key;
+        if (fields & client_fields::PUBLIC_KEY) projection.public_key = client.public_key;
+        if (fields & client_fields::LOGIN) projection.login = client.login;
+        if (fields & client_fields::FULL_NAME) projection.full_name = client.full_name;
+        if (fields & client_fields::IP) projection.ip = client.ip;
+        if (fields & client_fields::ACCOUNT_STATUS) projection.account_status = client.account_status;
+        if (fields & client_fields::ADMINISTRATIVE_ACCOUNT_STATUS) projection.administrative_account_status = client.administrative_account_status;
+        if (fields & client_fields::CONNECTION_STATUS) projection.connection_status = client.connection_status;
+        if (fields & client_fields::CREATION_DATE) projection.creation_date = client.creation_date;
+        if (fields & client_fields::RELEASE_DATE) projection.release_date = client.release_date;
+        if (fields & client_fields::EXPIRATION_DATE) projection.expiration_date = client.expiration_date;
+        if (fields & client_fields::ALLOWED_IPS) projection.allowed_ips = client.allowed_ips;
+        if (fields & client_fields::DNS) projection.dns = client.dns;
+        return projection;
+    }
+
+    /// @brief Sorts positions of clients by login once per snapshot, snapshot is immutable so order never changes
+    /// @return positions of clients
+    const std::vector<size_t>& ConfigurationSnapshot::GetLoginOrder() const
+    {
+        std::call_once(this->login_order_flag, [this]()
+        {
+            this->login_order.resize(this->clients.Size());
+            std::iota(this->login_order.begin(), this->login_order.end(), 0);
+            std::sort(this->login_order.begin(), this->login_order.end(), [this](size_t left, size_t right)
+            {
+                return LoginLess(this->clients.At(left), this->clients.At(right));
+            });
+        });
+        return this->login_order;
+    }
+
+    /// @brief Finds clients of the last snapshot by filters. Clients are ordered by (login, uuid), so login prefix is a range of order
+    /// @param query filters, cursor and size of page
+    /// @return page of pointers to clients of snapshot and cursor of the next page
+    ClientPage Wireguard::QueryClients(const ClientQuery& query) const
+    {
+        std::shared_ptr<const ConfigurationSnapshot> snapshot = this->GetSnapshot();
+        const ClientRegistry& clients = snapshot->clients;
+        const ClientStateTable& states = clients.GetStates();
+        const std::vector<size_t>& order = snapshot->GetLoginOrder();
+        size_t limit = (query.limit != 0) ? query.limit : QUERY_LIMIT_DEFAULT;
+        int64_t expiration_from = ToUnixTime(query.expiration_from);
+        int64_t expiration_to = ToUnixTime(query.expiration_to);
+
+        std::vector<size_t>::const_iterator position = std::lower_bound(order.begin(), order.end(), query.login_prefix, [&clients](size_t index, const std::string& prefix)
+        {
+            return clients.At(index).login < prefix;
+        });
+        if (!query.after.Empty())
+        {
+            position = std::max(position, std::upper_bound(order.begin(), order.end(), query.after, [&clients](const ClientCursor& cursor, size_t index)
+            {
+                return Compare(clients.At(index), cursor.login, cursor.uuid) > 0;
+            }));
+        }
+
+        std::vector<const Client*> items;
+        ClientCursor next_cursor;
+        for (; position != order.end(); position++)
+        {
+            const Client& client = clients.At(*position);
+            if (client.login.compare(0, query.login_prefix.size(), query.login_prefix) != 0) break; // end of prefix range
+            if (!Match(query.account_status, states.GetAccountStatus(*position)) || !Match(query.connection_status, states.GetConnectionStatus(*position))) continue;
+            int64_t expiration_date = states.GetExpirationDate(*position);
+            if (expiration_date < expiration_from || expiration_date > expiration_to) continue;
+            if (items.size() == limit) // there is one more client, so the next page isn't empty
+            {
+                next_cursor = ClientCursor{ items.back()->login.ToString(), items.back()->uuid.ToString() };
+                break;
+            }
+            items.push_back(&client);
+        }
+        return ClientPage(std::move(snapshot), std::move(items), std::move(next_cursor));
+    }
+}
@@ -0,0 +1,268 @@
+#include "wireguard.hpp"
+
+namespace timlibs
+{
+    namespace
+    {
+        /// @brief Finds position in index
+        /// @param index one of indexes
+        /// @param value value of indexed field
+        /// @return position or NO_POSITION
+        template <typename Index, typename Value>
+        size_t FindPosition(const Index& index, const Value& value)
+        {
+            const size_t* found = index.Find(value);
+            return (found != nullptr) ? *found : NO_POSITION;
+        }
+    }
+
+    /// @brief Adds client to registry and indexes it
+    /// @param client client configuration as Client structure
+    void ClientRegistry::Insert(const Client& client)
+    {
+        if (client.uuid.empty()) throw WireguardException("Client UUID is empty");
+        if (this->by_uuid.Contains(client.uuid)) throw WireguardException("Client UUID \"" + client.uuid + "\" is already used");
+        if (!client.public_key.empty() && this->by_public_key.Contains(client.public_key)) throw WireguardException("Client public key \"" + client.public_key + "\" is already used");
+        if (!client.login.empty() && this->by_login.Contains(client.login.View())) throw WireguardException("Client login \"" + client.login + "\" is already used");
+        uint32_t ip = ToHostOrder(client.ip);
+        if (ip != NULL_IP_DEC && this->by_ip.Contains(ip)) throw WireguardException("Client ip " + client.ip.GetAsString() + " is already used");
+
+        this->clients.PushBack(client);
+        this->states.Append(client);
+        this->Link(this->clients.Size() - 1);
+        this->version++;
+    }
+
+    /// @brief Removes client from registry by it's UUID
+    /// @param uuid UUID of client
+    /// @return true if client was found and removed
+    bool ClientRegistry::Remove(const std::string& uuid) { return this->RemoveAt(this->GetPosition(uuid)); }
+
+    /// @brief Removes client from registry by it's UUID
+    /// @param uuid UUID of client
+    /// @return true if client was found and removed
+    bool ClientRegistry::Remove(const ClientUuid& uuid) { return this->RemoveAt(this->GetPosition(uuid)); }
+
+    /// @brief Removes client at position, the last client takes its position
+    /// @param position position of client or NO_POSITION
+    /// @return false for NO_POSITION
+    bool ClientRegistry::RemoveAt(size_t position)
+    {
+        if (position == NO_POSITION) return false;
+
+        size_t last = this->clients.Size() - 1;
+        this->Unlink(position);
+        if (position != last) // move last client to the free position, so the vector stays dense
+        {
+            this->Unlink(last);
+            Client& record = this->clients.Mutable(position);
+            record = std::move(this->clients.Mutable(last));
+            this->Link(position);
+        }
+        this->clients.PopBack();
+        this->states.Remove(position);
+        this->version++;
+        return true;
+    }
+
+    /// @brief Replaces client at position without move of other clients, account and connection statuses are kept
+    /// @param position position of client
+    /// @param client new configuration of client with the same UUID
+    void ClientRegistry::Update(size_t position, const Client& client)
+    {
+        const Client& old = this->clients[position];
+        if (client.uuid != old.uuid) throw WireguardException("Client UUID can't be changed");
+        size_t other = client.public_key.empty() ? NO_POSITION : FindPosition(this->by_public_key, client.public_key);
+        if (other != NO_POSITION && other != position) throw WireguardException("Client public key \"" + client.public_key + "\" is already used");
+        other = client.login.empty() ? NO_POSITION : FindPosition(this->by_login, client.login.View());
+        if (other != NO_POSITION && other != position) throw WireguardException("Client login \"" + client.login + "\" is already used");
+        uint32_t ip = ToHostOrder(client.ip);
+        other = ip == NULL_IP_DEC ? NO_POSITION : FindPosition(this->by_ip, ip);
+        if (other != NO_POSITION && other != position) throw WireguardException("Client ip " + client.ip.GetAsString() + " is already used");
+
+        Client& record = this->clients.Mutable(position);
+        bool account_status = record.account_status;
+        bool connection_status = record.connection_status;
+        this->Unlink(position);
+        record = client;
+        record.account_status = account_status; // statuses are set by controllers only
+        record.connection_status = connection_status;
+        this->Link(position);
+        this->states.Update(position, client);
+    }
+
+    /// @brief Removes all clients
+    void ClientRegistry::Clear()
+    {
+        this->clients.Clear();
+        this->by_uuid.Clear();
+        this->by_public_key.Clear();
+        this->by_login.Clear();
+        this->by_ip.Clear();
+        this->states.Clear();
+        this->version++;
+    }
+
+    /// @brief Reserves memory for clients and indexes
+    /// @param count expected count of clients
+    void ClientRegistry::Reserve(size_t count)
+    {
+        this->clients.Reserve(count);
+        this->by_uuid.Reserve(count);
+        this->by_public_key.Reserve(count);
+        this->by_login.Reserve(count);
+        this->by_ip.Reserve(count);
+        this->states.Reserve(count);
+    }
+
+    /// @brief Finds client by UUID
+    /// @param uuid UUID of client
+    /// @return pointer to client or nullptr
+    const Client* ClientRegistry::FindByUuid(const std::string& uuid) const
+    {
+        size_t position = this->GetPosition(uuid);
+        return (position != NO_POSITION) ? &this->clients[position] : nullptr;
+    }
+
+    /// @brief Finds client by UUID without conversion to text
+    /// @param uuid UUID of client
+    /// @return pointer to client or nullptr
+    const Client* ClientRegistry::FindByUuid(const ClientUuid& uuid) const
+    {
+        size_t position = this->GetPosition(uuid);
+        return (position != NO_POSITION) ? &this->clients[position] : nullptr;
+    }
+
+    /// @brief Finds client by public key
+    /// @param public_key client public key
+    /// @return pointer to client or nullptr
+    const Client* ClientRegistry::FindByPublicKey(const std::string& public_key) const
+    {
+        size_t position = this->GetPositionByPublicKey(public_key);
+        return (position != NO_POSITION) ? &this->clients[position] : nullptr;
+    }
+
+    /// @brief Finds client by public key
+    /// @param public_key client public key (raw bytes are compared, text isn't formatted)
+    /// @return pointer to client or nullptr
+    const Client* ClientRegistry::FindByPublicKey(const WireguardKey& public_key) const
+    {
+        size_t position = public_key.empty() ? NO_POSITION : FindPosition(this->by_public_key, public_key);
+        return (position != NO_POSITION) ? &this->clients[position] : nullptr;
+    }
+
+    const Client* ClientRegistry::FindByPublicKey(const char* public_key) const { return this->FindByPublicKey(std::string(public_key)); }
+
+    /// @brief Finds client by login
+    /// @param login client login
+    /// @return pointer to client or nullptr
+    const Client* ClientRegistry::FindByLogin(const std::string& login) const
+    {
+        size_t position = login.empty() ? NO_POSITION : FindPosition(this->by_login, std::string_view(login));
+        return (position != NO_POSITION) ? &this->clients[position] : nullptr;
+    }
+
+    /// @brief Finds client by login
+    /// @param login client login
+    /// @return pointer to client or nullptr
+    const Client* ClientRegistry::FindByLogin(const PooledString& login) const
+    {
+        size_t position = login.empty() ? NO_POSITION : FindPosition(this->by_login, login.View());
+        return (position != NO_POSITION) ? &this->clients[position] : nullptr;
+    }
+
+    const Client* ClientRegistry::FindByLogin(const char* login) const { return this->FindByLogin(std::string(login)); }
+
+    /// @brief Finds client by vpn ip address
+    /// @param ip client vpn ip address
+    /// @return pointer to client or nullptr
+    const Client* ClientRegistry::FindByIp(const IPv4& ip) const
+    {
+        uint32_t address = ToHostOrder(ip);
+        size_t position = address == NULL_IP_DEC ? NO_POSITION : FindPosition(this->by_ip, address);
+        return (position != NO_POSITION) ? &this->clients[position] : nullptr;
+    }
+
+    /// @brief Finds position of client by UUID
+    /// @param uuid UUID of client (text is parsed, not copied)
+    /// @return position in registry and state table or NO_POSITION
+    size_t ClientRegistry::GetPosition(const std::string& uuid) const
+    {
+        ClientUuid key;
+        if (uuid.empty() || !ClientUuid::Lookup(uuid, key)) return NO_POSITION;
+        return FindPosition(this->by_uuid, key);
+    }
+
+    /// @brief Finds position of client by UUID
+    /// @param uuid UUID of client
+    /// @return position in registry and state table or NO_POSITION
+    size_t ClientRegistry::GetPosition(const ClientUuid& uuid) const { return FindPosition(this->by_uuid, uuid); }
+
+    /// @brief Finds position of client by public key, ex. for peers of dump
+    /// @param public_key client public key (base64)
+    /// @return position in registry and state table or NO_POSITION
+    size_t ClientRegistry::GetPositionByPublicKey(const std::string& public_key) const
+    {
+        WireguardKey key;
+        if (public_key.empty() || !WireguardKey::Lookup(public_key, key)) return NO_POSITION;
+        return FindPosition(this->by_public_key, key);
+    }
+
+    const Client& ClientRegistry::At(size_t position) const { return this->clients[position]; }
+
+    /// @brief Sets account status of client in record and state table
+    /// @param position position of client
+    /// @param status account status
+    void ClientRegistry::SetAccountStatus(size_t position, bool status)
+    {
+        if (this->clients[position].account_status != status) this->clients.Mutable(position).account_status = status;
+        this->states.SetAccountStatus(position, status);
+    }
+
+    /// @brief Sets connection status of client in record and state table
+    /// @param position position of client
+    /// @param status connection status
+    void ClientRegistry::SetConnectionStatus(size_t position, bool status)
+    {
+        if (this->clients[position].connection_status != status) this->clients.Mutable(position).connection_status = status;
+        this->states.SetConnectionStatus(position, status);
+    }
+
+    const ClientStateTable& ClientRegistry::GetStates() const { return this->states; }
+
+    size_t ClientRegistry::Size() const { return this->clients.Size(); }
+
+    bool ClientRegistry::Empty() const { return this->clients.Empty(); }
+
+    uint64_t ClientRegistry::GetVersion() const { return this->version; }
+
+    void ClientRegistry::Touch() { this->version++; }
+
+    ClientRegistry::const_iterator ClientRegistry::begin() const { return this->clients.begin(); }
+
+    ClientRegistry::const_iterator ClientRegistry::end() const { return this->clients.end(); }
+
+    /// @brief Adds indexed fields of client at position to indexes
+    /// @param position position of client in vector
+    void ClientRegistry::Link(size_t position)
+    {
+        const Client& client = this->clients[position];
+        this->by_uuid.Set(client.uuid, position);
+        if (!client.public_key.empty()) this->by_public_key.Set(client.public_key, position);
+        if (!client.login.empty()) this->by_login.Set(client.login.View(), position);
+        uint32_t ip = ToHostOrder(client.ip);
+        if (ip != NULL_IP_DEC) this->by_ip.Set(ip, position);
+    }
+
+    /// @brief Removes indexed fields of client at position from indexes
+    /// @param position position of client in vector
+    void ClientRegistry::Unlink(size_t position)
+    {
+        const Client& client = this->clients[position];
+        this->by_uuid.Erase(client.uuid);
+        if (!client.public_key.empty()) this->by_public_key.Erase(client.public_key);
+        if (!client.login.empty()) this->by_login.Erase(client.login.View());
+        uint32_t ip = ToHostOrder(client.ip);
+        if (ip != NULL_IP_DEC) this->by_ip.Erase(ip);
+    }
+}
@@ -0,0 +1,185 @@
+#include "client_state_table.hpp"
+#include "wireguard.hpp"
+#include <algorithm>
+
+namespace timlibs
+{
+    namespace
+    {
+        template <typename Bits>
+        bool GetBit(const Bits& bits, size_t position) { return bits[position / 64] >> (position % 64) & 1; }
+
+        template <typename Bits>
+        void SetBit(Bits& bits, size_t position, bool value)
+        {
+            uint64_t mask = (uint64_t)1 << (position % 64);
+            if (GetBit(bits, position) == value) return; // shared page isn't copied for nothing
+            if (value) bits.Mutable(position / 64) |= mask;
+            else bits.Mutable(position / 64) &= ~mask;
+        }
+
+        /// @brief Adds positions of set bits of word to list
+        /// @param word bits of 64 positions
+        /// @param first position of the lowest bit
+        /// @param positions output list
+        void CollectBits(uint64_t word, size_t first, std::vector<size_t>& positions)
+        {
+            while (word)
+            {
+                positions.push_back(first + __builtin_ctzll(word));
+                word &= word - 1;
+            }
+        }
+    }
+
+    /// @brief Adds hot fields of client as the last position
+    /// @param client client configuration as Client structure
+    void ClientStateTable::Append(const Client& client)
+    {
+        size_t position = this->release_dates.Size();
+        if (position % 64 == 0)
+        {
+            this->account_bits.PushBack(0);
+            this->administrative_bits.PushBack(0);
+            this->connection_bits.PushBack(0);
+        }
+        SetBit(this->account_bits, position, client.account_status);
+        SetBit(this->administrative_bits, position, client.administrative_account_status);
+        SetBit(this->connection_bits, position, client.connection_status);
+        this->release_dates.PushBack(ToUnixTime(client.release_date));
+        this->expiration_dates.PushBack(ToUnixTime(client.expiration_date));
+    }
+
+    /// @brief Replaces fields of client which are set by user, fields set by controllers are kept
+    /// @param position position of client
+    /// @param client new configuration of client
+    void ClientStateTable::Update(size_t position, const Client& client)
+    {
+        SetBit(this->administrative_bits, position, client.administrative_account_status);
+        this->release_dates.Mutable(position) = ToUnixTime(client.release_date);
+        this->expiration_dates.Mutable(position) = ToUnixTime(client.expiration_date);
+    }
+
+    /// @brief Removes client at position, the last client takes its position
+    /// @param position position of client
+    void ClientStateTable::Remove(size_t position)
+    {
+        size_t last = this->release_dates.Size() - 1;
+        if (position != last)
+        {
+            SetBit(this->account_bits, position, GetBit(this->account_bits, last));
+            SetBit(this->administrative_bits, position, GetBit(this->administrative_bits, last));
+            SetBit(this->connection_bits, position, GetBit(this->connection_bits, last));
+            this->release_dates.Mutable(position) = this->release_dates[last];
+            this->expiration_dates.Mutable(position) = this->expiration_dates[last];
+        }
+
+        // bits after the last position are always zero, sweeps rely on it
+        SetBit(this->account_bits, last, false);
+        SetBit(this->administrative_bits, last, false);
+        SetBit(this->connection_bits, last, false);
+        if (last % 64 == 0)
+        {
+            this->account_bits.PopBack();
+            this->administrative_bits.PopBack();
+            this->connection_bits.PopBack();
+        }
+        this->release_dates.PopBack();
+        this->expiration_dates.PopBack();
+    }
+
+    /// @brief Removes all clients
+    void ClientStateTable::Clear()
+    {
+        this->account_bits.Clear();
+        this->administrative_bits.Clear();
+        this->connection_bits.Clear();
+        this->release_dates.Clear();
+        this->expiration_dates.Clear();
+    }
+
+    /// @brief Reserves memory for clients
+    /// @param count expected count of clients
+    void ClientStateTable::Reserve(size_t count)
+    {
+        size_t words = (count + 63) / 64;
+        this->account_bits.Reserve(words);
+        this->administrative_bits.Reserve(words);
+        this->connection_bits.Reserve(words);
+        this->release_dates.Reserve(count);
+        this->expiration_dates.Reserve(count);
+    }
+
+    size_t ClientStateTable::Size() const { return this->release_dates.Size(); }
+
+    bool ClientStateTable::GetAccountStatus(size_t position) const { return GetBit(this->account_bits, position); }
+
+    void ClientStateTable::SetAccountStatus(size_t position, bool status) { SetBit(this->account_bits, position, status); }
+
+    bool ClientStateTable::GetConnectionStatus(size_t position) const { return GetBit(this->connection_bits, position); }
+
+    void ClientStateTable::SetConnectionStatus(size_t position, bool status) { SetBit(this->connection_bits, position, status); }
+
+    int64_t ClientStateTable::GetExpirationDate(size_t position) const { return this->expiration_dates[position]; }
+
+    /// @brief Finds clients whose account status must change: active iff administrative status is on and release <= now <= expiration.
+    /// @brief Dates are compared 64 clients per word without branches, so the inner loop is vectorized by compiler
+    /// @brief (64 positions of word are always in one page)
+    /// @param now current unix time
+    /// @param changed output list of positions
+    void ClientStateTable::SweepDates(int64_t now, std::vector<size_t>& changed) const
+    {
+        size_t count = this->release_dates.Size();
+        for (size_t word = 0; word < this->account_bits.Size(); word++)
+        {
+            size_t first = word * 64;
+            size_t lanes = std::min<size_t>(64, count - first);
+            const int64_t* release_dates = &this->release_dates[first];
+            const int64_t* expiration_dates = &this->expiration_dates[first];
+            uint64_t in_dates = 0;
+            for (size_t lane = 0; lane < lanes; lane++)
+            {
+                in_dates |= (uint64_t)((release_dates[lane] <= now) & (now <= expiration_dates[lane])) << lane;
+            }
+            uint64_t active = this->administrative_bits[word] & in_dates;
+            CollectBits(active ^ this->account_bits[word], first, changed);
+        }
+    }
+
+    /// @brief Finds clients whose connection status must change: clients of connected peers are connected, all others are disconnected.
+    /// @brief Connected positions become a bitset, which is compared with statuses word by word
+    /// @param connected positions of clients whose peers are connected
+    /// @param changed output list of positions
+    void ClientStateTable::SweepConnections(const std::vector<size_t>& connected, std::vector<size_t>& changed) const
+    {
+        std::vector<uint64_t> connected_bits(this->connection_bits.Size(), 0);
+        for (size_t position : connected) connected_bits[position / 64] |= (uint64_t)1 << (position % 64);
+        for (size_t word = 0; word < this->connection_bits.Size(); word++)
+        {
+            CollectBits(connected_bits[word] ^ this->connection_bits[word], word * 64, changed);
+        }
+    }
+
+    /// @brief Gets moment when account status of client may change next time
+    /// @param position position of client
+    /// @param now current unix time
+    /// @return unix time or NEVER (administrative status is off or expiration date has passed)
+    int64_t ClientStateTable::GetNextMoment(size_t position, int64_t now) const
+    {
+        if (!GetBit(this->administrative_bits, position)) return NEVER; // only administrator can turn account on
+        int64_t release_date = this->release_dates[position];
+        int64_t expiration_date = this->expiration_dates[position];
+        if (now < release_date) return release_date;
+        if (now <= expiration_date && expiration_date != NEVER) return expiration_date + 1;
+        return NEVER;
+    }
+
+    /// @brief Evaluates account status of one client, as SweepDates() does for all clients
+    /// @param position position of client
+    /// @param now current unix time
+    /// @return true if administrative status is on and release <= now <= expiration
+    bool ClientStateTable::GetDueAccountStatus(size_t position, int64_t now) const
+    {
+        return GetBit(this->administrative_bits, position) && this->release_dates[position] <= now && now <= this->expiration_dates[position];
+    }
+}
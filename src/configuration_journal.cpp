@@ -0,0 +1,197 @@
+#include "configuration_journal.hpp"
+#include "wireguard.hpp"
+#include <fstream>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+namespace timlibs
+{
+    namespace
+    {
+        /// @brief Writes whole buffer to file descriptor
+        /// @param fd file descriptor
+        /// @param data buffer
+        /// @param size size of buffer
+        /// @return true if everything was written
+        bool WriteAll(int fd, const char* data, size_t size)
+        {
+            while (size > 0)
+            {
+                ssize_t written = write(fd, data, size);
+                if (written < 0)
+                {
+                    if (errno == EINTR) continue;
+                    return false;
+                }
+                data += written;
+                size -= (size_t)written;
+            }
+            return true;
+        }
+
+        /// @brief Syncs directory of file, so rename of file is durable
+        /// @param path path of file in directory
+        void SyncDirectory(const std::string& path)
+        {
+            size_t slash = path.find_last_of('/');
+            std::string directory = (slash == std::string::npos) ? "." : path.substr(0, slash + 1);
+            int fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (fd < 0) return;
+            fsync(fd);
+            close(fd);
+        }
+
+        /// @brief Renames written temporary file to path, temporary file is removed on error
+        /// @param temporary_path path of synced temporary file
+        /// @param path path of file
+        void ReplaceFile(const std::string& temporary_path, const std::string& path)
+        {
+            if (rename(temporary_path.c_str(), path.c_str()) < 0)
+            {
+                std::string error = strerror(errno);
+                unlink(temporary_path.c_str());
+                throw WireguardException("Unable to replace " + path + ": " + error);
+            }
+            SyncDirectory(path);
+        }
+    }
+
+    /// @brief Initialize journal
+    /// @param path path of journal file, ex. /etc/wireguard/wg0.journal
+    ConfigurationJournal::ConfigurationJournal(const std::string& path) : path{ path }
+    {
+        struct stat status;
+        if (stat(this->path.c_str(), &status) == 0) this->size = (size_t)status.st_size;
+    }
+
+    ConfigurationJournal::~ConfigurationJournal()
+    {
+        if (this->fd >= 0) close(this->fd);
+    }
+
+    /// @brief Appends records to journal durably
+    /// @param records JSON objects of changes
+    void ConfigurationJournal::Append(const std::vector<nlohmann::json>& records)
+    {
+        if (records.empty()) return;
+        this->Open();
+
+        std::string lines;
+        for (const nlohmann::json& record : records)
+        {
+            lines += record.dump();
+            lines += '\n';
+        }
+        if (!WriteAll(this->fd, lines.data(), lines.size()) || fdatasync(this->fd) < 0) throw WireguardException("Unable to write journal " + this->path + ": " + strerror(errno));
+        this->size += lines.size();
+    }
+
+    /// @brief Reads records of journal
+    /// @return JSON objects of changes in order of appending
+    std::vector<nlohmann::json> ConfigurationJournal::Read() const
+    {
+        std::vector<nlohmann::json> records;
+        std::ifstream file(this->path);
+        if (!file.is_open()) return records;
+
+        std::string line;
+        while (std::getline(file, line))
+        {
+            if (line.empty()) continue;
+            nlohmann::json record = nlohmann::json::parse(line, nullptr, false);
+            if (record.is_discarded() || !record.is_object()) break; // crash in the middle of write, records after it can't be trusted
+            records.push_back(std::move(record));
+        }
+        return records;
+    }
+
+    /// @brief Empties journal
+    void ConfigurationJournal::Reset()
+    {
+        this->Open();
+        if (ftruncate(this->fd, 0) < 0 || fsync(this->fd) < 0) throw WireguardException("Unable to reset journal " + this->path + ": " + strerror(errno));
+        this->size = 0;
+    }
+
+    size_t ConfigurationJournal::GetSize() const { return this->size; }
+
+    /// @brief Opens journal file for appending, if it isn't opened yet
+    void ConfigurationJournal::Open()
+    {
+        if (this->fd >= 0) return;
+        this->fd = open(this->path.c_str(), O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+        if (this->fd < 0) throw WireguardException("Unable access to " + this->path + ": " + strerror(errno));
+
+        // cut torn last record, otherwise the next record would be glued to it
+        off_t end = lseek(this->fd, 0, SEEK_END);
+        off_t valid = end;
+        char symbol = '\n';
+        while (valid > 0 && pread(this->fd, &symbol, 1, valid - 1) == 1 && symbol != '\n') valid--;
+        if (valid != end && ftruncate(this->fd, valid) < 0) throw WireguardException("Unable to repair journal " + this->path + ": " + strerror(errno));
+        this->size = (size_t)valid;
+    }
+
+    /// @brief Replaces file content so that readers see either old or new content, even after crash
+    /// @param path path of file
+    /// @param content new content
+    void WriteFileAtomically(const std::string& path, const std::string& content)
+    {
+        std::string temporary_path = path + ".tmp";
+        int fd = open(temporary_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        if (fd < 0) throw WireguardException("Unable access to " + temporary_path + ": " + strerror(errno));
+        if (!WriteAll(fd, content.data(), content.size()) || fsync(fd) < 0)
+        {
+            std::string error = strerror(errno);
+            close(fd);
+            unlink(temporary_path.c_str());
+            throw WireguardException("Unable to write " + temporary_path + ": " + error);
+        }
+        close(fd);
+        ReplaceFile(temporary_path, path);
+    }
+
+    /// @brief Creates temporary file next to file, it's readable only by owner because it may contain private keys
+    /// @param path path of file
+    AtomicFileWriter::AtomicFileWriter(const std::string& path) : path{ path }, temporary_path{ path + ".tmp" }, buffer(ATOMIC_FILE_BUFFER_SIZE)
+    {
+        int fd = open(this->temporary_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        if (fd < 0) throw WireguardException("Unable access to " + this->temporary_path + ": " + strerror(errno));
+        close(fd);
+        this->stream.rdbuf()->pubsetbuf(this->buffer.data(), this->buffer.size());
+        this->stream.open(this->temporary_path, std::ios::binary | std::ios::trunc);
+        if (!this->stream.is_open())
+        {
+            unlink(this->temporary_path.c_str());
+            throw WireguardException("Unable access to " + this->temporary_path);
+        }
+    }
+
+    AtomicFileWriter::~AtomicFileWriter()
+    {
+        if (this->committed) return;
+        this->stream.close();
+        unlink(this->temporary_path.c_str());
+    }
+
+    std::ostream& AtomicFileWriter::GetStream() { return this->stream; }
+
+    /// @brief Flushes stream, syncs temporary file and replaces file by it
+    void AtomicFileWriter::Commit()
+    {
+        this->stream.flush();
+        bool written = this->stream.good();
+        this->stream.close();
+        int fd = written ? open(this->temporary_path.c_str(), O_RDONLY | O_CLOEXEC) : -1;
+        if (fd < 0 || fsync(fd) < 0)
+        {
+            if (fd >= 0) close(fd);
+            throw WireguardException("Unable to write " + this->temporary_path);
+        }
+        close(fd);
+        ReplaceFile(this->temporary_path, this->path);
+        this->committed = true;
+    }
+}
@@ -0,0 +1,408 @@
+#include "configuration_loader.hpp"
+#include "configuration_keys.hpp"
+#include "uuid.hpp"
+
+#define UNKNOWN_KEY std::numeric_limits<uint32_t>::max()
+
+namespace timlibs
+{
+    namespace
+    {
+        enum class Section
+        {
+            NONE, // before root object
+            ROOT,
+            SERVER,
+            CLIENTS,
+            CLIENT,
+            DONE // after root object
+        };
+
+        enum class Expected
+        {
+            STRING,
+            STRING_OR_NULL,
+            UNSIGNED,
+            BOOLEAN,
+            BOOLEAN_OR_NULL
+        };
+
+        enum class Type
+        {
+            NUL,
+            BOOLEAN,
+            UNSIGNED,
+            STRING,
+            OTHER // negative or float number, binary
+        };
+
+        struct Value
+        {
+            Type type{ Type::NUL };
+            bool boolean{ false };
+            uint64_t number{ 0 };
+            std::string* text{ nullptr };
+        };
+
+        /// @brief Gets type which field of configuration must have
+        /// @param key KEY of server or clients section
+        /// @return expected type
+        Expected GetExpected(uint32_t key)
+        {
+            switch (key)
+            {
+            case server::KEY::LISTEN_PORT:
+            case server::KEY::PUBLIC_LISTEN_PORT:
+                return Expected::UNSIGNED;
+            case server::KEY::ENDPOINT_DNS:
+            case server::KEY::ENDPOINT_IP:
+            case clients::KEY::RELEASE_DATE:
+            case clients::KEY::EXPIRATION_DATE:
+            case clients::KEY::DNS:
+                return Expected::STRING_OR_NULL;
+            case clients::KEY::ACCOUNT_STATUS:
+            case clients::KEY::ADMINISTRATIVE_ACCOUNT_STATUS:
+                return Expected::BOOLEAN;
+            case clients::KEY::CONNECTION_STATUS:
+                return Expected::BOOLEAN_OR_NULL;
+            default:
+                return Expected::STRING;
+            }
+        }
+
+        /// @brief Checks that value has the type expected for field
+        /// @param expected expected type
+        /// @param type type of value
+        /// @return true if value is acceptable
+        bool IsAcceptable(Expected expected, Type type)
+        {
+            switch (expected)
+            {
+            case Expected::STRING: return type == Type::STRING;
+            case Expected::STRING_OR_NULL: return type == Type::STRING || type == Type::NUL;
+            case Expected::UNSIGNED: return type == Type::UNSIGNED;
+            case Expected::BOOLEAN: return type == Type::BOOLEAN;
+            case Expected::BOOLEAN_OR_NULL: return type == Type::BOOLEAN || type == Type::NUL;
+            }
+            return false;
+        }
+
+        /// @brief Builds error of field type
+        /// @param key KEY of field
+        /// @param section KEY of section of field
+        /// @return exception with the same text as the old DOM validation
+        WireguardException TypeError(uint32_t key, uint32_t section)
+        {
+            std::string type;
+            switch (GetExpected(key))
+            {
+            case Expected::STRING: type = "string"; break;
+            case Expected::STRING_OR_NULL: type = "string or null"; break;
+            case Expected::UNSIGNED: type = "unsigned integer"; break;
+            case Expected::BOOLEAN: type = "boolean"; break;
+            case Expected::BOOLEAN_OR_NULL: type = "boolean or null"; break;
+            }
+            return WireguardException(std::string("Field \"") + keys.at(key) + "\" of section \"" + keys.at(section) + "\" must be " + type + " type");
+        }
+
+        /// @brief Finds KEY by name of field, names are unique only inside section
+        /// @param first first KEY of section
+        /// @param last LAST KEY of section
+        /// @param name name of field
+        /// @return KEY or UNKNOWN_KEY
+        uint32_t FindKey(uint32_t first, uint32_t last, const std::string& name)
+        {
+            for (uint32_t key = first; key < last; key++)
+            {
+                if (keys.at(key) == name) return key;
+            }
+            return UNKNOWN_KEY;
+        }
+
+        /// @brief Bit of KEY in mask of present fields
+        uint64_t Bit(uint32_t key) { return (uint64_t)1 << key; }
+
+        // Builds server and clients from sax events, every field is checked when it arrives
+        class ConfigurationHandler : public nlohmann::json_sax<nlohmann::json>
+        {
+        public:
+            ConfigurationHandler(Server& server, const std::function<void(Client& client)>& on_client) : server{ server }, on_client{ on_client } {}
+
+            bool null() override { return this->OnValue(Value{ Type::NUL }); }
+            bool boolean(bool value) override { return this->OnValue(Value{ Type::BOOLEAN, value }); }
+            bool number_integer(number_integer_t) override { return this->OnValue(Value{ Type::OTHER }); } // only negative numbers get here
+            bool number_unsigned(number_unsigned_t value) override { return this->OnValue(Value{ Type::UNSIGNED, false, value }); }
+            bool number_float(number_float_t, const string_t&) override { return this->OnValue(Value{ Type::OTHER }); }
+            bool string(string_t& value) override { return this->OnValue(Value{ Type::STRING, false, 0, &value }); }
+            bool binary(binary_t&) override { return this->OnValue(Value{ Type::OTHER }); }
+
+            bool key(string_t& name) override
+            {
+                if (this->skip_depth) return true;
+                switch (this->section)
+                {
+                case Section::ROOT: this->field = FindKey(general::KEY::FIRST, general::KEY::LAST, name); break;
+                case Section::SERVER: this->field = FindKey(server::KEY::FIRST, server::KEY::LAST, name); break;
+                case Section::CLIENT: this->field = FindKey(clients::KEY::FIRST, clients::KEY::LAST, name); break;
+                default: this->field = UNKNOWN_KEY; break;
+                }
+                if (this->field != UNKNOWN_KEY)
+                {
+                    if (this->section == Section::ROOT) this->root_present |= Bit(this->field);
+                    else this->present |= Bit(this->field);
+                }
+                return true;
+            }
+
+            bool start_object(std::size_t) override
+            {
+                if (this->skip_depth)
+                {
+                    this->skip_depth++;
+                    return true;
+                }
+                switch (this->section)
+                {
+                case Section::NONE:
+                    this->section = Section::ROOT;
+                    break;
+                case Section::ROOT:
+                    if (this->field == general::KEY::SERVER)
+                    {
+                        this->section = Section::SERVER;
+                        this->present = 0;
+                        this->endpoint_dns_is_null = false;
+                        this->endpoint_ip_is_null = false;
+                    }
+                    else if (this->field == general::KEY::CLIENTS) throw WireguardException(std::string("Section \"") + keys.at(general::KEY::CLIENTS) + "\" must be array type");
+                    else this->skip_depth = 1;
+                    break;
+                case Section::CLIENTS:
+                    this->section = Section::CLIENT;
+                    this->present = 0;
+                    this->client = Client();
+                    break;
+                default:
+                    this->OnContainer();
+                    break;
+                }
+                return true;
+            }
+
+            bool end_object() override
+            {
+                if (this->skip_depth)
+                {
+                    this->skip_depth--;
+                    return true;
+                }
+                switch (this->section)
+                {
+                case Section::SERVER:
+                    this->CheckPresent(server::KEY::FIRST, server::KEY::LAST, general::KEY::SERVER);
+                    if (this->endpoint_dns_is_null && this->endpoint_ip_is_null) throw WireguardException(std::string("One of the fields, \"") + keys.at(server::KEY::ENDPOINT_DNS) + "\" or \"" + keys.at(server::KEY::ENDPOINT_IP) + "\", of section \"" + keys.at(general::KEY::SERVER) + "\" must be string type");
+                    this->section = Section::ROOT;
+                    break;
+                case Section::CLIENT:
+                    this->present |= Bit(clients::KEY::DNS); // optional field
+                    this->CheckPresent(clients::KEY::FIRST, clients::KEY::LAST, general::KEY::CLIENTS);
+                    this->on_client(this->client);
+                    this->section = Section::CLIENTS;
+                    break;
+                case Section::ROOT:
+                    for (uint32_t key = general::KEY::FIRST; key < general::KEY::LAST; key++)
+                    {
+                        if (!(this->root_present & Bit(key))) throw WireguardException(std::string("No section in configuration file: \"") + keys.at(key) + '"');
+                    }
+                    this->section = Section::DONE;
+                    break;
+                default:
+                    break;
+                }
+                return true;
+            }
+
+            bool start_array(std::size_t) override
+            {
+                if (this->skip_depth)
+                {
+                    this->skip_depth++;
+                    return true;
+                }
+                switch (this->section)
+                {
+                case Section::NONE:
+                    throw WireguardException(std::string("No section in configuration file: \"") + keys.at(general::KEY::SERVER) + '"');
+                case Section::ROOT:
+                    if (this->field == general::KEY::CLIENTS) this->section = Section::CLIENTS;
+                    else if (this->field == general::KEY::SERVER) throw WireguardException(std::string("Section \"") + keys.at(general::KEY::SERVER) + "\" must be object type");
+                    else this->skip_depth = 1;
+                    break;
+                case Section::CLIENTS:
+                    throw WireguardException(std::string("Element of section \"") + keys.at(general::KEY::CLIENTS) + "\" must be object type");
+                default:
+                    this->OnContainer();
+                    break;
+                }
+                return true;
+            }
+
+            bool end_array() override
+            {
+                if (this->skip_depth) this->skip_depth--;
+                else if (this->section == Section::CLIENTS) this->section = Section::ROOT;
+                return true;
+            }
+
+            bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception&) override
+            {
+                throw WireguardException("json::parse_error");
+            }
+        private:
+            /// @brief Checks scalar value and writes it to server or client
+            /// @param value scalar value
+            /// @return true to continue parsing
+            bool OnValue(const Value& value)
+            {
+                if (this->skip_depth) return true;
+                switch (this->section)
+                {
+                case Section::NONE:
+                    throw WireguardException(std::string("No section in configuration file: \"") + keys.at(general::KEY::SERVER) + '"');
+                case Section::ROOT:
+                    if (this->field == general::KEY::SERVER) throw WireguardException(std::string("Section \"") + keys.at(general::KEY::SERVER) + "\" must be object type");
+                    if (this->field == general::KEY::CLIENTS) throw WireguardException(std::string("Section \"") + keys.at(general::KEY::CLIENTS) + "\" must be array type");
+                    break;
+                case Section::CLIENTS:
+                    throw WireguardException(std::string("Element of section \"") + keys.at(general::KEY::CLIENTS) + "\" must be object type");
+                case Section::SERVER:
+                    if (this->field == UNKNOWN_KEY) break;
+                    if (!IsAcceptable(GetExpected(this->field), value.type)) throw TypeError(this->field, general::KEY::SERVER);
+                    this->SetServerField(value);
+                    break;
+                case Section::CLIENT:
+                    if (this->field == UNKNOWN_KEY) break;
+                    if (!IsAcceptable(GetExpected(this->field), value.type)) throw TypeError(this->field, general::KEY::CLIENTS);
+                    this->SetClientField(value);
+                    break;
+                default:
+                    break;
+                }
+                return true;
+            }
+
+            /// @brief Object or array as value of field in server or client
+            void OnContainer()
+            {
+                if (this->field == UNKNOWN_KEY) this->skip_depth = 1;
+                else throw TypeError(this->field, (this->section == Section::SERVER) ? general::KEY::SERVER : general::KEY::CLIENTS);
+            }
+
+            /// @brief Checks that all fields of object were present
+            /// @param first first KEY of section
+            /// @param last LAST KEY of section
+            /// @param section KEY of section
+            void CheckPresent(uint32_t first, uint32_t last, uint32_t section) const
+            {
+                for (uint32_t key = first; key < last; key++)
+                {
+                    if (!(this->present & Bit(key))) throw WireguardException(std::string("No section \"") + keys.at(key) + "\" of section \"" + keys.at(section) + "\" in configuration file");
+                }
+            }
+
+            /// @brief Writes checked value to field of server
+            /// @param value value of type expected for field
+            void SetServerField(const Value& value)
+            {
+                try
+                {
+                    switch (this->field)
+                    {
+                    case server::KEY::INTERFACE_NAME: this->server.interface_name = std::move(*value.text); break;
+                    case server::KEY::LISTEN_PORT: this->server.listen_port = (uint16_t)value.number; break;
+                    case server::KEY::IP: this->server.ip = IPv4(*value.text); break;
+                    case server::KEY::NETWORK: this->server.network = IPv4Mask(*value.text); break;
+                    case server::KEY::ENDPOINT_DNS:
+                        this->endpoint_dns_is_null = value.type == Type::NUL;
+                        if (!this->endpoint_dns_is_null) this->server.endpoint_dns = std::move(*value.text);
+                        break;
+                    case server::KEY::ENDPOINT_IP:
+                        this->endpoint_ip_is_null = value.type == Type::NUL;
+                        if (!this->endpoint_ip_is_null) this->server.endpoint_ip = IPv4(*value.text);
+                        break;
+                    case server::KEY::PUBLIC_LISTEN_PORT: this->server.public_listen_port = (uint16_t)value.number; break;
+                    case server::KEY::PRIVATE_KEY: this->server.private_key = std::move(*value.text); break;
+                    case server::KEY::PUBLIC_KEY: this->server.public_key = std::move(*value.text); break;
+                    case server::KEY::PRE_UP: this->server.pre_up = std::move(*value.text); break;
+                    case server::KEY::POST_UP: this->server.post_up = std::move(*value.text); break;
+                    case server::KEY::PRE_DOWN: this->server.pre_down = std::move(*value.text); break;
+                    case server::KEY::POST_DOWN: this->server.post_down = std::move(*value.text); break;
+                    default: break;
+                    }
+                }
+                catch (const ExceptionIPv4& error)
+                {
+                    throw WireguardException("Server IPv4 Error: " + error.what());
+                }
+            }
+
+            /// @brief Writes checked value to field of client, statuses are evaluated again after load
+            /// @param value value of type expected for field
+            void SetClientField(const Value& value)
+            {
+                switch (this->field)
+                {
+                case clients::KEY::UUID:
+                    if (!is_correct(*value.text)) throw WireguardException("UUID for client isn't correct");
+                    this->client.uuid = std::move(*value.text);
+                    break;
+                case clients::KEY::PRIVATE_KEY: this->client.private_key = std::move(*value.text); break;
+                case clients::KEY::PUBLIC_KEY: this->client.public_key = std::move(*value.text); break;
+                case clients::KEY::LOGIN: this->client.login = std::move(*value.text); break;
+                case clients::KEY::FULL_NAME: this->client.full_name = std::move(*value.text); break;
+                case clients::KEY::IP:
+                    try
+                    {
+                        this->client.ip = IPv4(*value.text);
+                    }
+                    catch (const ExceptionIPv4& error)
+                    {
+                        throw WireguardException("Client IPv4 Error: " + error.what());
+                    }
+                    break;
+                case clients::KEY::ADMINISTRATIVE_ACCOUNT_STATUS: this->client.administrative_account_status = value.boolean; break;
+                case clients::KEY::CREATION_DATE:
+                    if (!Time::IsValid(*value.text)) throw WireguardException("Client creation date isn't valid");
+                    this->client.creation_date = Time(*value.text);
+                    break;
+                case clients::KEY::RELEASE_DATE: this->client.release_date = (value.type == Type::STRING) ? Time(*value.text) : MIN_TIME; break;
+                case clients::KEY::EXPIRATION_DATE: this->client.expiration_date = (value.type == Type::STRING) ? Time(*value.text) : MAX_TIME; break;
+                case clients::KEY::ALLOWED_IPS: this->client.allowed_ips = std::move(*value.text); break;
+                case clients::KEY::DNS: this->client.dns = (value.type == Type::STRING) ? std::move(*value.text) : NULL_STRING; break;
+                default: break; // account and connection statuses
+                }
+            }
+
+            Server& server;
+            const std::function<void(Client& client)>& on_client;
+            Section section{ Section::NONE };
+            uint32_t field{ UNKNOWN_KEY }; // KEY of the last key event
+            size_t skip_depth{ 0 }; // depth inside value of unknown field
+            uint64_t root_present{ 0 }; // bits of sections present in root
+            uint64_t present{ 0 }; // bits of fields present in current server or client object
+            bool endpoint_dns_is_null{ false };
+            bool endpoint_ip_is_null{ false };
+            Client client; // client which is being read
+        };
+    }
+
+    /// @brief Reads json configuration in one pass without building json object
+    /// @param input stream of json configuration
+    /// @param server server which fields are overwritten
+    /// @param on_client called for every checked client, client may be moved from
+    void LoadJsonConfiguration(std::istream& input, Server& server, const std::function<void(Client& client)>& on_client)
+    {
+        ConfigurationHandler handler(server, on_client);
+        nlohmann::json::sax_parse(input, &handler);
+    }
+}
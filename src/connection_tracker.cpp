@@ -0,0 +1,217 @@
+#include "connection_tracker.hpp"
+#include <algorithm>
+
+namespace timlibs
+{
+    namespace
+    {
+        /// @brief Classifies peer by age of its latest handshake
+        /// @param latest_handshake unix time of handshake (0 if there was no handshake)
+        /// @param now time of dump
+        /// @param thresholds maximal ages of states
+        /// @return state of peer
+        ConnectionState Classify(time_t latest_handshake, time_t now, const ConnectionThresholds& thresholds)
+        {
+            if (latest_handshake == 0) return ConnectionState::DISCONNECTED;
+            int64_t age = (int64_t)now - (int64_t)latest_handshake;
+            if (age < thresholds.connected.count()) return ConnectionState::CONNECTED;
+            if (age < thresholds.idle.count()) return ConnectionState::IDLE;
+            if (age < thresholds.stale.count()) return ConnectionState::STALE;
+            return ConnectionState::DISCONNECTED;
+        }
+    }
+
+    /// @brief Gets name of state, ex. for logs and event sinks
+    /// @param state connection state
+    /// @return connected, idle, stale or disconnected
+    const char* ToString(ConnectionState state)
+    {
+        switch (state)
+        {
+        case ConnectionState::CONNECTED: return "connected";
+        case ConnectionState::IDLE: return "idle";
+        case ConnectionState::STALE: return "stale";
+        default: return "disconnected";
+        }
+    }
+
+    /// @brief Creates tracker without peers
+    /// @param history_size closed sessions kept in memory
+    ConnectionTracker::ConnectionTracker(size_t history_size) : sessions(std::max<size_t>(history_size, 1)) {}
+
+    void ConnectionTracker::SetThresholds(const ConnectionThresholds& thresholds)
+    {
+        std::lock_guard<std::mutex> lock(this->tracker_mutex);
+        this->thresholds = thresholds;
+    }
+
+    ConnectionThresholds ConnectionTracker::GetThresholds() const
+    {
+        std::lock_guard<std::mutex> lock(this->tracker_mutex);
+        return this->thresholds;
+    }
+
+    /// @brief Moves every peer of dump to state of its handshake age, peers that are absent in dump are disconnected and forgotten.
+    /// @brief Subscribers get transitions after the whole dump is processed
+    /// @param peers full dump of interface
+    /// @param now time of dump
+    /// @param thresholds own thresholds of peers in order of dump, nullptr - thresholds of tracker (empty vector - for all peers)
+    /// @param states output state of every peer of dump
+    void ConnectionTracker::Process(const std::vector<PeerInfo>& peers, time_t now, const std::vector<const ConnectionThresholds*>& thresholds, std::vector<ConnectionState>& states)
+    {
+        std::vector<ConnectionEvent> events;
+        std::vector<ConnectionHandler> handlers;
+        {
+            std::lock_guard<std::mutex> lock(this->tracker_mutex);
+            this->generation++;
+            states.resize(peers.size());
+            for (size_t index = 0; index < peers.size(); index++)
+            {
+                const PeerInfo& info = peers[index];
+                const ConnectionThresholds* own = index < thresholds.size() ? thresholds[index] : nullptr;
+                ConnectionState state = Classify(info.latest_handshake, now, own != nullptr ? *own : this->thresholds);
+                auto found = this->peers.find(info.public_key);
+                if (found == this->peers.end())
+                {
+                    found = this->peers.emplace(info.public_key, Peer()).first;
+                    this->counts[(size_t)ConnectionState::DISCONNECTED]++;
+                }
+                Peer& peer = found->second;
+                peer.generation = this->generation;
+                if (peer.state == ConnectionState::DISCONNECTED && state != ConnectionState::DISCONNECTED)
+                {
+                    peer.session = ConnectionSession{ 0, info.public_key, info.latest_handshake, info.latest_handshake, 0, 0, 0 };
+                    peer.rx_base = info.rx_bytes;
+                    peer.tx_base = info.tx_bytes;
+                }
+                if (state != ConnectionState::DISCONNECTED || peer.state != ConnectionState::DISCONNECTED)
+                {
+                    if (info.rx_bytes < peer.rx_base || info.tx_bytes < peer.tx_base) // peer was added to interface again, counters are reset
+                    {
+                        peer.rx_base = 0;
+                        peer.tx_base = 0;
+                    }
+                    peer.session.latest_handshake = std::max(peer.session.latest_handshake, info.latest_handshake);
+                    peer.session.rx_bytes = std::max(peer.session.rx_bytes, info.rx_bytes - peer.rx_base);
+                    peer.session.tx_bytes = std::max(peer.session.tx_bytes, info.tx_bytes - peer.tx_base);
+                }
+                if (state != peer.state) this->Transit(peer, info.public_key, state, now, events);
+                states[index] = state;
+            }
+
+            for (auto peer = this->peers.begin(); peer != this->peers.end();)
+            {
+                if (peer->second.generation == this->generation)
+                {
+                    peer++;
+                    continue;
+                }
+                if (peer->second.state != ConnectionState::DISCONNECTED) this->Transit(peer->second, peer->first, ConnectionState::DISCONNECTED, now, events);
+                this->counts[(size_t)ConnectionState::DISCONNECTED]--;
+                peer = this->peers.erase(peer);
+            }
+
+            if (events.empty()) return;
+            handlers.reserve(this->handlers.size());
+            for (const auto& handler : this->handlers) handlers.push_back(handler.second);
+        }
+        for (const ConnectionEvent& event : events)
+        {
+            for (const ConnectionHandler& handler : handlers) handler(event);
+        }
+    }
+
+    /// @brief Gets state of peer
+    /// @param public_key peer public key
+    /// @return state of the last dump (DISCONNECTED if peer is unknown)
+    ConnectionState ConnectionTracker::GetState(const std::string& public_key) const
+    {
+        std::lock_guard<std::mutex> lock(this->tracker_mutex);
+        auto found = this->peers.find(public_key);
+        return found != this->peers.end() ? found->second.state : ConnectionState::DISCONNECTED;
+    }
+
+    /// @brief Counts peers of the last dump in state
+    /// @param state connection state
+    /// @return count of peers
+    size_t ConnectionTracker::GetCount(ConnectionState state) const
+    {
+        std::lock_guard<std::mutex> lock(this->tracker_mutex);
+        return this->counts[(size_t)state];
+    }
+
+    /// @brief Gets sessions of peer, ex. for usage accounting
+    /// @param public_key peer public key
+    /// @return closed sessions that are still in ring and open session (ended is 0), oldest first
+    std::vector<ConnectionSession> ConnectionTracker::GetSessions(const std::string& public_key) const
+    {
+        std::lock_guard<std::mutex> lock(this->tracker_mutex);
+        std::vector<ConnectionSession> sessions;
+        uint64_t first = this->session_sequence > this->sessions.size() ? this->session_sequence - this->sessions.size() + 1 : 1;
+        for (uint64_t sequence = first; sequence <= this->session_sequence; sequence++)
+        {
+            const ConnectionSession& session = this->sessions[(sequence - 1) % this->sessions.size()];
+            if (session.public_key == public_key) sessions.push_back(session);
+        }
+        auto found = this->peers.find(public_key);
+        if (found != this->peers.end() && found->second.state != ConnectionState::DISCONNECTED) sessions.push_back(found->second.session);
+        return sessions;
+    }
+
+    /// @brief Gets closed sessions of all peers
+    /// @param after_sequence the last sequence that caller has already seen
+    /// @return sessions that are still in ring, oldest first
+    std::vector<ConnectionSession> ConnectionTracker::GetClosedSessions(uint64_t after_sequence) const
+    {
+        std::lock_guard<std::mutex> lock(this->tracker_mutex);
+        std::vector<ConnectionSession> sessions;
+        uint64_t first = this->session_sequence > this->sessions.size() ? this->session_sequence - this->sessions.size() + 1 : 1;
+        for (uint64_t sequence = std::max(first, after_sequence + 1); sequence <= this->session_sequence; sequence++)
+        {
+            sessions.push_back(this->sessions[(sequence - 1) % this->sessions.size()]);
+        }
+        return sessions;
+    }
+
+    /// @brief Adds handler of transitions
+    /// @param handler handler, it's called by thread of Process
+    /// @return id of subscription
+    uint64_t ConnectionTracker::Subscribe(ConnectionHandler handler)
+    {
+        std::lock_guard<std::mutex> lock(this->tracker_mutex);
+        this->handlers.emplace(++this->subscription_sequence, std::move(handler));
+        return this->subscription_sequence;
+    }
+
+    void ConnectionTracker::Unsubscribe(uint64_t subscription)
+    {
+        std::lock_guard<std::mutex> lock(this->tracker_mutex);
+        this->handlers.erase(subscription);
+    }
+
+    /// @brief Changes state of peer, session is closed when peer is disconnected
+    /// @param peer tracked peer
+    /// @param public_key peer public key
+    /// @param state new state
+    /// @param now time of dump
+    /// @param events output list of transitions
+    void ConnectionTracker::Transit(Peer& peer, const std::string& public_key, ConnectionState state, time_t now, std::vector<ConnectionEvent>& events)
+    {
+        events.push_back(ConnectionEvent{ ++this->event_sequence, now, public_key, peer.state, state, peer.session.latest_handshake });
+        this->counts[(size_t)peer.state]--;
+        this->counts[(size_t)state]++;
+        peer.state = state;
+        if (state != ConnectionState::DISCONNECTED) return;
+        peer.session.ended = now;
+        this->CloseSession(peer);
+    }
+
+    /// @brief Moves session of peer to ring of closed sessions
+    /// @param peer tracked peer
+    void ConnectionTracker::CloseSession(Peer& peer)
+    {
+        peer.session.sequence = ++this->session_sequence;
+        this->sessions[(peer.session.sequence - 1) % this->sessions.size()] = std::move(peer.session);
+        peer.session = ConnectionSession();
+    }
+}
@@ -0,0 +1,337 @@
+#include "curve25519.hpp"
+#include "wireguard.hpp"
+#include "thread_pool.hpp"
+#include <cstring>
+#include <cerrno>
+#include <sys/random.h>
+
+#define LIMB_MASK 0x7FFFFFFFFFFFFull // 2^51 - 1
+#define A24 121665 // (486662 - 2) / 4
+#define KEY_PAIR_BATCH 256 // keys per task of parallel generation
+
+namespace timlibs
+{
+    namespace
+    {
+        typedef unsigned __int128 uint128_t;
+
+        // Element of GF(2^255 - 19) in radix 2^51: value = l[0] + l[1] * 2^51 + ... + l[4] * 2^204,
+        // limbs may exceed 51 bits between operations, they are reduced by multiplication and ToBytes
+        struct FieldElement
+        {
+            uint64_t l[5];
+        };
+
+        uint64_t Load64(const uint8_t* data)
+        {
+            uint64_t value = 0;
+            for (int index = 7; index >= 0; index--) value = value << 8 | data[index];
+            return value;
+        }
+
+        void Store64(uint8_t* data, uint64_t value)
+        {
+            for (int index = 0; index < 8; index++, value >>= 8) data[index] = (uint8_t)value;
+        }
+
+        /// @brief Unpacks little-endian number, the top bit is ignored (RFC 7748)
+        FieldElement FromBytes(const uint8_t bytes[WG_KEY_SIZE])
+        {
+            return { {
+                Load64(bytes) & LIMB_MASK,
+                (Load64(bytes + 6) >> 3) & LIMB_MASK,
+                (Load64(bytes + 12) >> 6) & LIMB_MASK,
+                (Load64(bytes + 19) >> 1) & LIMB_MASK,
+                (Load64(bytes + 24) >> 12) & LIMB_MASK
+            } };
+        }
+
+        /// @brief Propagates carries, so every limb is below 2^51 (the top carry is multiplied by 19, as 2^255 = 19)
+        void Carry(FieldElement& h)
+        {
+            for (int index = 0; index < 4; index++)
+            {
+                h.l[index + 1] += h.l[index] >> 51;
+                h.l[index] &= LIMB_MASK;
+            }
+            h.l[0] += 19 * (h.l[4] >> 51);
+            h.l[4] &= LIMB_MASK;
+        }
+
+        /// @brief Packs fully reduced value (0 <= value < p) as little-endian number
+        void ToBytes(uint8_t bytes[WG_KEY_SIZE], FieldElement h)
+        {
+            Carry(h);
+            Carry(h); // value < 2^255, but it may be >= p
+            h.l[0] += 19; // value + 19 >= 2^255 only if value >= p
+            Carry(h);
+            h.l[0] += LIMB_MASK + 1 - 19; // + 2^255 - 19, so the top carry is dropped instead of wrapping
+            for (int index = 1; index < 5; index++) h.l[index] += LIMB_MASK;
+            for (int index = 0; index < 4; index++)
+            {
+                h.l[index + 1] += h.l[index] >> 51;
+                h.l[index] &= LIMB_MASK;
+            }
+            h.l[4] &= LIMB_MASK;
+
+            Store64(bytes, h.l[0] | h.l[1] << 51);
+            Store64(bytes + 8, h.l[1] >> 13 | h.l[2] << 38);
+            Store64(bytes + 16, h.l[2] >> 26 | h.l[3] << 25);
+            Store64(bytes + 24, h.l[3] >> 39 | h.l[4] << 12);
+        }
+
+        FieldElement Add(const FieldElement& a, const FieldElement& b)
+        {
+            return { { a.l[0] + b.l[0], a.l[1] + b.l[1], a.l[2] + b.l[2], a.l[3] + b.l[3], a.l[4] + b.l[4] } };
+        }
+
+        /// @brief Subtracts with 8p added, so limbs don't underflow for reduced b
+        FieldElement Subtract(const FieldElement& a, const FieldElement& b)
+        {
+            const uint64_t low = 0x3FFFFFFFFFFF68ull; // 8 * (2^51 - 19)
+            const uint64_t high = 0x3FFFFFFFFFFFF8ull; // 8 * (2^51 - 1)
+            return { { a.l[0] + low - b.l[0], a.l[1] + high - b.l[1], a.l[2] + high - b.l[2], a.l[3] + high - b.l[3], a.l[4] + high - b.l[4] } };
+        }
+
+        /// @brief Reduces 128-bit products into limbs below 2^51 (+ small carry in the second one)
+        FieldElement Reduce(uint128_t r0, uint128_t r1, uint128_t r2, uint128_t r3, uint128_t r4)
+        {
+            FieldElement h;
+            r1 += (uint64_t)(r0 >> 51);
+            h.l[0] = (uint64_t)r0 & LIMB_MASK;
+            r2 += (uint64_t)(r1 >> 51);
+            h.l[1] = (uint64_t)r1 & LIMB_MASK;
+            r3 += (uint64_t)(r2 >> 51);
+            h.l[2] = (uint64_t)r2 & LIMB_MASK;
+            r4 += (uint64_t)(r3 >> 51);
+            h.l[3] = (uint64_t)r3 & LIMB_MASK;
+            h.l[4] = (uint64_t)r4 & LIMB_MASK;
+            uint128_t low = (uint128_t)(uint64_t)(r4 >> 51) * 19 + h.l[0]; // carry of subtracted inputs (< 2^55) may reach 2^64 after * 19
+            h.l[0] = (uint64_t)low & LIMB_MASK;
+            h.l[1] += (uint64_t)(low >> 51);
+            return h;
+        }
+
+        FieldElement Multiply(const FieldElement& a, const FieldElement& b)
+        {
+            const uint64_t* x = a.l;
+            const uint64_t* y = b.l;
+            uint64_t y1 = y[1] * 19, y2 = y[2] * 19, y3 = y[3] * 19, y4 = y[4] * 19; // terms above 2^255 wrap with factor 19
+            uint128_t r0 = (uint128_t)x[0] * y[0] + (uint128_t)x[1] * y4 + (uint128_t)x[2] * y3 + (uint128_t)x[3] * y2 + (uint128_t)x[4] * y1;
+            uint128_t r1 = (uint128_t)x[0] * y[1] + (uint128_t)x[1] * y[0] + (uint128_t)x[2] * y4 + (uint128_t)x[3] * y3 + (uint128_t)x[4] * y2;
+            uint128_t r2 = (uint128_t)x[0] * y[2] + (uint128_t)x[1] * y[1] + (uint128_t)x[2] * y[0] + (uint128_t)x[3] * y4 + (uint128_t)x[4] * y3;
+            uint128_t r3 = (uint128_t)x[0] * y[3] + (uint128_t)x[1] * y[2] + (uint128_t)x[2] * y[1] + (uint128_t)x[3] * y[0] + (uint128_t)x[4] * y4;
+            uint128_t r4 = (uint128_t)x[0] * y[4] + (uint128_t)x[1] * y[3] + (uint128_t)x[2] * y[2] + (uint128_t)x[3] * y[1] + (uint128_t)x[4] * y[0];
+            return Reduce(r0, r1, r2, r3, r4);
+        }
+
+        FieldElement Square(const FieldElement& a)
+        {
+            const uint64_t* x = a.l;
+            uint64_t d0 = x[0] * 2, d1 = x[1] * 2, d2 = x[2] * 2 * 19, d4 = x[4] * 19, d419 = d4 * 2;
+            uint128_t r0 = (uint128_t)x[0] * x[0] + (uint128_t)d419 * x[1] + (uint128_t)d2 * x[3];
+            uint128_t r1 = (uint128_t)d0 * x[1] + (uint128_t)d419 * x[2] + (uint128_t)(x[3] * 19) * x[3];
+            uint128_t r2 = (uint128_t)d0 * x[2] + (uint128_t)x[1] * x[1] + (uint128_t)d419 * x[3];
+            uint128_t r3 = (uint128_t)d0 * x[3] + (uint128_t)d1 * x[2] + (uint128_t)d4 * x[4];
+            uint128_t r4 = (uint128_t)d0 * x[4] + (uint128_t)d1 * x[3] + (uint128_t)x[2] * x[2];
+            return Reduce(r0, r1, r2, r3, r4);
+        }
+
+        FieldElement Square(FieldElement a, int times)
+        {
+            for (int index = 0; index < times; index++) a = Square(a);
+            return a;
+        }
+
+        FieldElement MultiplyA24(const FieldElement& a)
+        {
+            return Reduce((uint128_t)a.l[0] * A24, (uint128_t)a.l[1] * A24, (uint128_t)a.l[2] * A24, (uint128_t)a.l[3] * A24, (uint128_t)a.l[4] * A24);
+        }
+
+        /// @brief Computes z^(p - 2) = 1 / z by chain of 254 squares and 11 multiplications
+        FieldElement Invert(const FieldElement& z)
+        {
+            FieldElement z2 = Square(z);
+            FieldElement z9 = Multiply(Square(z2, 2), z);
+            FieldElement z11 = Multiply(z9, z2);
+            FieldElement z2_5_0 = Multiply(Square(z11), z9); // z^(2^5 - 1)
+            FieldElement z2_10_0 = Multiply(Square(z2_5_0, 5), z2_5_0);
+            FieldElement z2_20_0 = Multiply(Square(z2_10_0, 10), z2_10_0);
+            FieldElement z2_40_0 = Multiply(Square(z2_20_0, 20), z2_20_0);
+            FieldElement z2_50_0 = Multiply(Square(z2_40_0, 10), z2_10_0);
+            FieldElement z2_100_0 = Multiply(Square(z2_50_0, 50), z2_50_0);
+            FieldElement z2_200_0 = Multiply(Square(z2_100_0, 100), z2_100_0);
+            FieldElement z2_250_0 = Multiply(Square(z2_200_0, 50), z2_50_0);
+            return Multiply(Square(z2_250_0, 5), z11); // z^(2^255 - 21)
+        }
+
+        /// @brief Swaps a and b if swap is 1, without branches
+        void ConditionalSwap(FieldElement& a, FieldElement& b, uint64_t swap)
+        {
+            uint64_t mask = 0 - swap;
+            for (int index = 0; index < 5; index++)
+            {
+                uint64_t difference = (a.l[index] ^ b.l[index]) & mask;
+                a.l[index] ^= difference;
+                b.l[index] ^= difference;
+            }
+        }
+
+        /// @brief Fills keys from random private keys
+        /// @param pairs output, the same size as count of keys in random
+        /// @param random WG_KEY_SIZE random bytes per key
+        /// @param begin the first key
+        /// @param end key after the last one
+        void FillKeyPairs(std::vector<KeyPair>& pairs, uint8_t* random, size_t begin, size_t end)
+        {
+            for (size_t index = begin; index < end; index++)
+            {
+                uint8_t* private_key = random + index * WG_KEY_SIZE;
+                uint8_t public_key[WG_KEY_SIZE];
+                ClampPrivateKey(private_key);
+                X25519Base(public_key, private_key);
+                pairs[index].private_key = Base64Encode(private_key, WG_KEY_SIZE);
+                pairs[index].public_key = Base64Encode(public_key, WG_KEY_SIZE);
+            }
+        }
+    }
+
+    /// @brief Multiplies point by scalar with Montgomery ladder, time doesn't depend on values
+    /// @param output u-coordinate of result
+    /// @param scalar scalar, it's clamped as private key
+    /// @param point u-coordinate of point
+    void X25519(uint8_t output[WG_KEY_SIZE], const uint8_t scalar[WG_KEY_SIZE], const uint8_t point[WG_KEY_SIZE])
+    {
+        uint8_t key[WG_KEY_SIZE];
+        memcpy(key, scalar, WG_KEY_SIZE);
+        ClampPrivateKey(key);
+
+        FieldElement x1 = FromBytes(point);
+        FieldElement x2 = { { 1, 0, 0, 0, 0 } };
+        FieldElement z2 = { { 0, 0, 0, 0, 0 } };
+        FieldElement x3 = x1;
+        FieldElement z3 = { { 1, 0, 0, 0, 0 } };
+        uint64_t swap = 0;
+        for (int bit = 254; bit >= 0; bit--)
+        {
+            uint64_t current = (key[bit >> 3] >> (bit & 7)) & 1;
+            swap ^= current;
+            ConditionalSwap(x2, x3, swap);
+            ConditionalSwap(z2, z3, swap);
+            swap = current;
+
+            FieldElement a = Add(x2, z2);
+            FieldElement aa = Square(a);
+            FieldElement b = Subtract(x2, z2);
+            FieldElement bb = Square(b);
+            FieldElement e = Subtract(aa, bb);
+            FieldElement c = Add(x3, z3);
+            FieldElement d = Subtract(x3, z3);
+            FieldElement da = Multiply(d, a);
+            FieldElement cb = Multiply(c, b);
+            x3 = Square(Add(da, cb));
+            z3 = Multiply(x1, Square(Subtract(da, cb)));
+            x2 = Multiply(aa, bb);
+            z2 = Multiply(e, Add(aa, MultiplyA24(e)));
+        }
+        ConditionalSwap(x2, x3, swap);
+        ConditionalSwap(z2, z3, swap);
+        ToBytes(output, Multiply(x2, Invert(z2)));
+        memset(key, 0, sizeof(key));
+    }
+
+    /// @brief Derives public key
+    /// @param public_key output public key
+    /// @param private_key private key
+    void X25519Base(uint8_t public_key[WG_KEY_SIZE], const uint8_t private_key[WG_KEY_SIZE])
+    {
+        static const uint8_t base_point[WG_KEY_SIZE] = { 9 };
+        X25519(public_key, private_key, base_point);
+    }
+
+    /// @brief Clears 3 low bits and the top bit, sets bit 254, as "wg genkey" does
+    /// @param private_key key
+    void ClampPrivateKey(uint8_t private_key[WG_KEY_SIZE])
+    {
+        private_key[0] &= 248;
+        private_key[31] &= 127;
+        private_key[31] |= 64;
+    }
+
+    /// @brief Reads random bytes from kernel CSPRNG
+    /// @param data output buffer
+    /// @param size count of bytes
+    void GenerateRandomBytes(uint8_t* data, size_t size)
+    {
+        while (size > 0)
+        {
+            ssize_t read = getrandom(data, size, 0);
+            if (read < 0)
+            {
+                if (errno == EINTR) continue;
+                throw WireguardException(std::string("Unable to get random bytes: ") + strerror(errno));
+            }
+            data += read;
+            size -= (size_t)read;
+        }
+    }
+
+    KeyPair GenerateKeyPair()
+    {
+        return GenerateKeyPairs(1).front();
+    }
+
+    /// @brief Generates keys in the calling thread
+    /// @param count count of keys
+    /// @return keys in base64
+    std::vector<KeyPair> GenerateKeyPairs(size_t count)
+    {
+        std::vector<KeyPair> pairs(count);
+        std::vector<uint8_t> random(count * WG_KEY_SIZE);
+        GenerateRandomBytes(random.data(), random.size());
+        FillKeyPairs(pairs, random.data(), 0, count);
+        memset(random.data(), 0, random.size());
+        return pairs;
+    }
+
+    /// @brief Generates keys on pool, keys are split into batches of KEY_PAIR_BATCH
+    /// @param count count of keys
+    /// @param pool worker threads
+    /// @return keys in base64
+    std::vector<KeyPair> GenerateKeyPairs(size_t count, ThreadPool& pool)
+    {
+        std::vector<KeyPair> pairs(count);
+        std::vector<uint8_t> random(count * WG_KEY_SIZE);
+        GenerateRandomBytes(random.data(), random.size());
+        pool.ParallelFor((count + KEY_PAIR_BATCH - 1) / KEY_PAIR_BATCH, [&pairs, &random, count](size_t batch)
+        {
+            FillKeyPairs(pairs, random.data(), batch * KEY_PAIR_BATCH, std::min(count, (batch + 1) * KEY_PAIR_BATCH));
+        });
+        memset(random.data(), 0, random.size());
+        return pairs;
+    }
+
+    /// @brief Derives public key from private key, as "wg pubkey"
+    /// @param private_key private key in base64
+    /// @return public key in base64
+    std::string DerivePublicKey(const std::string& private_key)
+    {
+        uint8_t key[WG_KEY_SIZE];
+        if (!Base64Decode(private_key, key, WG_KEY_SIZE)) throw WireguardException("Invalid private key");
+        uint8_t public_key[WG_KEY_SIZE];
+        X25519Base(public_key, key);
+        memset(key, 0, sizeof(key));
+        return Base64Encode(public_key, WG_KEY_SIZE);
+    }
+
+    /// @brief Generates preshared key, it's random 32 bytes without clamping
+    /// @return key in base64
+    std::string GeneratePresharedKey()
+    {
+        uint8_t key[WG_KEY_SIZE];
+        GenerateRandomBytes(key, WG_KEY_SIZE);
+        std::string text = Base64Encode(key, WG_KEY_SIZE);
+        memset(key, 0, sizeof(key));
+        return text;
+    }
+}
@@ -0,0 +1,349 @@
+#include "event_bus.hpp"
+#include "wireguard.hpp"
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define NDJSON_RECONNECT_INTERVAL std::chrono::seconds(1) // events are dropped without connect attempts while socket is down
+#define NDJSON_SEND_TIMEOUT std::chrono::milliseconds(100) // dispatcher waits so long for consumer of socket which doesn't read
+#define EVENT_BLOCK_WAIT std::chrono::milliseconds(1) // blocked publisher rechecks queue at least so often
+
+namespace timlibs
+{
+    namespace
+    {
+        /// @brief Writes whole buffer to file
+        /// @param fd descriptor
+        /// @param data buffer
+        /// @return false if descriptor is broken
+        bool WriteAll(int fd, const std::string& data)
+        {
+            size_t written = 0;
+            while (written < data.size())
+            {
+                ssize_t result = write(fd, data.data() + written, data.size() - written);
+                if (result < 0 && errno == EINTR) continue;
+                if (result <= 0) return false;
+                written += result;
+            }
+            return true;
+        }
+
+        /// @brief Sends buffer to non-blocking socket until deadline, send() without SIGPIPE is used
+        /// @param fd descriptor
+        /// @param data buffer
+        /// @param deadline when waiting for free space of socket ends
+        /// @param expired output: deadline has passed before whole buffer was sent
+        /// @return sent bytes, less than size of buffer if socket is broken or deadline has passed
+        size_t SendUntil(int fd, const std::string& data, std::chrono::steady_clock::time_point deadline, bool& expired)
+        {
+            size_t sent = 0;
+            expired = false;
+            while (sent < data.size())
+            {
+                ssize_t result = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+                if (result > 0)
+                {
+                    sent += result;
+                    continue;
+                }
+                if (result < 0 && errno == EINTR) continue;
+                if (result == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) return sent;
+
+                int timeout = (int)std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+                pollfd output{ fd, POLLOUT, 0 };
+                if (timeout <= 0 || poll(&output, 1, timeout) == 0)
+                {
+                    expired = true;
+                    return sent;
+                }
+            }
+            return sent;
+        }
+
+        // Destination of NDJSON subscription, it's owned by handler and closed with the last copy of handler
+        class NdjsonSink
+        {
+        public:
+            NdjsonSink(const std::string& path, NdjsonTarget target) : path(path), target(target)
+            {
+                if (target == NdjsonTarget::FILE)
+                {
+                    this->fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0640);
+                    if (this->fd < 0) throw WireguardException("Cannot open event file " + path + ": " + strerror(errno));
+                }
+                else if (path.empty() || path.size() >= sizeof(sockaddr_un::sun_path)) throw WireguardException("Invalid event socket path " + path);
+            }
+
+            ~NdjsonSink()
+            {
+                if (this->fd >= 0) close(this->fd);
+            }
+
+            /// @brief Writes one line, socket is reconnected if it's broken. Dispatcher waits for slow consumer of socket at most
+            /// @brief NDJSON_SEND_TIMEOUT, then its lines are dropped without waiting until it reads again
+            /// @param line JSON object with trailing newline
+            void Write(const std::string& line)
+            {
+                if (this->fd < 0 && !this->Connect()) return;
+                if (this->target == NdjsonTarget::FILE)
+                {
+                    WriteAll(this->fd, line);
+                    return;
+                }
+
+                std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+                bool expired = false;
+                size_t sent = SendUntil(this->fd, line, this->stalled ? now : now + NDJSON_SEND_TIMEOUT, expired);
+                if (sent == line.size())
+                {
+                    this->stalled = false;
+                    return;
+                }
+                if (sent == 0 && expired) // line is dropped, stream stays valid
+                {
+                    this->stalled = true;
+                    return;
+                }
+                close(this->fd); // peer has gone or line is cut, the next event connects again
+                this->fd = -1;
+                this->stalled = false;
+            }
+        private:
+            /// @brief Connects to stream socket, attempts are throttled
+            /// @return false if socket isn't available
+            bool Connect()
+            {
+                auto now = std::chrono::steady_clock::now();
+                if (this->target != NdjsonTarget::UNIX_SOCKET || now < this->next_connect) return false;
+                this->next_connect = now + NDJSON_RECONNECT_INTERVAL;
+                int socket_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0); // connect fails at once if listener's backlog is full
+                if (socket_fd < 0) return false;
+                sockaddr_un address{};
+                address.sun_family = AF_UNIX;
+                memcpy(address.sun_path, this->path.c_str(), this->path.size());
+                if (connect(socket_fd, (const sockaddr*)&address, sizeof(address)) != 0)
+                {
+                    close(socket_fd);
+                    return false;
+                }
+                this->fd = socket_fd;
+                return true;
+            }
+
+            std::string path;
+            NdjsonTarget target;
+            int fd{ -1 };
+            bool stalled{ false }; // the last line wasn't sent before deadline, consumer doesn't read
+            std::chrono::steady_clock::time_point next_connect{};
+        };
+    }
+
+    /// @brief Gets name of event type, ex. for NDJSON sinks
+    /// @param type one type (not mask)
+    /// @return snake case name, ex.: client_created
+    const char* ToString(event_types::TYPE type)
+    {
+        switch (type)
+        {
+        case event_types::CLIENT_CREATED: return "client_created";
+        case event_types::CLIENT_UPDATED: return "client_updated";
+        case event_types::CLIENT_REMOVED: return "client_removed";
+        case event_types::CLIENT_ACTIVATED: return "client_activated";
+        case event_types::CLIENT_DEACTIVATED: return "client_deactivated";
+        case event_types::CLIENT_EXPIRED: return "client_expired";
+        case event_types::CLIENT_CONNECTED: return "client_connected";
+        case event_types::CLIENT_DISCONNECTED: return "client_disconnected";
+        case event_types::PEERS_CHANGED: return "peers_changed";
+        case event_types::SERVER_UPDATED: return "server_updated";
+        default: return "unknown";
+        }
+    }
+
+    /// @brief Converts event to JSON object, empty fields are omitted
+    /// @param event event of bus
+    /// @return ex.: {"sequence":5,"type":"client_connected","time":1700000000,"interface":"wg0","uuid":"...","login":"...","public_key":"..."}
+    nlohmann::json ToJson(const WireguardEvent& event)
+    {
+        nlohmann::json json;
+        json["sequence"] = event.sequence;
+        json["type"] = ToString(event.type);
+        json["time"] = (int64_t)event.time;
+        json["interface"] = event.interface_name;
+        if (!event.uuid.empty()) json["uuid"] = event.uuid;
+        if (!event.login.empty()) json["login"] = event.login;
+        if (!event.public_key.empty()) json["public_key"] = event.public_key;
+        if (event.type == event_types::PEERS_CHANGED)
+        {
+            json["added"] = event.peers_added;
+            json["updated"] = event.peers_updated;
+            json["removed"] = event.peers_removed;
+        }
+        return json;
+    }
+
+    /// @brief Creates bus without subscribers, dispatcher thread is started by the first subscription
+    /// @param capacity events queued for dispatcher (rounded up to power of two)
+    /// @param policy what publisher does when queue is full
+    EventBus::EventBus(size_t capacity, BackpressurePolicy policy) : queue(capacity), policy(policy), subscribers(std::make_shared<const std::vector<Subscriber>>()) {}
+
+    EventBus::~EventBus()
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->dispatch_mutex);
+            this->stop_requested = true;
+        }
+        this->dispatch_condition.notify_one();
+        if (this->dispatcher.joinable()) this->dispatcher.join();
+    }
+
+    /// @brief Queues event for subscribers. It's lock-free unless queue is full (BLOCK waits, DROP_OLDEST drops queued event)
+    /// @param event event without sequence
+    void EventBus::Publish(WireguardEvent event)
+    {
+        if (!this->HasSubscribers()) return;
+        if (event.time == 0) event.time = time(nullptr);
+        while (!this->queue.TryPush(event))
+        {
+            if (this->policy == BackpressurePolicy::DROP_NEWEST)
+            {
+                this->dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            if (this->policy == BackpressurePolicy::DROP_OLDEST)
+            {
+                WireguardEvent oldest;
+                if (this->queue.TryPop(oldest))
+                {
+                    this->dropped.fetch_add(1, std::memory_order_relaxed);
+                    this->Finish(1);
+                }
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(this->dispatch_mutex);
+            this->dispatch_condition.notify_one();
+            this->flush_condition.wait_for(lock, EVENT_BLOCK_WAIT);
+        }
+        this->published.fetch_add(1);
+        if (this->dispatcher_waiting.load())
+        {
+            std::lock_guard<std::mutex> lock(this->dispatch_mutex);
+            this->dispatch_condition.notify_one();
+        }
+    }
+
+    /// @brief Adds subscriber, events published before subscription aren't delivered to it
+    /// @param handler called on dispatcher thread in order of events
+    /// @param types mask of event_types
+    /// @return id of subscription for Unsubscribe()
+    uint64_t EventBus::Subscribe(EventHandler handler, uint32_t types)
+    {
+        std::lock_guard<std::mutex> lock(this->subscribers_mutex);
+        auto subscribers = std::make_shared<std::vector<Subscriber>>(*this->subscribers);
+        Subscriber subscriber;
+        subscriber.id = ++this->subscription_sequence;
+        subscriber.types = types;
+        subscriber.handler = std::move(handler);
+        subscribers->push_back(std::move(subscriber));
+        this->subscribers = subscribers;
+        this->subscriber_count.store(subscribers->size(), std::memory_order_release);
+        if (!this->dispatcher.joinable()) this->dispatcher = std::thread(&EventBus::Dispatch, this);
+        return this->subscription_sequence;
+    }
+
+    /// @brief Adds subscriber writing newline-delimited JSON (ToJson()) to file or Unix stream socket
+    /// @param path file or socket path
+    /// @param target FILE is opened at once, UNIX_SOCKET is connected by the first event
+    /// @param types mask of event_types
+    /// @return id of subscription for Unsubscribe()
+    uint64_t EventBus::SubscribeNdjson(const std::string& path, NdjsonTarget target, uint32_t types)
+    {
+        auto sink = std::make_shared<NdjsonSink>(path, target);
+        return this->Subscribe([sink](const WireguardEvent& event) { sink->Write(ToJson(event).dump() + "\n"); }, types);
+    }
+
+    void EventBus::Unsubscribe(uint64_t subscription)
+    {
+        std::lock_guard<std::mutex> lock(this->subscribers_mutex);
+        auto subscribers = std::make_shared<std::vector<Subscriber>>(*this->subscribers);
+        for (auto subscriber = subscribers->begin(); subscriber != subscribers->end(); subscriber++)
+        {
+            if (subscriber->id != subscription) continue;
+            subscribers->erase(subscriber);
+            this->subscribers = subscribers;
+            this->subscriber_count.store(subscribers->size(), std::memory_order_release);
+            return;
+        }
+    }
+
+    /// @brief Waits until events published before the call are delivered or dropped
+    void EventBus::Flush()
+    {
+        uint64_t target = this->published.load();
+        std::unique_lock<std::mutex> lock(this->dispatch_mutex);
+        if (this->finished >= target) return;
+        this->dispatch_condition.notify_one();
+        this->flush_condition.wait(lock, [this, target]() { return this->finished >= target; });
+    }
+
+    uint64_t EventBus::GetDroppedCount() const { return this->dropped.load(std::memory_order_relaxed); }
+
+    bool EventBus::HasSubscribers() const { return this->subscriber_count.load(std::memory_order_acquire) != 0; }
+
+    void EventBus::Finish(uint64_t count)
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->dispatch_mutex);
+            this->finished += count;
+        }
+        this->flush_condition.notify_all();
+    }
+
+    /// @brief Delivers queued events until bus is destroyed, queue is drained before exit
+    void EventBus::Dispatch()
+    {
+        while (true)
+        {
+            std::shared_ptr<const std::vector<Subscriber>> subscribers;
+            {
+                std::lock_guard<std::mutex> lock(this->subscribers_mutex);
+                subscribers = this->subscribers;
+            }
+            uint64_t delivered = 0;
+            WireguardEvent event;
+            while (this->queue.TryPop(event))
+            {
+                event.sequence = ++this->sequence;
+                for (const Subscriber& subscriber : *subscribers)
+                {
+                    if ((subscriber.types & event.type) == 0) continue;
+                    try
+                    {
+                        subscriber.handler(event);
+                    }
+                    catch (...)
+                    {
+                        // broken subscriber doesn't stop delivery to others
+                    }
+                }
+                delivered++;
+            }
+            if (delivered > 0) this->Finish(delivered);
+
+            std::unique_lock<std::mutex> lock(this->dispatch_mutex);
+            this->dispatcher_waiting.store(true);
+            if (this->finished < this->published.load()) // event is pushed after the queue was drained
+            {
+                this->dispatcher_waiting.store(false);
+                continue;
+            }
+            if (this->stop_requested) return;
+            this->dispatch_condition.wait_for(lock, EVENT_DISPATCH_WAIT);
+            this->dispatcher_waiting.store(false);
+        }
+    }
+}
@@ -0,0 +1,82 @@
+#include "expiry_scheduler.hpp"
+
+namespace timlibs
+{
+    /// @brief Schedules check of client at moment
+    /// @param uuid UUID of client
+    /// @param moment unix time of next possible change of account status (NEVER to cancel)
+    void ExpiryScheduler::Schedule(const ClientUuid& uuid, time_t moment)
+    {
+        if (moment == NEVER)
+        {
+            this->Cancel(uuid);
+            return;
+        }
+        auto found = this->moments.find(uuid);
+        if (found != this->moments.end() && found->second == moment) return;
+        this->moments[uuid] = moment;
+        this->heap.push(Entry{ moment, uuid });
+        if (this->heap.size() > 2 * this->moments.size() + 64) this->Compact();
+    }
+
+    /// @brief Cancels check of client
+    /// @param uuid UUID of client
+    void ExpiryScheduler::Cancel(const ClientUuid& uuid)
+    {
+        this->moments.erase(uuid);
+    }
+
+    /// @brief Takes clients whose moment has come
+    /// @param now current unix time
+    /// @return UUIDs of clients, every client only once
+    std::vector<ClientUuid> ExpiryScheduler::PopDue(time_t now)
+    {
+        std::vector<ClientUuid> due;
+        while (!this->heap.empty() && this->heap.top().moment <= now)
+        {
+            Entry entry = this->heap.top();
+            this->heap.pop();
+            auto found = this->moments.find(entry.uuid);
+            if (found == this->moments.end() || found->second != entry.moment) continue; // replaced or canceled
+            this->moments.erase(found);
+            due.push_back(std::move(entry.uuid));
+        }
+        return due;
+    }
+
+    /// @brief Gets the nearest scheduled moment
+    /// @return unix time or NEVER
+    time_t ExpiryScheduler::GetNextMoment() const
+    {
+        this->DropStale();
+        return this->heap.empty() ? NEVER : this->heap.top().moment;
+    }
+
+    size_t ExpiryScheduler::Size() const { return this->moments.size(); }
+
+    void ExpiryScheduler::Clear()
+    {
+        this->heap = decltype(this->heap)();
+        this->moments.clear();
+    }
+
+    /// @brief Removes replaced and canceled entries from top of heap
+    void ExpiryScheduler::DropStale() const
+    {
+        while (!this->heap.empty())
+        {
+            auto found = this->moments.find(this->heap.top().uuid);
+            if (found != this->moments.end() && found->second == this->heap.top().moment) break;
+            this->heap.pop();
+        }
+    }
+
+    /// @brief Rebuilds heap from valid moments only, when stale entries are the majority
+    void ExpiryScheduler::Compact()
+    {
+        std::vector<Entry> entries;
+        entries.reserve(this->moments.size());
+        for (const auto& moment : this->moments) entries.push_back(Entry{ moment.second, moment.first });
+        this->heap = decltype(this->heap)(std::greater<Entry>(), std::move(entries));
+    }
+}
@@ -0,0 +1,323 @@
+#include "metrics.hpp"
+#include "wireguard.hpp"
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#include <unistd.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#define METRICS_POLL_TIMEOUT_MS 200 // how fast server notices stop
+#define METRICS_IO_TIMEOUT_S 1 // slow client can't block server for longer
+#define METRICS_REQUEST_SIZE_MAX 8192
+
+namespace timlibs
+{
+    namespace
+    {
+        // Upper bounds of histogram buckets, the last bucket is +Inf
+        constexpr uint64_t BOUNDS_NS[] = { 100000, 500000, 1000000, 5000000, 10000000, 50000000, 100000000, 500000000, 1000000000, 5000000000, 10000000000 };
+
+        /// @brief Formats number as OpenMetrics value
+        /// @param value number
+        /// @return shortest exact enough text, ex.: 0.0005
+        std::string FormatValue(double value)
+        {
+            char buffer[32];
+            snprintf(buffer, sizeof(buffer), "%.9g", value);
+            return buffer;
+        }
+
+        /// @brief Joins labels of metric with extra label
+        /// @param labels labels of metric, ex.: phase="date"
+        /// @param extra extra label, ex.: le="0.5"
+        /// @return labels in braces or empty string if there are no labels
+        std::string FormatLabels(const std::string& labels, const std::string& extra = "")
+        {
+            if (labels.empty() && extra.empty()) return "";
+            if (labels.empty()) return "{" + extra + "}";
+            if (extra.empty()) return "{" + labels + "}";
+            return "{" + labels + "," + extra + "}";
+        }
+
+        /// @brief Sends whole buffer to socket
+        /// @param fd socket
+        /// @param data buffer
+        /// @return false if connection is broken or timed out
+        bool SendAll(int fd, const std::string& data)
+        {
+            size_t sent = 0;
+            while (sent < data.size())
+            {
+                ssize_t result = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+                if (result < 0 && errno == EINTR) continue;
+                if (result <= 0) return false;
+                sent += result;
+            }
+            return true;
+        }
+    }
+
+    static_assert(sizeof(BOUNDS_NS) / sizeof(BOUNDS_NS[0]) + 1 == 12, "Histogram::BUCKETS doesn't match bounds");
+
+    void Counter::Add(uint64_t value) { this->value.fetch_add(value, std::memory_order_relaxed); }
+
+    uint64_t Counter::Get() const { return this->value.load(std::memory_order_relaxed); }
+
+    void Gauge::Set(int64_t value) { this->value.store(value, std::memory_order_relaxed); }
+
+    int64_t Gauge::Get() const { return this->value.load(std::memory_order_relaxed); }
+
+    const std::vector<double>& Histogram::GetBounds()
+    {
+        static const std::vector<double> bounds = []()
+        {
+            std::vector<double> bounds;
+            for (uint64_t bound : BOUNDS_NS) bounds.push_back(bound / 1e9);
+            return bounds;
+        }();
+        return bounds;
+    }
+
+    /// @brief Adds duration to its bucket, two relaxed atomic increments without locks
+    /// @param duration measured duration
+    void Histogram::Observe(std::chrono::nanoseconds duration)
+    {
+        uint64_t nanoseconds = (duration.count() > 0) ? duration.count() : 0;
+        size_t bucket = 0;
+        while (bucket < BUCKETS - 1 && nanoseconds > BOUNDS_NS[bucket]) bucket++;
+        this->counts[bucket].fetch_add(1, std::memory_order_relaxed);
+        this->sum_ns.fetch_add(nanoseconds, std::memory_order_relaxed);
+    }
+
+    uint64_t Histogram::GetCount() const
+    {
+        uint64_t count = 0;
+        for (const std::atomic<uint64_t>& bucket : this->counts) count += bucket.load(std::memory_order_relaxed);
+        return count;
+    }
+
+    double Histogram::GetSum() const { return this->sum_ns.load(std::memory_order_relaxed) / 1e9; }
+
+    /// @brief Gets counts of observations less or equal to every bound, as OpenMetrics buckets
+    /// @return counts per bound, the last one is +Inf (count of all observations)
+    std::vector<uint64_t> Histogram::GetCumulativeCounts() const
+    {
+        std::vector<uint64_t> cumulative(BUCKETS);
+        uint64_t count = 0;
+        for (size_t bucket = 0; bucket < BUCKETS; bucket++)
+        {
+            count += this->counts[bucket].load(std::memory_order_relaxed);
+            cumulative[bucket] = count;
+        }
+        return cumulative;
+    }
+
+    ScopedTimer::ScopedTimer(Histogram& histogram) : histogram{ histogram }, start{ std::chrono::steady_clock::now() } {}
+
+    ScopedTimer::~ScopedTimer() { this->histogram.Observe(std::chrono::steady_clock::now() - this->start); }
+
+    /// @brief Registers counter
+    /// @param name name of family without _total suffix, ex.: wireguard_peer_changes
+    /// @param help description of family
+    /// @param labels labels of counter inside family, ex.: change="added"
+    /// @return counter, valid while registry exists
+    Counter& MetricsRegistry::AddCounter(const std::string& name, const std::string& help, const std::string& labels)
+    {
+        std::lock_guard<std::mutex> lock(this->families_mutex);
+        Family& family = this->GetFamily(name, help, Type::COUNTER);
+        family.labels.push_back(labels);
+        family.counters.push_back(std::make_unique<Counter>());
+        return *family.counters.back();
+    }
+
+    /// @brief Registers gauge
+    /// @param name name of family, ex.: wireguard_clients
+    /// @param help description of family
+    /// @param labels labels of gauge inside family
+    /// @return gauge, valid while registry exists
+    Gauge& MetricsRegistry::AddGauge(const std::string& name, const std::string& help, const std::string& labels)
+    {
+        std::lock_guard<std::mutex> lock(this->families_mutex);
+        Family& family = this->GetFamily(name, help, Type::GAUGE);
+        family.labels.push_back(labels);
+        family.gauges.push_back(std::make_unique<Gauge>());
+        return *family.gauges.back();
+    }
+
+    /// @brief Registers histogram of durations
+    /// @param name name of family, ex.: wireguard_controller_duration_seconds
+    /// @param help description of family
+    /// @param labels labels of histogram inside family, ex.: phase="date_and_mode"
+    /// @return histogram, valid while registry exists
+    Histogram& MetricsRegistry::AddHistogram(const std::string& name, const std::string& help, const std::string& labels)
+    {
+        std::lock_guard<std::mutex> lock(this->families_mutex);
+        Family& family = this->GetFamily(name, help, Type::HISTOGRAM);
+        family.labels.push_back(labels);
+        family.histograms.push_back(std::make_unique<Histogram>());
+        return *family.histograms.back();
+    }
+
+    /// @brief Renders all metrics in OpenMetrics text format, values are read without stopping writers
+    /// @return text exposition terminated by # EOF
+    std::string MetricsRegistry::Render() const
+    {
+        std::lock_guard<std::mutex> lock(this->families_mutex);
+        const std::vector<double>& bounds = Histogram::GetBounds();
+        std::string text;
+        for (const std::unique_ptr<Family>& family : this->families)
+        {
+            static const char* types[] = { "counter", "gauge", "histogram" };
+            text += "# TYPE " + family->name + " " + types[(int)family->type] + "\n";
+            text += "# HELP " + family->name + " " + family->help + "\n";
+            for (size_t index = 0; index < family->labels.size(); index++)
+            {
+                const std::string& labels = family->labels[index];
+                switch (family->type)
+                {
+                case Type::COUNTER:
+                    text += family->name + "_total" + FormatLabels(labels) + " " + std::to_string(family->counters[index]->Get()) + "\n";
+                    break;
+                case Type::GAUGE:
+                    text += family->name + FormatLabels(labels) + " " + std::to_string(family->gauges[index]->Get()) + "\n";
+                    break;
+                case Type::HISTOGRAM:
+                {
+                    const Histogram& histogram = *family->histograms[index];
+                    std::vector<uint64_t> cumulative = histogram.GetCumulativeCounts();
+                    for (size_t bucket = 0; bucket < cumulative.size(); bucket++)
+                    {
+                        std::string bound = (bucket < bounds.size()) ? FormatValue(bounds[bucket]) : "+Inf";
+                        text += family->name + "_bucket" + FormatLabels(labels, "le=\"" + bound + "\"") + " " + std::to_string(cumulative[bucket]) + "\n";
+                    }
+                    text += family->name + "_count" + FormatLabels(labels) + " " + std::to_string(cumulative.back()) + "\n";
+                    text += family->name + "_sum" + FormatLabels(labels) + " " + FormatValue(histogram.GetSum()) + "\n";
+                    break;
+                }
+                }
+            }
+        }
+        text += "# EOF\n";
+        return text;
+    }
+
+    /// @brief Finds family by name or creates it
+    /// @param name name of family
+    /// @param help description, used only for new family
+    /// @param type type of metrics
+    /// @return family
+    MetricsRegistry::Family& MetricsRegistry::GetFamily(const std::string& name, const std::string& help, Type type)
+    {
+        for (std::unique_ptr<Family>& family : this->families)
+        {
+            if (family->name != name) continue;
+            if (family->type != type) throw WireguardException("Metric " + name + " is already registered with other type");
+            return *family;
+        }
+        this->families.push_back(std::make_unique<Family>());
+        Family& family = *this->families.back();
+        family.name = name;
+        family.help = help;
+        family.type = type;
+        return family;
+    }
+
+    /// @brief Binds listening socket and starts thread of server
+    /// @param render callback that returns OpenMetrics text, called from thread of server
+    /// @param address IPv4 address to listen, ex.: 127.0.0.1 or 0.0.0.0
+    /// @param port TCP port (0 for any free port)
+    MetricsServer::MetricsServer(std::function<std::string()> render, const std::string& address, uint16_t port) : render{ std::move(render) }
+    {
+        sockaddr_in socket_address{};
+        socket_address.sin_family = AF_INET;
+        socket_address.sin_port = htons(port);
+        if (inet_pton(AF_INET, address.c_str(), &socket_address.sin_addr) != 1) throw WireguardException("Invalid address of metrics server: " + address);
+
+        this->socket_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (this->socket_fd < 0) throw WireguardException("Unable to create socket: " + std::string(strerror(errno)));
+        int reuse = 1;
+        setsockopt(this->socket_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        socklen_t length = sizeof(socket_address);
+        if (bind(this->socket_fd, (sockaddr*)&socket_address, sizeof(socket_address)) < 0 || listen(this->socket_fd, SOMAXCONN) < 0
+            || getsockname(this->socket_fd, (sockaddr*)&socket_address, &length) < 0)
+        {
+            std::string error = strerror(errno);
+            close(this->socket_fd);
+            throw WireguardException("Unable to listen " + address + ":" + std::to_string(port) + ": " + error);
+        }
+        this->port = ntohs(socket_address.sin_port);
+        this->server_thread = std::thread(&MetricsServer::Serve, this);
+    }
+
+    MetricsServer::~MetricsServer()
+    {
+        this->stop_requested = true;
+        if (this->server_thread.joinable()) this->server_thread.join();
+        close(this->socket_fd);
+    }
+
+    uint16_t MetricsServer::GetPort() const { return this->port; }
+
+    /// @brief Accepts connections until stop, the listening socket is polled with timeout to notice stop
+    void MetricsServer::Serve()
+    {
+        while (!this->stop_requested)
+        {
+            pollfd listening{ this->socket_fd, POLLIN, 0 };
+            if (poll(&listening, 1, METRICS_POLL_TIMEOUT_MS) <= 0) continue;
+            int connection_fd = accept4(this->socket_fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (connection_fd < 0) continue;
+            timeval timeout{ METRICS_IO_TIMEOUT_S, 0 };
+            setsockopt(connection_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            setsockopt(connection_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+            this->Respond(connection_fd);
+            close(connection_fd);
+        }
+    }
+
+    /// @brief Reads request headers and answers with metrics, every response closes connection
+    /// @param connection_fd accepted socket
+    void MetricsServer::Respond(int connection_fd) const
+    {
+        std::string request;
+        char buffer[1024];
+        while (request.find("\r\n\r\n") == std::string::npos && request.size() < METRICS_REQUEST_SIZE_MAX)
+        {
+            ssize_t result = recv(connection_fd, buffer, sizeof(buffer), 0);
+            if (result < 0 && errno == EINTR) continue;
+            if (result <= 0) return;
+            request.append(buffer, result);
+        }
+
+        std::string status = "200 OK";
+        std::string content_type = METRICS_CONTENT_TYPE;
+        std::string body;
+        size_t method_end = request.find(' ');
+        size_t path_end = (method_end != std::string::npos) ? request.find_first_of(" ?", method_end + 1) : std::string::npos;
+        if (path_end == std::string::npos) status = "400 Bad Request";
+        else if (request.compare(0, method_end, "GET") != 0) status = "405 Method Not Allowed";
+        else if (request.compare(method_end + 1, path_end - method_end - 1, "/metrics") != 0) status = "404 Not Found";
+        else
+        {
+            try
+            {
+                body = this->render();
+            }
+            catch (...)
+            {
+                status = "500 Internal Server Error";
+            }
+        }
+        if (status.compare(0, 3, "200") != 0)
+        {
+            content_type = "text/plain; charset=utf-8";
+            body = status + "\n";
+        }
+
+        SendAll(connection_fd, "HTTP/1.1 " + status + "\r\nContent-Type: " + content_type + "\r\nContent-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n");
+        SendAll(connection_fd, body);
+    }
+}
@@ -0,0 +1,438 @@
+#include "wireguard.hpp"
+#include "peer_controller.hpp"
+#include "base64.hpp"
+#include "allowed_ips.hpp"
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <linux/netlink.h>
+#include <linux/genetlink.h>
+#include <linux/wireguard.h>
+
+#define NETLINK_MESSAGE_LIMIT 32768 // max size of one WG_CMD_SET_DEVICE message, bigger batches are split
+#define NETLINK_RECEIVE_BUFFER 65536
+#define NETLINK_FAMILY_TIMEOUT std::chrono::milliseconds(5000) // resolution of wireguard family by constructor
+#define NETLINK_ALLOWED_IPS_PER_PEER 1000 // allowed ips in one peer attribute (28 bytes each), longer lists are split, nla_len is 16 bits
+
+namespace timlibs
+{
+    namespace
+    {
+        /// @brief Builder of netlink attributes (type-length-value with 4 bytes alignment)
+        class AttributeBuffer
+        {
+        public:
+            void Put(uint16_t type, const void* data, size_t size)
+            {
+                size_t offset = this->buffer.size();
+                this->buffer.resize(offset + NLA_ALIGN(NLA_HDRLEN + size), 0);
+                nlattr* attribute = reinterpret_cast<nlattr*>(this->buffer.data() + offset);
+                attribute->nla_type = type;
+                attribute->nla_len = (uint16_t)(NLA_HDRLEN + size);
+                if (size) std::memcpy(this->buffer.data() + offset + NLA_HDRLEN, data, size);
+            }
+
+            template <typename Value> void PutValue(uint16_t type, Value value) { this->Put(type, &value, sizeof(value)); }
+
+            void PutString(uint16_t type, const std::string& value) { this->Put(type, value.c_str(), value.size() + 1); }
+
+            size_t BeginNested(uint16_t type)
+            {
+                size_t offset = this->buffer.size();
+                this->Put(type | NLA_F_NESTED, nullptr, 0);
+                return offset;
+            }
+
+            void EndNested(size_t offset)
+            {
+                size_t size = this->buffer.size() - offset;
+                if (size > UINT16_MAX) throw WireguardException("Netlink attribute is too long");
+                reinterpret_cast<nlattr*>(this->buffer.data() + offset)->nla_len = (uint16_t)size;
+            }
+
+            void Append(const AttributeBuffer& other) { this->buffer.insert(this->buffer.end(), other.buffer.begin(), other.buffer.end()); }
+
+            size_t Size() const { return this->buffer.size(); }
+
+            std::vector<uint8_t> buffer;
+        };
+
+        /// @brief Builds generic netlink message
+        /// @param type netlink message type (family id)
+        /// @param flags netlink flags
+        /// @param command generic netlink command
+        /// @param version generic netlink family version
+        /// @param attributes payload of message
+        /// @return message without length and sequence
+        std::vector<uint8_t> BuildMessage(uint16_t type, uint16_t flags, uint8_t command, uint8_t version, const AttributeBuffer& attributes)
+        {
+            std::vector<uint8_t> message(NLMSG_HDRLEN + GENL_HDRLEN, 0);
+            nlmsghdr* header = reinterpret_cast<nlmsghdr*>(message.data());
+            header->nlmsg_type = type;
+            header->nlmsg_flags = flags;
+            genlmsghdr* generic_header = reinterpret_cast<genlmsghdr*>(message.data() + NLMSG_HDRLEN);
+            generic_header->cmd = command;
+            generic_header->version = version;
+            message.insert(message.end(), attributes.buffer.begin(), attributes.buffer.end());
+            return message;
+        }
+
+        /// @brief Calls handler for every attribute in buffer
+        /// @param data pointer to first attribute
+        /// @param size size of attributes
+        /// @param handler function (type, payload, payload size)
+        template <typename Handler> void ForEachAttribute(const uint8_t* data, size_t size, const Handler& handler)
+        {
+            while (size >= NLA_HDRLEN)
+            {
+                const nlattr* attribute = reinterpret_cast<const nlattr*>(data);
+                if (attribute->nla_len < NLA_HDRLEN || attribute->nla_len > size) break;
+                handler((uint16_t)(attribute->nla_type & NLA_TYPE_MASK), data + NLA_HDRLEN, (size_t)(attribute->nla_len - NLA_HDRLEN));
+                size_t step = NLA_ALIGN(attribute->nla_len);
+                if (step >= size) break;
+                data += step;
+                size -= step;
+            }
+        }
+
+        template <typename Value> Value ReadValue(const uint8_t* data, size_t size)
+        {
+            Value value{};
+            std::memcpy(&value, data, std::min(size, sizeof(value)));
+            return value;
+        }
+
+        /// @brief Converts allowed ip attribute to text, ex.: 10.0.30.2/32
+        std::string FormatAllowedIp(const uint8_t* data, size_t size)
+        {
+            uint16_t family = AF_UNSPEC;
+            const uint8_t* address = nullptr;
+            size_t address_size = 0;
+            uint8_t cidr = 0;
+            ForEachAttribute(data, size, [&](uint16_t type, const uint8_t* payload, size_t payload_size)
+            {
+                if (type == WGALLOWEDIP_A_FAMILY) family = ReadValue<uint16_t>(payload, payload_size);
+                else if (type == WGALLOWEDIP_A_IPADDR) { address = payload; address_size = payload_size; }
+                else if (type == WGALLOWEDIP_A_CIDR_MASK) cidr = ReadValue<uint8_t>(payload, payload_size);
+            });
+            char text[INET6_ADDRSTRLEN] = { 0 };
+            if (address == nullptr) return NULL_STRING;
+            if (family == AF_INET && address_size >= sizeof(in_addr)) inet_ntop(AF_INET, address, text, sizeof(text));
+            else if (family == AF_INET6 && address_size >= sizeof(in6_addr)) inet_ntop(AF_INET6, address, text, sizeof(text));
+            else return NULL_STRING;
+            return std::string(text) + '/' + std::to_string(cidr);
+        }
+
+        /// @brief Converts endpoint attribute (sockaddr_in or sockaddr_in6) to text, ex.: 203.0.113.5:51820
+        std::string FormatEndpoint(const uint8_t* data, size_t size)
+        {
+            char text[INET6_ADDRSTRLEN] = { 0 };
+            if (size < sizeof(sa_family_t)) return NULL_STRING;
+            sa_family_t family = ReadValue<sa_family_t>(data, size);
+            if (family == AF_INET && size >= sizeof(sockaddr_in))
+            {
+                sockaddr_in endpoint = ReadValue<sockaddr_in>(data, size);
+                inet_ntop(AF_INET, &endpoint.sin_addr, text, sizeof(text));
+                return std::string(text) + ':' + std::to_string(ntohs(endpoint.sin_port));
+            }
+            if (family == AF_INET6 && size >= sizeof(sockaddr_in6))
+            {
+                sockaddr_in6 endpoint = ReadValue<sockaddr_in6>(data, size);
+                inet_ntop(AF_INET6, &endpoint.sin6_addr, text, sizeof(text));
+                return '[' + std::string(text) + "]:" + std::to_string(ntohs(endpoint.sin6_port));
+            }
+            return NULL_STRING;
+        }
+
+        /// @brief Puts allowed ips list as nested attribute
+        /// @param attributes attributes of peer
+        /// @param first the first prefix of list
+        /// @param last end of list
+        void PutAllowedIps(AttributeBuffer& attributes, std::vector<IpPrefix>::const_iterator first, std::vector<IpPrefix>::const_iterator last)
+        {
+            size_t allowed_ips_offset = attributes.BeginNested(WGPEER_A_ALLOWEDIPS);
+            for (; first != last; first++)
+            {
+                in_addr address{ htonl(first->address) };
+                size_t allowed_ip_offset = attributes.BeginNested(0);
+                attributes.PutValue<uint16_t>(WGALLOWEDIP_A_FAMILY, AF_INET);
+                attributes.Put(WGALLOWEDIP_A_IPADDR, &address, sizeof(address));
+                attributes.PutValue<uint8_t>(WGALLOWEDIP_A_CIDR_MASK, (uint8_t)first->length);
+                attributes.EndNested(allowed_ip_offset);
+            }
+            attributes.EndNested(allowed_ips_offset);
+        }
+
+        /// @brief Encodes one peer of WGDEVICE_A_PEERS, peer with many allowed ips is split into several attributes:
+        /// @brief the first one replaces allowed ips, next ones add the rest (they must be sent in order, as wg does)
+        /// @param public_key public key of peer (base64)
+        /// @param flags WGPEER_F_* flags
+        /// @param allowed_ips allowed ips of peer (ignored for removal)
+        /// @return nested peer attributes
+        std::vector<AttributeBuffer> EncodePeer(const std::string& public_key, uint32_t flags, const std::string& allowed_ips)
+        {
+            uint8_t raw_key[WG_KEY_LEN];
+            if (!Base64Decode(public_key, raw_key, WG_KEY_LEN)) throw WireguardException("Public key \"" + public_key + "\" isn't valid");
+            std::vector<IpPrefix> prefixes;
+            if (!(flags & WGPEER_F_REMOVE_ME) && !ParseAllowedIps(allowed_ips, prefixes)) throw WireguardException("Allowed ips \"" + allowed_ips + "\" of peer " + public_key + " aren't list of IPv4 prefixes");
+
+            std::vector<AttributeBuffer> parts;
+            size_t next = 0;
+            do
+            {
+                size_t count = std::min<size_t>(prefixes.size() - next, NETLINK_ALLOWED_IPS_PER_PEER);
+                AttributeBuffer peer;
+                size_t peer_offset = peer.BeginNested(0);
+                peer.Put(WGPEER_A_PUBLIC_KEY, raw_key, WG_KEY_LEN);
+                peer.PutValue<uint32_t>(WGPEER_A_FLAGS, parts.empty() ? flags : 0);
+                if (!(flags & WGPEER_F_REMOVE_ME)) PutAllowedIps(peer, prefixes.begin() + next, prefixes.begin() + next + count);
+                peer.EndNested(peer_offset);
+                parts.push_back(std::move(peer));
+                next += count;
+            } while (next < prefixes.size());
+            return parts;
+        }
+
+        /// @brief Generic netlink socket of one call: calls don't share sockets, so a slow or expired call can't block
+        /// @brief other calls or leave its replies for them
+        class NetlinkSocket
+        {
+        public:
+            NetlinkSocket()
+            {
+                this->socket_fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_GENERIC);
+                if (this->socket_fd < 0) throw WireguardException("Unable to open netlink socket: " + std::string(strerror(errno)));
+
+                sockaddr_nl address{};
+                address.nl_family = AF_NETLINK;
+                socklen_t address_size = sizeof(address);
+                if (bind(this->socket_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || getsockname(this->socket_fd, reinterpret_cast<sockaddr*>(&address), &address_size) < 0)
+                {
+                    std::string error = strerror(errno);
+                    close(this->socket_fd);
+                    throw WireguardException("Unable to bind netlink socket: " + error);
+                }
+                this->port_id = address.nl_pid;
+            }
+
+            ~NetlinkSocket() { close(this->socket_fd); }
+            NetlinkSocket(const NetlinkSocket&) = delete;
+            NetlinkSocket& operator=(const NetlinkSocket&) = delete;
+
+            /// @brief Sends netlink message to kernel
+            /// @param message message built by BuildMessage, length and sequence are set here
+            void Send(std::vector<uint8_t>& message)
+            {
+                nlmsghdr* header = reinterpret_cast<nlmsghdr*>(message.data());
+                header->nlmsg_len = (uint32_t)message.size();
+                header->nlmsg_seq = ++this->sequence;
+                header->nlmsg_pid = this->port_id;
+
+                sockaddr_nl kernel{};
+                kernel.nl_family = AF_NETLINK;
+                ssize_t sent;
+                do
+                {
+                    sent = sendto(this->socket_fd, message.data(), message.size(), 0, reinterpret_cast<sockaddr*>(&kernel), sizeof(kernel));
+                } while (sent < 0 && errno == EINTR);
+                if (sent != (ssize_t)message.size()) throw WireguardException("Unable to send netlink message: " + std::string(strerror(errno)));
+            }
+
+            /// @brief Receives replies for last sent message until ACK or end of dump, waits for every reply until deadline of call
+            /// @param handler function that is called for every data message
+            /// @param control deadline and cancellation of call, cancellation is checked every CALL_POLL_INTERVAL
+            /// @param operation name of call for error message
+            template <typename Handler> void Receive(const Handler& handler, const CallControl& control, const std::string& operation)
+            {
+                std::vector<uint8_t> buffer(NETLINK_RECEIVE_BUFFER);
+                while (true)
+                {
+                    control.Check(operation);
+                    std::chrono::steady_clock::duration remaining = control.GetDeadline() - std::chrono::steady_clock::now();
+                    int timeout = (int)std::chrono::duration_cast<std::chrono::milliseconds>(std::min<std::chrono::steady_clock::duration>(remaining, CALL_POLL_INTERVAL)).count();
+                    pollfd input{ this->socket_fd, POLLIN, 0 };
+                    int ready = poll(&input, 1, std::max(timeout, 0) + 1); // +1: rounded down timeout doesn't spin just before deadline
+                    if (ready < 0 && errno != EINTR) throw WireguardException("Unable to wait for netlink message: " + std::string(strerror(errno)));
+                    if (ready <= 0) continue;
+
+                    ssize_t received = recv(this->socket_fd, buffer.data(), buffer.size(), MSG_DONTWAIT);
+                    if (received < 0)
+                    {
+                        if (errno == EINTR || errno == EAGAIN) continue;
+                        throw WireguardException("Unable to receive netlink message: " + std::string(strerror(errno)));
+                    }
+
+                    size_t size = (size_t)received;
+                    for (const nlmsghdr* header = reinterpret_cast<const nlmsghdr*>(buffer.data()); NLMSG_OK(header, size); header = NLMSG_NEXT(header, size))
+                    {
+                        if (header->nlmsg_seq != this->sequence) continue; // reply for earlier message
+                        if (header->nlmsg_type == NLMSG_DONE) return;
+                        if (header->nlmsg_type == NLMSG_ERROR)
+                        {
+                            const nlmsgerr* error = reinterpret_cast<const nlmsgerr*>(NLMSG_DATA(header));
+                            if (error->error == 0) return; // ACK
+                            throw WireguardException("Netlink error: " + std::string(strerror(-error->error)));
+                        }
+                        handler(header);
+                    }
+                }
+            }
+        private:
+            int socket_fd{ -1 };
+            uint32_t port_id{ 0 };
+            uint32_t sequence{ 0 };
+        };
+    }
+
+    /// @brief Resolves wireguard family
+    NetlinkPeerController::NetlinkPeerController()
+    {
+        NetlinkSocket socket;
+        AttributeBuffer attributes;
+        attributes.PutString(CTRL_ATTR_FAMILY_NAME, WG_GENL_NAME);
+        std::vector<uint8_t> message = BuildMessage(GENL_ID_CTRL, NLM_F_REQUEST | NLM_F_ACK, CTRL_CMD_GETFAMILY, 1, attributes);
+        socket.Send(message);
+        socket.Receive([this](const nlmsghdr* header)
+        {
+            if (header->nlmsg_type != GENL_ID_CTRL) return;
+            const uint8_t* payload = reinterpret_cast<const uint8_t*>(NLMSG_DATA(header)) + GENL_HDRLEN;
+            ForEachAttribute(payload, header->nlmsg_len - NLMSG_HDRLEN - GENL_HDRLEN, [this](uint16_t type, const uint8_t* data, size_t size)
+            {
+                if (type == CTRL_ATTR_FAMILY_ID) this->family_id = ReadValue<uint16_t>(data, size);
+            });
+        }, CallControl(NETLINK_FAMILY_TIMEOUT), "Resolution of netlink family \"" WG_GENL_NAME "\"");
+        if (this->family_id == 0) throw WireguardException("Netlink family \"" WG_GENL_NAME "\" is unavailable");
+    }
+
+    /// @brief Reads all peers of interface by one WG_CMD_GET_DEVICE dump
+    /// @param interface_name name of wireguard interface, ex. wg0
+    /// @return list of peers with handshakes, endpoints and counters
+    std::vector<PeerInfo> NetlinkPeerController::Dump(const std::string& interface_name)
+    {
+        return this->Dump(interface_name, CallControl());
+    }
+
+    /// @brief Reads all peers of interface by one WG_CMD_GET_DEVICE dump on own socket, waiting for kernel ends at deadline
+    /// @param interface_name name of wireguard interface, ex. wg0
+    /// @param control deadline and cancellation of call
+    /// @return list of peers with handshakes, endpoints and counters
+    std::vector<PeerInfo> NetlinkPeerController::Dump(const std::string& interface_name, const CallControl& control)
+    {
+        std::string operation = "Dump of peers of " + interface_name;
+        control.Check(operation);
+        NetlinkSocket socket;
+        AttributeBuffer attributes;
+        attributes.PutString(WGDEVICE_A_IFNAME, interface_name);
+        std::vector<uint8_t> message = BuildMessage(this->family_id, NLM_F_REQUEST | NLM_F_DUMP, WG_CMD_GET_DEVICE, WG_GENL_VERSION, attributes);
+        socket.Send(message);
+
+        std::vector<PeerInfo> peers;
+        socket.Receive([&peers](const nlmsghdr* header)
+        {
+            const uint8_t* payload = reinterpret_cast<const uint8_t*>(NLMSG_DATA(header)) + GENL_HDRLEN;
+            ForEachAttribute(payload, header->nlmsg_len - NLMSG_HDRLEN - GENL_HDRLEN, [&peers](uint16_t type, const uint8_t* data, size_t size)
+            {
+                if (type != WGDEVICE_A_PEERS) return;
+                ForEachAttribute(data, size, [&peers](uint16_t, const uint8_t* peer_data, size_t peer_size)
+                {
+                    PeerInfo peer;
+                    ForEachAttribute(peer_data, peer_size, [&peer](uint16_t peer_type, const uint8_t* value, size_t value_size)
+                    {
+                        switch (peer_type)
+                        {
+                        case WGPEER_A_PUBLIC_KEY:
+                            if (value_size == WG_KEY_LEN) peer.public_key = Base64Encode(value, WG_KEY_LEN);
+                            break;
+                        case WGPEER_A_ENDPOINT:
+                            peer.endpoint = FormatEndpoint(value, value_size);
+                            break;
+                        case WGPEER_A_LAST_HANDSHAKE_TIME:
+                            peer.latest_handshake = (time_t)ReadValue<int64_t>(value, value_size); // struct __kernel_timespec, seconds first
+                            break;
+                        case WGPEER_A_RX_BYTES:
+                            peer.rx_bytes = ReadValue<uint64_t>(value, value_size);
+                            break;
+                        case WGPEER_A_TX_BYTES:
+                            peer.tx_bytes = ReadValue<uint64_t>(value, value_size);
+                            break;
+                        case WGPEER_A_ALLOWEDIPS:
+                            ForEachAttribute(value, value_size, [&peer](uint16_t, const uint8_t* allowed_ip, size_t allowed_ip_size)
+                            {
+                                std::string prefix = FormatAllowedIp(allowed_ip, allowed_ip_size);
+                                if (prefix == NULL_STRING) return;
+                                if (!peer.allowed_ips.empty()) peer.allowed_ips += ", ";
+                                peer.allowed_ips += prefix;
+                            });
+                            break;
+                        default:
+                            break;
+                        }
+                    });
+
+                    // peer with many allowed ips may be split into several messages, the next message repeats only key and allowed ips
+                    if (!peers.empty() && peers.back().public_key == peer.public_key)
+                    {
+                        if (!peer.allowed_ips.empty())
+                        {
+                            if (!peers.back().allowed_ips.empty()) peers.back().allowed_ips += ", ";
+                            peers.back().allowed_ips += peer.allowed_ips;
+                        }
+                    }
+                    else peers.push_back(std::move(peer));
+                });
+            });
+        }, control, operation);
+        return peers;
+    }
+
+    /// @brief Applies all changes of peers by WG_CMD_SET_DEVICE messages (as few as possible)
+    /// @param interface_name name of wireguard interface, ex. wg0
+    /// @param changes peers to add, update and remove
+    void NetlinkPeerController::Apply(const std::string& interface_name, const PeerChanges& changes)
+    {
+        this->Apply(interface_name, changes, CallControl());
+    }
+
+    /// @brief Applies all changes of peers by WG_CMD_SET_DEVICE messages on own socket, messages after deadline aren't sent
+    /// @param interface_name name of wireguard interface, ex. wg0
+    /// @param changes peers to add, update and remove
+    /// @param control deadline and cancellation of call
+    void NetlinkPeerController::Apply(const std::string& interface_name, const PeerChanges& changes, const CallControl& control)
+    {
+        if (changes.Empty()) return;
+        std::string operation = "Change of peers of " + interface_name;
+
+        std::vector<AttributeBuffer> encoded_peers;
+        encoded_peers.reserve(changes.Size());
+        auto encode = [&encoded_peers](const std::string& public_key, uint32_t flags, const std::string& allowed_ips)
+        {
+            for (AttributeBuffer& part : EncodePeer(public_key, flags, allowed_ips)) encoded_peers.push_back(std::move(part));
+        };
+        for (const std::string& public_key : changes.removals) encode(public_key, WGPEER_F_REMOVE_ME, NULL_STRING);
+        for (const PeerInfo& peer : changes.upserts) encode(peer.public_key, WGPEER_F_REPLACE_ALLOWEDIPS, peer.allowed_ips);
+
+        NetlinkSocket socket;
+        size_t next = 0;
+        while (next < encoded_peers.size())
+        {
+            AttributeBuffer attributes;
+            attributes.PutString(WGDEVICE_A_IFNAME, interface_name);
+            size_t peers_offset = attributes.BeginNested(WGDEVICE_A_PEERS);
+            do
+            {
+                attributes.Append(encoded_peers[next++]);
+            } while (next < encoded_peers.size() && attributes.Size() + encoded_peers[next].Size() <= NETLINK_MESSAGE_LIMIT);
+            attributes.EndNested(peers_offset);
+
+            std::vector<uint8_t> message = BuildMessage(this->family_id, NLM_F_REQUEST | NLM_F_ACK, WG_CMD_SET_DEVICE, WG_GENL_VERSION, attributes);
+            control.Check(operation);
+            socket.Send(message);
+            socket.Receive([](const nlmsghdr*) {}, control, operation);
+        }
+    }
+}
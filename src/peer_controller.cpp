@@ -0,0 +1,271 @@
+#include "wireguard.hpp"
+#include "peer_controller.hpp"
+#include "allowed_ips.hpp"
+#include "process.hpp"
+#include <algorithm>
+#include <thread>
+
+#define WG_COMMAND "wg"
+#define WG_SET_ARGUMENTS_LIMIT 262144 // bytes of peers arguments in one "wg set" call, keeps far below ARG_MAX
+
+namespace timlibs
+{
+    bool PeerChanges::Empty() const { return this->upserts.empty() && this->removals.empty(); }
+
+    size_t PeerChanges::Size() const { return this->upserts.size() + this->removals.size(); }
+
+
+    /// @brief Reads peers if call isn't expired yet, controllers without long calls don't need more
+    /// @param interface_name name of wireguard interface, ex. wg0
+    /// @param control deadline and cancellation of call
+    /// @return list of peers
+    std::vector<PeerInfo> PeerController::Dump(const std::string& interface_name, const CallControl& control)
+    {
+        control.Check("Dump of peers of " + interface_name);
+        return this->Dump(interface_name);
+    }
+
+    /// @brief Applies changes of peers if call isn't expired yet
+    /// @param interface_name name of wireguard interface, ex. wg0
+    /// @param changes peers to add, update and remove
+    /// @param control deadline and cancellation of call
+    void PeerController::Apply(const std::string& interface_name, const PeerChanges& changes, const CallControl& control)
+    {
+        control.Check("Change of peers of " + interface_name);
+        this->Apply(interface_name, changes);
+    }
+
+
+    /// @brief Reads all peers of interface by one "wg show <interface> dump" call
+    /// @param interface_name name of wireguard interface, ex. wg0
+    /// @return list of peers with handshakes, endpoints and counters
+    std::vector<PeerInfo> ShellPeerController::Dump(const std::string& interface_name)
+    {
+        return this->Dump(interface_name, CallControl());
+    }
+
+    /// @brief Reads all peers of interface by one "wg show <interface> dump" call, stalled wg is killed at deadline
+    /// @param interface_name name of wireguard interface, ex. wg0
+    /// @param control deadline and cancellation of call
+    /// @return list of peers with handshakes, endpoints and counters
+    std::vector<PeerInfo> ShellPeerController::Dump(const std::string& interface_name, const CallControl& control)
+    {
+        ProcessResult result = RunProcess({ WG_COMMAND, "show", interface_name, "dump" }, control);
+        if (result.exit_code != 0) throw WireguardException("Unable to read peers of " + interface_name);
+
+        std::vector<PeerInfo> peers;
+        size_t line_begin = result.output.find('\n'); // first line is interface itself
+        while (line_begin != std::string::npos && line_begin + 1 < result.output.size())
+        {
+            line_begin++;
+            size_t line_end = result.output.find('\n', line_begin);
+            if (line_end == std::string::npos) line_end = result.output.size();
+
+            // public-key preshared-key endpoint allowed-ips latest-handshake transfer-rx transfer-tx persistent-keepalive
+            std::string fields[8];
+            size_t field = 0;
+            for (size_t begin = line_begin; field < 8 && begin <= line_end; field++)
+            {
+                size_t end = result.output.find('\t', begin);
+                if (end == std::string::npos || end > line_end) end = line_end;
+                fields[field].assign(result.output, begin, end - begin);
+                begin = end + 1;
+            }
+            line_begin = (line_end < result.output.size()) ? line_end : std::string::npos;
+            if (field < 7) continue;
+
+            PeerInfo peer;
+            peer.public_key = std::move(fields[0]);
+            if (fields[2] != "(none)") peer.endpoint = std::move(fields[2]);
+            if (fields[3] != "(none)") peer.allowed_ips = std::move(fields[3]);
+            try
+            {
+                peer.latest_handshake = (time_t)std::stoll(fields[4]);
+                peer.rx_bytes = std::stoull(fields[5]);
+                peer.tx_bytes = std::stoull(fields[6]);
+            }
+            catch (...)
+            {
+                throw WireguardException("Unexpected output of wg show dump for peer " + peer.public_key);
+            }
+            peers.push_back(std::move(peer));
+        }
+        return peers;
+    }
+
+    /// @brief Applies changes of peers by as few "wg set" calls as possible (one, if arguments fit in WG_SET_ARGUMENTS_LIMIT)
+    /// @param interface_name name of wireguard interface, ex. wg0
+    /// @param changes peers to add, update and remove
+    void ShellPeerController::Apply(const std::string& interface_name, const PeerChanges& changes)
+    {
+        this->Apply(interface_name, changes, CallControl());
+    }
+
+    /// @brief Applies changes of peers by as few "wg set" calls as possible, stalled wg is killed at deadline
+    /// @param interface_name name of wireguard interface, ex. wg0
+    /// @param changes peers to add, update and remove
+    /// @param control deadline and cancellation of call
+    void ShellPeerController::Apply(const std::string& interface_name, const PeerChanges& changes, const CallControl& control)
+    {
+        std::vector<std::string> arguments;
+        size_t arguments_size = 0;
+        auto flush = [&]()
+        {
+            if (arguments.size() <= 3) return;
+            if (RunProcess(arguments, control).exit_code != 0) throw WireguardException("Unable to set peers of " + interface_name);
+            arguments.resize(3);
+            arguments_size = 0;
+        };
+        auto add = [&](std::initializer_list<std::string> peer_arguments)
+        {
+            size_t peer_size = 0;
+            for (const std::string& argument : peer_arguments) peer_size += argument.size() + 1;
+            if (arguments_size + peer_size > WG_SET_ARGUMENTS_LIMIT) flush();
+            arguments.insert(arguments.end(), peer_arguments);
+            arguments_size += peer_size;
+        };
+
+        arguments = { WG_COMMAND, "set", interface_name };
+        for (const std::string& public_key : changes.removals) add({ "peer", public_key, "remove" });
+        for (const PeerInfo& peer : changes.upserts)
+        {
+            std::vector<IpPrefix> prefixes;
+            if (!ParseAllowedIps(peer.allowed_ips, prefixes)) throw WireguardException("Allowed ips \"" + peer.allowed_ips + "\" of peer " + peer.public_key + " aren't list of IPv4 prefixes");
+            std::string allowed_ips = FormatAllowedIps(prefixes);
+            allowed_ips.erase(std::remove(allowed_ips.begin(), allowed_ips.end(), ' '), allowed_ips.end()); // wg expects list without spaces
+            add({ "peer", peer.public_key, "allowed-ips", allowed_ips });
+        }
+        flush();
+    }
+
+
+    namespace
+    {
+        /// @brief Sleeps as long as simulated call lasts, but not after call expires
+        /// @param latency duration of call
+        /// @param control deadline and cancellation of call
+        /// @param operation name of call for error message
+        void SimulateLatency(std::chrono::microseconds latency, const CallControl& control, const std::string& operation)
+        {
+            std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now() + latency;
+            while (std::chrono::steady_clock::now() < end)
+            {
+                control.Check(operation);
+                std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(end - std::chrono::steady_clock::now(), CALL_POLL_INTERVAL));
+            }
+            control.Check(operation);
+        }
+    }
+
+    /// @brief Returns peers of fake interface
+    /// @param interface_name name of wireguard interface, ex. wg0
+    /// @return list of peers
+    std::vector<PeerInfo> FakePeerController::Dump(const std::string& interface_name)
+    {
+        return this->Dump(interface_name, CallControl());
+    }
+
+    /// @brief Returns peers of fake interface after simulated latency
+    /// @param interface_name name of wireguard interface, ex. wg0
+    /// @param control deadline and cancellation of call
+    /// @return list of peers
+    std::vector<PeerInfo> FakePeerController::Dump(const std::string& interface_name, const CallControl& control)
+    {
+        std::unique_lock<std::mutex> lock(this->interfaces_mutex);
+        std::chrono::microseconds latency = this->dump_latency;
+        lock.unlock(); // other calls aren't delayed by sleep
+        SimulateLatency(latency, control, "Dump of peers of " + interface_name);
+        lock.lock();
+        this->dump_count++;
+        std::vector<PeerInfo> peers;
+        auto found = this->interfaces.find(interface_name);
+        if (found == this->interfaces.end()) return peers;
+        peers.reserve(found->second.size());
+        for (const auto& peer : found->second) peers.push_back(peer.second);
+        return peers;
+    }
+
+    /// @brief Applies changes of peers to fake interface
+    /// @param interface_name name of wireguard interface, ex. wg0
+    /// @param changes peers to add, update and remove
+    void FakePeerController::Apply(const std::string& interface_name, const PeerChanges& changes)
+    {
+        this->Apply(interface_name, changes, CallControl());
+    }
+
+    /// @brief Applies changes of peers to fake interface after simulated latency, expired call changes nothing
+    /// @param interface_name name of wireguard interface, ex. wg0
+    /// @param changes peers to add, update and remove
+    /// @param control deadline and cancellation of call
+    void FakePeerController::Apply(const std::string& interface_name, const PeerChanges& changes, const CallControl& control)
+    {
+        std::unique_lock<std::mutex> lock(this->interfaces_mutex);
+        std::chrono::microseconds latency = this->apply_latency;
+        lock.unlock(); // other calls aren't delayed by sleep
+        SimulateLatency(latency, control, "Change of peers of " + interface_name);
+        lock.lock();
+        this->apply_count++;
+        std::map<std::string, PeerInfo>& peers = this->interfaces[interface_name];
+        for (const std::string& public_key : changes.removals) peers.erase(public_key);
+        for (const PeerInfo& peer : changes.upserts)
+        {
+            PeerInfo& current = peers[peer.public_key];
+            current.public_key = peer.public_key;
+            current.allowed_ips = peer.allowed_ips;
+        }
+    }
+
+    /// @brief Adds or replaces peer of fake interface without counting it as applied change
+    /// @param interface_name name of wireguard interface, ex. wg0
+    /// @param peer peer data
+    void FakePeerController::SetPeer(const std::string& interface_name, const PeerInfo& peer)
+    {
+        std::lock_guard<std::mutex> lock(this->interfaces_mutex);
+        this->interfaces[interface_name][peer.public_key] = peer;
+    }
+
+    /// @brief Sets latest handshake of existing peer of fake interface
+    /// @param interface_name name of wireguard interface, ex. wg0
+    /// @param public_key public key of peer
+    /// @param latest_handshake unix time of handshake
+    void FakePeerController::SetHandshake(const std::string& interface_name, const std::string& public_key, time_t latest_handshake)
+    {
+        std::lock_guard<std::mutex> lock(this->interfaces_mutex);
+        auto found = this->interfaces[interface_name].find(public_key);
+        if (found == this->interfaces[interface_name].end()) throw WireguardException("Peer " + public_key + " is not found on " + interface_name);
+        found->second.latest_handshake = latest_handshake;
+    }
+
+    /// @brief Replaces all peers of fake interface, ex. with generated peers for benchmarks
+    /// @param interface_name name of wireguard interface, ex. wg0
+    /// @param peers peers data
+    void FakePeerController::SetPeers(const std::string& interface_name, const std::vector<PeerInfo>& peers)
+    {
+        std::lock_guard<std::mutex> lock(this->interfaces_mutex);
+        std::map<std::string, PeerInfo>& interface_peers = this->interfaces[interface_name];
+        interface_peers.clear();
+        for (const PeerInfo& peer : peers) interface_peers[peer.public_key] = peer;
+    }
+
+    /// @brief Sets delays of Dump and Apply, so fake interface costs as much as process of wg command
+    /// @param dump_latency delay of every Dump call
+    /// @param apply_latency delay of every Apply call
+    void FakePeerController::SetLatency(std::chrono::microseconds dump_latency, std::chrono::microseconds apply_latency)
+    {
+        std::lock_guard<std::mutex> lock(this->interfaces_mutex);
+        this->dump_latency = dump_latency;
+        this->apply_latency = apply_latency;
+    }
+
+    size_t FakePeerController::GetDumpCount() const
+    {
+        std::lock_guard<std::mutex> lock(this->interfaces_mutex);
+        return this->dump_count;
+    }
+
+    size_t FakePeerController::GetApplyCount() const
+    {
+        std::lock_guard<std::mutex> lock(this->interfaces_mutex);
+        return this->apply_count;
+    }
+}
@@ -0,0 +1,171 @@
+#include "peer_executor.hpp"
+#include "wireguard.hpp"
+
+namespace timlibs
+{
+    namespace
+    {
+        /// @brief Waits for result of call until its deadline, expired call is cancelled, so worker stops it (wg process is killed)
+        /// @param future result of call
+        /// @param control deadline and cancellation of call
+        /// @param operation name of call for error message
+        template <typename Result>
+        void WaitUntilDeadline(std::future<Result>& future, CallControl& control, const std::string& operation)
+        {
+            if (!future.valid()) throw WireguardException(operation + " isn't started");
+            std::chrono::steady_clock::time_point deadline = control.GetDeadline();
+            bool ready = deadline == std::chrono::steady_clock::time_point::max() ? (future.wait(), true) : future.wait_until(deadline) == std::future_status::ready;
+            if (ready) return;
+            control.Cancel();
+            throw WireguardException(operation + " is timed out");
+        }
+    }
+
+    /// @brief Starts workers of reads and workers of changes
+    /// @param read_threads count of workers of reads (at least one)
+    /// @param change_threads count of workers of changes (at least one)
+    PeerExecutor::PeerExecutor(size_t read_threads, size_t change_threads)
+        : change_pool{ change_threads == 0 ? 1 : change_threads }, read_pool{ read_threads == 0 ? 1 : read_threads } {}
+
+    /// @brief Reads peers of interface on worker of reads, reads don't wait for changes
+    /// @param controller backend of peers management
+    /// @param interface_name name of wireguard interface, ex. wg0
+    /// @param control deadline and cancellation of call (nullptr - without deadline)
+    /// @param callback receives peers or error
+    void PeerExecutor::Dump(std::shared_ptr<PeerController> controller, const std::string& interface_name, std::shared_ptr<CallControl> control, DumpCallback callback)
+    {
+        if (!control) control = std::make_shared<CallControl>();
+        this->read_pool.Submit([controller, interface_name, control, callback]()
+        {
+            std::vector<PeerInfo> peers;
+            std::exception_ptr error;
+            try
+            {
+                control->Check("Dump of peers of " + interface_name);
+                peers = controller->Dump(interface_name, *control);
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+            callback(std::move(peers), error);
+        });
+    }
+
+    /// @brief Queues changes of peers of interface, they are applied after all changes queued before them
+    /// @param controller backend of peers management
+    /// @param interface_name name of wireguard interface, ex. wg0
+    /// @param changes peers to add, update and remove
+    /// @param control deadline and cancellation of call (nullptr - without deadline)
+    /// @param callback receives error (nullptr if changes are applied)
+    void PeerExecutor::Apply(std::shared_ptr<PeerController> controller, const std::string& interface_name, PeerChanges changes, std::shared_ptr<CallControl> control, ApplyCallback callback)
+    {
+        if (!control) control = std::make_shared<CallControl>();
+        std::shared_ptr<PeerChanges> shared_changes = std::make_shared<PeerChanges>(std::move(changes));
+        std::function<void()> call = [controller, interface_name, shared_changes, control, callback]()
+        {
+            std::exception_ptr error;
+            try
+            {
+                control->Check("Change of peers of " + interface_name);
+                controller->Apply(interface_name, *shared_changes, *control);
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+            callback(error);
+        };
+
+        std::lock_guard<std::mutex> lock(this->queues_mutex);
+        ChangesQueue& queue = this->queues[interface_name];
+        queue.calls.push_back(std::move(call));
+        if (queue.running) return;
+        queue.running = true;
+        this->change_pool.Submit([this, interface_name]() { this->Drain(interface_name); });
+    }
+
+    /// @brief Reads peers of interface on worker
+    /// @param controller backend of peers management
+    /// @param interface_name name of wireguard interface, ex. wg0
+    /// @param control deadline and cancellation of call (nullptr - without deadline)
+    /// @return future peers, it throws WireguardException if call failed or expired
+    std::future<std::vector<PeerInfo>> PeerExecutor::Dump(std::shared_ptr<PeerController> controller, const std::string& interface_name, std::shared_ptr<CallControl> control)
+    {
+        std::shared_ptr<std::promise<std::vector<PeerInfo>>> promise = std::make_shared<std::promise<std::vector<PeerInfo>>>();
+        std::future<std::vector<PeerInfo>> future = promise->get_future();
+        this->Dump(std::move(controller), interface_name, std::move(control), [promise](std::vector<PeerInfo> peers, std::exception_ptr error)
+        {
+            if (error) promise->set_exception(error);
+            else promise->set_value(std::move(peers));
+        });
+        return future;
+    }
+
+    /// @brief Queues changes of peers of interface
+    /// @param controller backend of peers management
+    /// @param interface_name name of wireguard interface, ex. wg0
+    /// @param changes peers to add, update and remove
+    /// @param control deadline and cancellation of call (nullptr - without deadline)
+    /// @return future which is ready when changes are applied, it throws WireguardException if call failed or expired
+    std::future<void> PeerExecutor::Apply(std::shared_ptr<PeerController> controller, const std::string& interface_name, PeerChanges changes, std::shared_ptr<CallControl> control)
+    {
+        std::shared_ptr<std::promise<void>> promise = std::make_shared<std::promise<void>>();
+        std::future<void> future = promise->get_future();
+        this->Apply(std::move(controller), interface_name, std::move(changes), std::move(control), [promise](std::exception_ptr error)
+        {
+            if (error) promise->set_exception(error);
+            else promise->set_value();
+        });
+        return future;
+    }
+
+    /// @brief Counts changes of interface which aren't finished
+    /// @param interface_name name of wireguard interface, ex. wg0
+    /// @return count of queued and running changes
+    size_t PeerExecutor::GetPendingChanges(const std::string& interface_name) const
+    {
+        std::lock_guard<std::mutex> lock(this->queues_mutex);
+        auto found = this->queues.find(interface_name);
+        if (found == this->queues.end()) return 0;
+        return found->second.calls.size();
+    }
+
+    /// @brief Runs queued changes of interface one by one until queue is empty
+    /// @param interface_name name of wireguard interface, ex. wg0
+    void PeerExecutor::Drain(const std::string& interface_name)
+    {
+        std::unique_lock<std::mutex> lock(this->queues_mutex);
+        ChangesQueue& queue = this->queues[interface_name]; // references of unordered_map stay valid after inserts
+        while (!queue.calls.empty())
+        {
+            std::function<void()>& call = queue.calls.front();
+            lock.unlock();
+            call(); // call doesn't throw, errors go to callback
+            lock.lock();
+            queue.calls.pop_front();
+        }
+        queue.running = false;
+    }
+
+    /// @brief Waits for peers read by executor until deadline of call
+    /// @param future result of PeerExecutor::Dump
+    /// @param control deadline and cancellation of call, it's cancelled at deadline
+    /// @param operation name of call for error message
+    /// @return peers of interface
+    std::vector<PeerInfo> WaitForCall(std::future<std::vector<PeerInfo>>& future, CallControl& control, const std::string& operation)
+    {
+        WaitUntilDeadline(future, control, operation);
+        return future.get();
+    }
+
+    /// @brief Waits for changes of peers applied by executor until deadline of call
+    /// @param future result of PeerExecutor::Apply
+    /// @param control deadline and cancellation of call, it's cancelled at deadline
+    /// @param operation name of call for error message
+    void WaitForCall(std::future<void>& future, CallControl& control, const std::string& operation)
+    {
+        WaitUntilDeadline(future, control, operation);
+        future.get();
+    }
+}
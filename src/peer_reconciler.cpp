@@ -0,0 +1,124 @@
+#include "peer_reconciler.hpp"
+#include "allowed_ips.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace timlibs
+{
+    namespace
+    {
+        struct LiveKey
+        {
+            uint8_t bytes[WG_KEY_SIZE]; // zero if key isn't canonical
+            bool canonical;
+            size_t index; // index of live peer
+
+            const uint8_t* GetBytes() const { return this->canonical ? this->bytes : nullptr; }
+        };
+
+        /// @brief Orders keys by raw bytes, keys which aren't canonical base64 go after them in order of texts
+        /// @param left_bytes raw key or nullptr if key isn't canonical
+        /// @param left_text text of key, it's used only if key isn't canonical
+        /// @param right_bytes raw key or nullptr if key isn't canonical
+        /// @param right_text text of key, it's used only if key isn't canonical
+        /// @return true if left key goes first
+        bool KeyLess(const uint8_t* left_bytes, const std::string& left_text, const uint8_t* right_bytes, const std::string& right_text)
+        {
+            if (left_bytes != nullptr && right_bytes != nullptr) return memcmp(left_bytes, right_bytes, WG_KEY_SIZE) < 0;
+            if (left_bytes != nullptr || right_bytes != nullptr) return left_bytes != nullptr;
+            return left_text < right_text;
+        }
+
+        std::string GetText(const WireguardKey& key) { return key.GetBytes() != nullptr ? std::string() : key.ToString(); }
+
+        /// @brief Decodes key of live peer without interning, so random keys on interface don't grow StringPool
+        /// @param peer live peer
+        /// @param index index of live peer
+        /// @return raw key
+        LiveKey MakeLiveKey(const PeerInfo& peer, size_t index)
+        {
+            static const uint8_t ZERO[WG_KEY_SIZE]{};
+            LiveKey key{ {}, false, index };
+            key.canonical = KeyCodec::Parse(peer.public_key, key.bytes) && memcmp(key.bytes, ZERO, WG_KEY_SIZE) != 0; // zero key is kept as text, as WireguardKey does
+            return key;
+        }
+    }
+
+    /// @brief Converts allowed ips list to canonical form of ParseAllowedIps(), so desired and live lists can be compared as strings
+    /// @param allowed_ips ip addresses, ex.: "10.0.30.5/24,10.0.0.1"
+    /// @return minimal sorted prefixes, ex.: "10.0.0.1/32, 10.0.30.0/24" (list as is, if it isn't list of IPv4 prefixes)
+    std::string NormalizeAllowedIps(const std::string& allowed_ips)
+    {
+        std::vector<IpPrefix> prefixes;
+        if (!ParseAllowedIps(allowed_ips, prefixes)) return allowed_ips; // ex. IPv6 prefix set outside, it's never equal to list of client
+        return FormatAllowedIps(prefixes);
+    }
+
+    /// @brief Sets peers which must be on interface
+    /// @param peers desired peers (public key and allowed ips)
+    void PeerReconciler::SetDesired(std::vector<DesiredPeer> peers)
+    {
+        for (DesiredPeer& peer : peers) peer.allowed_ips = NormalizeAllowedIps(peer.allowed_ips);
+        std::sort(peers.begin(), peers.end(), [](const DesiredPeer& left, const DesiredPeer& right)
+        {
+            return KeyLess(left.public_key.GetBytes(), GetText(left.public_key), right.public_key.GetBytes(), GetText(right.public_key));
+        });
+        this->desired = std::move(peers);
+    }
+
+    /// @brief Computes adds, updates and removals that turn live peers into desired peers
+    /// @param live peers of interface
+    /// @return delta and counters
+    ReconciliationReport PeerReconciler::Reconcile(const std::vector<PeerInfo>& live) const
+    {
+        ReconciliationReport report;
+        std::vector<LiveKey> live_keys(live.size());
+        for (size_t index = 0; index < live.size(); index++) live_keys[index] = MakeLiveKey(live[index], index);
+        std::sort(live_keys.begin(), live_keys.end(), [&live](const LiveKey& left, const LiveKey& right)
+        {
+            return KeyLess(left.GetBytes(), live[left.index].public_key, right.GetBytes(), live[right.index].public_key);
+        });
+        auto wanted_first = [&live](const DesiredPeer& wanted, const LiveKey& current)
+        {
+            return KeyLess(wanted.public_key.GetBytes(), GetText(wanted.public_key), current.GetBytes(), live[current.index].public_key);
+        };
+        auto current_first = [&live](const DesiredPeer& wanted, const LiveKey& current)
+        {
+            return KeyLess(current.GetBytes(), live[current.index].public_key, wanted.public_key.GetBytes(), GetText(wanted.public_key));
+        };
+
+        std::vector<DesiredPeer>::const_iterator wanted = this->desired.begin();
+        std::vector<LiveKey>::const_iterator current_key = live_keys.begin();
+        while (wanted != this->desired.end() || current_key != live_keys.end())
+        {
+            if (current_key == live_keys.end() || (wanted != this->desired.end() && wanted_first(*wanted, *current_key)))
+            {
+                report.changes.upserts.push_back(PeerInfo{ wanted->public_key.ToString(), wanted->allowed_ips });
+                report.added++;
+                wanted++;
+            }
+            else if (wanted == this->desired.end() || current_first(*wanted, *current_key))
+            {
+                report.changes.removals.push_back(live[current_key->index].public_key);
+                report.removed++;
+                current_key++;
+            }
+            else
+            {
+                // live list is usually canonical already, so normalization runs only on mismatch
+                const PeerInfo& current = live[current_key->index];
+                if (current.allowed_ips != wanted->allowed_ips && NormalizeAllowedIps(current.allowed_ips) != wanted->allowed_ips)
+                {
+                    report.changes.upserts.push_back(PeerInfo{ wanted->public_key.ToString(), wanted->allowed_ips });
+                    report.updated++;
+                }
+                else report.unchanged++;
+                wanted++;
+                current_key++;
+            }
+        }
+        return report;
+    }
+
+    size_t PeerReconciler::GetDesiredCount() const { return this->desired.size(); }
+}
@@ -0,0 +1,179 @@
+#include "peer_telemetry.hpp"
+#include <algorithm>
+
+namespace timlibs
+{
+    /// @brief Creates empty telemetry
+    /// @param history_size samples per peer (at least 2, rates need two samples)
+    /// @param events_size endpoint changes kept in memory
+    PeerTelemetry::PeerTelemetry(size_t history_size, size_t events_size) :
+        history_size{ std::max<size_t>(history_size, 2) }, events(std::max<size_t>(events_size, 1)) {}
+
+    /// @brief Adds sample of every peer of dump and endpoint changes, forgets peers that are absent
+    /// @param peers full dump of interface
+    /// @param now time of dump
+    void PeerTelemetry::Sample(const std::vector<PeerInfo>& peers, time_t now)
+    {
+        std::lock_guard<std::mutex> lock(this->telemetry_mutex);
+        this->generation++;
+        for (const PeerInfo& peer : peers)
+        {
+            auto found = this->by_public_key.find(peer.public_key);
+            size_t index = 0;
+            if (found != this->by_public_key.end()) index = found->second;
+            else
+            {
+                if (!this->free_slots.empty())
+                {
+                    index = this->free_slots.back();
+                    this->free_slots.pop_back();
+                }
+                else
+                {
+                    index = this->slots.size();
+                    this->slots.emplace_back();
+                    this->samples.resize(this->samples.size() + this->history_size);
+                }
+                Slot& slot = this->slots[index];
+                slot.public_key = peer.public_key;
+                slot.endpoint = peer.endpoint;
+                slot.head = 0;
+                slot.count = 0;
+                this->by_public_key.emplace(peer.public_key, index);
+            }
+
+            Slot& slot = this->slots[index];
+            slot.generation = this->generation;
+            if (slot.endpoint != peer.endpoint)
+            {
+                this->AddEndpointChange(slot, peer.endpoint, now);
+                slot.endpoint = peer.endpoint;
+            }
+            this->samples[index * this->history_size + slot.head] = PeerSample{ now, peer.latest_handshake, peer.rx_bytes, peer.tx_bytes };
+            slot.head = (slot.head + 1) % this->history_size;
+            slot.count = std::min(slot.count + 1, this->history_size);
+        }
+
+        for (size_t index = 0; index < this->slots.size(); index++)
+        {
+            Slot& slot = this->slots[index];
+            if (slot.public_key.empty() || slot.generation == this->generation) continue;
+            this->by_public_key.erase(slot.public_key);
+            slot.public_key.clear(); // capacity stays for the next peer of slot
+            this->free_slots.push_back(index);
+        }
+    }
+
+    /// @brief Gets samples of peer
+    /// @param public_key peer public key
+    /// @return samples, oldest first (empty if peer is unknown)
+    std::vector<PeerSample> PeerTelemetry::GetHistory(const std::string& public_key) const
+    {
+        std::lock_guard<std::mutex> lock(this->telemetry_mutex);
+        std::vector<PeerSample> history;
+        auto found = this->by_public_key.find(public_key);
+        if (found == this->by_public_key.end()) return history;
+        const Slot& slot = this->slots[found->second];
+        history.reserve(slot.count);
+        for (size_t age = slot.count; age > 0; age--) history.push_back(this->GetSample(slot, age - 1));
+        return history;
+    }
+
+    /// @brief Gets throughput of peer
+    /// @param public_key peer public key
+    /// @param rate output rates and counters
+    /// @return false if peer is unknown
+    bool PeerTelemetry::GetRate(const std::string& public_key, PeerRate& rate) const
+    {
+        std::lock_guard<std::mutex> lock(this->telemetry_mutex);
+        auto found = this->by_public_key.find(public_key);
+        if (found == this->by_public_key.end()) return false;
+        rate = this->GetRate(this->slots[found->second]);
+        return true;
+    }
+
+    /// @brief Gets peers with the biggest traffic between the last two samples
+    /// @param count maximal count of peers
+    /// @return peers by descending rx_rate + tx_rate
+    std::vector<PeerRate> PeerTelemetry::GetTopTalkers(size_t count) const
+    {
+        std::lock_guard<std::mutex> lock(this->telemetry_mutex);
+        std::vector<PeerRate> rates;
+        rates.reserve(this->by_public_key.size());
+        for (const Slot& slot : this->slots)
+        {
+            if (!slot.public_key.empty()) rates.push_back(this->GetRate(slot));
+        }
+        count = std::min(count, rates.size());
+        std::partial_sort(rates.begin(), rates.begin() + count, rates.end(), [](const PeerRate& left, const PeerRate& right)
+        {
+            return left.rx_rate + left.tx_rate > right.rx_rate + right.tx_rate;
+        });
+        rates.resize(count);
+        return rates;
+    }
+
+    /// @brief Gets endpoint changes, ex. roaming of clients between networks
+    /// @param after_sequence sequence of the last known event (0 for all)
+    /// @return events with bigger sequence that are still in ring, oldest first
+    std::vector<EndpointChange> PeerTelemetry::GetEndpointChanges(uint64_t after_sequence) const
+    {
+        std::lock_guard<std::mutex> lock(this->telemetry_mutex);
+        std::vector<EndpointChange> changes;
+        uint64_t first = (this->sequence > this->events.size()) ? this->sequence - this->events.size() + 1 : 1;
+        for (uint64_t sequence = std::max(first, after_sequence + 1); sequence <= this->sequence; sequence++)
+        {
+            changes.push_back(this->events[(sequence - 1) % this->events.size()]);
+        }
+        return changes;
+    }
+
+    size_t PeerTelemetry::GetPeerCount() const
+    {
+        std::lock_guard<std::mutex> lock(this->telemetry_mutex);
+        return this->by_public_key.size();
+    }
+
+    const PeerSample& PeerTelemetry::GetSample(const Slot& slot, size_t age) const
+    {
+        size_t index = (slot.head + this->history_size - 1 - age) % this->history_size;
+        return this->samples[(&slot - this->slots.data()) * this->history_size + index];
+    }
+
+    /// @brief Computes rates between the last two samples of slot, counters that went down (interface was recreated) count from zero
+    /// @param slot slot of peer
+    /// @return rates of peer
+    PeerRate PeerTelemetry::GetRate(const Slot& slot) const
+    {
+        PeerRate rate;
+        rate.public_key = slot.public_key;
+        rate.endpoint = slot.endpoint;
+        if (slot.count == 0) return rate;
+        const PeerSample& last = this->GetSample(slot, 0);
+        rate.rx_bytes = last.rx_bytes;
+        rate.tx_bytes = last.tx_bytes;
+        rate.latest_handshake = last.latest_handshake;
+        if (slot.count < 2) return rate;
+
+        const PeerSample& previous = this->GetSample(slot, 1);
+        if (last.time <= previous.time) return rate;
+        double seconds = (double)(last.time - previous.time);
+        rate.rx_rate = (last.rx_bytes - ((last.rx_bytes >= previous.rx_bytes) ? previous.rx_bytes : 0)) / seconds;
+        rate.tx_rate = (last.tx_bytes - ((last.tx_bytes >= previous.tx_bytes) ? previous.tx_bytes : 0)) / seconds;
+        return rate;
+    }
+
+    /// @brief Writes endpoint change to ring, the oldest event is overwritten
+    /// @param slot slot of peer with old endpoint
+    /// @param new_endpoint endpoint of dump
+    /// @param now time of dump
+    void PeerTelemetry::AddEndpointChange(const Slot& slot, const std::string& new_endpoint, time_t now)
+    {
+        EndpointChange& event = this->events[this->sequence % this->events.size()];
+        event.sequence = ++this->sequence;
+        event.time = now;
+        event.public_key = slot.public_key;
+        event.old_endpoint = slot.endpoint;
+        event.new_endpoint = new_endpoint;
+    }
+}
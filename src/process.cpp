@@ -0,0 +1,107 @@
+#include "process.hpp"
+#include "wireguard.hpp"
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+
+extern char** environ;
+
+namespace timlibs
+{
+    /// @brief Sets deadline of call
+    /// @param deadline moment after which call is expired (max - never)
+    CallControl::CallControl(std::chrono::steady_clock::time_point deadline) : deadline{ deadline } {}
+
+    /// @brief Sets deadline of call relative to now
+    /// @param timeout time for call
+    CallControl::CallControl(std::chrono::milliseconds timeout) : deadline{ std::chrono::steady_clock::now() + timeout } {}
+
+    void CallControl::Cancel() { this->cancelled.store(true); }
+
+    bool CallControl::IsCancelled() const { return this->cancelled.load(); }
+
+    bool CallControl::IsExpired() const { return this->IsCancelled() || std::chrono::steady_clock::now() >= this->deadline; }
+
+    /// @brief Stops call which is expired
+    /// @param operation name of call for error message, ex.: wg show wg0 dump
+    void CallControl::Check(const std::string& operation) const
+    {
+        if (this->IsCancelled()) throw WireguardException(operation + " is cancelled");
+        if (std::chrono::steady_clock::now() >= this->deadline) throw WireguardException(operation + " is timed out");
+    }
+
+    std::chrono::steady_clock::time_point CallControl::GetDeadline() const { return this->deadline; }
+
+
+    /// @brief Runs program without shell and waits for it, so arguments don't need escaping
+    /// @param arguments program name and arguments, ex.: {"wg", "show", "wg0", "dump"}
+    /// @return exit code and stdout of program
+    ProcessResult RunProcess(const std::vector<std::string>& arguments)
+    {
+        return RunProcess(arguments, CallControl());
+    }
+
+    /// @brief Runs program without shell and waits for it until call expires, stalled program is killed
+    /// @param arguments program name and arguments, ex.: {"wg", "show", "wg0", "dump"}
+    /// @param control deadline and cancellation of call
+    /// @return exit code and stdout of program
+    ProcessResult RunProcess(const std::vector<std::string>& arguments, const CallControl& control)
+    {
+        if (arguments.empty()) throw WireguardException("Program for run isn't set");
+
+        std::vector<char*> argv;
+        argv.reserve(arguments.size() + 1);
+        for (const std::string& argument : arguments) argv.push_back(const_cast<char*>(argument.c_str()));
+        argv.push_back(nullptr);
+
+        int pipe_fds[2];
+        if (pipe2(pipe_fds, O_CLOEXEC) < 0) throw WireguardException("Unable to create pipe: " + std::string(strerror(errno)));
+
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        posix_spawn_file_actions_adddup2(&actions, pipe_fds[1], STDOUT_FILENO);
+
+        pid_t pid;
+        int error = posix_spawnp(&pid, argv[0], &actions, nullptr, argv.data(), environ);
+        posix_spawn_file_actions_destroy(&actions);
+        close(pipe_fds[1]);
+        if (error != 0)
+        {
+            close(pipe_fds[0]);
+            throw WireguardException("Unable to run " + arguments[0] + ": " + std::string(strerror(error)));
+        }
+
+        ProcessResult result;
+        char buffer[8192];
+        bool expired = false;
+        while (true)
+        {
+            if (control.IsExpired())
+            {
+                expired = true;
+                break;
+            }
+            pollfd output{ pipe_fds[0], POLLIN, 0 };
+            int ready = poll(&output, 1, (int)std::chrono::duration_cast<std::chrono::milliseconds>(CALL_POLL_INTERVAL).count());
+            if (ready < 0 && errno == EINTR) continue;
+            if (ready == 0) continue;
+            ssize_t received = read(pipe_fds[0], buffer, sizeof(buffer));
+            if (received < 0 && errno == EINTR) continue;
+            if (received <= 0) break;
+            result.output.append(buffer, (size_t)received);
+        }
+        close(pipe_fds[0]);
+        if (expired) kill(pid, SIGKILL);
+
+        int status = 0;
+        while (waitpid(pid, &status, 0) < 0 && errno == EINTR);
+        result.exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+        if (expired) control.Check(arguments[0]);
+        return result;
+    }
+}
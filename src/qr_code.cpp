@@ -0,0 +1,711 @@
+#include "qr_code.hpp"
+#include "wireguard.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <charconv>
+#include <string_view>
+
+#define QR_VERSION_MIN 1
+#define QR_VERSION_MAX 40
+#define QR_SIZE_MAX (QR_VERSION_MAX * 4 + 17)
+#define ADLER_MODULUS 65521
+#define ADLER_CHUNK_SIZE 5552 // the largest chunk without overflow of 32-bit sums
+#define QR_PENALTY_N1 3
+#define QR_PENALTY_N2 3
+#define QR_PENALTY_N3 40
+#define QR_PENALTY_N4 10
+#define QR_MASK_PERIOD 12 // lcm of periods of all masks
+
+namespace timlibs
+{
+    namespace
+    {
+        // Error correction codewords per block, by level and version (index 0 is unused)
+        const int8_t ECC_CODEWORDS_PER_BLOCK[4][41] =
+        {
+            { -1,  7, 10, 15, 20, 26, 18, 20, 24, 30, 18, 20, 24, 26, 30, 22, 24, 28, 30, 28, 28, 28, 28, 30, 30, 26, 28, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30 },
+            { -1, 10, 16, 26, 18, 24, 16, 18, 22, 22, 26, 30, 22, 22, 24, 24, 28, 28, 26, 26, 26, 26, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28 },
+            { -1, 13, 22, 18, 26, 18, 24, 18, 22, 20, 24, 28, 26, 24, 20, 30, 24, 28, 28, 26, 30, 28, 30, 30, 30, 30, 28, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30 },
+            { -1, 17, 28, 22, 16, 22, 28, 26, 26, 24, 28, 24, 28, 22, 24, 24, 30, 28, 28, 26, 28, 30, 24, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30 }
+        };
+
+        // Error correction blocks, by level and version (index 0 is unused)
+        const int8_t ERROR_CORRECTION_BLOCKS[4][41] =
+        {
+            { -1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 4,  4,  4,  4,  4,  6,  6,  6,  6,  7,  8,  8,  9,  9, 10, 12, 12, 12, 13, 14, 15, 16, 17, 18, 19, 19, 20, 21, 22, 24, 25 },
+            { -1, 1, 1, 1, 2, 2, 4, 4, 4, 5, 5,  5,  8,  9,  9, 10, 10, 11, 13, 14, 16, 17, 17, 18, 20, 21, 23, 25, 26, 28, 29, 31, 33, 35, 37, 38, 40, 43, 45, 47, 49 },
+            { -1, 1, 1, 2, 2, 4, 4, 6, 6, 8, 8,  8, 10, 12, 16, 12, 17, 16, 18, 21, 20, 23, 23, 25, 27, 29, 34, 34, 35, 38, 40, 43, 45, 48, 51, 53, 56, 59, 62, 65, 68 },
+            { -1, 1, 1, 2, 4, 4, 4, 5, 6, 8, 8, 11, 11, 16, 16, 18, 16, 19, 21, 25, 25, 25, 34, 30, 32, 35, 37, 40, 42, 45, 48, 51, 54, 57, 60, 63, 66, 70, 74, 77, 81 }
+        };
+
+        const int FORMAT_BITS[4] = { 1, 0, 3, 2 }; // L, M, Q, H in format information
+
+        bool GetBit(long value, int index) { return ((value >> index) & 1) != 0; }
+
+        /// @brief Counts modules that may hold data and error correction bits
+        /// @param version version of code
+        /// @return count of modules
+        int GetRawDataModules(int version)
+        {
+            int result = (16 * version + 128) * version + 64;
+            if (version >= 2)
+            {
+                int alignments = version / 7 + 2;
+                result -= (25 * alignments - 10) * alignments - 55;
+                if (version >= 7) result -= 36;
+            }
+            return result;
+        }
+
+        /// @brief Counts data codewords of version without error correction codewords
+        /// @param version version of code
+        /// @param level error correction level
+        /// @return count of 8-bit codewords
+        int GetDataCodewords(int version, QrErrorCorrection level)
+        {
+            return GetRawDataModules(version) / 8 - ECC_CODEWORDS_PER_BLOCK[(int)level][version] * ERROR_CORRECTION_BLOCKS[(int)level][version];
+        }
+
+        /// @brief Gets coordinates of alignment patterns centers
+        /// @param version version of code
+        /// @return ascending coordinates, the same for x and y
+        std::vector<int> GetAlignmentPositions(int version)
+        {
+            if (version == 1) return {};
+            int alignments = version / 7 + 2;
+            int step = (version * 8 + alignments * 3 + 5) / (alignments * 4 - 4) * 2;
+            std::vector<int> positions(alignments);
+            positions[0] = 6;
+            for (int index = alignments - 1, position = version * 4 + 10; index >= 1; index--, position -= step) positions[index] = position;
+            return positions;
+        }
+
+        // Logarithms and powers of generator 2 in GF(2^8) modulo x^8 + x^4 + x^3 + x^2 + 1
+        struct GaloisTables
+        {
+            uint8_t exponents[512];
+            uint8_t logarithms[256];
+
+            GaloisTables()
+            {
+                int value = 1;
+                for (int power = 0; power < 255; power++)
+                {
+                    this->exponents[power] = (uint8_t)value;
+                    this->logarithms[value] = (uint8_t)power;
+                    value <<= 1;
+                    if (value & 0x100) value ^= 0x11D;
+                }
+                for (int power = 255; power < 512; power++) this->exponents[power] = this->exponents[power - 255]; // sum of logarithms isn't reduced
+                this->logarithms[0] = 0;
+            }
+        };
+
+        const GaloisTables GALOIS_TABLES;
+
+        uint8_t Multiply(uint8_t x, uint8_t y)
+        {
+            if (x == 0 || y == 0) return 0;
+            return GALOIS_TABLES.exponents[GALOIS_TABLES.logarithms[x] + GALOIS_TABLES.logarithms[y]];
+        }
+
+        typedef uint8_t MaskPatterns[8][QR_MASK_PERIOD][QR_MASK_PERIOD];
+
+        /// @brief Builds patterns of masks, every mask repeats with period of 12 modules in both directions
+        /// @return 1 for inverted module
+        const MaskPatterns& GetMaskPatterns()
+        {
+            static const struct Patterns
+            {
+                MaskPatterns values;
+
+                Patterns()
+                {
+                    for (int mask = 0; mask < 8; mask++)
+                    {
+                        for (int y = 0; y < QR_MASK_PERIOD; y++)
+                        {
+                            for (int x = 0; x < QR_MASK_PERIOD; x++)
+                            {
+                                bool invert = false;
+                                switch (mask)
+                                {
+                                case 0: invert = (x + y) % 2 == 0; break;
+                                case 1: invert = y % 2 == 0; break;
+                                case 2: invert = x % 3 == 0; break;
+                                case 3: invert = (x + y) % 3 == 0; break;
+                                case 4: invert = (x / 3 + y / 2) % 2 == 0; break;
+                                case 5: invert = x * y % 2 + x * y % 3 == 0; break;
+                                case 6: invert = (x * y % 2 + x * y % 3) % 2 == 0; break;
+                                default: invert = ((x + y) % 2 + x * y % 3) % 2 == 0; break;
+                                }
+                                this->values[mask][y][x] = invert;
+                            }
+                        }
+                    }
+                }
+            } patterns;
+            return patterns.values;
+        }
+
+        /// @brief Computes Reed-Solomon generator polynomial without leading term
+        /// @param degree count of error correction codewords
+        /// @return coefficients from highest to lowest power
+        std::vector<uint8_t> ComputeDivisor(int degree)
+        {
+            std::vector<uint8_t> result(degree);
+            result[degree - 1] = 1;
+            uint8_t root = 1;
+            for (int index = 0; index < degree; index++)
+            {
+                for (int term = 0; term < degree; term++)
+                {
+                    result[term] = Multiply(result[term], root);
+                    if (term + 1 < degree) result[term] ^= result[term + 1];
+                }
+                root = Multiply(root, 0x02);
+            }
+            return result;
+        }
+
+        /// @brief Computes error correction codewords of block
+        /// @param data data codewords of block
+        /// @param divisor generator polynomial
+        /// @return remainder of division
+        std::vector<uint8_t> ComputeRemainder(const uint8_t* data, size_t size, const std::vector<uint8_t>& divisor)
+        {
+            std::vector<uint8_t> result(divisor.size());
+            for (size_t index = 0; index < size; index++)
+            {
+                uint8_t factor = data[index] ^ result[0];
+                result.erase(result.begin());
+                result.push_back(0);
+                for (size_t term = 0; term < result.size(); term++) result[term] ^= Multiply(divisor[term], factor);
+            }
+            return result;
+        }
+
+        /// @brief Splits data into blocks, adds error correction to every block and interleaves codewords of blocks
+        /// @param data data codewords
+        /// @param version version of code
+        /// @param level error correction level
+        /// @return all codewords in order of placement
+        std::vector<uint8_t> AddErrorCorrection(const std::vector<uint8_t>& data, int version, QrErrorCorrection level)
+        {
+            int blocks = ERROR_CORRECTION_BLOCKS[(int)level][version];
+            int ecc_length = ECC_CODEWORDS_PER_BLOCK[(int)level][version];
+            int raw_codewords = GetRawDataModules(version) / 8;
+            int short_blocks = blocks - raw_codewords % blocks;
+            int short_block_length = raw_codewords / blocks;
+
+            std::vector<uint8_t> divisor = ComputeDivisor(ecc_length);
+            std::vector<std::vector<uint8_t>> parts;
+            size_t offset = 0;
+            for (int block = 0; block < blocks; block++)
+            {
+                size_t length = short_block_length - ecc_length + (block < short_blocks ? 0 : 1);
+                std::vector<uint8_t> part(data.begin() + offset, data.begin() + offset + length);
+                std::vector<uint8_t> ecc = ComputeRemainder(data.data() + offset, length, divisor);
+                offset += length;
+                if (block < short_blocks) part.push_back(0); // placeholder, skipped by interleaving
+                part.insert(part.end(), ecc.begin(), ecc.end());
+                parts.push_back(std::move(part));
+            }
+
+            std::vector<uint8_t> result;
+            result.reserve(raw_codewords);
+            for (size_t index = 0; index < parts[0].size(); index++)
+            {
+                for (int block = 0; block < blocks; block++)
+                {
+                    if (index != (size_t)(short_block_length - ecc_length) || block >= short_blocks) result.push_back(parts[block][index]);
+                }
+            }
+            return result;
+        }
+
+        /// @brief Computes penalty of runs and finder-like patterns (1:1:3:1:1 with 4 light modules at one side) of one row or column.
+        /// @brief Lengths of runs are collected without branches on modules, then only runs are checked
+        /// @param line modules of line
+        /// @param size count of modules
+        /// @return penalty
+        long GetLinePenalty(const uint8_t* line, int size)
+        {
+            int ends[QR_SIZE_MAX + 2]; // position after every run, stored without branches on modules
+            int index = line[0] ? 1 : 0;
+            ends[0] = 0; // empty light run before dark module
+            for (int position = 1; position < size; position++)
+            {
+                ends[index] = position;
+                index += line[position] != line[position - 1];
+            }
+            ends[index] = size;
+            int runs[QR_SIZE_MAX + 2]; // even runs are light, runs[0] and the last run include light border
+            runs[0] = ends[0];
+            for (int run = 1; run <= index; run++) runs[run] = ends[run] - ends[run - 1];
+
+            long result = 0;
+            for (int run = 0; run <= index; run++) result += (runs[run] >= 5) * (QR_PENALTY_N1 + runs[run] - 5);
+
+            runs[0] += size;
+            if (index & 1) runs[++index] = 0; // light border after dark run is a new run
+            runs[index] += size;
+            for (int run = 6; run <= index; run += 2) // patterns end with light run
+            {
+                int n = runs[run - 5];
+                bool core = n > 0 && runs[run - 4] == n && runs[run - 3] == n * 3 && runs[run - 2] == n && runs[run - 1] == n;
+                result += core * ((runs[run - 6] >= n * 4 && runs[run] >= n) + (runs[run] >= n * 4 && runs[run - 6] >= n)) * QR_PENALTY_N3;
+            }
+            return result;
+        }
+
+        // Bit writer of deflate stream, bits are packed from the least significant one
+        class BitWriter
+        {
+        public:
+            void Write(uint32_t value, int bits)
+            {
+                this->current |= (uint64_t)value << this->count;
+                this->count += bits;
+                while (this->count >= 8)
+                {
+                    this->output.push_back((char)this->current);
+                    this->current >>= 8;
+                    this->count -= 8;
+                }
+            }
+
+            void WriteCode(uint32_t code, int bits) // huffman codes are written from the most significant bit
+            {
+                uint32_t reversed = 0;
+                for (int index = 0; index < bits; index++) reversed |= ((code >> index) & 1) << (bits - 1 - index);
+                this->Write(reversed, bits);
+            }
+
+            void Reserve(size_t size) { this->output.reserve(size); }
+
+            std::string Finish()
+            {
+                if (this->count > 0) this->output.push_back((char)this->current);
+                return std::move(this->output);
+            }
+        private:
+            std::string output;
+            uint64_t current{ 0 };
+            int count{ 0 };
+        };
+
+        const uint16_t LENGTH_BASES[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+        const uint8_t LENGTH_EXTRA_BITS[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+        const uint16_t DISTANCE_BASES[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+        const uint8_t DISTANCE_EXTRA_BITS[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+        /// @brief Writes symbol of literal/length alphabet with fixed huffman code
+        void WriteSymbol(BitWriter& writer, int symbol)
+        {
+            if (symbol < 144) writer.WriteCode(0x30 + symbol, 8);
+            else if (symbol < 256) writer.WriteCode(0x190 + symbol - 144, 9);
+            else if (symbol < 280) writer.WriteCode(symbol - 256, 7);
+            else writer.WriteCode(0xC0 + symbol - 280, 8);
+        }
+
+        void WriteMatch(BitWriter& writer, int length, int distance)
+        {
+            int code = 28;
+            while (LENGTH_BASES[code] > length) code--;
+            WriteSymbol(writer, 257 + code);
+            writer.Write(length - LENGTH_BASES[code], LENGTH_EXTRA_BITS[code]);
+            code = 29;
+            while (DISTANCE_BASES[code] > distance) code--;
+            writer.WriteCode(code, 5);
+            writer.Write(distance - DISTANCE_BASES[code], DISTANCE_EXTRA_BITS[code]);
+        }
+
+        /// @brief Compresses image rows by deflate with fixed huffman codes. Only two distances are tried:
+        /// @brief the previous byte (runs of modules) and the previous row (rows of scaled module are equal), it's enough for QR images
+        /// @param data filtered rows of image
+        /// @param row_length bytes per row with filter byte
+        /// @return zlib stream
+        std::string Deflate(const std::string& data, size_t row_length)
+        {
+            BitWriter writer;
+            writer.Reserve(data.size() / 4);
+            writer.Write(1, 1); // the last block
+            writer.Write(1, 2); // fixed huffman codes
+            size_t position = 0;
+            while (position < data.size())
+            {
+                int best_length = 0;
+                int best_distance = 0;
+                for (size_t distance : { row_length, (size_t)1 })
+                {
+                    if (distance > position || distance > 32768) continue;
+                    int length = 0;
+                    while (length < 258 && position + length < data.size() && data[position + length] == data[position + length - distance]) length++;
+                    if (length > best_length)
+                    {
+                        best_length = length;
+                        best_distance = (int)distance;
+                    }
+                }
+                if (best_length >= 3)
+                {
+                    WriteMatch(writer, best_length, best_distance);
+                    position += best_length;
+                }
+                else WriteSymbol(writer, (uint8_t)data[position++]);
+            }
+            WriteSymbol(writer, 256); // end of block
+
+            uint32_t a = 1;
+            uint32_t b = 0;
+            for (size_t begin = 0; begin < data.size(); begin += ADLER_CHUNK_SIZE) // sums don't overflow within chunk
+            {
+                size_t end = std::min(begin + ADLER_CHUNK_SIZE, data.size());
+                for (size_t index = begin; index < end; index++)
+                {
+                    a += (uint8_t)data[index];
+                    b += a;
+                }
+                a %= ADLER_MODULUS;
+                b %= ADLER_MODULUS;
+            }
+            uint32_t adler = (b << 16) | a;
+            std::string stream = "\x78\x01";
+            stream += writer.Finish();
+            for (int shift = 24; shift >= 0; shift -= 8) stream.push_back((char)(adler >> shift));
+            return stream;
+        }
+
+        uint32_t Crc32(const std::string& data, uint32_t crc = 0)
+        {
+            static const std::vector<uint32_t> table = []()
+            {
+                std::vector<uint32_t> table(256);
+                for (uint32_t index = 0; index < 256; index++)
+                {
+                    uint32_t value = index;
+                    for (int bit = 0; bit < 8; bit++) value = (value & 1) ? 0xEDB88320 ^ (value >> 1) : value >> 1;
+                    table[index] = value;
+                }
+                return table;
+            }();
+            crc = ~crc;
+            for (char byte : data) crc = table[(crc ^ (uint8_t)byte) & 0xFF] ^ (crc >> 8);
+            return ~crc;
+        }
+
+        void AppendUint32(std::string& output, uint32_t value)
+        {
+            for (int shift = 24; shift >= 0; shift -= 8) output.push_back((char)(value >> shift));
+        }
+
+        void AppendChunk(std::string& png, const char* type, const std::string& data)
+        {
+            AppendUint32(png, (uint32_t)data.size());
+            std::string body = std::string(type, 4) + data;
+            png += body;
+            AppendUint32(png, Crc32(body));
+        }
+    }
+
+    /// @brief Encodes text in byte mode with the smallest version, the mask with the lowest penalty is chosen
+    /// @param text text, ex. client configuration
+    /// @param error_correction error correction level
+    /// @return QR code
+    QrCode QrCode::Encode(const std::string& text, QrErrorCorrection error_correction)
+    {
+        int version = QR_VERSION_MIN;
+        size_t used_bits = 0;
+        for (;; version++)
+        {
+            if (version > QR_VERSION_MAX) throw WireguardException("Text of " + std::to_string(text.size()) + " bytes doesn't fit in QR code");
+            int count_bits = (version <= 9) ? 8 : 16;
+            used_bits = 4 + count_bits + text.size() * 8;
+            if (text.size() < ((size_t)1 << count_bits) && used_bits <= (size_t)GetDataCodewords(version, error_correction) * 8) break;
+        }
+
+        size_t capacity = (size_t)GetDataCodewords(version, error_correction) * 8;
+        std::vector<uint8_t> data(capacity / 8);
+        size_t bit = 0;
+        auto append = [&data, &bit](uint32_t value, int bits)
+        {
+            for (int index = bits - 1; index >= 0; index--, bit++) data[bit >> 3] |= ((value >> index) & 1) << (7 - (bit & 7));
+        };
+        append(0x4, 4); // byte mode
+        append((uint32_t)text.size(), (version <= 9) ? 8 : 16);
+        for (char character : text) append((uint8_t)character, 8);
+        bit += std::min<size_t>(4, capacity - bit); // terminator
+        bit = (bit + 7) / 8 * 8;
+        for (uint8_t pad = 0xEC; bit < capacity; pad ^= 0xEC ^ 0x11) append(pad, 8);
+
+        QrCode code(version, error_correction);
+        code.DrawCodewords(AddErrorCorrection(data, version, error_correction));
+        long best_penalty = -1;
+        for (int mask = 0; mask < 8; mask++)
+        {
+            code.ApplyMask(mask);
+            code.DrawFormatBits(mask);
+            long penalty = code.GetPenaltyScore();
+            if (best_penalty < 0 || penalty < best_penalty)
+            {
+                best_penalty = penalty;
+                code.mask = mask;
+            }
+            code.ApplyMask(mask); // xor again to undo
+        }
+        code.ApplyMask(code.mask);
+        code.DrawFormatBits(code.mask);
+        return code;
+    }
+
+    QrCode::QrCode(int version, QrErrorCorrection error_correction) :
+        version{ version }, size{ version * 4 + 17 }, error_correction{ error_correction }, modules(size * size), function_modules(size * size)
+    {
+        this->DrawFunctionPatterns();
+    }
+
+    int QrCode::GetVersion() const { return this->version; }
+
+    int QrCode::GetSize() const { return this->size; }
+
+    int QrCode::GetMask() const { return this->mask; }
+
+    bool QrCode::GetModule(int x, int y) const
+    {
+        return x >= 0 && x < this->size && y >= 0 && y < this->size && this->modules[y * this->size + x];
+    }
+
+    /// @brief Renders code as SVG, dark modules of row are merged into horizontal runs
+    /// @param border light modules around code
+    /// @return SVG document
+    std::string QrCode::ToSvg(int border) const
+    {
+        int side = this->size + border * 2;
+        std::string svg = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+            "<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\" viewBox=\"0 0 " + std::to_string(side) + " " + std::to_string(side) + "\" stroke=\"none\">\n"
+            "<rect width=\"100%\" height=\"100%\" fill=\"#FFFFFF\"/>\n<path d=\"";
+        svg.reserve(svg.size() + (size_t)this->size * this->size * 4);
+        char buffer[64];
+        for (int y = 0; y < this->size; y++)
+        {
+            for (int x = 0; x < this->size; x++)
+            {
+                if (!this->GetModule(x, y)) continue;
+                int length = 1;
+                while (this->GetModule(x + length, y)) length++;
+                char* end = buffer;
+                *end++ = 'M';
+                end = std::to_chars(end, buffer + sizeof(buffer), x + border).ptr;
+                *end++ = ',';
+                end = std::to_chars(end, buffer + sizeof(buffer), y + border).ptr;
+                *end++ = 'h';
+                char* length_begin = end;
+                end = std::to_chars(end, buffer + sizeof(buffer), length).ptr;
+                std::string_view length_text(length_begin, end - length_begin);
+                svg.append(buffer, end - buffer);
+                svg += "v1h-";
+                svg += length_text;
+                svg += 'z';
+                x += length;
+            }
+        }
+        svg += "\" fill=\"#000000\"/>\n</svg>\n";
+        return svg;
+    }
+
+    /// @brief Renders code as 1-bit grayscale PNG
+    /// @param scale pixels per module
+    /// @param border light modules around code
+    /// @return PNG file
+    std::string QrCode::ToPng(int scale, int border) const
+    {
+        if (scale < 1 || border < 0) throw WireguardException("Invalid scale or border of QR code");
+        uint32_t width = (uint32_t)(this->size + border * 2) * scale;
+        size_t row_length = 1 + (width + 7) / 8; // filter byte + pixels
+        std::string rows;
+        rows.reserve(row_length * width);
+        for (int y = -border; y < this->size + border; y++) // pixel rows of module row are equal
+        {
+            std::string row(row_length, (char)0xFF); // light by default
+            row[0] = '\0'; // filter type 0 (none)
+            for (int module = 0; module < this->size; module++)
+            {
+                if (!this->GetModule(module, y)) continue;
+                for (uint32_t x = (uint32_t)(module + border) * scale, end = x + scale; x < end; x++) row[1 + x / 8] &= (char)~(0x80 >> (x % 8));
+            }
+            for (int copy = 0; copy < scale; copy++) rows += row;
+        }
+
+        std::string png = "\x89PNG\r\n\x1A\n";
+        std::string header;
+        AppendUint32(header, width);
+        AppendUint32(header, width);
+        header += std::string("\x01\x00\x00\x00\x00", 5); // bit depth 1, grayscale, deflate, no filter, no interlace
+        AppendChunk(png, "IHDR", header);
+        AppendChunk(png, "IDAT", Deflate(rows, row_length));
+        AppendChunk(png, "IEND", "");
+        return png;
+    }
+
+    void QrCode::DrawFunctionPatterns()
+    {
+        for (int index = 0; index < this->size; index++)
+        {
+            this->SetFunctionModule(6, index, index % 2 == 0);
+            this->SetFunctionModule(index, 6, index % 2 == 0);
+        }
+        this->DrawFinderPattern(3, 3);
+        this->DrawFinderPattern(this->size - 4, 3);
+        this->DrawFinderPattern(3, this->size - 4);
+
+        std::vector<int> positions = GetAlignmentPositions(this->version);
+        size_t count = positions.size();
+        for (size_t i = 0; i < count; i++)
+        {
+            for (size_t j = 0; j < count; j++)
+            {
+                if ((i == 0 && j == 0) || (i == 0 && j == count - 1) || (i == count - 1 && j == 0)) continue; // corners of finder patterns
+                this->DrawAlignmentPattern(positions[i], positions[j]);
+            }
+        }
+        this->DrawFormatBits(0); // reserves modules, real bits are drawn after mask is chosen
+        this->DrawVersion();
+    }
+
+    void QrCode::DrawFinderPattern(int x, int y)
+    {
+        for (int dy = -4; dy <= 4; dy++)
+        {
+            for (int dx = -4; dx <= 4; dx++)
+            {
+                int distance = std::max(std::abs(dx), std::abs(dy));
+                int module_x = x + dx;
+                int module_y = y + dy;
+                if (module_x >= 0 && module_x < this->size && module_y >= 0 && module_y < this->size) this->SetFunctionModule(module_x, module_y, distance != 2 && distance != 4);
+            }
+        }
+    }
+
+    void QrCode::DrawAlignmentPattern(int x, int y)
+    {
+        for (int dy = -2; dy <= 2; dy++)
+        {
+            for (int dx = -2; dx <= 2; dx++) this->SetFunctionModule(x + dx, y + dy, std::max(std::abs(dx), std::abs(dy)) != 1);
+        }
+    }
+
+    /// @brief Draws error correction level and mask with BCH code, two copies
+    /// @param mask mask of data modules
+    void QrCode::DrawFormatBits(int mask)
+    {
+        int data = FORMAT_BITS[(int)this->error_correction] << 3 | mask;
+        int remainder = data;
+        for (int index = 0; index < 10; index++) remainder = (remainder << 1) ^ ((remainder >> 9) * 0x537);
+        int bits = (data << 10 | remainder) ^ 0x5412;
+
+        for (int index = 0; index <= 5; index++) this->SetFunctionModule(8, index, GetBit(bits, index));
+        this->SetFunctionModule(8, 7, GetBit(bits, 6));
+        this->SetFunctionModule(8, 8, GetBit(bits, 7));
+        this->SetFunctionModule(7, 8, GetBit(bits, 8));
+        for (int index = 9; index < 15; index++) this->SetFunctionModule(14 - index, 8, GetBit(bits, index));
+
+        for (int index = 0; index < 8; index++) this->SetFunctionModule(this->size - 1 - index, 8, GetBit(bits, index));
+        for (int index = 8; index < 15; index++) this->SetFunctionModule(8, this->size - 15 + index, GetBit(bits, index));
+        this->SetFunctionModule(8, this->size - 8, true); // dark module
+    }
+
+    /// @brief Draws version with BCH code, two copies (versions 7 - 40 only)
+    void QrCode::DrawVersion()
+    {
+        if (this->version < 7) return;
+        int remainder = this->version;
+        for (int index = 0; index < 12; index++) remainder = (remainder << 1) ^ ((remainder >> 11) * 0x1F25);
+        long bits = (long)this->version << 12 | remainder;
+        for (int index = 0; index < 18; index++)
+        {
+            int a = this->size - 11 + index % 3;
+            int b = index / 3;
+            this->SetFunctionModule(a, b, GetBit(bits, index));
+            this->SetFunctionModule(b, a, GetBit(bits, index));
+        }
+    }
+
+    /// @brief Places codewords in zigzag of two-module columns from bottom right corner
+    /// @param codewords data and error correction codewords
+    void QrCode::DrawCodewords(const std::vector<uint8_t>& codewords)
+    {
+        size_t bit = 0;
+        for (int right = this->size - 1; right >= 1; right -= 2)
+        {
+            if (right == 6) right = 5; // timing pattern column
+            for (int vertical = 0; vertical < this->size; vertical++)
+            {
+                for (int column = 0; column < 2; column++)
+                {
+                    int x = right - column;
+                    bool upward = ((right + 1) & 2) == 0;
+                    int y = upward ? this->size - 1 - vertical : vertical;
+                    size_t index = y * this->size + x;
+                    if (this->function_modules[index] || bit >= codewords.size() * 8) continue;
+                    this->modules[index] = GetBit(codewords[bit >> 3], 7 - (int)(bit & 7));
+                    bit++;
+                }
+            }
+        }
+    }
+
+    /// @brief Inverts data modules by mask pattern, applying it twice restores modules
+    /// @param mask mask 0 - 7
+    void QrCode::ApplyMask(int mask)
+    {
+        const MaskPatterns& patterns = GetMaskPatterns();
+        for (int y = 0; y < this->size; y++)
+        {
+            const uint8_t* pattern = patterns[mask][y % QR_MASK_PERIOD];
+            uint8_t* row = &this->modules[y * this->size];
+            const uint8_t* function_row = &this->function_modules[y * this->size];
+            for (int x = 0, column = 0; x < this->size; x++, column = (column + 1 == QR_MASK_PERIOD) ? 0 : column + 1) row[x] ^= pattern[column] & (function_row[x] ^ 1);
+        }
+    }
+
+    /// @brief Computes penalty of standard: runs of the same color, 2x2 blocks, finder-like patterns and balance of dark modules
+    /// @return penalty, the lower the better
+    long QrCode::GetPenaltyScore() const
+    {
+        long result = 0;
+        std::vector<uint8_t> columns(this->modules.size()); // transposed, so columns are scanned as rows
+        for (int y = 0; y < this->size; y++)
+        {
+            for (int x = 0; x < this->size; x++) columns[x * this->size + y] = this->modules[y * this->size + x];
+        }
+        for (int line = 0; line < this->size; line++)
+        {
+            result += GetLinePenalty(&this->modules[line * this->size], this->size);
+            result += GetLinePenalty(&columns[line * this->size], this->size);
+        }
+
+        for (int y = 0; y + 1 < this->size; y++)
+        {
+            const uint8_t* row = &this->modules[y * this->size];
+            const uint8_t* below = row + this->size;
+            int blocks = 0;
+            for (int x = 0; x + 1 < this->size; x++) blocks += ((row[x] ^ row[x + 1]) | (row[x] ^ below[x]) | (row[x] ^ below[x + 1])) == 0;
+            result += blocks * QR_PENALTY_N2;
+        }
+
+        long dark = 0;
+        for (uint8_t module : this->modules) dark += module;
+        long total = (long)this->size * this->size;
+        long k = (std::abs(dark * 20 - total * 10) + total - 1) / total - 1;
+        result += k * QR_PENALTY_N4;
+        return result;
+    }
+
+    void QrCode::SetFunctionModule(int x, int y, bool dark)
+    {
+        size_t index = y * this->size + x;
+        this->modules[index] = dark;
+        this->function_modules[index] = true;
+    }
+}
@@ -0,0 +1,163 @@
+#include "server_configuration.hpp"
+#include "wireguard.hpp"
+#include "process.hpp"
+#include <fstream>
+#include <streambuf>
+#include <net/if.h>
+
+#define WG_COMMAND "wg"
+#define IP_COMMAND "ip"
+#define FNV_OFFSET_BASIS 14695981039346656037ull
+#define FNV_PRIME 1099511628211ull
+#define HASH_CHUNK_SIZE 65536
+
+namespace timlibs
+{
+    namespace
+    {
+        /// @brief Adds bytes to FNV-1a hash
+        /// @param hash current hash (FNV_OFFSET_BASIS for empty text)
+        /// @param data bytes
+        /// @param size count of bytes
+        /// @return new hash
+        uint64_t Fnv1a(uint64_t hash, const char* data, size_t size)
+        {
+            for (size_t index = 0; index < size; index++) hash = (hash ^ (uint8_t)data[index]) * FNV_PRIME;
+            return hash;
+        }
+
+        // Stream buffer that only hashes written text
+        class HashBuffer : public std::streambuf
+        {
+        public:
+            uint64_t GetHash() const { return this->hash; }
+        protected:
+            int_type overflow(int_type character) override
+            {
+                if (traits_type::eq_int_type(character, traits_type::eof())) return traits_type::not_eof(character);
+                char value = traits_type::to_char_type(character);
+                this->hash = Fnv1a(this->hash, &value, 1);
+                return character;
+            }
+
+            std::streamsize xsputn(const char* data, std::streamsize size) override
+            {
+                this->hash = Fnv1a(this->hash, data, (size_t)size);
+                return size;
+            }
+        private:
+            uint64_t hash{ FNV_OFFSET_BASIS };
+        };
+
+        /// @brief Writes wg-quick field, every line of multi-line value is a separate field (wg-quick runs them in order)
+        /// @param output output stream
+        /// @param name name of field, ex.: PostUp
+        /// @param value value of field, empty lines are skipped
+        void RenderField(std::ostream& output, const char* name, const std::string& value)
+        {
+            size_t begin = 0;
+            while (begin < value.size())
+            {
+                size_t end = value.find('\n', begin);
+                if (end == std::string::npos) end = value.size();
+                if (end > begin) output << name << " = " << value.substr(begin, end - begin) << "\n";
+                begin = end + 1;
+            }
+        }
+    }
+
+    /// @brief Builds address of interface from server ip and prefix length of network
+    /// @param server server configuration
+    /// @return address, ex.: 10.0.30.1/24 (empty if ip or network isn't set)
+    std::string GetInterfaceAddress(const Server& server)
+    {
+        uint32_t address = 0;
+        uint32_t prefix = 0;
+        if (ToHostOrder(server.ip) == NULL_IP_DEC || !ParseNetwork(server.network.GetAsString(), address, prefix)) return NULL_STRING;
+        return server.ip.GetAsString() + "/" + std::to_string(prefix);
+    }
+
+    /// @brief Renders configuration of interface, peers are the same as desired peers of PeersConnectionController
+    /// @param server server configuration
+    /// @param clients clients configuration, only clients with active account and public key are peers
+    /// @param style wg-quick file or fields of wg syncconf
+    /// @param output output stream
+    void RenderServerConfiguration(const Server& server, const ClientRegistry& clients, ServerConfigurationStyle style, std::ostream& output)
+    {
+        output << "[Interface]\n";
+        if (style == ServerConfigurationStyle::WG_QUICK) RenderField(output, "Address", GetInterfaceAddress(server));
+        if (server.listen_port != 0) output << "ListenPort = " << server.listen_port << "\n";
+        RenderField(output, "PrivateKey", server.private_key);
+        if (style == ServerConfigurationStyle::WG_QUICK)
+        {
+            RenderField(output, "PreUp", server.pre_up);
+            RenderField(output, "PostUp", server.post_up);
+            RenderField(output, "PreDown", server.pre_down);
+            RenderField(output, "PostDown", server.post_down);
+        }
+
+        for (const Client& client : clients)
+        {
+            if (!client.account_status || client.public_key == NULL_STRING) continue;
+            output << "\n[Peer]\n";
+            RenderField(output, "PublicKey", client.public_key.ToString());
+            RenderField(output, "AllowedIPs", client.allowed_ips);
+        }
+    }
+
+    /// @brief Hashes configuration while it's rendered, so it may be compared with file without building text
+    /// @param server server configuration
+    /// @param clients clients configuration
+    /// @param style wg-quick file or fields of wg syncconf
+    /// @return FNV-1a hash of text
+    uint64_t HashServerConfiguration(const Server& server, const ClientRegistry& clients, ServerConfigurationStyle style)
+    {
+        HashBuffer buffer;
+        std::ostream output(&buffer);
+        RenderServerConfiguration(server, clients, style, output);
+        return buffer.GetHash();
+    }
+
+    /// @brief Hashes file by chunks
+    /// @param path path of file
+    /// @param hash FNV-1a hash of content
+    /// @return false if file can't be read
+    bool HashFile(const std::string& path, uint64_t& hash)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open()) return false;
+        std::vector<char> chunk(HASH_CHUNK_SIZE);
+        hash = FNV_OFFSET_BASIS;
+        while (file)
+        {
+            file.read(chunk.data(), chunk.size());
+            hash = Fnv1a(hash, chunk.data(), (size_t)file.gcount());
+        }
+        return file.eof();
+    }
+
+    /// @brief Applies configuration file to running interface: only changed peers and fields are set, sessions of other peers are kept
+    /// @param interface_name name of wireguard interface, ex. wg0
+    /// @param path configuration in style ServerConfigurationStyle::WG
+    void SyncInterface(const std::string& interface_name, const std::string& path)
+    {
+        ProcessResult result = RunProcess({ WG_COMMAND, "syncconf", interface_name, path });
+        if (result.exit_code != 0) throw WireguardException("Unable to sync " + interface_name + " with " + path);
+    }
+
+    bool InterfaceExists(const std::string& interface_name) { return if_nametoindex(interface_name.c_str()) != 0; }
+
+    /// @brief Changes address of running interface as wg-quick sets it. Old address is removed first: new address in the same subnet
+    /// @brief would be its secondary address and would be removed with it. Routes of old network are removed with old address
+    /// @param interface_name name of wireguard interface, ex. wg0
+    /// @param old_address address with prefix length, empty if interface has no address
+    /// @param new_address address with prefix length, empty to remove address
+    void ReplaceInterfaceAddress(const std::string& interface_name, const std::string& old_address, const std::string& new_address)
+    {
+        if (old_address == new_address) return;
+        if (!old_address.empty()) RunProcess({ IP_COMMAND, "-4", "address", "del", old_address, "dev", interface_name }); // it may be absent already
+        if (new_address.empty()) return;
+        ProcessResult result = RunProcess({ IP_COMMAND, "-4", "address", "replace", new_address, "dev", interface_name });
+        if (result.exit_code != 0) throw WireguardException("Unable to set address " + new_address + " of " + interface_name);
+    }
+}
@@ -0,0 +1,255 @@
+#include "string_pool.hpp"
+#include "wireguard.hpp"
+#include <cstring>
+#include <new>
+#include <algorithm>
+#include <functional>
+#include <string_view>
+
+#define STRING_POOL_INDEX_SIZE_MIN 1024
+
+namespace timlibs
+{
+    // Header of interned text, the text follows it
+    struct StringPool::Entry
+    {
+        std::atomic<uint32_t> references;
+        uint32_t length;
+        uint64_t hash;
+
+        const char* GetText() const { return reinterpret_cast<const char*>(this + 1); }
+        static Entry* FromText(const char* text) { return reinterpret_cast<Entry*>(const_cast<char*>(text)) - 1; }
+    };
+
+    namespace
+    {
+        uint64_t HashText(const char* text, size_t length) { return std::hash<std::string_view>()(std::string_view(text, length)); }
+    }
+
+    /// @brief Pool is never destroyed, so strings of static objects can be released at exit
+    StringPool& StringPool::GetInstance()
+    {
+        static StringPool* pool = new StringPool();
+        return *pool;
+    }
+
+    /// @brief Finds interned copy of text or adds copy of text
+    /// @param text text (may contain zeros)
+    /// @param length length of text
+    /// @return interned copy with one more reference, see Release()
+    const char* StringPool::Intern(const char* text, size_t length)
+    {
+        if (length > UINT32_MAX) throw WireguardException("Pooled string is too long");
+        uint64_t hash = HashText(text, length);
+        std::lock_guard<std::mutex> lock(this->pool_mutex);
+        if ((this->size + 1) * 2 > this->slots.size()) this->Grow(); // load factor is at most 1/2
+        size_t slot = 0;
+        Entry* entry = this->FindLocked(text, length, hash, slot);
+        if (entry != nullptr)
+        {
+            entry->references.fetch_add(1, std::memory_order_relaxed);
+            return entry->GetText();
+        }
+
+        size_t entry_size = sizeof(Entry) + length + 1;
+        entry = new (new char[entry_size]) Entry{ { 1 }, (uint32_t)length, hash };
+        char* copy = const_cast<char*>(entry->GetText());
+        memcpy(copy, text, length);
+        copy[length] = '\0';
+        this->slots[slot] = entry;
+        this->size++;
+        this->entry_bytes += entry_size;
+        return copy;
+    }
+
+    /// @brief Finds interned copy of text without interning it
+    /// @param text text
+    /// @param length length of text
+    /// @return interned copy with one more reference or nullptr
+    const char* StringPool::Find(const char* text, size_t length)
+    {
+        uint64_t hash = HashText(text, length);
+        std::lock_guard<std::mutex> lock(this->pool_mutex);
+        if (this->slots.empty()) return nullptr;
+        size_t slot = 0;
+        Entry* entry = this->FindLocked(text, length, hash, slot);
+        if (entry == nullptr) return nullptr;
+        entry->references.fetch_add(1, std::memory_order_relaxed);
+        return entry->GetText();
+    }
+
+    /// @brief Adds reference to text whose reference is held by caller, so text can't be freed meanwhile and lock isn't needed
+    /// @param text interned text
+    void StringPool::AddReference(const char* text) { Entry::FromText(text)->references.fetch_add(1, std::memory_order_relaxed); }
+
+    /// @brief Releases reference to text. References are released without lock while other references exist,
+    /// @brief the last one is released under lock, as Intern() and Find() may take new reference from index meanwhile
+    /// @param text interned text
+    void StringPool::Release(const char* text)
+    {
+        Entry* entry = Entry::FromText(text);
+        uint32_t references = entry->references.load(std::memory_order_relaxed);
+        while (references > 1)
+        {
+            if (entry->references.compare_exchange_weak(references, references - 1, std::memory_order_release, std::memory_order_relaxed)) return;
+        }
+
+        std::lock_guard<std::mutex> lock(this->pool_mutex);
+        if (entry->references.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+        size_t slot = 0;
+        this->FindLocked(entry->GetText(), entry->length, entry->hash, slot);
+        this->EraseLocked(slot);
+        this->size--;
+        this->entry_bytes -= sizeof(Entry) + entry->length + 1;
+        entry->~Entry();
+        delete[] reinterpret_cast<char*>(entry);
+    }
+
+    size_t StringPool::GetLength(const char* text) { return Entry::FromText(text)->length; }
+
+    size_t StringPool::GetSize() const
+    {
+        std::lock_guard<std::mutex> lock(this->pool_mutex);
+        return this->size;
+    }
+
+    size_t StringPool::GetMemoryUsage() const
+    {
+        std::lock_guard<std::mutex> lock(this->pool_mutex);
+        return this->entry_bytes + this->slots.capacity() * sizeof(Entry*);
+    }
+
+    /// @brief Probes index, pool_mutex is held by caller
+    /// @param text text
+    /// @param length length of text
+    /// @param hash hash of text
+    /// @param slot output slot of text or the free slot where it would be
+    /// @return entry of text or nullptr
+    StringPool::Entry* StringPool::FindLocked(const char* text, size_t length, uint64_t hash, size_t& slot) const
+    {
+        size_t mask = this->slots.size() - 1;
+        for (slot = hash & mask; this->slots[slot] != nullptr; slot = (slot + 1) & mask)
+        {
+            Entry* candidate = this->slots[slot];
+            if (candidate->hash == hash && candidate->length == length && memcmp(candidate->GetText(), text, length) == 0) return candidate;
+        }
+        return nullptr;
+    }
+
+    /// @brief Frees slot and moves back following entries of its probe chain, pool_mutex is held by caller
+    /// @param slot occupied slot
+    void StringPool::EraseLocked(size_t slot)
+    {
+        size_t mask = this->slots.size() - 1;
+        size_t hole = slot;
+        for (size_t next = (hole + 1) & mask; this->slots[next] != nullptr; next = (next + 1) & mask)
+        {
+            size_t home = this->slots[next]->hash & mask;
+            if (((next - home) & mask) < ((next - hole) & mask)) continue; // home is between hole and entry, entry stays
+            this->slots[hole] = this->slots[next];
+            hole = next;
+        }
+        this->slots[hole] = nullptr;
+    }
+
+    void StringPool::Grow()
+    {
+        std::vector<Entry*> slots(std::max<size_t>(this->slots.size() * 2, STRING_POOL_INDEX_SIZE_MIN), nullptr);
+        size_t mask = slots.size() - 1;
+        for (Entry* entry : this->slots)
+        {
+            if (entry == nullptr) continue;
+            size_t slot = entry->hash & mask;
+            while (slots[slot] != nullptr) slot = (slot + 1) & mask;
+            slots[slot] = entry;
+        }
+        this->slots.swap(slots);
+    }
+
+    PooledString::PooledString(const std::string& text) { *this = text; }
+
+    PooledString::PooledString(const char* text) { *this = text; }
+
+    PooledString::PooledString(const PooledString& other) : text(other.text)
+    {
+        if (this->text != nullptr) StringPool::GetInstance().AddReference(this->text);
+    }
+
+    PooledString::PooledString(PooledString&& other) noexcept : text(other.text) { other.text = nullptr; }
+
+    PooledString::~PooledString()
+    {
+        if (this->text != nullptr) StringPool::GetInstance().Release(this->text);
+    }
+
+    PooledString& PooledString::operator=(const std::string& text)
+    {
+        this->Reset(text.empty() ? nullptr : StringPool::GetInstance().Intern(text.data(), text.size()));
+        return *this;
+    }
+
+    PooledString& PooledString::operator=(const char* text)
+    {
+        size_t length = strlen(text);
+        this->Reset(length == 0 ? nullptr : StringPool::GetInstance().Intern(text, length));
+        return *this;
+    }
+
+    PooledString& PooledString::operator=(const PooledString& other)
+    {
+        if (other.text != nullptr) StringPool::GetInstance().AddReference(other.text); // before release, other may be this
+        this->Reset(other.text);
+        return *this;
+    }
+
+    PooledString& PooledString::operator=(PooledString&& other) noexcept
+    {
+        if (this == &other) return *this;
+        this->Reset(other.text);
+        other.text = nullptr;
+        return *this;
+    }
+
+    /// @brief Replaces text, reference of new text is already taken
+    /// @param text interned text or nullptr
+    void PooledString::Reset(const char* text)
+    {
+        if (this->text != nullptr) StringPool::GetInstance().Release(this->text);
+        this->text = text;
+    }
+
+    /// @brief Gets pooled string for lookups in indexes, strings which were never interned aren't added to pool
+    /// @param text text
+    /// @param value output pooled string
+    /// @return false if text isn't in pool, so no pooled string is equal to it
+    bool PooledString::Lookup(const std::string& text, PooledString& value)
+    {
+        value.Reset(text.empty() ? nullptr : StringPool::GetInstance().Find(text.data(), text.size()));
+        return text.empty() || value.text != nullptr;
+    }
+
+    std::string PooledString::ToString() const { return this->text == nullptr ? std::string() : std::string(this->text, StringPool::GetLength(this->text)); }
+
+    const char* PooledString::c_str() const { return this->text == nullptr ? "" : this->text; }
+
+    size_t PooledString::size() const { return this->text == nullptr ? 0 : StringPool::GetLength(this->text); }
+
+    bool PooledString::empty() const { return this->text == nullptr; }
+
+    size_t PooledString::Hash() const { return std::hash<const char*>()(this->text); }
+
+    std::string_view PooledString::View() const { return std::string_view(this->c_str(), this->size()); }
+
+    bool PooledString::operator==(const std::string& other) const { return this->size() == other.size() && memcmp(this->c_str(), other.data(), other.size()) == 0; }
+
+    bool PooledString::operator==(const char* other) const { return strcmp(this->c_str(), other) == 0; }
+
+    bool PooledString::operator<(const PooledString& other) const
+    {
+        return std::string_view(this->c_str(), this->size()) < std::string_view(other.c_str(), other.size());
+    }
+
+    void to_json(nlohmann::json& json, const PooledString& value) { json = value.ToString(); }
+
+    void from_json(const nlohmann::json& json, PooledString& value) { value = json.get_ref<const std::string&>(); }
+}
@@ -0,0 +1,114 @@
+#include "thread_pool.hpp"
+#include <atomic>
+#include <memory>
+#include <exception>
+#include <algorithm>
+
+namespace timlibs
+{
+    namespace
+    {
+        // Progress of one ParallelFor, shared with tasks that may start after it returned
+        struct ParallelState
+        {
+            std::atomic<size_t> next{ 0 }; // the next index to take
+            size_t count{ 0 };
+            const std::function<void(size_t)>* body{ nullptr }; // used only while indexes remain
+            std::mutex state_mutex;
+            std::condition_variable finished;
+            size_t running{ 0 }; // participants that may still call body
+            std::exception_ptr error{};
+        };
+
+        /// @brief Takes indexes and calls body until indexes are over
+        /// @param state progress of ParallelFor
+        void Participate(ParallelState& state)
+        {
+            {
+                std::lock_guard<std::mutex> lock(state.state_mutex);
+                state.running++;
+            }
+            for (size_t index = state.next++; index < state.count; index = state.next++)
+            {
+                try
+                {
+                    (*state.body)(index);
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(state.state_mutex);
+                    if (!state.error) state.error = std::current_exception();
+                    state.next = state.count; // the rest isn't started
+                }
+            }
+            std::lock_guard<std::mutex> lock(state.state_mutex);
+            if (--state.running == 0) state.finished.notify_all();
+        }
+    }
+
+    /// @brief Starts worker threads
+    /// @param threads count of threads (0 for one per core)
+    ThreadPool::ThreadPool(size_t threads)
+    {
+        if (threads == 0) threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+        this->threads.reserve(threads);
+        for (size_t index = 0; index < threads; index++) this->threads.emplace_back(&ThreadPool::Work, this);
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->queue_mutex);
+            this->stopping = true;
+        }
+        this->queue_condition.notify_all();
+        for (std::thread& thread : this->threads) thread.join();
+    }
+
+    /// @brief Queues task for the first free worker
+    /// @param task task without exceptions
+    void ThreadPool::Submit(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->queue_mutex);
+            this->tasks.push_back(std::move(task));
+        }
+        this->queue_condition.notify_one();
+    }
+
+    /// @brief Calls body for every index in [0, count) on workers and caller, indexes are taken one by one, so uneven work is balanced
+    /// @param count count of indexes
+    /// @param body function of index
+    void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t index)>& body)
+    {
+        if (count == 0) return;
+        std::shared_ptr<ParallelState> state = std::make_shared<ParallelState>();
+        state->count = count;
+        state->body = &body;
+        size_t helpers = std::min(this->threads.size(), count - 1);
+        for (size_t helper = 0; helper < helpers; helper++) this->Submit([state]() { Participate(*state); });
+
+        Participate(*state);
+        std::unique_lock<std::mutex> lock(state->state_mutex);
+        state->finished.wait(lock, [&state]() { return state->running == 0; }); // helpers that start later see no indexes
+        if (state->error) std::rethrow_exception(state->error);
+    }
+
+    size_t ThreadPool::GetThreadCount() const { return this->threads.size(); }
+
+    void ThreadPool::Work()
+    {
+        while (true)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(this->queue_mutex);
+                this->queue_condition.wait(lock, [this]() { return this->stopping || !this->tasks.empty(); });
+                if (this->tasks.empty()) return;
+                task = std::move(this->tasks.front());
+                this->tasks.pop_front();
+            }
+            task();
+        }
+    }
+}
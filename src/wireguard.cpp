@@ -1,629 +1,1537 @@
-#include "wireguard.hpp"
-#include "uuid.hpp"
-#include <fstream>
-#include "wg_utils.hpp"
-#include <set>
-#include "ipv4.hpp"
-
-#define ROOT_PATH "/etc/wireguard/"
-#define DELTA_HANDSHAKE_TIME 130
-
-#define INTERFACE_NAME_DEFAULT "wg0"
-#define LISTEN_PORT_DEFAULT 55255
-#define ENDPOINT_IP_DEFAULT "127.0.0.1"
-#define ENDPOINT_DNS_DEFAULT ""
-#define IP_DEFAULT "10.0.30.1"
-#define NETMASK_DEFAULT "255.255.255.0"
-#define PRIVATE_KEY_DEFAULT
-#define PUBLIC_KEY_DEFAULT
-#define PRE_UP_DEFAULT "echo Wireguard PreUp"
-#define POST_UP_DEFAULT "echo Wireguard PostUp"
-#define PRE_DOWN_DEFAULT "echo Wireguard PreDown"
-#define POST_DOWN_DEFAULT "echo Wireguard PostDown"
-
-namespace timlibs
-{
-
-    WireguardException::WireguardException() : error_discription{ NULL_STRING } {}
-
-
-    WireguardException::WireguardException(const std::string& discription) : error_discription{ discription } {}
-
-
-    WireguardException::WireguardException(const char* discription) : error_discription{ discription } {}
-
-
-    std::string WireguardException::what() const { return this->error_discription; }
-}
-
-namespace timlibs
-{
-    namespace general
-    {
-        enum KEY
-        {
-            FIRST,
-            SERVER = FIRST,
-            CLIENTS,
-            LAST // leave it as the last value!!!
-        };
-    }
-    
-    namespace server
-    {
-        enum KEY
-        {
-            FIRST = general::KEY::LAST,
-            INTERFACE_NAME = FIRST,
-            LISTEN_PORT,
-            IP,
-            NETWORK,
-            ENDPOINT_DNS,
-            ENDPOINT_IP,
-            PUBLIC_LISTEN_PORT,
-            PRIVATE_KEY,
-            PUBLIC_KEY,
-            PRE_UP,
-            POST_UP,
-            PRE_DOWN,
-            POST_DOWN,
-            LAST // leave it as the last value!!!
-        };
-    }
-    
-    namespace clients
-    {
-        enum KEY
-        {
-            FIRST = server::KEY::LAST,
-            UUID = FIRST,
-            PRIVATE_KEY,
-            PUBLIC_KEY,
-            LOGIN,
-            FULL_NAME,
-            IP,
-            ACCOUNT_STATUS,
-            ADMINISTRATIVE_ACCOUNT_STATUS,
-            CONNECTION_STATUS,
-            CREATION_DATE,
-            RELEASE_DATE,
-            EXPIRATION_DATE,
-            ALLOWED_IPS,
-            DNS,
-            LAST
-        };
-    }
-    
-    const std::unordered_map<uint32_t, std::string> keys
-    {
-        {general::KEY::SERVER, "server"},
-        {server::KEY::INTERFACE_NAME, "interface_name"},
-        {server::KEY::LISTEN_PORT, "listen_port"},
-        {server::KEY::IP, "ip"},
-        {server::KEY::NETWORK, "network"},
-        {server::KEY::ENDPOINT_DNS, "endpoint_dns"},
-        {server::KEY::ENDPOINT_IP, "endpoint_ip"},
-        {server::KEY::PUBLIC_LISTEN_PORT, "public_listen_port"},
-        {server::KEY::PRIVATE_KEY, "private_key"},
-        {server::KEY::PUBLIC_KEY, "public_key"},
-        {server::KEY::PRE_UP, "pre_up"},
-        {server::KEY::POST_UP, "post_up"},
-        {server::KEY::PRE_DOWN, "pre_down"},
-        {server::KEY::POST_DOWN, "post_down"},
-        {general::KEY::CLIENTS, "clients"},
-        {clients::KEY::UUID, "uuid"},
-        {clients::KEY::PRIVATE_KEY, "private_key"},
-        {clients::KEY::PUBLIC_KEY, "public_key"},
-        {clients::KEY::LOGIN, "login"},
-        {clients::KEY::FULL_NAME, "full_name"},
-        {clients::KEY::IP, "ip"},
-        {clients::KEY::ACCOUNT_STATUS, "account_status"},
-        {clients::KEY::ADMINISTRATIVE_ACCOUNT_STATUS, "administrative_account_status"},
-        {clients::KEY::CONNECTION_STATUS, "connection_status"},
-        {clients::KEY::CREATION_DATE, "creation_date"},
-        {clients::KEY::RELEASE_DATE, "release_date"},
-        {clients::KEY::EXPIRATION_DATE, "expiration_date"},
-        {clients::KEY::ALLOWED_IPS, "allowed_ips"},
-        {clients::KEY::DNS, "dns"}
-    };
-
-
-    /// @brief Initialize the wireguard server
-    /// @param interface_name name of wireguard interface, ex. wg0
-    Wireguard::Wireguard(const std::string& interface_name)
-    {
-        //if file exist - load, else new configuration
-        if (interface_name == NULL_STRING) this->server.interface_name = INTERFACE_NAME_DEFAULT;
-        else this->server.interface_name = interface_name;
-        if (std::ifstream(ROOT_PATH + this->server.interface_name + ".json")) this->ReadConfiguration();
-        else
-        {
-            // Бляяя, я заебался уже писать
-        }
-    }
-
-    /// @brief Gets server configuration
-    /// @return server configuration as Server structure
-    Server Wireguard::GetServer() { return this -> server; }
-
-    /// @brief Creates a client
-    /// @param client object of Client class that containt information about client
-    /// @return UUID of new client
-    std::string Wireguard::CreateClient(Client client)
-    {
-        // написать ебейшие проверки, да и вообще подумать
-        client.uuid = generate_uuid();
-        this->clients.push_back(client);
-        return client.uuid;
-    }
-
-    /// @brief Returns copy of client by it's UUID
-    /// @param uuid UUID of client
-    /// @return client configuration as Client structure
-    Client Wireguard::GetClient(const std::string& uuid)
-    {
-        for (Client client : this->clients)
-        {
-            if (client.uuid == uuid) return client;
-        }
-        throw WireguardException("Client id is not found");
-    }
-
-    /// @brief Controls that real configuration is equal to configuration in RAM.
-    /// @brief It's using DateAndModeController, ConnectionStatusController, PeersConnectionController
-    void Wireguard::Controller()
-    {
-        this->PeersConnectionController();
-        if (this->DateAndModeController() && this->ConnectionStatusController()) this->SerializeConfiguration();
-    }
-
-    /// @brief Controls dates of client and accaunt status of clients
-    /// @return Flag of changes in configuration
-    bool Wireguard::DateAndModeController()
-    {
-        time_t now = time(nullptr);
-        bool any_changes_flag = true;
-        for (Client client : this->clients)
-        {
-            if (client.administrative_account_status)
-            {
-                if (client.account_status)
-                {
-                    if (client.expiration_date < now)
-                    {
-                        client.account_status = false;
-                        any_changes_flag = true;
-                    }
-                }
-                else
-                {
-                    if (client.release_date > now and client.expiration_date < now)
-                    {
-                        client.account_status = true;
-                        any_changes_flag = true;
-                    }
-                }
-            }
-            else
-            {
-                if (client.account_status) // if client account status is "active", we must shut it down
-                {
-                    client.account_status = false;
-                    any_changes_flag = true;
-                }
-            }
-        }
-        return any_changes_flag;
-    }
-
-    /// @brief Controls connection statuses of clients
-    /// @return Flag of changes in configuration
-    bool Wireguard::ConnectionStatusController()
-    {
-        auto hadshackes = wg_show_latest_handshakes(this->server.interface_name);
-        Time now(time(nullptr));
-        bool any_changes = false;
-
-        for (auto handshacke : hadshackes)
-        {
-            for (Client& client : this->clients)
-            {
-                if (client.public_key == handshacke.first)
-                {
-                    if (now - handshacke.second < DELTA_HANDSHAKE_TIME && client.connection_status != true)
-                    {
-                        client.connection_status = true;
-                        any_changes = true;
-                    }
-                    if (now - handshacke.second > DELTA_HANDSHAKE_TIME && client.connection_status != false)
-                    {
-                        client.connection_status = false;
-                        any_changes = true;
-                    }
-                }
-                break;
-            }
-        }
-        return any_changes;
-    }
-
-    /// @brief Controls that only allowed peers may be in current wireguard configuration
-    void Wireguard::PeersConnectionController() const
-    {
-        std::vector<std::string> peers_public_keys_vector = wg_show_peers(this->server.interface_name);
-
-        std::set<std::string> current_peers(std::make_move_iterator(peers_public_keys_vector.begin()), std::make_move_iterator(peers_public_keys_vector.end()));
-        std::set<std::string> active_clients{};
-
-        for (const Client& client : this->clients)
-        {
-            if (client.account_status) active_clients.insert(client.public_key);
-        }
-
-        std::set<std::string> illegal_peers{};
-        std::set_intersection(current_peers.begin(), current_peers.end(), active_clients.begin(), active_clients.end(), std::inserter(illegal_peers, illegal_peers.begin()));
-
-        std::set<std::string> legal_peers_not_added{};
-        std::set_intersection(active_clients.begin(), active_clients.end(), current_peers.begin(), current_peers.end(), std::inserter(legal_peers_not_added, legal_peers_not_added.begin()));
-
-        for (const std::string& public_key : illegal_peers) this->RemovePeer(public_key);
-        for (const std::string& public_key : legal_peers_not_added)
-        {
-            for (const Client& client : this->clients)
-            {
-                if (client.public_key == public_key)
-                {
-                    this->AddPeer(client);
-                    break;
-                }
-            }
-        }
-        // и сравнивать с теми, кто должен там быть
-    }
-
-    /// @brief Add a peer to wireguard configuration by client link
-    /// @param client link to client object
-    void Wireguard::AddPeer(const Client& client) const
-    {
-        wg_set(this->server.interface_name, client.public_key, client.allowed_ips);
-    }
-
-    /// @brief Remove a peer from wireguard configuration by client link
-    /// @param client link to client object
-    void Wireguard::RemovePeer(const Client& client) const
-    {
-        this->RemovePeer(client.public_key);
-    }
-
-    /// @brief Remove a peer from wireguard configuration by public key
-    /// @param public_key public key of peer
-    void Wireguard::RemovePeer(const std::string& public_key) const
-    {
-        wg_set_remove(this->server.interface_name, public_key);
-    }
-
-    /// @brief Converts configuration from jsom file to configuration in RAM
-    void Wireguard::ReadConfiguration()
-    {
-        DeserializeConfiguration(this->DownloadConfiguration());
-    }
-
-    /// @brief Converts configuration  in RAM to json file
-    void Wireguard::WriteConfiguration()
-    {
-        UploadConfiguration(this->SerializeConfiguration());
-    }
-
-    /// @brief Converts configuration in RAM to JSON object
-    /// @return Configuration as JSON object
-    nlohmann::json Wireguard::SerializeConfiguration() const
-    {
-        nlohmann::json json_configuration;
-        nlohmann::json json_server_configuration;
-        nlohmann::json json_users_configuration;
-
-
-        json_server_configuration[keys.at(server::KEY::INTERFACE_NAME)] = this->server.interface_name;
-        json_server_configuration[keys.at(server::KEY::LISTEN_PORT)] = this->server.listen_port;
-        json_server_configuration[keys.at(server::KEY::IP)] = this->server.ip.GetAsString();
-        json_server_configuration[keys.at(server::KEY::NETWORK)] = this->server.network.GetAsString();
-        json_server_configuration[keys.at(server::KEY::ENDPOINT_DNS)] = this->server.endpoint_dns;
-        json_server_configuration[keys.at(server::KEY::ENDPOINT_IP)] = this->server.endpoint_ip.GetAsString();
-        json_server_configuration[keys.at(server::KEY::PUBLIC_LISTEN_PORT)] = this->server.public_listen_port;
-        json_server_configuration[keys.at(server::KEY::PRIVATE_KEY)] = this->server.private_key;
-        json_server_configuration[keys.at(server::KEY::PUBLIC_KEY)] = this->server.public_key;
-        json_server_configuration[keys.at(server::KEY::PRE_UP)] = this->server.pre_up;
-        json_server_configuration[keys.at(server::KEY::POST_UP)] = this->server.post_up;
-        json_server_configuration[keys.at(server::KEY::PRE_DOWN)] = this->server.pre_down;
-        json_server_configuration[keys.at(server::KEY::POST_DOWN)] = this->server.post_down;
-
-        json_users_configuration = nlohmann::json::array();
-        for (Client client : this->clients)
-        {
-            nlohmann::json json_user_configuration;
-            json_user_configuration[keys.at(clients::KEY::UUID)] = client.uuid;
-            json_user_configuration[keys.at(clients::KEY::PRIVATE_KEY)] = client.private_key;
-            json_user_configuration[keys.at(clients::KEY::PUBLIC_KEY)] = client.public_key;
-            json_user_configuration[keys.at(clients::KEY::LOGIN)] = client.login;
-            json_user_configuration[keys.at(clients::KEY::FULL_NAME)] = client.full_name;
-            json_user_configuration[keys.at(clients::KEY::IP)] = client.ip.GetAsString();
-            json_user_configuration[keys.at(clients::KEY::ACCOUNT_STATUS)] = client.account_status;
-            json_user_configuration[keys.at(clients::KEY::ADMINISTRATIVE_ACCOUNT_STATUS)] = client.administrative_account_status;
-            json_user_configuration[keys.at(clients::KEY::CONNECTION_STATUS)] = client.connection_status;
-            json_user_configuration[keys.at(clients::KEY::CREATION_DATE)] = client.creation_date.GetAsString();
-            json_user_configuration[keys.at(clients::KEY::RELEASE_DATE)] = client.release_date.GetAsString();
-            json_user_configuration[keys.at(clients::KEY::EXPIRATION_DATE)] = client.expiration_date.GetAsString();
-            json_user_configuration[keys.at(clients::KEY::ALLOWED_IPS)] = client.allowed_ips;
-
-            json_users_configuration.push_back(json_user_configuration);
-        }
-
-        json_configuration[keys.at(general::KEY::SERVER)] = json_server_configuration;
-        json_configuration[keys.at(general::KEY::CLIENTS)] = json_users_configuration;
-
-        return json_configuration;
-    }
-
-    /// @brief Converts JSON object to configuration in RAM
-    /// @param json_configuration JSON object
-    void Wireguard::DeserializeConfiguration(const nlohmann::json& json_configuration)
-    {
-        nlohmann::json json_server_configuration = json_configuration[keys.at(general::KEY::SERVER)];
-        nlohmann::json json_users_configuration = json_configuration[keys.at(general::KEY::CLIENTS)];
-
-        // Deserialize server config
-        this->server.interface_name = json_server_configuration[keys.at(server::KEY::INTERFACE_NAME)];
-        this->server.listen_port = json_server_configuration[keys.at(server::KEY::LISTEN_PORT)];
-        if (!json_server_configuration[keys.at(server::KEY::ENDPOINT_DNS)].is_null()) this->server.endpoint_dns = json_server_configuration[keys.at(server::KEY::ENDPOINT_DNS)];
-        if (!json_server_configuration[keys.at(server::KEY::ENDPOINT_IP)].is_null()) this->server.endpoint_dns = json_server_configuration[keys.at(server::KEY::ENDPOINT_IP)];
-        this->server.public_listen_port = json_server_configuration[keys.at(server::KEY::PUBLIC_LISTEN_PORT)];
-        this->server.private_key = json_server_configuration[keys.at(server::KEY::PRIVATE_KEY)];
-        this->server.public_key = json_server_configuration[keys.at(server::KEY::PUBLIC_KEY)];
-        this->server.pre_up = (!json_server_configuration[keys.at(server::KEY::PRE_UP)].is_null()) ? json_server_configuration[keys.at(server::KEY::PRE_UP)] : PRE_UP_DEFAULT;
-        this->server.post_up = (!json_server_configuration[keys.at(server::KEY::POST_UP)].is_null()) ? json_server_configuration[keys.at(server::KEY::POST_UP)] : PRE_UP_DEFAULT;
-        this->server.pre_down = (!json_server_configuration[keys.at(server::KEY::PRE_DOWN)].is_null()) ? json_server_configuration[keys.at(server::KEY::PRE_DOWN)] : PRE_UP_DEFAULT;
-        this->server.post_down = (!json_server_configuration[keys.at(server::KEY::POST_DOWN)].is_null()) ? json_server_configuration[keys.at(server::KEY::POST_DOWN)] : PRE_UP_DEFAULT;
-        try
-        {
-            this->server.ip = IPv4((std::string)json_server_configuration[keys.at(server::KEY::IP)]);
-            this->server.network = IPv4Mask((std::string)json_server_configuration[keys.at(server::KEY::NETWORK)]);
-        }
-        catch (const ExceptionIPv4& error)
-        {
-            throw WireguardException("Server IPv4 Error: " + error.what());
-        }
-        catch (...)
-        {
-            throw;
-        }
-
-        // Deserialize clients config
-        for (const nlohmann::json& json_user_configuration : json_users_configuration)
-        {
-            Client client;
-            if (is_correct(json_user_configuration[keys.at(clients::KEY::UUID)])) client.uuid = json_user_configuration[keys.at(clients::KEY::UUID)];
-            else throw WireguardException("UUID for client isn't correct");
-            client.private_key = json_user_configuration[keys.at(clients::KEY::PRIVATE_KEY)];
-            client.public_key = json_user_configuration[keys.at(clients::KEY::PUBLIC_KEY)];
-            client.login = json_user_configuration[keys.at(clients::KEY::LOGIN)];
-            client.full_name = json_user_configuration[keys.at(clients::KEY::FULL_NAME)];
-            client.connection_status = false;
-            client.account_status = false;
-            client.administrative_account_status = json_user_configuration[keys.at(clients::KEY::ADMINISTRATIVE_ACCOUNT_STATUS)];
-            client.release_date = (!json_user_configuration[keys.at(clients::KEY::RELEASE_DATE)].is_null()) ? Time((std::string)json_user_configuration[keys.at(clients::KEY::RELEASE_DATE)]) : MIN_TIME;
-            client.expiration_date = (!json_user_configuration[keys.at(clients::KEY::EXPIRATION_DATE)].is_null()) ? Time((std::string)json_user_configuration[keys.at(clients::KEY::EXPIRATION_DATE)]) : MAX_TIME;
-            if (Time::IsValid(json_user_configuration[keys.at(clients::KEY::CREATION_DATE)])) client.creation_date = Time((std::string)json_user_configuration[keys.at(clients::KEY::CREATION_DATE)]);
-            else throw WireguardException("Client creation date isn't valid");
-            client.allowed_ips = json_user_configuration[keys.at(clients::KEY::ALLOWED_IPS)];
-
-            try
-            {
-                client.ip = IPv4((std::string)json_user_configuration[keys.at(clients::KEY::IP)]);
-            }
-            catch (const ExceptionIPv4& error)
-            {
-                throw WireguardException("Client IPv4 Error: " + error.what());
-            }
-            catch (...)
-            {
-                throw;
-            }
-
-            this->clients.push_back(client);
-        }
-    }
-
-    /// @brief Converts server configuration in RAM to wg.conf file of server configuration
-    void Wireguard::WriteServerConfiguration() const
-    {
-        //тут написать как переводить конфиг в файл конфига wg (wg0.conf)
-        //прям записать в файл
-    }
-
-    /// @brief Writes JSON object to json file
-    /// @param json_configuration JSON object
-    void Wireguard::UploadConfiguration(const nlohmann::json& json_configuration) const
-    {
-        std::ofstream file(ROOT_PATH + this->server.interface_name + ".json");
-        if (file.is_open()) file << std::setw(4) << json_configuration;
-        else
-        {
-            throw WireguardException("Unable access to " + this->server.interface_name + ".json");
-            exit(EXIT_FAILURE);
-        }
-        file.close();
-    }
-
-    /// @brief Read JSON file and convert in to JSON object
-    /// @return JSON object
-    nlohmann::json Wireguard::DownloadConfiguration() const
-    {
-#pragma region Парсинг_ср-ми_библиотеки
-        nlohmann::json json_configuration;
-        std::ifstream file(ROOT_PATH + this->server.interface_name + ".json");
-        if (file.is_open())
-        {
-            try
-            {
-                json_configuration = nlohmann::json::parse(file);
-            }
-            catch (const nlohmann::json::parse_error& error)
-            {
-                throw WireguardException("json::parse_error");
-            }
-            catch (...)
-            {
-                throw;
-            }
-
-        }
-        else throw WireguardException("Unable access to " + this->server.interface_name + ".json");
-        file.close();
-#pragma endregion
-
-#pragma region Проверка_наличия_полей
-
-#pragma region Проверка_наличия_полей_server_и_clients
-        // Check that general section for keys
-        for (uint32_t key = general::KEY::FIRST; key < general::KEY::LAST; key++)
-        {
-            if (!json_configuration.contains(keys.at(key))) throw WireguardException("No section in configuration file: \"" + keys.at(key) + '"');
-        }
-#pragma endregion
-        nlohmann::json json_server_configuration = json_configuration[keys.at(general::KEY::SERVER)];
-        nlohmann::json json_clients_configuration = json_configuration[keys.at(general::KEY::CLIENTS)];
-#pragma region Проверка_наличия_полей_в_секции_server
-        // Check server section for keys
-        for (uint32_t key = server::KEY::FIRST; key < server::KEY::LAST; key++)
-        {
-            if (!json_server_configuration.contains(keys.at(key))) throw WireguardException("No section \"" + keys.at(key) + "\" of section \"" + keys.at(general::KEY::SERVER) + "\" in configuration file");
-        }
-#pragma endregion
-
-#pragma region Проверка_наличия_полей_секции_clients
-        // Check clients section for keys
-        for (const nlohmann::json& json_client_configuration : json_clients_configuration)
-        {
-            for (uint32_t key = clients::KEY::FIRST; key < clients::KEY::LAST; key++)
-            {
-                if (!json_clients_configuration.contains(keys.at(key))) throw WireguardException("No section \"" + keys.at(key) + "\" of section \"" + keys.at(general::KEY::CLIENTS) + "\" in configuration file");
-            }
-        }    
-#pragma endregion
-
-#pragma endregion
-
-#pragma region Проверка_типов_полей
-
-#pragma region Проверка_типов_полей_server_и_clients
-        // Check types of fields in general section
-        if (!json_server_configuration.is_object()) throw WireguardException("Section \"" + keys.at(general::KEY::SERVER) + "\" must be object type");
-        if (!json_clients_configuration.is_array()) throw WireguardException("Section \"" + keys.at(general::KEY::CLIENTS) + "\" must be array type");
-#pragma endregion
-
-#pragma region Проверка_типов_полей_секции_server
-        // Check types of fields in server section
-        for (uint32_t key = server::KEY::FIRST; key < server::KEY::LAST; key++)
-        {
-            if (key != server::KEY::LISTEN_PORT && key != server::KEY::PUBLIC_LISTEN_PORT) // all without numeric fields
-            {
-                if (key != server::KEY::ENDPOINT_DNS && key != server::KEY::ENDPOINT_IP) // fields that only may be string type
-                {
-                    if (!json_server_configuration[keys.at(key)].is_string()) throw WireguardException("Field \"" + keys.at(key) + "\" of section \"" + keys.at(general::KEY::SERVER) + "\" must be string type");
-                }
-                else // fields that may be string or null type (ENDPOINT_DNS and ENDPOINT_IP)
-                {
-                    if (!json_server_configuration[keys.at(key)].is_string() && !json_server_configuration[keys.at(key)].is_null()) throw WireguardException("Field \"" + keys.at(key) + "\" of section \"" + keys.at(general::KEY::SERVER) + "\" must be string or null type"); // just check string or null
-                }
-            }
-            else //numeric fields
-            {
-                if (!json_server_configuration[keys.at(key)].is_number_unsigned()) throw WireguardException("Field \"" + keys.at(key) + "\" of section \"" + keys.at(general::KEY::SERVER) + "\" must be unsigned integer type");
-            }
-        }
-        // Check that at least one of fields (ENDPOINT_DNS and ENDPOINT_IP) is not null type
-        if (json_server_configuration[keys.at(server::KEY::ENDPOINT_DNS)].is_null() && json_server_configuration[keys.at(server::KEY::ENDPOINT_IP)].is_null()) throw WireguardException("One of the fields, \"" + keys.at(server::KEY::ENDPOINT_DNS) + "\" or \"" + keys.at(server::KEY::ENDPOINT_IP) + "\", of section \"" + keys.at(general::KEY::SERVER) + "\" must be string type");
-#pragma endregion
-
-#pragma region Проверка_типов_полей_секции_clients
-        // Check types of fields in clients section
-        for (const nlohmann::json& json_client_configuration : json_clients_configuration) // itterate clients
-        {
-            if (!json_client_configuration.is_object()) throw WireguardException("Element of section \"" + keys.at(general::KEY::CLIENTS) + "\" must be object type"); // client must be object type
-            for (uint32_t key = clients::KEY::FIRST; key < clients::KEY::LAST; key++)
-            {
-                if (key != clients::KEY::ACCOUNT_STATUS && key != clients::KEY::ADMINISTRATIVE_ACCOUNT_STATUS && key != clients::KEY::CONNECTION_STATUS) // all without bool fields
-                {
-                    if (key != clients::KEY::RELEASE_DATE && key != clients::KEY::EXPIRATION_DATE) // fields that only may be string type
-                    {
-                        if (!json_client_configuration[keys.at(key)].is_string()) throw WireguardException("Field \"" + keys.at(key) + "\" of section \"" + keys.at(general::KEY::CLIENTS) + "\" must be string type");
-                    }
-                    else // fields that may be string or null type (RELEASE_DATE and EXPIRATION_DATE)
-                    {
-                        if (!json_server_configuration[keys.at(key)].is_string() && !json_server_configuration[keys.at(key)].is_null()) throw WireguardException("Field \"" + keys.at(key) + "\" of section \"" + keys.at(general::KEY::CLIENTS) + "\" must be string or null type"); // just check string or null
-                    }
-                }
-                else // bool fields
-                {
-                    if (key != clients::KEY::CONNECTION_STATUS)
-                    {
-                        if (!json_client_configuration[keys.at(key)].is_boolean()) throw WireguardException("Field \"" + keys.at(key) + "\" of section \"" + keys.at(general::KEY::CLIENTS) + "\" must be boolean type");
-                    }
-                    else // field CONNECTION_STATUS may be bool or null type
-                    {
-                        if (!json_client_configuration[keys.at(key)].is_boolean() && !json_client_configuration[keys.at(key)].is_null()) throw WireguardException("Field \"" + keys.at(key) + "\" of section \"" + keys.at(general::KEY::CLIENTS) + "\" must be boolean or null type");
-                    }
-                }
-            }
-        }
-#pragma endregion
-
-#pragma endregion
-
-        return json_configuration;
-    }
-
-    /// @brief Gets list of clients
-    /// @return list of Client structures as clients configuration
-    std::vector<Client> Wireguard::GetClients()
-    {
-        return this->clients;
-    }
-
-    /// @brief Remove client from configuration by it's UUID
-    /// @param uuid UUID of client
-    void Wireguard::RemoveClient(const std::string& uuid)
-    {
-        for (std::vector<Client>::iterator itter = this->clients.begin(); itter != this->clients.end(); itter++)
-        {
-            if (itter->uuid == uuid)
-            {
-                this->clients.erase(itter);
-                break;
-            }
-        }
-    }
-
-    /// @brief Starts the wireguard server with clients
-    void Wireguard::StartServer()
-    {
-        wg_quick_up(this->server.interface_name);
-        for (Client client : this->clients)
-        {
-            if (client.account_status) this->AddPeer(client);
-        }
-    }
-
-    /// @brief Stops the wireguard server
-    void Wireguard::StopServer()
-    {
-        wg_quick_down(this->server.interface_name);
-    }
-
-    /// @brief Reboots the wireguard server, by stop start commands
-    void Wireguard::RebootServer()
-    {
-        this->StopServer();
-        this->StartServer();
-    }
+#include "wireguard.hpp"
+#include "uuid.hpp"
+#include <fstream>
+#include <unordered_set>
+#include "wg_utils.hpp"
+#include "ipv4.hpp"
+#include "binary_snapshot.hpp"
+#include "configuration_keys.hpp"
+#include "configuration_loader.hpp"
+#include "server_configuration.hpp"
+#include "client_configuration.hpp"
+#include "curve25519.hpp"
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define JSON_EXTENSION ".json"
+#define BINARY_SNAPSHOT_EXTENSION ".snap"
+#define JOURNAL_EXTENSION ".journal"
+#define WG_SYNC_EXTENSION ".sync.conf" // temporary file for wg syncconf
+
+#define JOURNAL_OPERATION "operation"
+#define JOURNAL_CLIENT "client"
+#define JOURNAL_CREATE "create"
+#define JOURNAL_UPDATE "update"
+#define JOURNAL_REMOVE "remove"
+#define JOURNAL_STATUS "status"
+#define JOURNAL_SERVER "server"
+
+#define LISTEN_PORT_DEFAULT 55255
+#define ENDPOINT_IP_DEFAULT "127.0.0.1"
+#define ENDPOINT_DNS_DEFAULT ""
+#define IP_DEFAULT "10.0.30.1"
+#define NETMASK_DEFAULT "255.255.255.0"
+#define PRIVATE_KEY_DEFAULT
+#define PUBLIC_KEY_DEFAULT
+#define PRE_UP_DEFAULT "echo Wireguard PreUp"
+#define POST_UP_DEFAULT "echo Wireguard PostUp"
+#define PRE_DOWN_DEFAULT "echo Wireguard PreDown"
+#define POST_DOWN_DEFAULT "echo Wireguard PostDown"
+
+namespace timlibs
+{
+
+    WireguardException::WireguardException() : error_discription{ NULL_STRING } {}
+
+
+    WireguardException::WireguardException(const std::string& discription) : error_discription{ discription } {}
+
+
+    WireguardException::WireguardException(const char* discription) : error_discription{ discription } {}
+
+
+    std::string WireguardException::what() const { return this->error_discription; }
+
+
+    /// @brief Converts Time to seconds since epoch
+    /// @param time time object
+    /// @return unix time
+    time_t ToUnixTime(const Time& time) { return (time_t)(time - Time((time_t)0)); }
+
+    /// @brief Converts IPv4 to number in host byte order
+    /// @param ip ip address
+    /// @return ip as number, ex.: 10.0.30.1 -> 0x0A001E01
+    uint32_t ToHostOrder(const IPv4& ip)
+    {
+        in_addr address{};
+        if (inet_pton(AF_INET, ip.GetAsString().c_str(), &address) != 1) throw WireguardException("IPv4 \"" + ip.GetAsString() + "\" isn't valid");
+        return ntohl(address.s_addr);
+    }
+
+    /// @brief Converts number in host byte order to IPv4
+    /// @param ip ip as number, ex.: 0x0A001E01
+    /// @return ip address, ex.: 10.0.30.1
+    IPv4 FromHostOrder(uint32_t ip)
+    {
+        in_addr address{};
+        address.s_addr = htonl(ip);
+        char text[INET_ADDRSTRLEN] = { 0 };
+        inet_ntop(AF_INET, &address, text, sizeof(text));
+        return IPv4(std::string(text));
+    }
+}
+
+namespace timlibs
+{
+    namespace
+    {
+        /// @brief Copies fields of patch to client, NULL_IP_DEC keeps the old ip
+        /// @param client client to change
+        /// @param patch fields and their values
+        void PatchClient(Client& client, const ClientPatch& patch)
+        {
+            const Client& values = patch.values;
+            if (patch.fields & client_fields::PRIVATE_KEY) client.private_key = values.private_key;
+            if (patch.fields & client_fields::PUBLIC_KEY) client.public_key = values.public_key;
+            if (patch.fields & client_fields::LOGIN) client.login = values.login;
+            if (patch.fields & client_fields::FULL_NAME) client.full_name = values.full_name;
+            if ((patch.fields & client_fields::IP) && ToHostOrder(values.ip) != NULL_IP_DEC) client.ip = values.ip;
+            if (patch.fields & client_fields::ADMINISTRATIVE_ACCOUNT_STATUS) client.administrative_account_status = values.administrative_account_status;
+            if (patch.fields & client_fields::RELEASE_DATE) client.release_date = values.release_date;
+            if (patch.fields & client_fields::EXPIRATION_DATE) client.expiration_date = values.expiration_date;
+            if (patch.fields & client_fields::ALLOWED_IPS) client.allowed_ips = values.allowed_ips;
+            if (patch.fields & client_fields::DNS) client.dns = values.dns;
+        }
+
+        /// @brief Compares fields of clients which may be changed by patch
+        /// @param old client before patch
+        /// @param updated client after patch
+        /// @return changed client_fields
+        uint32_t GetChangedFields(const Client& old, const Client& updated)
+        {
+            uint32_t changed = 0;
+            if (old.private_key != updated.private_key) changed |= client_fields::PRIVATE_KEY;
+            if (old.public_key != updated.public_key) changed |= client_fields::PUBLIC_KEY;
+            if (old.login != updated.login) changed |= client_fields::LOGIN;
+            if (old.full_name != updated.full_name) changed |= client_fields::FULL_NAME;
+            if (ToHostOrder(old.ip) != ToHostOrder(updated.ip)) changed |= client_fields::IP;
+            if (old.administrative_account_status != updated.administrative_account_status) changed |= client_fields::ADMINISTRATIVE_ACCOUNT_STATUS;
+            if (ToUnixTime(old.release_date) != ToUnixTime(updated.release_date)) changed |= client_fields::RELEASE_DATE;
+            if (ToUnixTime(old.expiration_date) != ToUnixTime(updated.expiration_date)) changed |= client_fields::EXPIRATION_DATE;
+            if (old.allowed_ips != updated.allowed_ips) changed |= client_fields::ALLOWED_IPS;
+            if (old.dns != updated.dns) changed |= client_fields::DNS;
+            return changed;
+        }
+
+        /// @brief Copies fields of patch to server
+        /// @param server server to change
+        /// @param patch fields and their values
+        void PatchServer(Server& server, const ServerPatch& patch)
+        {
+            const Server& values = patch.values;
+            if (patch.fields & server_fields::LISTEN_PORT) server.listen_port = values.listen_port;
+            if (patch.fields & server_fields::IP) server.ip = values.ip;
+            if (patch.fields & server_fields::NETWORK) server.network = values.network;
+            if (patch.fields & server_fields::ENDPOINT_DNS) server.endpoint_dns = values.endpoint_dns;
+            if (patch.fields & server_fields::ENDPOINT_IP) server.endpoint_ip = values.endpoint_ip;
+            if (patch.fields & server_fields::PUBLIC_LISTEN_PORT) server.public_listen_port = values.public_listen_port;
+            if (patch.fields & server_fields::PRIVATE_KEY) server.private_key = values.private_key;
+            if (patch.fields & server_fields::PUBLIC_KEY) server.public_key = values.public_key;
+            if (patch.fields & server_fields::PRE_UP) server.pre_up = values.pre_up;
+            if (patch.fields & server_fields::POST_UP) server.post_up = values.post_up;
+            if (patch.fields & server_fields::PRE_DOWN) server.pre_down = values.pre_down;
+            if (patch.fields & server_fields::POST_DOWN) server.post_down = values.post_down;
+        }
+
+        /// @brief Compares fields of servers
+        /// @param old server before patch
+        /// @param updated server after patch
+        /// @return changed server_fields
+        uint32_t GetChangedFields(const Server& old, const Server& updated)
+        {
+            uint32_t changed = 0;
+            if (old.interface_name != updated.interface_name) changed |= server_fields::INTERFACE_NAME;
+            if (old.listen_port != updated.listen_port) changed |= server_fields::LISTEN_PORT;
+            if (old.ip.GetAsString() != updated.ip.GetAsString()) changed |= server_fields::IP;
+            if (old.network.GetAsString() != updated.network.GetAsString()) changed |= server_fields::NETWORK;
+            if (old.endpoint_dns != updated.endpoint_dns) changed |= server_fields::ENDPOINT_DNS;
+            if (old.endpoint_ip.GetAsString() != updated.endpoint_ip.GetAsString()) changed |= server_fields::ENDPOINT_IP;
+            if (old.public_listen_port != updated.public_listen_port) changed |= server_fields::PUBLIC_LISTEN_PORT;
+            if (old.private_key != updated.private_key) changed |= server_fields::PRIVATE_KEY;
+            if (old.public_key != updated.public_key) changed |= server_fields::PUBLIC_KEY;
+            if (old.pre_up != updated.pre_up) changed |= server_fields::PRE_UP;
+            if (old.post_up != updated.post_up) changed |= server_fields::POST_UP;
+            if (old.pre_down != updated.pre_down) changed |= server_fields::PRE_DOWN;
+            if (old.post_down != updated.post_down) changed |= server_fields::POST_DOWN;
+            return changed;
+        }
+    }
+
+
+    /// @brief Registers instruments of Wireguard
+    /// @param registry registry of metrics
+    WireguardMetrics::WireguardMetrics(MetricsRegistry& registry) :
+        date_and_mode_duration{ registry.AddHistogram("wireguard_controller_duration_seconds", "Duration of controller phases.", "phase=\"date_and_mode\"") },
+        connection_status_duration{ registry.AddHistogram("wireguard_controller_duration_seconds", "Duration of controller phases.", "phase=\"connection_status\"") },
+        peers_connection_duration{ registry.AddHistogram("wireguard_controller_duration_seconds", "Duration of controller phases.", "phase=\"peers_connection\"") },
+        serialize_duration{ registry.AddHistogram("wireguard_persistence_duration_seconds", "Duration of configuration persistence steps.", "step=\"serialize\"") },
+        upload_duration{ registry.AddHistogram("wireguard_persistence_duration_seconds", "Duration of configuration persistence steps.", "step=\"upload\"") },
+        journal_append_duration{ registry.AddHistogram("wireguard_persistence_duration_seconds", "Duration of configuration persistence steps.", "step=\"journal_append\"") },
+        peers_dump_duration{ registry.AddHistogram("wireguard_peer_controller_duration_seconds", "Latency of wireguard interface calls.", "operation=\"dump\"") },
+        peers_apply_duration{ registry.AddHistogram("wireguard_peer_controller_duration_seconds", "Latency of wireguard interface calls.", "operation=\"apply\"") },
+        peers_added{ registry.AddCounter("wireguard_peer_changes", "Peers changed on interface by reconciliation.", "change=\"added\"") },
+        peers_updated{ registry.AddCounter("wireguard_peer_changes", "Peers changed on interface by reconciliation.", "change=\"updated\"") },
+        peers_removed{ registry.AddCounter("wireguard_peer_changes", "Peers changed on interface by reconciliation.", "change=\"removed\"") },
+        account_status_changes{ registry.AddCounter("wireguard_status_changes", "Changes of client statuses by controllers.", "status=\"account\"") },
+        connection_status_changes{ registry.AddCounter("wireguard_status_changes", "Changes of client statuses by controllers.", "status=\"connection\"") },
+        clients{ registry.AddGauge("wireguard_clients", "Clients in configuration.") },
+        peers{ registry.AddGauge("wireguard_peers", "Peers of interface by the last dump.") } {}
+
+    /// @brief Initialize the wireguard server
+    /// @param interface_name name of wireguard interface, ex. wg0
+    /// @param peer_controller backend of peers management, by default netlink (or wg command if wireguard netlink family is unavailable)
+    /// @param root_path directory of configuration files, ex.: /etc/wireguard/
+    /// @param peer_executor workers for peer controller calls, may be shared by interfaces (own executor if nullptr)
+    /// @param event_bus bus of change events, may be shared by interfaces (own bus if nullptr)
+    Wireguard::Wireguard(const std::string& interface_name, std::shared_ptr<PeerController> peer_controller, const std::string& root_path, std::shared_ptr<PeerExecutor> peer_executor, std::shared_ptr<EventBus> event_bus)
+        : peer_controller{ peer_controller }, peer_executor{ peer_executor }, root_path{ root_path }, event_bus{ event_bus }
+    {
+        if (!this->peer_executor) this->peer_executor = std::make_shared<PeerExecutor>();
+        if (!this->event_bus) this->event_bus = std::make_shared<EventBus>();
+        if (!this->root_path.empty() && this->root_path.back() != '/') this->root_path += '/';
+        if (!this->peer_controller)
+        {
+            try
+            {
+                this->peer_controller = std::make_shared<NetlinkPeerController>();
+            }
+            catch (const WireguardException&)
+            {
+                this->peer_controller = std::make_shared<ShellPeerController>();
+            }
+        }
+
+        //if file exist - load, else new configuration
+        if (interface_name == NULL_STRING) this->server.interface_name = INTERFACE_NAME_DEFAULT;
+        else this->server.interface_name = interface_name;
+        this->journal = std::make_unique<ConfigurationJournal>(this->root_path + this->server.interface_name + JOURNAL_EXTENSION);
+        if (std::ifstream(this->root_path + this->server.interface_name + BINARY_SNAPSHOT_EXTENSION)) this->snapshot_format = SnapshotFormat::BINARY;
+        this->snapshot_exists = this->snapshot_format == SnapshotFormat::BINARY || std::ifstream(this->root_path + this->server.interface_name + JSON_EXTENSION);
+        if (this->snapshot_exists) this->ReadConfiguration();
+        else
+        {
+            // Бляяя, я заебался уже писать
+            this->RebuildAddresses();
+        }
+        this->PublishSnapshot();
+    }
+
+    /// @brief Gets server configuration
+    /// @return server configuration as Server structure
+    Server Wireguard::GetServer() const { return this->GetSnapshot()->server; }
+
+    /// @brief Gets the last published state of configuration without waiting for writer
+    /// @return immutable snapshot
+    std::shared_ptr<const ConfigurationSnapshot> Wireguard::GetSnapshot() const { return std::atomic_load(&this->snapshot); }
+
+    /// @brief Changes fields of server. Every field has the cheapest effect: endpoint fields are only saved (they are used by configurations
+    /// @brief of clients), Pre/Post Up/Down rewrite wg-quick file, listen port and keys are applied to running interface by wg syncconf,
+    /// @brief ip and network replace address of running interface and rebuild free addresses of clients. Interface isn't restarted
+    /// @param patch fields and their new values
+    /// @return changed server_fields, 0 if values are the same
+    uint32_t Wireguard::SetServer(const ServerPatch& patch)
+    {
+        if (patch.fields & server_fields::INTERFACE_NAME) throw WireguardException("Interface name can't be changed");
+        std::lock_guard<std::mutex> lock(this->write_mutex);
+        Server updated = this->server;
+        PatchServer(updated, patch);
+        if ((patch.fields & server_fields::PRIVATE_KEY) && !(patch.fields & server_fields::PUBLIC_KEY))
+        {
+            updated.public_key = updated.private_key == NULL_STRING ? NULL_STRING : DerivePublicKey(updated.private_key);
+        }
+        else if ((patch.fields & server_fields::PRIVATE_KEY) && updated.private_key != NULL_STRING && DerivePublicKey(updated.private_key) != updated.public_key)
+        {
+            throw WireguardException("Public key of server doesn't match private key");
+        }
+        uint32_t changed = GetChangedFields(this->server, updated);
+        if (changed == 0) return 0;
+
+        if (changed & (server_fields::IP | server_fields::NETWORK))
+        {
+            uint32_t address = 0;
+            uint32_t prefix = 0;
+            if (!ParseNetwork(updated.network.GetAsString(), address, prefix)) throw WireguardException("Server network " + updated.network.GetAsString() + " isn't valid");
+            uint32_t server_address = ToHostOrder(updated.ip);
+            uint32_t mask = prefix == 0 ? 0 : ~(uint32_t)0 << (32 - prefix);
+            if (server_address != NULL_IP_DEC)
+            {
+                if ((server_address & mask) != (address & mask)) throw WireguardException("Server ip " + updated.ip.GetAsString() + " isn't in network " + updated.network.GetAsString());
+                const Client* client = this->clients.FindByIp(updated.ip);
+                if (client != nullptr) throw WireguardException("Server ip " + updated.ip.GetAsString() + " is used by client \"" + client->uuid + '"');
+            }
+        }
+
+        std::string previous_address = GetInterfaceAddress(this->server);
+        this->server = updated;
+        if (changed & (server_fields::IP | server_fields::NETWORK)) this->RebuildAddresses();
+        this->JournalServer();
+        this->Emit(event_types::SERVER_UPDATED, nullptr);
+        this->Persist();
+
+        const uint32_t interface_fields = server_fields::LISTEN_PORT | server_fields::PRIVATE_KEY;
+        const uint32_t wg_quick_fields = interface_fields | server_fields::IP | server_fields::NETWORK | server_fields::PRE_UP | server_fields::POST_UP | server_fields::PRE_DOWN | server_fields::POST_DOWN;
+        if (changed & wg_quick_fields) this->WriteServerConfiguration();
+        if ((changed & (interface_fields | server_fields::IP | server_fields::NETWORK)) && InterfaceExists(this->server.interface_name)) // stopped interface gets them by wg-quick up
+        {
+            if (changed & interface_fields) this->SyncServerConfiguration();
+            if (changed & (server_fields::IP | server_fields::NETWORK)) ReplaceInterfaceAddress(this->server.interface_name, previous_address, GetInterfaceAddress(this->server));
+        }
+        return changed;
+    }
+
+    /// @brief Creates a client, it's validated as CREATE item of ApplyBatch()
+    /// @param client object of Client class that containt information about client (ip is allocated if it's NULL_IP_DEC)
+    /// @return UUID of new client
+    std::string Wireguard::CreateClient(Client client)
+    {
+        std::lock_guard<std::mutex> lock(this->write_mutex);
+        BatchReport report;
+        report.items.resize(1);
+        if (!this->ValidateBatch({ BatchItem{ BatchOperation::CREATE, client } }, report)) throw WireguardException(report.items[0].error);
+        std::vector<IpPrefix> prefixes;
+        ParseAllowedIps(client.allowed_ips, prefixes); // validated already
+        client.allowed_ips = FormatAllowedIps(prefixes);
+        client.uuid = generate_uuid();
+        uint32_t address = ToHostOrder(client.ip);
+        if (address == NULL_IP_DEC)
+        {
+            if (!this->address_allocator.Allocate(address)) throw WireguardException("No free ip address in network " + this->server.network.GetAsString());
+            client.ip = FromHostOrder(address);
+        }
+        else this->address_allocator.Reserve(address);
+        try
+        {
+            this->clients.Insert(client);
+        }
+        catch (...)
+        {
+            this->address_allocator.Release(address);
+            throw;
+        }
+        this->routes.Insert(client.uuid.ToString(), prefixes);
+        this->expiry_scheduler.Schedule(client.uuid, time(nullptr)); // account status is set by next controller call
+        this->JournalClient(JOURNAL_CREATE, client);
+        this->Emit(event_types::CLIENT_CREATED, &client);
+        this->Persist();
+        this->WakeUp();
+        return client.uuid.ToString();
+    }
+
+    /// @brief Creates many clients at once
+    /// @param clients objects of Client class (ip is allocated if it's NULL_IP_DEC)
+    /// @return UUIDs of new clients in the same order
+    std::vector<std::string> Wireguard::CreateClients(const std::vector<Client>& clients)
+    {
+        std::vector<BatchItem> items;
+        items.reserve(clients.size());
+        for (const Client& client : clients) items.push_back(BatchItem{ BatchOperation::CREATE, client });
+
+        BatchReport report = this->ApplyBatch(items);
+        std::vector<std::string> uuids;
+        uuids.reserve(report.items.size());
+        for (size_t index = 0; index < report.items.size(); index++)
+        {
+            if (!report.applied && report.items[index].error != NULL_STRING) throw WireguardException("Client " + std::to_string(index) + ": " + report.items[index].error);
+            uuids.push_back(report.items[index].uuid);
+        }
+        return uuids;
+    }
+
+    /// @brief Creates, updates and removes clients as one change: all items are validated first, then configuration is changed in RAM,
+    /// @brief written to journal once and peers of interface are updated by one batch
+    /// @param items changes of clients
+    /// @return result of every item, configuration isn't changed if any item isn't valid
+    BatchReport Wireguard::ApplyBatch(const std::vector<BatchItem>& items)
+    {
+        std::lock_guard<std::mutex> lock(this->write_mutex);
+        return this->ApplyBatchLocked(items);
+    }
+
+    /// @brief Replaces key pairs of clients, ex. after leak of configurations. Keys are generated before the writer lock is taken,
+    /// @brief then clients are updated by one batch: one journal write and one update of interface (old peers are removed, new ones are added)
+    /// @param uuids UUIDs of clients
+    /// @return result of every client, nothing is changed if any client isn't found
+    BatchReport Wireguard::RotateClientKeys(const std::vector<std::string>& uuids)
+    {
+        std::vector<KeyPair> pairs = GenerateKeyPairs(uuids.size());
+        std::lock_guard<std::mutex> lock(this->write_mutex);
+        std::vector<BatchItem> items(uuids.size());
+        for (size_t index = 0; index < uuids.size(); index++)
+        {
+            items[index].operation = BatchOperation::UPDATE;
+            const Client* client = this->clients.FindByUuid(uuids[index]);
+            if (client != nullptr) items[index].client = *client;
+            else items[index].client.uuid = uuids[index]; // error is reported by validation
+            items[index].client.private_key = std::move(pairs[index].private_key);
+            items[index].client.public_key = std::move(pairs[index].public_key);
+        }
+        return this->ApplyBatchLocked(items);
+    }
+
+    BatchReport Wireguard::ApplyBatchLocked(const std::vector<BatchItem>& items)
+    {
+        BatchReport report;
+        report.items.resize(items.size());
+        if (!this->ValidateBatch(items, report)) return report;
+
+        // changes in RAM are undone if anything throws before they are journalled, so batch is applied fully or not at all
+        BatchUndo undo;
+        undo.records_size = this->pending_records.size();
+        undo.events_size = this->pending_events.size();
+        try
+        {
+            // old records go first, so new records can take their keys, logins and addresses
+            std::vector<std::pair<Client, const char*>> inserts; // client and journal operation
+            inserts.reserve(items.size());
+            for (size_t index = 0; index < items.size(); index++)
+            {
+                const Client& client = items[index].client;
+                if (items[index].operation == BatchOperation::CREATE)
+                {
+                    inserts.emplace_back(client, JOURNAL_CREATE);
+                    inserts.back().first.uuid = generate_uuid();
+                    continue;
+                }
+
+                undo.removed.push_back(*this->clients.FindByUuid(client.uuid));
+                const Client& old = undo.removed.back();
+                this->address_allocator.Release(ToHostOrder(old.ip));
+                this->routes.Remove(old.uuid.ToString());
+                this->clients.Remove(old.uuid);
+                if (items[index].operation == BatchOperation::REMOVE)
+                {
+                    this->expiry_scheduler.Cancel(old.uuid);
+                    this->JournalRemove(old.uuid.ToString());
+                    this->Emit(event_types::CLIENT_REMOVED, &old);
+                    report.items[index].uuid = old.uuid.ToString();
+                    continue;
+                }
+                inserts.emplace_back(client, JOURNAL_UPDATE);
+                Client& updated = inserts.back().first;
+                updated.creation_date = old.creation_date;
+                updated.account_status = old.account_status;
+                updated.connection_status = old.connection_status;
+                if (ToHostOrder(updated.ip) == NULL_IP_DEC) updated.ip = old.ip;
+            }
+
+            // explicit addresses are reserved before allocation, so allocated addresses can't collide with them
+            size_t without_ip = 0;
+            for (const std::pair<Client, const char*>& insert : inserts)
+            {
+                uint32_t address = ToHostOrder(insert.first.ip);
+                if (address == NULL_IP_DEC) without_ip++;
+                else if (this->address_allocator.Reserve(address)) undo.reserved.push_back(address);
+            }
+            std::vector<uint32_t> addresses = this->address_allocator.Allocate(without_ip);
+            undo.reserved.insert(undo.reserved.end(), addresses.begin(), addresses.end());
+            std::vector<uint32_t>::const_iterator next_address = addresses.begin();
+
+            this->clients.Reserve(this->clients.Size() + inserts.size());
+            time_t now = time(nullptr);
+            size_t insert_index = 0;
+            std::vector<IpPrefix> prefixes;
+            for (size_t index = 0; index < items.size(); index++)
+            {
+                if (items[index].operation == BatchOperation::REMOVE) continue;
+                Client& client = inserts[insert_index].first;
+                if (ToHostOrder(client.ip) == NULL_IP_DEC) client.ip = FromHostOrder(*next_address++);
+                ParseAllowedIps(client.allowed_ips, prefixes); // validated already
+                client.allowed_ips = FormatAllowedIps(prefixes);
+                undo.inserted.push_back(client.uuid);
+                this->clients.Insert(client);
+                this->routes.Insert(client.uuid.ToString(), prefixes);
+                this->expiry_scheduler.Schedule(client.uuid, now);
+                this->JournalClient(inserts[insert_index].second, client);
+                this->Emit(items[index].operation == BatchOperation::CREATE ? event_types::CLIENT_CREATED : event_types::CLIENT_UPDATED, &client);
+                report.items[index].uuid = client.uuid.ToString();
+                insert_index++;
+            }
+        }
+        catch (...)
+        {
+            this->UndoBatch(undo);
+            throw;
+        }
+        report.applied = true;
+
+        this->DateAndModeController(time(nullptr));
+        this->Persist();
+        this->WakeUp();
+        std::vector<PeerInfo> peers = this->DumpPeers(); // configuration is saved already, if interface fails, Run retries it
+        this->last_reconciliation = this->PeersConnectionController(peers);
+        this->WaitPeerChanges();
+        this->PublishEvents(); // changes of peers
+        return report;
+    }
+
+    /// @brief Returns configuration in RAM to the state before batch: new records are removed, old records are inserted again,
+    /// @brief journal records and events of batch are dropped (nothing is journalled before the whole batch is applied)
+    /// @param undo changes made by batch so far
+    void Wireguard::UndoBatch(const BatchUndo& undo)
+    {
+        for (const ClientUuid& uuid : undo.inserted)
+        {
+            this->routes.Remove(uuid.ToString());
+            this->clients.Remove(uuid);
+            this->expiry_scheduler.Cancel(uuid);
+        }
+        for (uint32_t address : undo.reserved) this->address_allocator.Release(address);
+        time_t now = time(nullptr);
+        std::vector<IpPrefix> prefixes;
+        for (const Client& old : undo.removed)
+        {
+            if (this->clients.FindByUuid(old.uuid) == nullptr) this->clients.Insert(old);
+            if (ParseAllowedIps(old.allowed_ips, prefixes)) this->routes.Insert(old.uuid.ToString(), prefixes);
+            this->address_allocator.Reserve(ToHostOrder(old.ip));
+            this->expiry_scheduler.Schedule(old.uuid, now);
+        }
+        this->pending_records.resize(undo.records_size);
+        this->pending_events.resize(undo.events_size);
+    }
+
+    /// @brief Checks batch against configuration and against itself: uuids of updates and removes exist and are used once,
+    /// @brief public keys, logins and ip addresses are unique after batch, ip addresses are in server network, dates are valid,
+    /// @brief allowed ips are IPv4 prefixes which don't overlap with allowed ips of other clients
+    /// @param items changes of clients
+    /// @param report report with items, errors are set
+    /// @return true if all items are valid
+    bool Wireguard::ValidateBatch(const std::vector<BatchItem>& items, BatchReport& report) const
+    {
+        // values of old records of updates and removes are free after batch
+        std::unordered_set<std::string> changed_uuids; // texts, as owners of routes
+        std::unordered_set<WireguardKey, PackedTextHash> released_keys;
+        std::unordered_set<PooledString, PooledStringHash> released_logins;
+        std::unordered_set<uint32_t> released_ips;
+        for (size_t index = 0; index < items.size(); index++)
+        {
+            if (items[index].operation == BatchOperation::CREATE) continue;
+            const ClientUuid& uuid = items[index].client.uuid;
+            const Client* old = this->clients.FindByUuid(uuid);
+            if (old == nullptr) report.items[index].error = "Client \"" + uuid + "\" is not found";
+            else if (!changed_uuids.insert(uuid.ToString()).second) report.items[index].error = "Client \"" + uuid + "\" is changed twice in batch";
+            else
+            {
+                released_keys.insert(old->public_key);
+                released_logins.insert(old->login);
+                released_ips.insert(ToHostOrder(old->ip));
+            }
+        }
+
+        std::unordered_set<WireguardKey, PackedTextHash> claimed_keys;
+        std::unordered_set<PooledString, PooledStringHash> claimed_logins;
+        std::unordered_set<uint32_t> claimed_ips;
+        AllowedIpsTrie claimed_routes; // allowed ips of checked items, owner is index of item
+        std::vector<IpPrefix> prefixes;
+        size_t without_ip = 0;
+        for (size_t index = 0; index < items.size(); index++)
+        {
+            if (items[index].operation == BatchOperation::REMOVE || report.items[index].error != NULL_STRING) continue;
+            const Client& client = items[index].client;
+            std::string& error = report.items[index].error;
+
+            if (!client.public_key.empty())
+            {
+                if (!claimed_keys.insert(client.public_key).second) error = "Public key \"" + client.public_key + "\" is used twice in batch";
+                else if (this->clients.FindByPublicKey(client.public_key) != nullptr && !released_keys.count(client.public_key)) error = "Public key \"" + client.public_key + "\" is already used";
+            }
+            if (error == NULL_STRING && !client.login.empty())
+            {
+                if (!claimed_logins.insert(client.login).second) error = "Login \"" + client.login + "\" is used twice in batch";
+                else if (this->clients.FindByLogin(client.login) != nullptr && !released_logins.count(client.login)) error = "Login \"" + client.login + "\" is already used";
+            }
+
+            uint32_t address = ToHostOrder(client.ip);
+            if (address == NULL_IP_DEC && items[index].operation == BatchOperation::UPDATE) address = ToHostOrder(this->clients.FindByUuid(client.uuid)->ip); // old ip is kept
+            if (error == NULL_STRING)
+            {
+                if (address == NULL_IP_DEC) without_ip++;
+                else if (!claimed_ips.insert(address).second) error = "Client ip " + client.ip.GetAsString() + " is used twice in batch";
+                else if (this->clients.FindByIp(FromHostOrder(address)) != nullptr && !released_ips.count(address)) error = "Client ip " + client.ip.GetAsString() + " is already used";
+                else if (!this->address_allocator.Contains(address) && !released_ips.count(address)) error = "Client ip " + client.ip.GetAsString() + " isn't in server network " + this->server.network.GetAsString();
+            }
+
+            if (error == NULL_STRING && ToUnixTime(client.release_date) > ToUnixTime(client.expiration_date)) error = "Client release date is after expiration date";
+
+            if (error == NULL_STRING && !ParseAllowedIps(client.allowed_ips, prefixes)) error = "Allowed ips \"" + client.allowed_ips + "\" aren't list of IPv4 prefixes";
+            for (size_t prefix_index = 0; prefix_index < prefixes.size() && error == NULL_STRING; prefix_index++)
+            {
+                const IpPrefix& prefix = prefixes[prefix_index];
+                const std::string* owner = this->routes.FindOverlap(prefix, changed_uuids);
+                if (owner != nullptr) error = "Allowed ip " + FormatPrefix(prefix) + " overlaps with allowed ips of client \"" + *owner + '"';
+                else if ((owner = claimed_routes.FindOverlap(prefix, {})) != nullptr) error = "Allowed ip " + FormatPrefix(prefix) + " overlaps with allowed ips of item " + *owner + " of batch";
+            }
+            if (error == NULL_STRING) claimed_routes.Insert(std::to_string(index), prefixes);
+        }
+
+        // every released address becomes free, every claimed address becomes used (both for kept addresses of updates)
+        size_t released_in_network = 0;
+        size_t claimed_in_network = 0;
+        for (uint32_t address : released_ips) released_in_network += this->address_allocator.Contains(address);
+        for (uint32_t address : claimed_ips) claimed_in_network += this->address_allocator.Contains(address);
+        if (this->address_allocator.GetFreeCount() + released_in_network < claimed_in_network + without_ip)
+        {
+            for (size_t index = 0; index < items.size(); index++)
+            {
+                if (items[index].operation == BatchOperation::CREATE && ToHostOrder(items[index].client.ip) == NULL_IP_DEC && report.items[index].error == NULL_STRING) report.items[index].error = "No free ip address in network " + this->server.network.GetAsString();
+            }
+        }
+
+        for (const BatchItemResult& result : report.items)
+        {
+            if (result.error != NULL_STRING) return false;
+        }
+        return true;
+    }
+
+    /// @brief Returns copy of client by it's UUID
+    /// @param uuid UUID of client
+    /// @return client configuration as Client structure
+    Client Wireguard::GetClient(const std::string& uuid) const
+    {
+        std::shared_ptr<const ConfigurationSnapshot> snapshot = this->GetSnapshot();
+        const Client* client = snapshot->clients.FindByUuid(uuid);
+        if (client == nullptr) throw WireguardException("Client id is not found");
+        return *client;
+    }
+
+    /// @brief Finds client which receives packets to address from interface, as wireguard chooses it: by the longest prefix of allowed ips
+    /// @param address ip address, ex.: 10.100.34.7
+    /// @return client configuration as Client structure
+    Client Wireguard::FindClientByAddress(const IPv4& address) const
+    {
+        std::shared_ptr<const ConfigurationSnapshot> snapshot = this->GetSnapshot();
+        const std::string* uuid = snapshot->routes.FindOwner(ToHostOrder(address));
+        const Client* client = (uuid != nullptr) ? snapshot->clients.FindByUuid(*uuid) : nullptr;
+        if (client == nullptr) throw WireguardException("No client routes address " + address.GetAsString());
+        return *client;
+    }
+
+    /// @brief Renders wg-quick configuration of client from the last snapshot
+    /// @param uuid UUID of client
+    /// @return configuration text
+    std::string Wireguard::GetClientConfiguration(const std::string& uuid) const
+    {
+        std::shared_ptr<const ConfigurationSnapshot> snapshot = this->GetSnapshot();
+        const Client* client = snapshot->clients.FindByUuid(uuid);
+        if (client == nullptr) throw WireguardException("Client id is not found");
+        return RenderClientConfiguration(snapshot->server, *client);
+    }
+
+    /// @brief Controls that real configuration is equal to configuration in RAM.
+    /// @brief It's using DateAndModeController, ConnectionStatusController, PeersConnectionController
+    void Wireguard::Controller()
+    {
+        std::lock_guard<std::mutex> lock(this->write_mutex);
+        std::vector<PeerInfo> peers = this->DumpPeers(); // one read for both controllers
+        this->DateAndModeController(time(nullptr));
+        this->last_reconciliation = this->PeersConnectionController(peers);
+        this->ConnectionStatusController(peers); // while changes of peers are applied
+        this->Persist();
+        this->WaitPeerChanges();
+    }
+
+    /// @brief Runs controllers in loop until Stop() is called.
+    /// @brief Account statuses are changed exactly at release/expiration dates, peers and handshakes are checked with intervals from ControllerSettings
+    void Wireguard::Run()
+    {
+        std::unique_lock<std::mutex> lock(this->run_mutex);
+        this->stop_requested = false;
+        lock.unlock();
+        {
+            std::lock_guard<std::mutex> write_lock(this->write_mutex);
+            this->next_handshake_poll = std::chrono::system_clock::time_point();
+            this->next_peers_check = std::chrono::system_clock::time_point();
+        }
+
+        lock.lock();
+        while (!this->stop_requested)
+        {
+            this->wake_requested = false;
+            lock.unlock();
+            std::chrono::system_clock::time_point wake_up = this->RunOnce();
+            lock.lock();
+            this->run_condition.wait_until(lock, wake_up, [this]() { return this->stop_requested || this->wake_requested; });
+        }
+    }
+
+    /// @brief Runs controllers which are due: account statuses at release/expiration dates, peers and handshakes by intervals of ControllerSettings
+    /// @return moment of the next iteration (earlier after changes of clients, see SetWakeUpHandler())
+    std::chrono::system_clock::time_point Wireguard::RunOnce()
+    {
+        using clock = std::chrono::system_clock;
+        ControllerSettings settings;
+        {
+            std::lock_guard<std::mutex> lock(this->run_mutex);
+            settings = this->controller_settings;
+        }
+
+        std::lock_guard<std::mutex> write_lock(this->write_mutex);
+        clock::time_point now = clock::now();
+        bool account_changes = this->DateAndModeController(clock::to_time_t(now));
+        bool peers_due = account_changes || now >= this->next_peers_check;
+        bool handshakes_due = now >= this->next_handshake_poll;
+        std::vector<PeerInfo> peers;
+        if (peers_due || handshakes_due) peers = this->DumpPeers(); // one read for both controllers
+        if (peers_due)
+        {
+            this->last_reconciliation = this->PeersConnectionController(peers);
+            this->next_peers_check = now + settings.peers_check_interval;
+        }
+        if (handshakes_due)
+        {
+            this->ConnectionStatusController(peers); // while changes of peers are applied
+            this->next_handshake_poll = now + settings.handshake_poll_interval;
+        }
+        this->Persist();
+        try
+        {
+            this->WaitPeerChanges();
+        }
+        catch (const WireguardException&)
+        {
+            this->next_peers_check = clock::time_point(); // reconciliation is repeated by the next iteration
+            throw;
+        }
+
+        clock::time_point wake_up = std::min(this->next_handshake_poll, this->next_peers_check);
+        time_t next_moment = this->expiry_scheduler.GetNextMoment();
+        if (next_moment < clock::to_time_t(wake_up)) wake_up = clock::from_time_t(next_moment); // far dates don't fit in time_point
+        return wake_up;
+    }
+
+    /// @brief Stops loop of Run()
+    void Wireguard::Stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->run_mutex);
+            this->stop_requested = true;
+        }
+        this->run_condition.notify_all();
+    }
+
+    /// @brief Sets function which is called when RunOnce() is due now, ex. scheduler of many interfaces reschedules interface.
+    /// @brief Handler is called by writer thread with write lock held, so it must not call methods of this object
+    /// @param handler function or nullptr
+    void Wireguard::SetWakeUpHandler(std::function<void()> handler)
+    {
+        std::lock_guard<std::mutex> lock(this->run_mutex);
+        this->wake_up_handler = std::move(handler);
+    }
+
+    const std::string& Wireguard::GetRootPath() const { return this->root_path; }
+
+    /// @brief Sets intervals of Run() loop
+    /// @param settings intervals of checks
+    void Wireguard::SetControllerSettings(const ControllerSettings& settings)
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->run_mutex);
+            this->controller_settings = settings;
+        }
+        {
+            std::lock_guard<std::mutex> lock(this->write_mutex);
+            this->peer_call_timeout = settings.peer_call_timeout;
+        }
+        this->connections.SetThresholds(settings.connection_thresholds);
+        this->run_condition.notify_all();
+    }
+
+    /// @brief Sets size of journal after which it is compacted into snapshot, journal of big configuration may grow up to size of snapshot
+    /// @param bytes size limit of journal
+    void Wireguard::SetJournalSizeLimit(size_t bytes)
+    {
+        std::lock_guard<std::mutex> lock(this->write_mutex);
+        this->journal_size_limit = bytes;
+    }
+
+    /// @brief Sets format of snapshot file and converts existing snapshot to it
+    /// @param format JSON or BINARY
+    void Wireguard::SetSnapshotFormat(SnapshotFormat format)
+    {
+        std::lock_guard<std::mutex> lock(this->write_mutex);
+        if (this->snapshot_format == format) return;
+        this->snapshot_format = format;
+        if (this->snapshot_exists) this->WriteConfiguration();
+    }
+
+    SnapshotFormat Wireguard::GetSnapshotFormat() const
+    {
+        std::lock_guard<std::mutex> lock(this->write_mutex);
+        return this->snapshot_format;
+    }
+
+    /// @brief Returns peers changes that were applied by last call of Controller
+    /// @return report of peers reconciliation
+    ReconciliationReport Wireguard::GetLastReconciliation() const
+    {
+        std::lock_guard<std::mutex> lock(this->write_mutex);
+        return this->last_reconciliation;
+    }
+
+    const PeerTelemetry& Wireguard::GetTelemetry() const { return this->telemetry; }
+
+    ConnectionTracker& Wireguard::GetConnections() { return this->connections; }
+
+    EventBus& Wireguard::GetEventBus() { return *this->event_bus; }
+
+    /// @brief Sets own connection thresholds of client, ex. longer ones for clients behind unstable links
+    /// @param uuid UUID of client
+    /// @param thresholds maximal handshake ages of connection states
+    void Wireguard::SetClientConnectionThresholds(const std::string& uuid, const ConnectionThresholds& thresholds)
+    {
+        std::lock_guard<std::mutex> lock(this->write_mutex);
+        if (this->clients.FindByUuid(uuid) == nullptr) throw WireguardException("Client id is not found");
+        this->client_thresholds[uuid] = thresholds;
+    }
+
+    /// @brief Returns client to connection thresholds of ControllerSettings
+    /// @param uuid UUID of client
+    void Wireguard::ResetClientConnectionThresholds(const std::string& uuid)
+    {
+        std::lock_guard<std::mutex> lock(this->write_mutex);
+        this->client_thresholds.erase(uuid);
+    }
+
+    /// @brief Renders metrics of controllers, persistence and peers, doesn't wait for writer
+    /// @return OpenMetrics text
+    std::string Wireguard::RenderMetrics() const
+    {
+        return this->metrics_registry.Render();
+    }
+
+    MetricsRegistry& Wireguard::GetMetricsRegistry() { return this->metrics_registry; }
+
+    /// @brief Publishes copy of configuration for readers, called after every change
+    void Wireguard::PublishSnapshot()
+    {
+        std::shared_ptr<ConfigurationSnapshot> snapshot = std::make_shared<ConfigurationSnapshot>();
+        snapshot->server = this->server;
+        snapshot->clients = this->clients;
+        snapshot->routes = this->routes;
+        snapshot->version = ++this->snapshot_version;
+        this->metrics.clients.Set(snapshot->clients.Size());
+        std::atomic_store(&this->snapshot, std::shared_ptr<const ConfigurationSnapshot>(std::move(snapshot)));
+    }
+
+    /// @brief Wakes Run() (or external scheduler) up, so new release/expiration moments are taken into account
+    void Wireguard::WakeUp()
+    {
+        std::function<void()> handler;
+        {
+            std::lock_guard<std::mutex> lock(this->run_mutex);
+            this->wake_requested = true;
+            handler = this->wake_up_handler;
+        }
+        this->run_condition.notify_all();
+        if (handler) handler();
+    }
+
+    /// @brief Controls account statuses of clients whose release or expiration moment has come: only due clients of scheduler
+    /// @brief are evaluated, all clients are swept once after configuration is loaded
+    /// @param now current unix time
+    /// @return Flag of changes in configuration
+    bool Wireguard::DateAndModeController(time_t now)
+    {
+        ScopedTimer timer(this->metrics.date_and_mode_duration);
+        if (!this->dates_resync_required && this->expiry_scheduler.GetNextMoment() > now) return false;
+
+        std::vector<size_t> changed;
+        const ClientStateTable& states = this->clients.GetStates();
+        if (this->dates_resync_required)
+        {
+            states.SweepDates(now, changed);
+            this->expiry_scheduler.Clear();
+            for (size_t position = 0; position < this->clients.Size(); position++) this->expiry_scheduler.Schedule(this->clients.At(position).uuid, states.GetNextMoment(position, now));
+            this->dates_resync_required = false;
+        }
+        else
+        {
+            for (const ClientUuid& uuid : this->expiry_scheduler.PopDue(now)) // due clients without change of status are scheduled too
+            {
+                size_t position = this->clients.GetPosition(uuid);
+                if (position == NO_POSITION) continue;
+                if (states.GetDueAccountStatus(position, now) != states.GetAccountStatus(position)) changed.push_back(position);
+                this->expiry_scheduler.Schedule(uuid, states.GetNextMoment(position, now));
+            }
+        }
+        for (size_t position : changed)
+        {
+            this->clients.SetAccountStatus(position, !states.GetAccountStatus(position));
+            this->JournalStatus(this->clients.At(position));
+            event_types::TYPE type = event_types::CLIENT_ACTIVATED;
+            if (!states.GetAccountStatus(position)) type = states.GetExpirationDate(position) < now ? event_types::CLIENT_EXPIRED : event_types::CLIENT_DEACTIVATED;
+            this->Emit(type, &this->clients.At(position));
+        }
+        if (!changed.empty()) this->clients.Touch(); // account statuses define peers of interface
+        this->metrics.account_status_changes.Add(changed.size());
+        return !changed.empty();
+    }
+
+    /// @brief Controls connection statuses of clients by one pass over peers: connection tracker moves every peer to state of its
+    /// @brief handshake age (own thresholds of client or thresholds of ControllerSettings), clients of connected peers are connected,
+    /// @brief others (including clients without peer on interface) are disconnected
+    /// @param peers peers of interface
+    /// @return Flag of changes in configuration
+    bool Wireguard::ConnectionStatusController(const std::vector<PeerInfo>& peers)
+    {
+        ScopedTimer timer(this->metrics.connection_status_duration);
+        time_t now = time(nullptr);
+        this->telemetry.Sample(peers, now);
+        const ClientStateTable& states = this->clients.GetStates();
+        std::vector<size_t> positions(peers.size());
+        std::vector<const ConnectionThresholds*> thresholds;
+        if (!this->client_thresholds.empty()) thresholds.resize(peers.size(), nullptr);
+        for (size_t index = 0; index < peers.size(); index++)
+        {
+            positions[index] = this->clients.GetPositionByPublicKey(peers[index].public_key);
+            if (thresholds.empty() || positions[index] == NO_POSITION) continue;
+            auto found = this->client_thresholds.find(this->clients.At(positions[index]).uuid);
+            if (found != this->client_thresholds.end()) thresholds[index] = &found->second;
+        }
+        std::vector<ConnectionState> peer_states;
+        this->connections.Process(peers, now, thresholds, peer_states);
+
+        std::vector<size_t> connected;
+        for (size_t index = 0; index < peers.size(); index++)
+        {
+            if (positions[index] != NO_POSITION && peer_states[index] == ConnectionState::CONNECTED) connected.push_back(positions[index]);
+        }
+        std::vector<size_t> changed;
+        states.SweepConnections(connected, changed);
+        for (size_t position : changed)
+        {
+            this->clients.SetConnectionStatus(position, !states.GetConnectionStatus(position));
+            this->JournalStatus(this->clients.At(position));
+            this->Emit(states.GetConnectionStatus(position) ? event_types::CLIENT_CONNECTED : event_types::CLIENT_DISCONNECTED, &this->clients.At(position));
+        }
+        this->metrics.connection_status_changes.Add(changed.size());
+        return !changed.empty();
+    }
+
+    /// @brief Controls that only allowed peers may be in current wireguard configuration
+    /// @param live_peers peers of interface
+    /// @return Changes of peers, they are applied in background
+    ReconciliationReport Wireguard::PeersConnectionController(std::vector<PeerInfo>& live_peers)
+    {
+        ScopedTimer timer(this->metrics.peers_connection_duration);
+        if (this->desired_peers_version != this->clients.GetVersion()) // desired table is rebuilt only after changes of clients
+        {
+            std::vector<DesiredPeer> desired_peers;
+            desired_peers.reserve(this->clients.Size());
+            for (const Client& client : this->clients)
+            {
+                if (client.account_status && !client.public_key.empty()) desired_peers.push_back(DesiredPeer{ client.public_key, client.allowed_ips });
+            }
+            this->peer_reconciler.SetDesired(std::move(desired_peers));
+            this->desired_peers_version = this->clients.GetVersion();
+            this->WriteServerConfiguration(); // wg-quick up restores the same peers
+        }
+
+        ReconciliationReport report = this->peer_reconciler.Reconcile(live_peers);
+        if (!report.changes.Empty())
+        {
+            this->ApplyPeersInBackground(report.changes);
+            WireguardEvent* event = this->Emit(event_types::PEERS_CHANGED, nullptr);
+            if (event != nullptr)
+            {
+                event->peers_added = report.added;
+                event->peers_updated = report.updated;
+                event->peers_removed = report.removed;
+            }
+        }
+        this->metrics.peers_added.Add(report.added);
+        this->metrics.peers_updated.Add(report.updated);
+        this->metrics.peers_removed.Add(report.removed);
+        return report;
+    }
+
+    /// @brief Add a peer to wireguard configuration by client link
+    /// @param client link to client object
+    void Wireguard::AddPeer(const Client& client) const
+    {
+        PeerChanges changes;
+        changes.upserts.push_back(PeerInfo{ client.public_key.ToString(), client.allowed_ips });
+        this->ApplyPeers(changes);
+    }
+
+    /// @brief Remove a peer from wireguard configuration by client link
+    /// @param client link to client object
+    void Wireguard::RemovePeer(const Client& client) const
+    {
+        this->RemovePeer(client.public_key.ToString());
+    }
+
+    /// @brief Remove a peer from wireguard configuration by public key
+    /// @param public_key public key of peer
+    void Wireguard::RemovePeer(const std::string& public_key) const
+    {
+        PeerChanges changes;
+        changes.removals.push_back(public_key);
+        this->ApplyPeers(changes);
+    }
+
+    /// @brief Gets peers of interface and measures latency of peer controller. Reads don't wait for changes of peers in background
+    /// @return peers of interface
+    std::vector<PeerInfo> Wireguard::DumpPeers() const
+    {
+        std::vector<PeerInfo> peers;
+        {
+            ScopedTimer timer(this->metrics.peers_dump_duration);
+            std::shared_ptr<CallControl> control = std::make_shared<CallControl>(this->peer_call_timeout);
+            std::future<std::vector<PeerInfo>> future = this->peer_executor->Dump(this->peer_controller, this->server.interface_name, control);
+            peers = WaitForCall(future, *control, "Dump of peers of " + this->server.interface_name);
+        }
+        this->metrics.peers.Set(peers.size());
+        return peers;
+    }
+
+    /// @brief Applies changes of peers to interface after changes in background and measures latency of peer controller
+    /// @param changes upserts and removals of peers
+    void Wireguard::ApplyPeers(const PeerChanges& changes) const
+    {
+        ScopedTimer timer(this->metrics.peers_apply_duration);
+        std::shared_ptr<CallControl> control = std::make_shared<CallControl>(this->peer_call_timeout);
+        std::future<void> future = this->peer_executor->Apply(this->peer_controller, this->server.interface_name, changes, control);
+        WaitForCall(future, *control, "Change of peers of " + this->server.interface_name);
+    }
+
+    /// @brief Queues changes of peers of interface, caller continues while they are applied
+    /// @param changes upserts and removals of peers
+    void Wireguard::ApplyPeersInBackground(const PeerChanges& changes)
+    {
+        this->WaitPeerChanges(); // only one background change is tracked
+        this->pending_peer_control = std::make_shared<CallControl>(this->peer_call_timeout);
+        this->pending_peer_start = std::chrono::steady_clock::now();
+        this->pending_peer_changes = this->peer_executor->Apply(this->peer_controller, this->server.interface_name, changes, this->pending_peer_control);
+    }
+
+    /// @brief Waits for changes of peers in background until their deadline and measures their latency
+    void Wireguard::WaitPeerChanges()
+    {
+        if (!this->pending_peer_changes.valid()) return;
+        std::future<void> future = std::move(this->pending_peer_changes);
+        WaitForCall(future, *this->pending_peer_control, "Change of peers of " + this->server.interface_name);
+        this->metrics.peers_apply_duration.Observe(std::chrono::steady_clock::now() - this->pending_peer_start);
+    }
+
+    /// @brief Converts configuration from jsom file and journal of changes to configuration in RAM
+    void Wireguard::ReadConfiguration()
+    {
+        if (this->snapshot_format == SnapshotFormat::BINARY) this->ReadBinaryConfiguration();
+        else this->ReadJsonConfiguration();
+        this->snapshot_size = this->GetSnapshotSize();
+        this->ReplayJournal();
+        this->RebuildAddresses();
+        this->expiry_scheduler.Clear();
+        this->dates_resync_required = true; // statuses are evaluated by the next DateAndModeController()
+    }
+
+    /// @brief Marks addresses of all clients as used in allocator and indexes their allowed ips, linear in count of clients.
+    /// @brief Stored allowed ips aren't rejected here: lists which aren't IPv4 aren't indexed, overlaps are kept as wireguard keeps them
+    void Wireguard::RebuildAddresses()
+    {
+        this->address_allocator.Reset(this->server.network, this->server.ip);
+        this->routes.Clear();
+        std::vector<IpPrefix> prefixes;
+        for (const Client& client : this->clients)
+        {
+            this->address_allocator.Reserve(ToHostOrder(client.ip));
+            if (ParseAllowedIps(client.allowed_ips, prefixes)) this->routes.Insert(client.uuid.ToString(), prefixes);
+        }
+    }
+
+    /// @brief Converts json snapshot file to configuration in RAM, clients go to registry while file is parsed
+    void Wireguard::ReadJsonConfiguration()
+    {
+        std::ifstream file(this->root_path + this->server.interface_name + JSON_EXTENSION);
+        if (!file.is_open()) throw WireguardException("Unable access to " + this->server.interface_name + JSON_EXTENSION);
+
+        this->clients.Clear();
+        LoadJsonConfiguration(file, this->server, [this](Client& client) { this->clients.Insert(client); });
+    }
+
+    /// @brief Converts binary snapshot file to configuration in RAM
+    void Wireguard::ReadBinaryConfiguration()
+    {
+        BinarySnapshot snapshot(this->root_path + this->server.interface_name + BINARY_SNAPSHOT_EXTENSION);
+        this->server = snapshot.GetServer();
+
+        this->clients.Clear();
+        this->clients.Reserve(snapshot.GetClientCount());
+        for (size_t index = 0; index < snapshot.GetClientCount(); index++)
+        {
+            Client client = snapshot.GetClient(index);
+            client.account_status = false; // statuses are evaluated again, as for json snapshot
+            client.connection_status = false;
+            this->clients.Insert(client);
+        }
+    }
+
+    /// @brief Converts configuration  in RAM to json file, journal isn't needed after it
+    void Wireguard::WriteConfiguration()
+    {
+        std::string path = this->root_path + this->server.interface_name;
+        if (this->snapshot_format == SnapshotFormat::BINARY)
+        {
+            ScopedTimer timer(this->metrics.upload_duration); // binary records are written without separate serialization
+            BinarySnapshot::Write(path + BINARY_SNAPSHOT_EXTENSION, this->server, this->clients);
+            unlink((path + JSON_EXTENSION).c_str()); // only one snapshot may exist, else it's unknown which one is actual
+        }
+        else
+        {
+            nlohmann::json json_configuration;
+            {
+                ScopedTimer timer(this->metrics.serialize_duration);
+                json_configuration = this->SerializeConfiguration();
+            }
+            ScopedTimer timer(this->metrics.upload_duration);
+            UploadConfiguration(json_configuration);
+            unlink((path + BINARY_SNAPSHOT_EXTENSION).c_str());
+        }
+        this->snapshot_exists = true;
+        this->snapshot_size = this->GetSnapshotSize();
+        this->pending_records.clear();
+        this->journal->Reset();
+    }
+
+    /// @brief Gets size of snapshot file of current format
+    /// @return bytes, 0 if there is no file
+    size_t Wireguard::GetSnapshotSize() const
+    {
+        struct stat status{};
+        std::string path = this->root_path + this->server.interface_name + (this->snapshot_format == SnapshotFormat::BINARY ? BINARY_SNAPSHOT_EXTENSION : JSON_EXTENSION);
+        return (stat(path.c_str(), &status) == 0) ? (size_t)status.st_size : 0;
+    }
+
+    /// @brief Adds record of created or updated client to pending journal records
+    /// @param operation JOURNAL_CREATE or JOURNAL_UPDATE
+    /// @param client link to client object
+    void Wireguard::JournalClient(const char* operation, const Client& client)
+    {
+        nlohmann::json record;
+        record[JOURNAL_OPERATION] = operation;
+        record[JOURNAL_CLIENT] = this->SerializeClient(client);
+        this->pending_records.push_back(std::move(record));
+    }
+
+    /// @brief Adds record of removed client to pending journal records
+    /// @param uuid UUID of client
+    void Wireguard::JournalRemove(const std::string& uuid)
+    {
+        nlohmann::json record;
+        record[JOURNAL_OPERATION] = JOURNAL_REMOVE;
+        record[keys.at(clients::KEY::UUID)] = uuid;
+        this->pending_records.push_back(std::move(record));
+    }
+
+    /// @brief Adds record of changed statuses of client to pending journal records
+    /// @param client link to client object
+    void Wireguard::JournalStatus(const Client& client)
+    {
+        nlohmann::json record;
+        record[JOURNAL_OPERATION] = JOURNAL_STATUS;
+        record[keys.at(clients::KEY::UUID)] = client.uuid;
+        record[keys.at(clients::KEY::ACCOUNT_STATUS)] = client.account_status;
+        record[keys.at(clients::KEY::CONNECTION_STATUS)] = client.connection_status;
+        this->pending_records.push_back(std::move(record));
+    }
+
+    /// @brief Adds record of changed server to pending journal records, the whole server is written (it's small)
+    void Wireguard::JournalServer()
+    {
+        nlohmann::json record;
+        record[JOURNAL_OPERATION] = JOURNAL_SERVER;
+        record[JOURNAL_SERVER] = this->SerializeServer();
+        this->pending_records.push_back(std::move(record));
+    }
+
+    /// @brief Writes pending records to journal, compacts journal into json snapshot if it's bigger than limit
+    /// @brief Events of changes are published after their records are saved
+    void Wireguard::Persist()
+    {
+        if (!this->pending_records.empty())
+        {
+            this->PublishSnapshot(); // every change of configuration has journal record
+            if (!this->snapshot_exists) this->WriteConfiguration();
+            else
+            {
+                {
+                    ScopedTimer timer(this->metrics.journal_append_duration);
+                    this->journal->Append(this->pending_records);
+                }
+                this->pending_records.clear();
+                if (this->journal->GetSize() > std::max(this->journal_size_limit, this->snapshot_size)) this->WriteConfiguration(); // O(clients) once per O(clients) records
+            }
+        }
+        this->PublishEvents();
+    }
+
+    /// @brief Adds event of change to pending events, nothing is built if bus has no subscribers
+    /// @param type type of event
+    /// @param client client of event, nullptr for events of interface
+    /// @return pending event for extra fields or nullptr
+    WireguardEvent* Wireguard::Emit(event_types::TYPE type, const Client* client)
+    {
+        if (!this->event_bus->HasSubscribers()) return nullptr;
+        WireguardEvent event;
+        event.type = type;
+        event.time = time(nullptr);
+        event.interface_name = this->server.interface_name;
+        if (client != nullptr)
+        {
+            event.uuid = client->uuid.ToString();
+            event.login = client->login.ToString();
+            event.public_key = client->public_key.ToString();
+        }
+        this->pending_events.push_back(std::move(event));
+        return &this->pending_events.back();
+    }
+
+    /// @brief Sends pending events to bus in order of changes
+    void Wireguard::PublishEvents()
+    {
+        if (this->pending_events.empty()) return;
+        std::vector<WireguardEvent> events;
+        events.swap(this->pending_events);
+        for (WireguardEvent& event : events) this->event_bus->Publish(std::move(event));
+    }
+
+    /// @brief Applies journal records to configuration loaded from json snapshot.
+    /// @brief Records are idempotent, because crash may happen between writing of snapshot and reset of journal
+    void Wireguard::ReplayJournal()
+    {
+        time_t now = time(nullptr);
+        for (const nlohmann::json& record : this->journal->Read())
+        {
+            try
+            {
+                const std::string& operation = record.at(JOURNAL_OPERATION).get_ref<const std::string&>();
+                if (operation == JOURNAL_CREATE || operation == JOURNAL_UPDATE)
+                {
+                    Client client = this->DeserializeClient(record.at(JOURNAL_CLIENT));
+                    this->clients.Remove(client.uuid);
+                    this->clients.Insert(client);
+                    this->expiry_scheduler.Schedule(client.uuid, now);
+                }
+                else if (operation == JOURNAL_REMOVE)
+                {
+                    const std::string& uuid = record.at(keys.at(clients::KEY::UUID)).get_ref<const std::string&>();
+                    this->clients.Remove(uuid);
+                    this->expiry_scheduler.Cancel(uuid);
+                }
+                else if (operation == JOURNAL_STATUS)
+                {
+                    size_t position = this->clients.GetPosition(record.at(keys.at(clients::KEY::UUID)).get_ref<const std::string&>());
+                    if (position == NO_POSITION) continue;
+                    this->clients.SetAccountStatus(position, record.at(keys.at(clients::KEY::ACCOUNT_STATUS)));
+                    this->clients.SetConnectionStatus(position, record.at(keys.at(clients::KEY::CONNECTION_STATUS)));
+                    this->clients.Touch();
+                }
+                else if (operation == JOURNAL_SERVER)
+                {
+                    std::string interface_name = this->server.interface_name; // name of file is the name of interface
+                    this->server = this->DeserializeServer(record.at(JOURNAL_SERVER));
+                    this->server.interface_name = interface_name;
+                }
+                else throw WireguardException("Unknown journal operation \"" + operation + '"');
+            }
+            catch (const nlohmann::json::exception& error)
+            {
+                throw WireguardException("Journal record isn't valid: " + std::string(error.what()));
+            }
+        }
+    }
+
+    /// @brief Converts configuration in RAM to JSON object
+    /// @return Configuration as JSON object
+    nlohmann::json Wireguard::SerializeConfiguration() const
+    {
+        nlohmann::json json_configuration;
+        nlohmann::json json_users_configuration = nlohmann::json::array();
+        for (const Client& client : this->clients) json_users_configuration.push_back(this->SerializeClient(client));
+
+        json_configuration[keys.at(general::KEY::SERVER)] = this->SerializeServer();
+        json_configuration[keys.at(general::KEY::CLIENTS)] = json_users_configuration;
+
+        return json_configuration;
+    }
+
+    /// @brief Converts server in RAM to JSON object
+    /// @return Server as JSON object
+    nlohmann::json Wireguard::SerializeServer() const
+    {
+        nlohmann::json json_server_configuration;
+        json_server_configuration[keys.at(server::KEY::INTERFACE_NAME)] = this->server.interface_name;
+        json_server_configuration[keys.at(server::KEY::LISTEN_PORT)] = this->server.listen_port;
+        json_server_configuration[keys.at(server::KEY::IP)] = this->server.ip.GetAsString();
+        json_server_configuration[keys.at(server::KEY::NETWORK)] = this->server.network.GetAsString();
+        json_server_configuration[keys.at(server::KEY::ENDPOINT_DNS)] = this->server.endpoint_dns;
+        json_server_configuration[keys.at(server::KEY::ENDPOINT_IP)] = this->server.endpoint_ip.GetAsString();
+        json_server_configuration[keys.at(server::KEY::PUBLIC_LISTEN_PORT)] = this->server.public_listen_port;
+        json_server_configuration[keys.at(server::KEY::PRIVATE_KEY)] = this->server.private_key;
+        json_server_configuration[keys.at(server::KEY::PUBLIC_KEY)] = this->server.public_key;
+        json_server_configuration[keys.at(server::KEY::PRE_UP)] = this->server.pre_up;
+        json_server_configuration[keys.at(server::KEY::POST_UP)] = this->server.post_up;
+        json_server_configuration[keys.at(server::KEY::PRE_DOWN)] = this->server.pre_down;
+        json_server_configuration[keys.at(server::KEY::POST_DOWN)] = this->server.post_down;
+        return json_server_configuration;
+    }
+
+    /// @brief Converts JSON object written by SerializeServer() to server
+    /// @param json_server_configuration JSON object of server
+    /// @return server configuration as Server structure
+    Server Wireguard::DeserializeServer(const nlohmann::json& json_server_configuration) const
+    {
+        Server server;
+        server.interface_name = json_server_configuration.at(keys.at(server::KEY::INTERFACE_NAME));
+        server.listen_port = json_server_configuration.at(keys.at(server::KEY::LISTEN_PORT));
+        server.endpoint_dns = json_server_configuration.at(keys.at(server::KEY::ENDPOINT_DNS));
+        server.public_listen_port = json_server_configuration.at(keys.at(server::KEY::PUBLIC_LISTEN_PORT));
+        server.private_key = json_server_configuration.at(keys.at(server::KEY::PRIVATE_KEY));
+        server.public_key = json_server_configuration.at(keys.at(server::KEY::PUBLIC_KEY));
+        server.pre_up = json_server_configuration.at(keys.at(server::KEY::PRE_UP));
+        server.post_up = json_server_configuration.at(keys.at(server::KEY::POST_UP));
+        server.pre_down = json_server_configuration.at(keys.at(server::KEY::PRE_DOWN));
+        server.post_down = json_server_configuration.at(keys.at(server::KEY::POST_DOWN));
+        try
+        {
+            server.ip = IPv4((std::string)json_server_configuration.at(keys.at(server::KEY::IP)));
+            server.network = IPv4Mask((std::string)json_server_configuration.at(keys.at(server::KEY::NETWORK)));
+            server.endpoint_ip = IPv4((std::string)json_server_configuration.at(keys.at(server::KEY::ENDPOINT_IP)));
+        }
+        catch (const ExceptionIPv4& error)
+        {
+            throw WireguardException("Server IPv4 Error: " + error.what());
+        }
+        return server;
+    }
+
+    /// @brief Converts client in RAM to JSON object
+    /// @param client link to client object
+    /// @return Client as JSON object
+    nlohmann::json Wireguard::SerializeClient(const Client& client) const
+    {
+        nlohmann::json json_user_configuration;
+        json_user_configuration[keys.at(clients::KEY::UUID)] = client.uuid;
+        json_user_configuration[keys.at(clients::KEY::PRIVATE_KEY)] = client.private_key;
+        json_user_configuration[keys.at(clients::KEY::PUBLIC_KEY)] = client.public_key;
+        json_user_configuration[keys.at(clients::KEY::LOGIN)] = client.login;
+        json_user_configuration[keys.at(clients::KEY::FULL_NAME)] = client.full_name;
+        json_user_configuration[keys.at(clients::KEY::IP)] = client.ip.GetAsString();
+        json_user_configuration[keys.at(clients::KEY::ACCOUNT_STATUS)] = client.account_status;
+        json_user_configuration[keys.at(clients::KEY::ADMINISTRATIVE_ACCOUNT_STATUS)] = client.administrative_account_status;
+        json_user_configuration[keys.at(clients::KEY::CONNECTION_STATUS)] = client.connection_status;
+        json_user_configuration[keys.at(clients::KEY::CREATION_DATE)] = client.creation_date.GetAsString();
+        json_user_configuration[keys.at(clients::KEY::RELEASE_DATE)] = client.release_date.GetAsString();
+        json_user_configuration[keys.at(clients::KEY::EXPIRATION_DATE)] = client.expiration_date.GetAsString();
+        json_user_configuration[keys.at(clients::KEY::ALLOWED_IPS)] = client.allowed_ips;
+        json_user_configuration[keys.at(clients::KEY::DNS)] = client.dns;
+        return json_user_configuration;
+    }
+
+    /// @brief Converts JSON object to client
+    /// @param json_user_configuration JSON object of client
+    /// @return client configuration as Client structure
+    Client Wireguard::DeserializeClient(const nlohmann::json& json_user_configuration) const
+    {
+        Client client;
+        if (is_correct(json_user_configuration[keys.at(clients::KEY::UUID)])) client.uuid = json_user_configuration[keys.at(clients::KEY::UUID)].get<std::string>();
+        else throw WireguardException("UUID for client isn't correct");
+        client.private_key = json_user_configuration[keys.at(clients::KEY::PRIVATE_KEY)].get<std::string>();
+        client.public_key = json_user_configuration[keys.at(clients::KEY::PUBLIC_KEY)].get<std::string>();
+        client.login = json_user_configuration[keys.at(clients::KEY::LOGIN)].get<std::string>();
+        client.full_name = json_user_configuration[keys.at(clients::KEY::FULL_NAME)].get<std::string>();
+        client.connection_status = false;
+        client.account_status = false;
+        client.administrative_account_status = json_user_configuration[keys.at(clients::KEY::ADMINISTRATIVE_ACCOUNT_STATUS)];
+        client.release_date = (!json_user_configuration[keys.at(clients::KEY::RELEASE_DATE)].is_null()) ? Time((std::string)json_user_configuration[keys.at(clients::KEY::RELEASE_DATE)]) : MIN_TIME;
+        client.expiration_date = (!json_user_configuration[keys.at(clients::KEY::EXPIRATION_DATE)].is_null()) ? Time((std::string)json_user_configuration[keys.at(clients::KEY::EXPIRATION_DATE)]) : MAX_TIME;
+        if (Time::IsValid(json_user_configuration[keys.at(clients::KEY::CREATION_DATE)])) client.creation_date = Time((std::string)json_user_configuration[keys.at(clients::KEY::CREATION_DATE)]);
+        else throw WireguardException("Client creation date isn't valid");
+        client.allowed_ips = json_user_configuration[keys.at(clients::KEY::ALLOWED_IPS)];
+        if (json_user_configuration.contains(keys.at(clients::KEY::DNS)) && json_user_configuration[keys.at(clients::KEY::DNS)].is_string()) client.dns = json_user_configuration[keys.at(clients::KEY::DNS)];
+
+        try
+        {
+            client.ip = IPv4((std::string)json_user_configuration[keys.at(clients::KEY::IP)]);
+        }
+        catch (const ExceptionIPv4& error)
+        {
+            throw WireguardException("Client IPv4 Error: " + error.what());
+        }
+        catch (...)
+        {
+            throw;
+        }
+        return client;
+    }
+
+    /// @brief Renders wg-quick configuration of server and active clients, file isn't rewritten if hash of content is the same
+    /// @return true if file was written
+    bool Wireguard::WriteServerConfiguration()
+    {
+        std::string path = this->root_path + this->server.interface_name + WG_QUICK_EXTENSION;
+        uint64_t hash = HashServerConfiguration(this->server, this->clients, ServerConfigurationStyle::WG_QUICK);
+        if (this->server_configuration_hash == 0) HashFile(path, this->server_configuration_hash); // file of previous run
+        if (hash == this->server_configuration_hash) return false;
+
+        AtomicFileWriter writer(path);
+        RenderServerConfiguration(this->server, this->clients, ServerConfigurationStyle::WG_QUICK, writer.GetStream());
+        writer.Commit();
+        this->server_configuration_hash = hash;
+        return true;
+    }
+
+    /// @brief Writes wg-quick configuration and applies it to running interface by wg syncconf, so sessions of peers aren't dropped.
+    /// @brief Address and Pre/Post Up/Down aren't fields of wireguard interface, they are applied by the next wg-quick up
+    void Wireguard::ApplyServerConfiguration()
+    {
+        std::lock_guard<std::mutex> lock(this->write_mutex);
+        this->SyncServerConfiguration();
+    }
+
+    /// @brief ApplyServerConfiguration(), write_mutex is held by caller
+    void Wireguard::SyncServerConfiguration()
+    {
+        this->WriteServerConfiguration();
+        uint64_t hash = HashServerConfiguration(this->server, this->clients, ServerConfigurationStyle::WG);
+        if (hash == this->synced_configuration_hash) return;
+
+        std::string path = this->root_path + this->server.interface_name + WG_SYNC_EXTENSION;
+        {
+            AtomicFileWriter writer(path);
+            RenderServerConfiguration(this->server, this->clients, ServerConfigurationStyle::WG, writer.GetStream());
+            writer.Commit();
+        }
+        try
+        {
+            SyncInterface(this->server.interface_name, path);
+        }
+        catch (const WireguardException&)
+        {
+            unlink(path.c_str());
+            throw;
+        }
+        unlink(path.c_str());
+        this->synced_configuration_hash = hash;
+    }
+
+    /// @brief Writes JSON object to json file
+    /// @param json_configuration JSON object
+    void Wireguard::UploadConfiguration(const nlohmann::json& json_configuration) const
+    {
+        WriteFileAtomically(this->root_path + this->server.interface_name + JSON_EXTENSION, json_configuration.dump(4));
+    }
+
+    /// @brief Gets list of clients
+    /// @return list of Client structures as clients configuration
+    std::vector<Client> Wireguard::GetClients() const
+    {
+        std::shared_ptr<const ConfigurationSnapshot> snapshot = this->GetSnapshot();
+        return std::vector<Client>(snapshot->clients.begin(), snapshot->clients.end());
+    }
+
+    /// @brief Changes fields of client in place, uuid is kept. Every change has the cheapest effect: only affected peer is upserted or
+    /// @brief removed (new key swaps peer), dates and administrative status re-evaluate account status of the client, names, login,
+    /// @brief dns and private key are only written to journal
+    /// @param uuid UUID of client
+    /// @param patch fields and their new values
+    /// @return changed client_fields, 0 if values are the same
+    uint32_t Wireguard::UpgradeClient(const std::string& uuid, const ClientPatch& patch)
+    {
+        const uint32_t library_fields = client_fields::UUID | client_fields::ACCOUNT_STATUS | client_fields::CONNECTION_STATUS | client_fields::CREATION_DATE;
+        if (patch.fields & library_fields) throw WireguardException("UUID, statuses and creation date of client can't be changed");
+        std::lock_guard<std::mutex> lock(this->write_mutex);
+        size_t position = this->clients.GetPosition(uuid);
+        if (position == NO_POSITION) throw WireguardException("Client id is not found");
+        const Client old = this->clients.At(position);
+        Client updated = old;
+        PatchClient(updated, patch);
+        std::vector<IpPrefix> prefixes;
+        if ((patch.fields & client_fields::ALLOWED_IPS) && ParseAllowedIps(updated.allowed_ips, prefixes)) updated.allowed_ips = FormatAllowedIps(prefixes);
+        uint32_t changed = GetChangedFields(old, updated);
+        if (changed == 0) return 0;
+
+        BatchReport report;
+        report.items.resize(1);
+        if (!this->ValidateBatch({ BatchItem{ BatchOperation::UPDATE, updated } }, report)) throw WireguardException(report.items[0].error);
+
+        if (changed & client_fields::IP)
+        {
+            this->address_allocator.Release(ToHostOrder(old.ip));
+            this->address_allocator.Reserve(ToHostOrder(updated.ip));
+        }
+        if (changed & client_fields::ALLOWED_IPS) this->routes.Insert(uuid, prefixes);
+        this->clients.Update(position, updated);
+        this->JournalClient(JOURNAL_UPDATE, this->clients.At(position));
+        this->Emit(event_types::CLIENT_UPDATED, &this->clients.At(position));
+        bool rescheduled = (changed & (client_fields::ADMINISTRATIVE_ACCOUNT_STATUS | client_fields::RELEASE_DATE | client_fields::EXPIRATION_DATE)) != 0;
+        if (rescheduled)
+        {
+            time_t now = time(nullptr);
+            this->expiry_scheduler.Schedule(uuid, now);
+            this->DateAndModeController(now); // status of the client is changed at once, it touches registry itself
+        }
+
+        const Client& client = this->clients.At(position);
+        PeerChanges changes;
+        bool peer_changed = (changed & (client_fields::PUBLIC_KEY | client_fields::ALLOWED_IPS)) != 0;
+        if (old.account_status && !old.public_key.empty() && (!client.account_status || (changed & client_fields::PUBLIC_KEY))) changes.removals.push_back(old.public_key.ToString());
+        if (client.account_status && !client.public_key.empty() && (!old.account_status || peer_changed)) changes.upserts.push_back(PeerInfo{ client.public_key.ToString(), client.allowed_ips });
+        if (!changes.Empty()) this->clients.Touch(); // desired peers and wg-quick file are rebuilt by the next controller run
+        this->Persist();
+        if (!changes.Empty()) this->ApplyPeers(changes); // change is saved already, if interface fails, the next controller run repeats it
+        if (rescheduled) this->WakeUp();
+        return changed;
+    }
+
+    /// @brief Remove client from configuration by it's UUID
+    /// @param uuid UUID of client
+    void Wireguard::RemoveClient(const std::string& uuid)
+    {
+        std::lock_guard<std::mutex> lock(this->write_mutex);
+        const Client* client = this->clients.FindByUuid(uuid);
+        if (client == nullptr) return;
+        this->Emit(event_types::CLIENT_REMOVED, client);
+        this->address_allocator.Release(ToHostOrder(client->ip));
+        this->routes.Remove(uuid);
+        this->client_thresholds.erase(uuid);
+        this->clients.Remove(uuid);
+        this->expiry_scheduler.Cancel(uuid);
+        this->JournalRemove(uuid);
+        this->Persist();
+    }
+
+    /// @brief Starts the wireguard server with clients, peers of active clients are in rendered configuration
+    void Wireguard::StartServer()
+    {
+        this->WriteServerConfiguration();
+        wg_quick_up(this->server.interface_name);
+        this->synced_configuration_hash = HashServerConfiguration(this->server, this->clients, ServerConfigurationStyle::WG);
+    }
+
+    /// @brief Stops the wireguard server
+    void Wireguard::StopServer()
+    {
+        wg_quick_down(this->server.interface_name);
+        this->synced_configuration_hash = 0;
+    }
+
+    /// @brief Reboots the wireguard server, by stop start commands
+    void Wireguard::RebootServer()
+    {
+        this->StopServer();
+        this->StartServer();
+    }
 }
\ No newline at end of file
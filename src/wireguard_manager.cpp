@@ -0,0 +1,325 @@
+#include "wireguard_manager.hpp"
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <cctype>
+#include <dirent.h>
+
+#define JSON_EXTENSION ".json"
+#define BINARY_SNAPSHOT_EXTENSION ".snap"
+
+namespace timlibs
+{
+    namespace
+    {
+        /// @brief Checks name as kernel checks names of network interfaces
+        /// @param name name, ex.: wg0
+        /// @return true if interface may have the name
+        bool IsInterfaceName(const std::string& name)
+        {
+            if (name.empty() || name.size() > INTERFACE_NAME_LENGTH_MAX || name == "." || name == "..") return false;
+            for (char character : name)
+            {
+                if (character == '/' || character == ':' || isspace((unsigned char)character)) return false;
+            }
+            return true;
+        }
+
+        /// @brief Cuts extension from file name
+        /// @param file_name name of file, ex.: wg0.json
+        /// @param extension extension with dot, ex.: .json
+        /// @param name name without extension
+        /// @return false if file has another extension
+        bool CutExtension(const std::string& file_name, const char* extension, std::string& name)
+        {
+            size_t length = strlen(extension);
+            if (file_name.size() <= length || file_name.compare(file_name.size() - length, length, extension) != 0) return false;
+            name = file_name.substr(0, file_name.size() - length);
+            return true;
+        }
+    }
+
+    /// @brief Creates manager without interfaces, see Load()
+    /// @param root_path directory of configuration files, ex.: /etc/wireguard/
+    /// @param threads count of shared workers (0 - one per core)
+    /// @param peer_controller_factory backend of peers for every interface (nullptr - netlink if available, else wg command)
+    WireguardManager::WireguardManager(const std::string& root_path, size_t threads, PeerControllerFactory peer_controller_factory)
+        : root_path{ root_path }, peer_controller_factory{ std::move(peer_controller_factory) }, pool{ threads }
+    {
+        if (!this->root_path.empty() && this->root_path.back() != '/') this->root_path += '/';
+        this->peer_executor = std::make_shared<PeerExecutor>(this->pool.GetThreadCount(), this->pool.GetThreadCount()); // controllers of every worker may wait for peers and change them
+        this->event_bus = std::make_shared<EventBus>();
+    }
+
+    /// @brief Finds snapshots of interfaces in root path and loads interfaces which aren't loaded yet, one interface per worker
+    /// @return names of loaded interfaces, sorted
+    std::vector<std::string> WireguardManager::Load()
+    {
+        std::string directory_path = this->root_path.empty() ? "." : this->root_path;
+        DIR* directory = opendir(directory_path.c_str());
+        if (directory == nullptr) throw WireguardException("Unable to open " + directory_path + ": " + strerror(errno));
+        std::vector<std::string> names;
+        for (dirent* entry = readdir(directory); entry != nullptr; entry = readdir(directory))
+        {
+            std::string name;
+            if (!CutExtension(entry->d_name, JSON_EXTENSION, name) && !CutExtension(entry->d_name, BINARY_SNAPSHOT_EXTENSION, name)) continue;
+            if (IsInterfaceName(name)) names.push_back(name);
+        }
+        closedir(directory);
+        std::sort(names.begin(), names.end());
+        names.erase(std::unique(names.begin(), names.end()), names.end());
+
+        ControllerSettings settings;
+        {
+            std::lock_guard<std::mutex> lock(this->interfaces_mutex);
+            names.erase(std::remove_if(names.begin(), names.end(), [this](const std::string& name) { return this->Find(name) != nullptr; }), names.end());
+            settings = this->controller_settings;
+        }
+
+        std::vector<std::unique_ptr<Interface>> opened(names.size());
+        this->pool.ParallelFor(names.size(), [this, &names, &opened, &settings](size_t index) { opened[index] = this->Open(names[index], settings); });
+        this->Attach(std::move(opened));
+        return names;
+    }
+
+    /// @brief Adds interface which has no configuration yet
+    /// @param interface_name name of interface, ex.: wg3
+    /// @return interface, it lives as long as manager
+    Wireguard& WireguardManager::Add(const std::string& interface_name)
+    {
+        if (!IsInterfaceName(interface_name)) throw WireguardException("Invalid interface name \"" + interface_name + '"');
+        ControllerSettings settings;
+        {
+            std::lock_guard<std::mutex> lock(this->interfaces_mutex);
+            if (this->Find(interface_name) != nullptr) throw WireguardException("Interface " + interface_name + " is already loaded");
+            settings = this->controller_settings;
+        }
+        std::vector<std::unique_ptr<Interface>> opened;
+        opened.push_back(this->Open(interface_name, settings));
+        Wireguard& wireguard = *opened.back()->wireguard;
+        this->Attach(std::move(opened));
+        return wireguard;
+    }
+
+    Wireguard& WireguardManager::Get(const std::string& interface_name)
+    {
+        std::lock_guard<std::mutex> lock(this->interfaces_mutex);
+        Interface* interface = this->Find(interface_name);
+        if (interface == nullptr) throw WireguardException("Interface " + interface_name + " is not loaded");
+        return *interface->wireguard;
+    }
+
+    std::vector<std::string> WireguardManager::GetInterfaceNames() const
+    {
+        std::vector<std::string> names;
+        for (const Interface* interface : this->GetInterfaces()) names.push_back(interface->name);
+        return names;
+    }
+
+    /// @brief Finds clients with public key in all interfaces, ex. to trace a leaked key
+    /// @param public_key public key of client
+    /// @return clients with names of their interfaces, in order of interface names
+    std::vector<InterfaceClient> WireguardManager::FindClientsByPublicKey(const std::string& public_key) const
+    {
+        std::vector<InterfaceClient> found;
+        for (const Interface* interface : this->GetInterfaces())
+        {
+            std::shared_ptr<const ConfigurationSnapshot> snapshot = interface->wireguard->GetSnapshot();
+            const Client* client = snapshot->clients.FindByPublicKey(public_key);
+            if (client != nullptr) found.push_back(InterfaceClient{ interface->name, *client });
+        }
+        return found;
+    }
+
+    /// @brief Finds clients with vpn ip address in all interfaces
+    /// @param ip vpn ip address of client
+    /// @return clients with names of their interfaces, in order of interface names
+    std::vector<InterfaceClient> WireguardManager::FindClientsByIp(const IPv4& ip) const
+    {
+        std::vector<InterfaceClient> found;
+        for (const Interface* interface : this->GetInterfaces())
+        {
+            std::shared_ptr<const ConfigurationSnapshot> snapshot = interface->wireguard->GetSnapshot();
+            const Client* client = snapshot->clients.FindByIp(ip);
+            if (client != nullptr) found.push_back(InterfaceClient{ interface->name, *client });
+        }
+        return found;
+    }
+
+    /// @brief Gets schedule of interfaces and results of their last controllers runs
+    /// @return statuses in order of interface names
+    std::vector<InterfaceStatus> WireguardManager::GetStatuses() const
+    {
+        std::vector<Interface*> interfaces = this->GetInterfaces();
+        std::vector<InterfaceStatus> statuses;
+        statuses.reserve(interfaces.size());
+        std::lock_guard<std::mutex> lock(this->schedule_mutex);
+        for (const Interface* interface : interfaces) statuses.push_back(InterfaceStatus{ interface->name, interface->next_run, interface->last_error });
+        return statuses;
+    }
+
+    /// @brief Runs controllers of all interfaces once, interfaces are distributed over pool
+    void WireguardManager::Controller()
+    {
+        std::vector<Interface*> interfaces = this->GetInterfaces();
+        this->pool.ParallelFor(interfaces.size(), [&interfaces](size_t index) { interfaces[index]->wireguard->Controller(); });
+    }
+
+    /// @brief Runs controllers of every interface when they are due (see Wireguard::RunOnce()) until Stop() is called.
+    /// @brief Calling thread only schedules, controllers run on pool, one run per interface at a time
+    void WireguardManager::Run()
+    {
+        using clock = std::chrono::system_clock;
+        std::unique_lock<std::mutex> lock(this->schedule_mutex);
+        this->stop_requested = false;
+        while (!this->stop_requested)
+        {
+            this->rescheduled = false;
+            clock::time_point now = clock::now();
+            clock::time_point wake_up = clock::time_point::max();
+            for (Interface* interface : this->GetInterfaces())
+            {
+                if (interface->running) continue;
+                if (interface->next_run > now)
+                {
+                    wake_up = std::min(wake_up, interface->next_run);
+                    continue;
+                }
+                interface->running = true;
+                this->running_count++;
+                this->pool.Submit([this, interface]() { this->RunInterface(*interface); });
+            }
+
+            auto woken = [this]() { return this->stop_requested || this->rescheduled; };
+            if (wake_up == clock::time_point::max()) this->schedule_condition.wait(lock, woken);
+            else this->schedule_condition.wait_until(lock, wake_up, woken);
+        }
+        this->schedule_condition.wait(lock, [this]() { return this->running_count == 0; });
+    }
+
+    /// @brief Stops loop of Run(), Run() returns when running controllers are finished
+    void WireguardManager::Stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->schedule_mutex);
+            this->stop_requested = true;
+        }
+        this->schedule_condition.notify_all();
+    }
+
+    /// @brief Sets intervals of controllers of all interfaces
+    /// @param settings intervals of checks
+    void WireguardManager::SetControllerSettings(const ControllerSettings& settings)
+    {
+        std::lock_guard<std::mutex> lock(this->interfaces_mutex);
+        this->controller_settings = settings;
+        for (const std::unique_ptr<Interface>& interface : this->interfaces) interface->wireguard->SetControllerSettings(settings);
+    }
+
+    ThreadPool& WireguardManager::GetPool() { return this->pool; }
+
+    EventBus& WireguardManager::GetEventBus() { return *this->event_bus; }
+
+    const std::string& WireguardManager::GetRootPath() const { return this->root_path; }
+
+    /// @brief Loads interface (or creates it without configuration file), it's called in parallel for different interfaces
+    /// @param interface_name name of interface
+    /// @param settings intervals of controllers
+    /// @return interface, it isn't scheduled yet
+    std::unique_ptr<WireguardManager::Interface> WireguardManager::Open(const std::string& interface_name, const ControllerSettings& settings)
+    {
+        std::unique_ptr<Interface> interface = std::make_unique<Interface>();
+        interface->name = interface_name;
+        std::shared_ptr<PeerController> peer_controller = this->peer_controller_factory ? this->peer_controller_factory(interface_name) : nullptr;
+        interface->wireguard = std::make_unique<Wireguard>(interface_name, peer_controller, this->root_path, this->peer_executor, this->event_bus);
+        interface->wireguard->SetControllerSettings(settings);
+        Interface* scheduled = interface.get();
+        interface->wireguard->SetWakeUpHandler([this, scheduled]() { this->WakeUp(*scheduled); });
+        return interface;
+    }
+
+    /// @brief Adds opened interfaces to list, Run() runs their controllers at once
+    /// @param opened opened interfaces
+    void WireguardManager::Attach(std::vector<std::unique_ptr<Interface>> opened)
+    {
+        if (opened.empty()) return;
+        {
+            std::lock_guard<std::mutex> lock(this->interfaces_mutex);
+            for (const std::unique_ptr<Interface>& interface : opened)
+            {
+                if (this->Find(interface->name) != nullptr) throw WireguardException("Interface " + interface->name + " is already loaded");
+            }
+            for (std::unique_ptr<Interface>& interface : opened) this->interfaces.push_back(std::move(interface));
+            std::sort(this->interfaces.begin(), this->interfaces.end(), [](const std::unique_ptr<Interface>& left, const std::unique_ptr<Interface>& right) { return left->name < right->name; });
+        }
+        {
+            std::lock_guard<std::mutex> lock(this->schedule_mutex);
+            this->rescheduled = true;
+        }
+        this->schedule_condition.notify_all();
+    }
+
+    WireguardManager::Interface* WireguardManager::Find(const std::string& interface_name) const
+    {
+        auto found = std::lower_bound(this->interfaces.begin(), this->interfaces.end(), interface_name,
+            [](const std::unique_ptr<Interface>& interface, const std::string& name) { return interface->name < name; });
+        return (found != this->interfaces.end() && (*found)->name == interface_name) ? found->get() : nullptr;
+    }
+
+    std::vector<WireguardManager::Interface*> WireguardManager::GetInterfaces() const
+    {
+        std::lock_guard<std::mutex> lock(this->interfaces_mutex);
+        std::vector<Interface*> interfaces;
+        interfaces.reserve(this->interfaces.size());
+        for (const std::unique_ptr<Interface>& interface : this->interfaces) interfaces.push_back(interface.get());
+        return interfaces;
+    }
+
+    /// @brief Runs controllers of interface which are due and schedules the next run. Failed interface is retried after MANAGER_RETRY_INTERVAL,
+    /// @brief other interfaces aren't affected
+    /// @param interface scheduled interface
+    void WireguardManager::RunInterface(Interface& interface)
+    {
+        using clock = std::chrono::system_clock;
+        clock::time_point next_run;
+        std::string error;
+        try
+        {
+            next_run = interface.wireguard->RunOnce();
+        }
+        catch (const std::exception& exception)
+        {
+            error = exception.what();
+        }
+        catch (const WireguardException&)
+        {
+            error = "Controllers of interface failed";
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(this->schedule_mutex);
+            if (error != NULL_STRING) next_run = clock::now() + MANAGER_RETRY_INTERVAL;
+            if (interface.woken) next_run = clock::now();
+            interface.next_run = next_run;
+            interface.woken = false;
+            interface.running = false;
+            interface.last_error = error;
+            this->running_count--;
+            this->rescheduled = true;
+        }
+        this->schedule_condition.notify_all();
+    }
+
+    /// @brief Makes run of interface due now, called by interface after changes of clients
+    /// @param interface changed interface
+    void WireguardManager::WakeUp(Interface& interface)
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->schedule_mutex);
+            if (interface.running) interface.woken = true;
+            else interface.next_run = std::chrono::system_clock::now();
+            this->rescheduled = true;
+        }
+        this->schedule_condition.notify_all();
+    }
+}